@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -24,16 +25,42 @@ extern "C" {
 
 struct cc_client_Ball;
 
+/* Storage for cc_client_Ball_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_CLIENT_BALL_SIZE (22 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
+
 typedef void (*cc_Ball_grab_reply_t)(struct cc_client_Ball *instance, bool success);
 
 int cc_Ball_grab(struct cc_client_Ball *instance, bool *success);
-int cc_Ball_grab_async(struct cc_client_Ball *instance, cc_Ball_grab_reply_t callback);
+/* The call, if not NULL, is set to the handle for cc_call_cancel() until the callback is invoked */
+int cc_Ball_grab_async(
+    struct cc_client_Ball *instance, cc_Ball_grab_reply_t callback, struct cc_call **call);
+/* Calls time out after usec, or the timeout of the instance for 0 */
+int cc_Ball_grab_timeout(struct cc_client_Ball *instance, uint64_t usec, bool *success);
+int cc_Ball_grab_async_timeout(
+    struct cc_client_Ball *instance, uint64_t usec, cc_Ball_grab_reply_t callback,
+    struct cc_call **call);
 
 int cc_Ball_drop(struct cc_client_Ball *instance);
 
+typedef void (*cc_Ball_availability_handler_t)(struct cc_client_Ball *instance, bool available);
+
 int cc_client_Ball_new(const char *address, void *data, struct cc_client_Ball **instance);
 struct cc_client_Ball *cc_client_Ball_free(struct cc_client_Ball *instance);
 void *cc_client_Ball_get_data(struct cc_client_Ball *instance);
+/* Method calls time out after usec, or 25 s if synchronous and 2 s if asynchronous for 0 */
+void cc_client_Ball_set_timeout(struct cc_client_Ball *instance, uint64_t usec);
+/* Whether the service of the instance has an owner on the bus, which peers always have,
+ * tracked only once a handler is set or calls are held and true before */
+bool cc_client_Ball_is_available(struct cc_client_Ball *instance);
+/* Invokes handler whenever the service appears or disappears, none for NULL */
+int cc_client_Ball_set_availability_handler(
+    struct cc_client_Ball *instance, cc_Ball_availability_handler_t handler);
+/* Asynchronous calls made while the service is unavailable are made once it appears */
+int cc_client_Ball_set_hold_calls(struct cc_client_Ball *instance, bool hold);
+int cc_client_Ball_init(
+    void *storage, size_t size, const char *address, void *data,
+    struct cc_client_Ball **instance);
+void cc_client_Ball_fini(struct cc_client_Ball *instance);
 
 
 #ifdef __cplusplus
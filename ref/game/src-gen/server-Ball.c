@@ -16,24 +16,68 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <capic/backend.h>
 #include <capic/dbus-private.h>
 #include <capic/log.h>
+#include <capic/memory.h>
 
 
 struct cc_server_Ball {
     struct cc_instance *instance;
     void *data;
     const struct cc_server_Ball_impl *impl;
+    /* Family the instance serves the objects of, NULL for a single object */
+    struct cc_server_Ball_family *family;
     struct sd_bus_slot *vtable_slot;
+    struct cc_admission admission;
+    struct cc_admission grab_admission;
+    struct cc_admission drop_admission;
 };
 
+/* Storage holds the server followed by its instance */
+_Static_assert(
+    sizeof(struct cc_server_Ball) <= 8 * CC_STORAGE_SLOT, "CC_SERVER_BALL_SIZE is too small");
+
+struct cc_server_Ball_family {
+    struct cc_instance *instance;
+    void *data;
+    cc_server_Ball_lookup_t lookup;
+    cc_server_Ball_enumerate_t enumerate;
+    /* Passed to method thunks, which look up the data of the object being invoked */
+    struct cc_server_Ball object;
+    struct sd_bus_slot *vtable_slot;
+    struct sd_bus_slot *enumerator_slot;
+};
+
+/* Objects of a family have their data looked up for every call rather than
+ * once found, so that calls served within one another each see their own */
+static int cc_server_Ball_object_enter(struct cc_server_Ball *ii, const char *path, void **previous)
+{
+    int result;
+    void *data = NULL;
+
+    *previous = ii->data;
+    if (!ii->family)
+        return 0;
+    result = ii->family->lookup(ii->family, path, &data);
+    if (result == 0)
+        result = -ENOENT;
+    if (result < 0) {
+        CC_LOG_ERROR("unable to look up object data: %s\n", strerror(-result));
+        return result;
+    }
+    ii->data = data;
+    return 0;
+}
+
 
 static int cc_Ball_grab_thunk(
     CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
 {
     int result = 0;
     struct cc_server_Ball *ii = (struct cc_server_Ball *) userdata;
+    void *previous_data;
     bool success;
 
     CC_LOG_DEBUG("invoked cc_Ball_grab_thunk()\n");
@@ -41,6 +85,10 @@ static int cc_Ball_grab_thunk(
     assert(ii && ii->impl);
     CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
 
+    /* Served once sd-bus returns if the implementation may make reentrant calls */
+    result = cc_instance_defer_call(ii->instance, m, &cc_Ball_grab_thunk, ii);
+    if (result != 0)
+        return result;
     result = sd_bus_message_read(m, "");
     if (result < 0) {
         CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
@@ -54,7 +102,14 @@ static int cc_Ball_grab_thunk(
         sd_bus_reply_method_error(m, error);
         return -ENOTSUP;
     }
-    result = ii->impl->grab(ii, &success);
+    result = cc_admission_enter(&ii->admission, &ii->grab_admission, ii->instance, m, 0, error);
+    if (result < 0)
+        return result;
+    result = cc_server_Ball_object_enter(ii, sd_bus_message_get_path(m), &previous_data);
+    if (result >= 0)
+        result = ii->impl->grab(ii, &success);
+    ii->data = previous_data;
+    cc_admission_leave(&ii->admission, &ii->grab_admission);
     if (result < 0) {
         CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
         sd_bus_error_setf(
@@ -78,12 +133,17 @@ static int cc_Ball_drop_thunk(
 {
     int result = 0;
     struct cc_server_Ball *ii = (struct cc_server_Ball *) userdata;
+    void *previous_data;
 
     CC_LOG_DEBUG("invoked cc_Ball_drop_thunk()\n");
     assert(m);
     assert(ii && ii->impl);
     CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
 
+    /* Served once sd-bus returns if the implementation may make reentrant calls */
+    result = cc_instance_defer_call(ii->instance, m, &cc_Ball_drop_thunk, ii);
+    if (result != 0)
+        return result;
     result = sd_bus_message_read(m, "");
     if (result < 0) {
         CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
@@ -97,7 +157,14 @@ static int cc_Ball_drop_thunk(
         sd_bus_reply_method_error(m, error);
         return -ENOTSUP;
     }
-    result = ii->impl->drop(ii);
+    result = cc_admission_enter(&ii->admission, &ii->drop_admission, ii->instance, m, 0, error);
+    if (result < 0)
+        return result;
+    result = cc_server_Ball_object_enter(ii, sd_bus_message_get_path(m), &previous_data);
+    if (result >= 0)
+        result = ii->impl->drop(ii);
+    ii->data = previous_data;
+    cc_admission_leave(&ii->admission, &ii->drop_admission);
     if (result < 0) {
         CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
         sd_bus_error_setf(
@@ -111,6 +178,27 @@ static int cc_Ball_drop_thunk(
     return 1;
 }
 
+void cc_Ball_set_limit(struct cc_server_Ball *instance, unsigned int limit)
+{
+    CC_LOG_DEBUG("invoked cc_Ball_set_limit()\n");
+    assert(instance);
+    instance->admission.limit = limit;
+}
+
+void cc_Ball_grab_set_limit(struct cc_server_Ball *instance, unsigned int limit)
+{
+    CC_LOG_DEBUG("invoked cc_Ball_grab_set_limit()\n");
+    assert(instance);
+    instance->grab_admission.limit = limit;
+}
+
+void cc_Ball_drop_set_limit(struct cc_server_Ball *instance, unsigned int limit)
+{
+    CC_LOG_DEBUG("invoked cc_Ball_drop_set_limit()\n");
+    assert(instance);
+    instance->drop_admission.limit = limit;
+}
+
 static const sd_bus_vtable vtable_Ball[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_METHOD("grab", "", "b", &cc_Ball_grab_thunk, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -123,24 +211,74 @@ int cc_server_Ball_new(
     struct cc_server_Ball **instance)
 {
     int result;
-    struct cc_server_Ball *ii;
-    struct cc_instance *i;
+    void *storage;
+    size_t size;
 
     CC_LOG_DEBUG("invoked cc_server_Ball_new\n");
     assert(address);
     assert(impl);
     assert(instance);
 
-    ii = (struct cc_server_Ball *) calloc(1, sizeof(*ii));
-    if (!ii) {
+    size = 8 * CC_STORAGE_SLOT + CC_INSTANCE_STORAGE(strlen(address));
+    storage = cc_malloc(size);
+    if (!storage) {
         CC_LOG_ERROR("failed to allocate instance memory\n");
         return -ENOMEM;
     }
 
-    result = cc_instance_new(address, true, &i);
+    result = cc_server_Ball_init(storage, size, address, impl, data, instance);
+    if (result < 0)
+        cc_free(storage);
+
+    return result;
+}
+
+struct cc_server_Ball *cc_server_Ball_free(struct cc_server_Ball *instance)
+{
+    CC_LOG_DEBUG("invoked cc_server_Ball_free()\n");
+    if (instance) {
+        cc_server_Ball_fini(instance);
+        /* User is resposible for memory management of impl and data. */
+        cc_free(instance);
+    }
+    return NULL;
+}
+
+void *cc_server_Ball_get_data(struct cc_server_Ball *instance)
+{
+    assert(instance);
+    return instance->data;
+}
+
+int cc_server_Ball_init(
+    void *storage, size_t size, const char *address, const struct cc_server_Ball_impl *impl,
+    void *data, struct cc_server_Ball **instance)
+{
+    int result;
+    struct cc_server_Ball *ii = (struct cc_server_Ball *) storage;
+    struct cc_instance *i;
+
+    CC_LOG_DEBUG("invoked cc_server_Ball_init\n");
+    assert(storage);
+    assert(address);
+    assert(impl);
+    assert(instance);
+    if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+        CC_LOG_ERROR("misaligned instance storage\n");
+        return -EINVAL;
+    }
+    if (size < 8 * CC_STORAGE_SLOT) {
+        CC_LOG_ERROR("insufficient instance storage\n");
+        return -ENOBUFS;
+    }
+
+    memset(ii, 0, sizeof(*ii));
+    result = cc_instance_init(
+        (char *) storage + 8 * CC_STORAGE_SLOT, size - 8 * CC_STORAGE_SLOT, address,
+        true, &i);
     if (result < 0) {
         CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
-        goto fail;
+        return result;
     }
     ii->instance = i;
     ii->impl = impl;
@@ -157,24 +295,138 @@ int cc_server_Ball_new(
     return 0;
 
 fail:
-    ii = cc_server_Ball_free(ii);
+    cc_server_Ball_fini(ii);
     return result;
 }
 
-struct cc_server_Ball *cc_server_Ball_free(struct cc_server_Ball *instance)
+void cc_server_Ball_fini(struct cc_server_Ball *instance)
 {
-    CC_LOG_DEBUG("invoked cc_server_Ball_free()\n");
-    if (instance) {
-        instance->vtable_slot = sd_bus_slot_unref(instance->vtable_slot);
-        instance->instance = cc_instance_free(instance->instance);
+    CC_LOG_DEBUG("invoked cc_server_Ball_fini()\n");
+    assert(instance);
+    instance->vtable_slot = sd_bus_slot_unref(instance->vtable_slot);
+    if (instance->instance)
+        cc_instance_fini(instance->instance);
+    instance->instance = NULL;
+}
+
+static int cc_server_Ball_family_find(
+    sd_bus *bus, const char *path, const char *interface, void *userdata, void **found,
+    sd_bus_error *error)
+{
+    int result;
+    struct cc_server_Ball_family *ff = (struct cc_server_Ball_family *) userdata;
+    void *data = NULL;
+    (void) bus;
+    (void) interface;
+    (void) error;
+
+    CC_LOG_DEBUG("invoked cc_server_Ball_family_find()\n");
+    assert(path);
+    assert(found);
+    assert(ff && ff->lookup);
+    CC_LOG_DEBUG("with path='%s'\n", path);
+
+    /* Only tells whether the object exists, its data is looked up per call */
+    result = ff->lookup(ff, path, &data);
+    if (result <= 0)
+        return result;
+    *found = &ff->object;
+
+    return 1;
+}
+
+static int cc_server_Ball_family_enumerate(
+    sd_bus *bus, const char *prefix, void *userdata, char ***nodes, sd_bus_error *error)
+{
+    struct cc_server_Ball_family *ff = (struct cc_server_Ball_family *) userdata;
+    (void) bus;
+    (void) prefix;
+    (void) error;
+
+    CC_LOG_DEBUG("invoked cc_server_Ball_family_enumerate()\n");
+    assert(nodes);
+    assert(ff && ff->enumerate);
+    CC_LOG_DEBUG("with prefix='%s'\n", prefix);
+
+    return ff->enumerate(ff, nodes);
+}
+
+int cc_server_Ball_family_new(
+    const char *address, const struct cc_server_Ball_impl *impl,
+    cc_server_Ball_lookup_t lookup, cc_server_Ball_enumerate_t enumerate, void *data,
+    struct cc_server_Ball_family **family)
+{
+    int result;
+    struct cc_server_Ball_family *ff;
+    struct cc_instance *i;
+
+    CC_LOG_DEBUG("invoked cc_server_Ball_family_new\n");
+    assert(address);
+    assert(impl);
+    assert(lookup);
+    assert(family);
+
+    ff = (struct cc_server_Ball_family *) cc_calloc(1, sizeof(*ff));
+    if (!ff) {
+        CC_LOG_ERROR("failed to allocate family memory\n");
+        return -ENOMEM;
+    }
+
+    result = cc_instance_new(address, true, &i);
+    if (result < 0) {
+        CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+        goto fail;
+    }
+    ff->instance = i;
+    ff->data = data;
+    ff->lookup = lookup;
+    ff->enumerate = enumerate;
+    ff->object.instance = i;
+    ff->object.impl = impl;
+    ff->object.family = ff;
+
+    /* A single registration serves all objects below the family path */
+    result = sd_bus_add_fallback_vtable(
+        i->backend->bus, &ff->vtable_slot, i->path, i->interface, vtable_Ball,
+        &cc_server_Ball_family_find, ff);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to initialize family vtable: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (enumerate) {
+        result = sd_bus_add_node_enumerator(
+            i->backend->bus, &ff->enumerator_slot, i->path,
+            &cc_server_Ball_family_enumerate, ff);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to initialize family enumerator: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+
+    *family = ff;
+    return 0;
+
+fail:
+    ff = cc_server_Ball_family_free(ff);
+    return result;
+}
+
+struct cc_server_Ball_family *cc_server_Ball_family_free(
+    struct cc_server_Ball_family *family)
+{
+    CC_LOG_DEBUG("invoked cc_server_Ball_family_free()\n");
+    if (family) {
+        family->enumerator_slot = sd_bus_slot_unref(family->enumerator_slot);
+        family->vtable_slot = sd_bus_slot_unref(family->vtable_slot);
+        family->instance = cc_instance_free(family->instance);
         /* User is resposible for memory management of impl and data. */
-        free(instance);
+        cc_free(family);
     }
     return NULL;
 }
 
-void *cc_server_Ball_get_data(struct cc_server_Ball *instance)
+void *cc_server_Ball_family_get_data(struct cc_server_Ball_family *family)
 {
-    assert(instance);
-    return instance->data;
+    assert(family);
+    return family->data;
 }
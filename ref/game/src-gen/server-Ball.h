@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -23,6 +24,10 @@ extern "C" {
 #endif
 
 struct cc_server_Ball;
+struct cc_server_Ball_family;
+
+/* Storage for cc_server_Ball_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_SERVER_BALL_SIZE (8 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
 
 typedef int (*cc_Ball_grab_t)(struct cc_server_Ball *instance, bool *success);
 typedef int (*cc_Ball_drop_t)(struct cc_server_Ball *instance);
@@ -32,11 +37,34 @@ struct cc_server_Ball_impl {
     cc_Ball_drop_t drop;
 };
 
+/* Object families resolve paths below the family path into per-object data */
+typedef int (*cc_server_Ball_lookup_t)(
+    struct cc_server_Ball_family *family, const char *path, void **data);
+typedef int (*cc_server_Ball_enumerate_t)(
+    struct cc_server_Ball_family *family, char ***paths);
+
 int cc_server_Ball_new(
     const char *address, const struct cc_server_Ball_impl *impl, void *data,
     struct cc_server_Ball **instance);
 struct cc_server_Ball *cc_server_Ball_free(struct cc_server_Ball *instance);
 void *cc_server_Ball_get_data(struct cc_server_Ball *instance);
+int cc_server_Ball_init(
+    void *storage, size_t size, const char *address, const struct cc_server_Ball_impl *impl,
+    void *data, struct cc_server_Ball **instance);
+void cc_server_Ball_fini(struct cc_server_Ball *instance);
+
+int cc_server_Ball_family_new(
+    const char *address, const struct cc_server_Ball_impl *impl,
+    cc_server_Ball_lookup_t lookup, cc_server_Ball_enumerate_t enumerate, void *data,
+    struct cc_server_Ball_family **family);
+struct cc_server_Ball_family *cc_server_Ball_family_free(
+    struct cc_server_Ball_family *family);
+void *cc_server_Ball_family_get_data(struct cc_server_Ball_family *family);
+
+/* Calls beyond limit in progress at once are refused, 0 removes the limit */
+void cc_Ball_set_limit(struct cc_server_Ball *instance, unsigned int limit);
+void cc_Ball_grab_set_limit(struct cc_server_Ball *instance, unsigned int limit);
+void cc_Ball_drop_set_limit(struct cc_server_Ball *instance, unsigned int limit);
 
 
 #ifdef __cplusplus
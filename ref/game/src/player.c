@@ -95,7 +95,7 @@ static int player_do_free(struct player_data *data, enum player_event event)
     switch (event) {
     case EVENT_GRAB:
         data->state = STATE_GRABBING;
-        result = cc_Ball_grab_async(data->ball, &player_grab_response_handler);
+        result = cc_Ball_grab_async(data->ball, &player_grab_response_handler, NULL);
         if (result < 0) {
             CC_LOG_ERROR("unable to invoke cc_Ball_grab_async(): %s\n", strerror(-result));
             return result;
@@ -16,44 +16,72 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <capic/backend.h>
 #include <capic/dbus-private.h>
 #include <capic/log.h>
+#include <capic/memory.h>
 
 
 struct cc_client_Calculator {
     struct cc_instance *instance;
     void *data;
     cc_Calculator_split_reply_t split_reply_callback;
-    sd_bus_slot *split_reply_slot;
+    struct cc_call split_call;
+    struct cc_watcher watcher;
+    cc_Calculator_availability_handler_t availability_handler;
+    bool hold_calls;
 };
 
+/* Storage holds the client followed by its instance */
+_Static_assert(
+    sizeof(struct cc_client_Calculator) <= 22 * CC_STORAGE_SLOT, "CC_CLIENT_CALCULATOR_SIZE is too small");
+
 
 int cc_Calculator_split(
     struct cc_client_Calculator *instance, double value, int32_t *whole, int32_t *fraction)
+{
+    return cc_Calculator_split_timeout(instance, 0, value, whole, fraction);
+}
+
+int cc_Calculator_split_timeout(
+    struct cc_client_Calculator *instance, uint64_t usec, double value, int32_t *whole,
+    int32_t *fraction)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
     sd_bus_message *reply = NULL;
     sd_bus_error error = SD_BUS_ERROR_NULL;
 
-    CC_LOG_DEBUG("invoked cc_Calculator_split()\n");
+    CC_LOG_DEBUG("invoked cc_Calculator_split_timeout()\n");
     assert(instance);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->split_reply_slot) {
+    if (instance->split_call.slot || instance->split_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->split_reply_callback);
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_SYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
-    result = sd_bus_call_method(
-        i->backend->bus, i->service, i->path, i->interface,
-        "split", &error, &reply, "d", value);
+    result = sd_bus_message_new_method_call(
+        i->backend->bus, &message, i->service, i->path, i->interface, "split");
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_message_append(message, "d", value);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = cc_instance_call(i, message, timeout, &error, &reply, NULL);
     if (result < 0) {
         CC_LOG_ERROR("unable to call method: %s\n", strerror(-result));
         goto fail;
@@ -89,7 +117,7 @@ static int cc_Calculator_split_reply_thunk(
     assert(bus);
     assert(ii);
     assert(ii->split_reply_callback);
-    assert(ii->split_reply_slot == sd_bus_get_current_slot(bus));
+    assert(ii->split_call.slot == sd_bus_get_current_slot(bus));
     result = sd_bus_message_get_errno(message);
     if (result != 0) {
         CC_LOG_ERROR("failed to receive response: %s\n", strerror(result));
@@ -107,31 +135,44 @@ static int cc_Calculator_split_reply_thunk(
 
 finish:
     ii->split_reply_callback = NULL;
-    ii->split_reply_slot = sd_bus_slot_unref(ii->split_reply_slot);
+    ii->split_call.slot = sd_bus_slot_unref(ii->split_call.slot);
 
     return result;
 }
 
 int cc_Calculator_split_async(
-    struct cc_client_Calculator *instance, double value,
-    cc_Calculator_split_reply_t callback)
+    struct cc_client_Calculator *instance, double value, cc_Calculator_split_reply_t callback,
+    struct cc_call **call)
+{
+    return cc_Calculator_split_async_timeout(instance, 0, value, callback, call);
+}
+
+int cc_Calculator_split_async_timeout(
+    struct cc_client_Calculator *instance, uint64_t usec, double value,
+    cc_Calculator_split_reply_t callback, struct cc_call **call)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
 
-    CC_LOG_DEBUG("invoked cc_Calculator_split_async()\n");
+    CC_LOG_DEBUG("invoked cc_Calculator_split_async_timeout()\n");
     assert(instance);
     assert(callback);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->split_reply_slot) {
+    if (instance->split_call.slot || instance->split_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->split_reply_callback);
+    result = cc_instance_check_write(i);
+    if (result < 0)
+        return result;
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
     result = sd_bus_message_new_method_call(
         i->backend->bus, &message, i->service, i->path, i->interface, "split");
@@ -144,10 +185,17 @@ int cc_Calculator_split_async(
         CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
         goto fail;
     }
+    if (instance->hold_calls && !cc_watcher_is_available(&instance->watcher)) {
+        CC_LOG_DEBUG("holding call until service appears\n");
+        instance->split_call.held = sd_bus_message_ref(message);
+        instance->split_reply_callback = callback;
+        result = 0;
+        goto fail;
+    }
 
     result = sd_bus_call_async(
-        i->backend->bus, &instance->split_reply_slot, message,
-        &cc_Calculator_split_reply_thunk, instance, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC);
+        i->backend->bus, &instance->split_call.slot, message, &cc_Calculator_split_reply_thunk,
+        instance, timeout);
     if (result < 0) {
         CC_LOG_ERROR("unable to issue method call: %s\n", strerror(-result));
         goto fail;
@@ -156,51 +204,43 @@ int cc_Calculator_split_async(
 
 fail:
     message = sd_bus_message_unref(message);
+    if (call && result >= 0)
+        *call = &instance->split_call;
 
     return result;
 }
 
-int cc_client_Calculator_new(
-    const char *address, void *data, struct cc_client_Calculator **instance)
+int cc_client_Calculator_new(const char *address, void *data, struct cc_client_Calculator **instance)
 {
     int result;
-    struct cc_client_Calculator *ii;
+    void *storage;
+    size_t size;
 
     CC_LOG_DEBUG("invoked cc_client_Calculator_new\n");
     assert(address);
     assert(instance);
 
-    ii = (struct cc_client_Calculator *) calloc(1, sizeof(*ii));
-    if (!ii) {
+    size = 22 * CC_STORAGE_SLOT + CC_INSTANCE_STORAGE(strlen(address));
+    storage = cc_malloc(size);
+    if (!storage) {
         CC_LOG_ERROR("failed to allocate instance memory\n");
         return -ENOMEM;
     }
 
-    result = cc_instance_new(address, false, &ii->instance);
-    if (result < 0) {
-        CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
-        goto fail;
-    }
-    ii->data = data;
+    result = cc_client_Calculator_init(storage, size, address, data, instance);
+    if (result < 0)
+        cc_free(storage);
 
-    *instance = ii;
-    return 0;
-
-fail:
-    ii = cc_client_Calculator_free(ii);
     return result;
 }
 
-struct cc_client_Calculator *cc_client_Calculator_free(
-    struct cc_client_Calculator *instance)
+struct cc_client_Calculator *cc_client_Calculator_free(struct cc_client_Calculator *instance)
 {
     CC_LOG_DEBUG("invoked cc_client_Calculator_free()\n");
     if (instance) {
-        instance->split_reply_slot = sd_bus_slot_unref(
-            instance->split_reply_slot);
-        instance->instance = cc_instance_free(instance->instance);
+        cc_client_Calculator_fini(instance);
         /* User is responsible for memory management of data. */
-        free(instance);
+        cc_free(instance);
     }
     return NULL;
 }
@@ -210,3 +250,118 @@ void *cc_client_Calculator_get_data(struct cc_client_Calculator *instance)
     assert(instance);
     return instance->data;
 }
+
+void cc_client_Calculator_set_timeout(struct cc_client_Calculator *instance, uint64_t usec)
+{
+    assert(instance && instance->instance);
+    instance->instance->timeout = usec;
+}
+
+static void cc_client_Calculator_availability_changed(struct cc_watcher *watcher, bool available)
+{
+    struct cc_client_Calculator *ii = (struct cc_client_Calculator *) watcher->data;
+    int result;
+    uint64_t timeout;
+    sd_bus_message *message;
+
+    CC_LOG_DEBUG("invoked cc_client_Calculator_availability_changed()\n");
+    assert(ii);
+    if (available && ii->split_call.held) {
+        message = ii->split_call.held;
+        ii->split_call.held = NULL;
+        result = cc_instance_get_timeout(ii->instance, 0, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+        if (result >= 0)
+            result = sd_bus_call_async(
+                sd_bus_message_get_bus(message), &ii->split_call.slot, message, &cc_Calculator_split_reply_thunk,
+                ii, timeout);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to issue held method call: %s\n", strerror(-result));
+            ii->split_reply_callback = NULL;
+        }
+        sd_bus_message_unref(message);
+    }
+    if (ii->availability_handler)
+        ii->availability_handler(ii, available);
+}
+
+/* Availability is tracked once asked for, so that other clients cost nothing */
+static int cc_client_Calculator_watch(struct cc_client_Calculator *instance)
+{
+    int result;
+
+    if (instance->watcher.changed)
+        return 0;
+    result = cc_watcher_add(
+        instance->instance, &instance->watcher, &cc_client_Calculator_availability_changed, instance);
+    if (result < 0)
+        CC_LOG_ERROR("unable to watch service: %s\n", strerror(-result));
+    return result;
+}
+
+bool cc_client_Calculator_is_available(struct cc_client_Calculator *instance)
+{
+    assert(instance);
+    return cc_watcher_is_available(&instance->watcher);
+}
+
+int cc_client_Calculator_set_availability_handler(
+    struct cc_client_Calculator *instance, cc_Calculator_availability_handler_t handler)
+{
+    assert(instance);
+    instance->availability_handler = handler;
+    return handler ? cc_client_Calculator_watch(instance) : 0;
+}
+
+int cc_client_Calculator_set_hold_calls(struct cc_client_Calculator *instance, bool hold)
+{
+    assert(instance);
+    instance->hold_calls = hold;
+    return hold ? cc_client_Calculator_watch(instance) : 0;
+}
+
+int cc_client_Calculator_init(
+    void *storage, size_t size, const char *address, void *data,
+    struct cc_client_Calculator **instance)
+{
+    int result;
+    struct cc_client_Calculator *ii = (struct cc_client_Calculator *) storage;
+
+    CC_LOG_DEBUG("invoked cc_client_Calculator_init\n");
+    assert(storage);
+    assert(address);
+    assert(instance);
+    if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+        CC_LOG_ERROR("misaligned instance storage\n");
+        return -EINVAL;
+    }
+    if (size < 22 * CC_STORAGE_SLOT) {
+        CC_LOG_ERROR("insufficient instance storage\n");
+        return -ENOBUFS;
+    }
+
+    memset(ii, 0, sizeof(*ii));
+    result = cc_instance_init(
+        (char *) storage + 22 * CC_STORAGE_SLOT, size - 22 * CC_STORAGE_SLOT,
+        address, false, &ii->instance);
+    if (result < 0) {
+        CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+        return result;
+    }
+    ii->data = data;
+    ii->split_call.instance = ii->instance;
+
+    *instance = ii;
+    return 0;
+}
+
+void cc_client_Calculator_fini(struct cc_client_Calculator *instance)
+{
+    CC_LOG_DEBUG("invoked cc_client_Calculator_fini()\n");
+    assert(instance);
+    cc_watcher_remove(&instance->watcher);
+    instance->split_call.slot = sd_bus_slot_unref(instance->split_call.slot);
+    instance->split_call.held = sd_bus_message_unref(instance->split_call.held);
+    if (instance->instance)
+        cc_instance_fini(instance->instance);
+    instance->instance = NULL;
+}
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -24,21 +25,50 @@ extern "C" {
 
 struct cc_client_Calculator;
 
+/* Storage for cc_client_Calculator_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_CLIENT_CALCULATOR_SIZE (22 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
+
 typedef void (*cc_Calculator_split_reply_t)(
     struct cc_client_Calculator *instance, int32_t whole, int32_t fraction);
 
 int cc_Calculator_split(
     struct cc_client_Calculator *instance, double value, int32_t *whole,
     int32_t *fraction);
+/* The call, if not NULL, is set to the handle for cc_call_cancel() until the callback is invoked */
 int cc_Calculator_split_async(
-    struct cc_client_Calculator *instance, double value,
-    cc_Calculator_split_reply_t callback);
+    struct cc_client_Calculator *instance, double value, cc_Calculator_split_reply_t callback,
+    struct cc_call **call);
+/* Calls time out after usec, or the timeout of the instance for 0 */
+int cc_Calculator_split_timeout(
+    struct cc_client_Calculator *instance, uint64_t usec, double value, int32_t *whole,
+    int32_t *fraction);
+int cc_Calculator_split_async_timeout(
+    struct cc_client_Calculator *instance, uint64_t usec, double value,
+    cc_Calculator_split_reply_t callback, struct cc_call **call);
+
+typedef void (
+    *cc_Calculator_availability_handler_t)(struct cc_client_Calculator *instance,
+    bool available);
 
 int cc_client_Calculator_new(
     const char *address, void *data, struct cc_client_Calculator **instance);
 struct cc_client_Calculator *cc_client_Calculator_free(
     struct cc_client_Calculator *instance);
 void *cc_client_Calculator_get_data(struct cc_client_Calculator *instance);
+/* Method calls time out after usec, or 25 s if synchronous and 2 s if asynchronous for 0 */
+void cc_client_Calculator_set_timeout(struct cc_client_Calculator *instance, uint64_t usec);
+/* Whether the service of the instance has an owner on the bus, which peers always have,
+ * tracked only once a handler is set or calls are held and true before */
+bool cc_client_Calculator_is_available(struct cc_client_Calculator *instance);
+/* Invokes handler whenever the service appears or disappears, none for NULL */
+int cc_client_Calculator_set_availability_handler(
+    struct cc_client_Calculator *instance, cc_Calculator_availability_handler_t handler);
+/* Asynchronous calls made while the service is unavailable are made once it appears */
+int cc_client_Calculator_set_hold_calls(struct cc_client_Calculator *instance, bool hold);
+int cc_client_Calculator_init(
+    void *storage, size_t size, const char *address, void *data,
+    struct cc_client_Calculator **instance);
+void cc_client_Calculator_fini(struct cc_client_Calculator *instance);
 
 
 #ifdef __cplusplus
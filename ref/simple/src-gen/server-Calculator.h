@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -23,6 +24,10 @@ extern "C" {
 #endif
 
 struct cc_server_Calculator;
+struct cc_server_Calculator_family;
+
+/* Storage for cc_server_Calculator_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_SERVER_CALCULATOR_SIZE (7 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
 
 typedef int (*cc_Calculator_split_t)(
     struct cc_server_Calculator *instance, double value, int32_t *whole, int32_t *fraction);
@@ -31,12 +36,34 @@ struct cc_server_Calculator_impl {
     cc_Calculator_split_t split;
 };
 
+/* Object families resolve paths below the family path into per-object data */
+typedef int (*cc_server_Calculator_lookup_t)(
+    struct cc_server_Calculator_family *family, const char *path, void **data);
+typedef int (*cc_server_Calculator_enumerate_t)(
+    struct cc_server_Calculator_family *family, char ***paths);
+
 int cc_server_Calculator_new(
     const char *address, const struct cc_server_Calculator_impl *impl, void *data,
     struct cc_server_Calculator **instance);
 struct cc_server_Calculator *cc_server_Calculator_free(
     struct cc_server_Calculator *instance);
 void *cc_server_Calculator_get_data(struct cc_server_Calculator *instance);
+int cc_server_Calculator_init(
+    void *storage, size_t size, const char *address, const struct cc_server_Calculator_impl *impl,
+    void *data, struct cc_server_Calculator **instance);
+void cc_server_Calculator_fini(struct cc_server_Calculator *instance);
+
+int cc_server_Calculator_family_new(
+    const char *address, const struct cc_server_Calculator_impl *impl,
+    cc_server_Calculator_lookup_t lookup, cc_server_Calculator_enumerate_t enumerate, void *data,
+    struct cc_server_Calculator_family **family);
+struct cc_server_Calculator_family *cc_server_Calculator_family_free(
+    struct cc_server_Calculator_family *family);
+void *cc_server_Calculator_family_get_data(struct cc_server_Calculator_family *family);
+
+/* Calls beyond limit in progress at once are refused, 0 removes the limit */
+void cc_Calculator_set_limit(struct cc_server_Calculator *instance, unsigned int limit);
+void cc_Calculator_split_set_limit(struct cc_server_Calculator *instance, unsigned int limit);
 
 
 #ifdef __cplusplus
@@ -87,7 +87,7 @@ int main()
         "expecting to receive whole=%d, fraction=%d\n", (int32_t)value,
         (int32_t)((value - (double)(int32_t)value) * 1.0e+9));
     result = cc_Calculator_split_async(
-        instance2, value, &complete_Calculator_split);
+        instance2, value, &complete_Calculator_split, NULL);
     if (result < 0) {
         printf("unable to issue cc_Calculator_split_async(): %s\n", strerror(-result));
         goto fail;
@@ -16,44 +16,66 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <capic/backend.h>
 #include <capic/dbus-private.h>
 #include <capic/log.h>
+#include <capic/memory.h>
 
 
 struct cc_client_Smartie {
     struct cc_instance *instance;
     void *data;
     cc_Smartie_ring_reply_t ring_reply_callback;
-    sd_bus_slot *ring_reply_slot;
+    struct cc_call ring_call;
     cc_Smartie_hangup_reply_t hangup_reply_callback;
-    sd_bus_slot *hangup_reply_slot;
+    struct cc_call hangup_call;
+    struct cc_watcher watcher;
+    cc_Smartie_availability_handler_t availability_handler;
+    bool hold_calls;
 };
 
+/* Storage holds the client followed by its instance */
+_Static_assert(
+    sizeof(struct cc_client_Smartie) <= 27 * CC_STORAGE_SLOT, "CC_CLIENT_SMARTIE_SIZE is too small");
+
 
 int cc_Smartie_ring(struct cc_client_Smartie *instance, int32_t *status)
+{
+    return cc_Smartie_ring_timeout(instance, 0, status);
+}
+
+int cc_Smartie_ring_timeout(struct cc_client_Smartie *instance, uint64_t usec, int32_t *status)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
     sd_bus_message *reply = NULL;
     sd_bus_error error = SD_BUS_ERROR_NULL;
 
-    CC_LOG_DEBUG("invoked cc_Smartie_ring()\n");
+    CC_LOG_DEBUG("invoked cc_Smartie_ring_timeout()\n");
     assert(instance);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->ring_reply_slot) {
+    if (instance->ring_call.slot || instance->ring_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->ring_reply_callback);
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_SYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
-    result = sd_bus_call_method(
-        i->backend->bus, i->service, i->path, i->interface, "ring", &error, &reply, "");
+    result = sd_bus_message_new_method_call(
+        i->backend->bus, &message, i->service, i->path, i->interface, "ring");
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = cc_instance_call(i, message, timeout, &error, &reply, NULL);
     if (result < 0) {
         CC_LOG_ERROR("unable to call method: %s\n", strerror(-result));
         goto fail;
@@ -88,7 +110,7 @@ static int cc_Smartie_ring_reply_thunk(
     assert(bus);
     assert(ii);
     assert(ii->ring_reply_callback);
-    assert(ii->ring_reply_slot == sd_bus_get_current_slot(bus));
+    assert(ii->ring_call.slot == sd_bus_get_current_slot(bus));
     result = sd_bus_message_get_errno(message);
     if (result != 0) {
         CC_LOG_ERROR("failed to receive response: %s\n", strerror(result));
@@ -106,30 +128,43 @@ static int cc_Smartie_ring_reply_thunk(
 
 finish:
     ii->ring_reply_callback = NULL;
-    ii->ring_reply_slot = sd_bus_slot_unref(ii->ring_reply_slot);
+    ii->ring_call.slot = sd_bus_slot_unref(ii->ring_call.slot);
 
     return result;
 }
 
 int cc_Smartie_ring_async(
-    struct cc_client_Smartie *instance, cc_Smartie_ring_reply_t callback)
+    struct cc_client_Smartie *instance, cc_Smartie_ring_reply_t callback, struct cc_call **call)
+{
+    return cc_Smartie_ring_async_timeout(instance, 0, callback, call);
+}
+
+int cc_Smartie_ring_async_timeout(
+    struct cc_client_Smartie *instance, uint64_t usec, cc_Smartie_ring_reply_t callback,
+    struct cc_call **call)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
 
-    CC_LOG_DEBUG("invoked cc_Smartie_ring_async()\n");
+    CC_LOG_DEBUG("invoked cc_Smartie_ring_async_timeout()\n");
     assert(instance);
     assert(callback);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->ring_reply_slot) {
+    if (instance->ring_call.slot || instance->ring_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->ring_reply_callback);
+    result = cc_instance_check_write(i);
+    if (result < 0)
+        return result;
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
     result = sd_bus_message_new_method_call(
         i->backend->bus, &message, i->service, i->path, i->interface, "ring");
@@ -142,10 +177,17 @@ int cc_Smartie_ring_async(
         CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
         goto fail;
     }
+    if (instance->hold_calls && !cc_watcher_is_available(&instance->watcher)) {
+        CC_LOG_DEBUG("holding call until service appears\n");
+        instance->ring_call.held = sd_bus_message_ref(message);
+        instance->ring_reply_callback = callback;
+        result = 0;
+        goto fail;
+    }
 
     result = sd_bus_call_async(
-        i->backend->bus, &instance->ring_reply_slot, message, &cc_Smartie_ring_reply_thunk,
-        instance, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC);
+        i->backend->bus, &instance->ring_call.slot, message, &cc_Smartie_ring_reply_thunk,
+        instance, timeout);
     if (result < 0) {
         CC_LOG_ERROR("unable to issue method call: %s\n", strerror(-result));
         goto fail;
@@ -154,32 +196,47 @@ int cc_Smartie_ring_async(
 
 fail:
     message = sd_bus_message_unref(message);
+    if (call && result >= 0)
+        *call = &instance->ring_call;
 
     return result;
 }
 
 int cc_Smartie_hangup(struct cc_client_Smartie *instance, int32_t *status)
+{
+    return cc_Smartie_hangup_timeout(instance, 0, status);
+}
+
+int cc_Smartie_hangup_timeout(struct cc_client_Smartie *instance, uint64_t usec, int32_t *status)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
     sd_bus_message *reply = NULL;
     sd_bus_error error = SD_BUS_ERROR_NULL;
 
-    CC_LOG_DEBUG("invoked cc_Smartie_hangup()\n");
+    CC_LOG_DEBUG("invoked cc_Smartie_hangup_timeout()\n");
     assert(instance);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->hangup_reply_slot) {
+    if (instance->hangup_call.slot || instance->hangup_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->hangup_reply_callback);
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_SYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
-    result = sd_bus_call_method(
-        i->backend->bus, i->service, i->path, i->interface, "hangup", &error, &reply, "");
+    result = sd_bus_message_new_method_call(
+        i->backend->bus, &message, i->service, i->path, i->interface, "hangup");
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = cc_instance_call(i, message, timeout, &error, &reply, NULL);
     if (result < 0) {
         CC_LOG_ERROR("unable to call method: %s\n", strerror(-result));
         goto fail;
@@ -214,7 +271,7 @@ static int cc_Smartie_hangup_reply_thunk(
     assert(bus);
     assert(ii);
     assert(ii->hangup_reply_callback);
-    assert(ii->hangup_reply_slot == sd_bus_get_current_slot(bus));
+    assert(ii->hangup_call.slot == sd_bus_get_current_slot(bus));
     result = sd_bus_message_get_errno(message);
     if (result != 0) {
         CC_LOG_ERROR("failed to receive response: %s\n", strerror(result));
@@ -232,30 +289,44 @@ static int cc_Smartie_hangup_reply_thunk(
 
 finish:
     ii->hangup_reply_callback = NULL;
-    ii->hangup_reply_slot = sd_bus_slot_unref(ii->hangup_reply_slot);
+    ii->hangup_call.slot = sd_bus_slot_unref(ii->hangup_call.slot);
 
     return result;
 }
 
 int cc_Smartie_hangup_async(
-    struct cc_client_Smartie *instance, cc_Smartie_hangup_reply_t callback)
+    struct cc_client_Smartie *instance, cc_Smartie_hangup_reply_t callback,
+    struct cc_call **call)
+{
+    return cc_Smartie_hangup_async_timeout(instance, 0, callback, call);
+}
+
+int cc_Smartie_hangup_async_timeout(
+    struct cc_client_Smartie *instance, uint64_t usec, cc_Smartie_hangup_reply_t callback,
+    struct cc_call **call)
 {
     int result = 0;
     struct cc_instance *i;
+    uint64_t timeout;
     sd_bus_message *message = NULL;
 
-    CC_LOG_DEBUG("invoked cc_Smartie_hangup_async()\n");
+    CC_LOG_DEBUG("invoked cc_Smartie_hangup_async_timeout()\n");
     assert(instance);
     assert(callback);
     i = instance->instance;
     assert(i && i->backend && i->backend->bus);
     assert(i->service && i->path && i->interface);
 
-    if (instance->hangup_reply_slot) {
+    if (instance->hangup_call.slot || instance->hangup_call.held) {
         CC_LOG_ERROR("unable to call method with already pending reply\n");
         return -EBUSY;
     }
-    assert(!instance->hangup_reply_callback);
+    result = cc_instance_check_write(i);
+    if (result < 0)
+        return result;
+    result = cc_instance_get_timeout(i, usec, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+    if (result < 0)
+        return result;
 
     result = sd_bus_message_new_method_call(
         i->backend->bus, &message, i->service, i->path, i->interface, "hangup");
@@ -268,10 +339,17 @@ int cc_Smartie_hangup_async(
         CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
         goto fail;
     }
+    if (instance->hold_calls && !cc_watcher_is_available(&instance->watcher)) {
+        CC_LOG_DEBUG("holding call until service appears\n");
+        instance->hangup_call.held = sd_bus_message_ref(message);
+        instance->hangup_reply_callback = callback;
+        result = 0;
+        goto fail;
+    }
 
     result = sd_bus_call_async(
-        i->backend->bus, &instance->hangup_reply_slot, message,
-        &cc_Smartie_hangup_reply_thunk, instance, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC);
+        i->backend->bus, &instance->hangup_call.slot, message, &cc_Smartie_hangup_reply_thunk,
+        instance, timeout);
     if (result < 0) {
         CC_LOG_ERROR("unable to issue method call: %s\n", strerror(-result));
         goto fail;
@@ -280,38 +358,33 @@ int cc_Smartie_hangup_async(
 
 fail:
     message = sd_bus_message_unref(message);
+    if (call && result >= 0)
+        *call = &instance->hangup_call;
 
     return result;
 }
 
-int cc_client_Smartie_new(
-    const char *address, void *data, struct cc_client_Smartie **instance)
+int cc_client_Smartie_new(const char *address, void *data, struct cc_client_Smartie **instance)
 {
     int result;
-    struct cc_client_Smartie *ii;
+    void *storage;
+    size_t size;
 
     CC_LOG_DEBUG("invoked cc_client_Smartie_new\n");
     assert(address);
     assert(instance);
 
-    ii = (struct cc_client_Smartie *) calloc(1, sizeof(*ii));
-    if (!ii) {
+    size = 27 * CC_STORAGE_SLOT + CC_INSTANCE_STORAGE(strlen(address));
+    storage = cc_malloc(size);
+    if (!storage) {
         CC_LOG_ERROR("failed to allocate instance memory\n");
         return -ENOMEM;
     }
 
-    result = cc_instance_new(address, false, &ii->instance);
-    if (result < 0) {
-        CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
-        goto fail;
-    }
-    ii->data = data;
-
-    *instance = ii;
-    return 0;
+    result = cc_client_Smartie_init(storage, size, address, data, instance);
+    if (result < 0)
+        cc_free(storage);
 
-fail:
-    ii = cc_client_Smartie_free(ii);
     return result;
 }
 
@@ -319,11 +392,9 @@ struct cc_client_Smartie *cc_client_Smartie_free(struct cc_client_Smartie *insta
 {
     CC_LOG_DEBUG("invoked cc_client_Smartie_free()\n");
     if (instance) {
-        instance->ring_reply_slot = sd_bus_slot_unref(instance->ring_reply_slot);
-        instance->hangup_reply_slot = sd_bus_slot_unref(instance->hangup_reply_slot);
-        instance->instance = cc_instance_free(instance->instance);
+        cc_client_Smartie_fini(instance);
         /* User is responsible for memory management of data. */
-        free(instance);
+        cc_free(instance);
     }
     return NULL;
 }
@@ -333,3 +404,135 @@ void *cc_client_Smartie_get_data(struct cc_client_Smartie *instance)
     assert(instance);
     return instance->data;
 }
+
+void cc_client_Smartie_set_timeout(struct cc_client_Smartie *instance, uint64_t usec)
+{
+    assert(instance && instance->instance);
+    instance->instance->timeout = usec;
+}
+
+static void cc_client_Smartie_availability_changed(struct cc_watcher *watcher, bool available)
+{
+    struct cc_client_Smartie *ii = (struct cc_client_Smartie *) watcher->data;
+    int result;
+    uint64_t timeout;
+    sd_bus_message *message;
+
+    CC_LOG_DEBUG("invoked cc_client_Smartie_availability_changed()\n");
+    assert(ii);
+    if (available && ii->ring_call.held) {
+        message = ii->ring_call.held;
+        ii->ring_call.held = NULL;
+        result = cc_instance_get_timeout(ii->instance, 0, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+        if (result >= 0)
+            result = sd_bus_call_async(
+                sd_bus_message_get_bus(message), &ii->ring_call.slot, message, &cc_Smartie_ring_reply_thunk,
+                ii, timeout);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to issue held method call: %s\n", strerror(-result));
+            ii->ring_reply_callback = NULL;
+        }
+        sd_bus_message_unref(message);
+    }
+    if (available && ii->hangup_call.held) {
+        message = ii->hangup_call.held;
+        ii->hangup_call.held = NULL;
+        result = cc_instance_get_timeout(ii->instance, 0, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+        if (result >= 0)
+            result = sd_bus_call_async(
+                sd_bus_message_get_bus(message), &ii->hangup_call.slot, message, &cc_Smartie_hangup_reply_thunk,
+                ii, timeout);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to issue held method call: %s\n", strerror(-result));
+            ii->hangup_reply_callback = NULL;
+        }
+        sd_bus_message_unref(message);
+    }
+    if (ii->availability_handler)
+        ii->availability_handler(ii, available);
+}
+
+/* Availability is tracked once asked for, so that other clients cost nothing */
+static int cc_client_Smartie_watch(struct cc_client_Smartie *instance)
+{
+    int result;
+
+    if (instance->watcher.changed)
+        return 0;
+    result = cc_watcher_add(
+        instance->instance, &instance->watcher, &cc_client_Smartie_availability_changed, instance);
+    if (result < 0)
+        CC_LOG_ERROR("unable to watch service: %s\n", strerror(-result));
+    return result;
+}
+
+bool cc_client_Smartie_is_available(struct cc_client_Smartie *instance)
+{
+    assert(instance);
+    return cc_watcher_is_available(&instance->watcher);
+}
+
+int cc_client_Smartie_set_availability_handler(
+    struct cc_client_Smartie *instance, cc_Smartie_availability_handler_t handler)
+{
+    assert(instance);
+    instance->availability_handler = handler;
+    return handler ? cc_client_Smartie_watch(instance) : 0;
+}
+
+int cc_client_Smartie_set_hold_calls(struct cc_client_Smartie *instance, bool hold)
+{
+    assert(instance);
+    instance->hold_calls = hold;
+    return hold ? cc_client_Smartie_watch(instance) : 0;
+}
+
+int cc_client_Smartie_init(
+    void *storage, size_t size, const char *address, void *data,
+    struct cc_client_Smartie **instance)
+{
+    int result;
+    struct cc_client_Smartie *ii = (struct cc_client_Smartie *) storage;
+
+    CC_LOG_DEBUG("invoked cc_client_Smartie_init\n");
+    assert(storage);
+    assert(address);
+    assert(instance);
+    if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+        CC_LOG_ERROR("misaligned instance storage\n");
+        return -EINVAL;
+    }
+    if (size < 27 * CC_STORAGE_SLOT) {
+        CC_LOG_ERROR("insufficient instance storage\n");
+        return -ENOBUFS;
+    }
+
+    memset(ii, 0, sizeof(*ii));
+    result = cc_instance_init(
+        (char *) storage + 27 * CC_STORAGE_SLOT, size - 27 * CC_STORAGE_SLOT,
+        address, false, &ii->instance);
+    if (result < 0) {
+        CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+        return result;
+    }
+    ii->data = data;
+    ii->ring_call.instance = ii->instance;
+    ii->hangup_call.instance = ii->instance;
+
+    *instance = ii;
+    return 0;
+}
+
+void cc_client_Smartie_fini(struct cc_client_Smartie *instance)
+{
+    CC_LOG_DEBUG("invoked cc_client_Smartie_fini()\n");
+    assert(instance);
+    cc_watcher_remove(&instance->watcher);
+    instance->ring_call.slot = sd_bus_slot_unref(instance->ring_call.slot);
+    instance->ring_call.held = sd_bus_message_unref(instance->ring_call.held);
+    instance->hangup_call.slot = sd_bus_slot_unref(instance->hangup_call.slot);
+    instance->hangup_call.held = sd_bus_message_unref(instance->hangup_call.held);
+    if (instance->instance)
+        cc_instance_fini(instance->instance);
+    instance->instance = NULL;
+}
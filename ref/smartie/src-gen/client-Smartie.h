@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -24,6 +25,9 @@ extern "C" {
 
 struct cc_client_Smartie;
 
+/* Storage for cc_client_Smartie_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_CLIENT_SMARTIE_SIZE (27 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
+
 typedef void (*cc_Smartie_ring_reply_t)(
     struct cc_client_Smartie *instance, int32_t status);
 typedef void (*cc_Smartie_hangup_reply_t)(
@@ -31,18 +35,49 @@ typedef void (*cc_Smartie_hangup_reply_t)(
 
 int cc_Smartie_ring(
     struct cc_client_Smartie *instance, int32_t *status);
+/* The call, if not NULL, is set to the handle for cc_call_cancel() until the callback is invoked */
 int cc_Smartie_ring_async(
-    struct cc_client_Smartie *instance, cc_Smartie_ring_reply_t callback);
+    struct cc_client_Smartie *instance, cc_Smartie_ring_reply_t callback,
+    struct cc_call **call);
+/* Calls time out after usec, or the timeout of the instance for 0 */
+int cc_Smartie_ring_timeout(struct cc_client_Smartie *instance, uint64_t usec, int32_t *status);
+int cc_Smartie_ring_async_timeout(
+    struct cc_client_Smartie *instance, uint64_t usec, cc_Smartie_ring_reply_t callback,
+    struct cc_call **call);
 
 int cc_Smartie_hangup(
     struct cc_client_Smartie *instance, int32_t *status);
+/* The call, if not NULL, is set to the handle for cc_call_cancel() until the callback is invoked */
 int cc_Smartie_hangup_async(
-    struct cc_client_Smartie *instance, cc_Smartie_hangup_reply_t callback);
+    struct cc_client_Smartie *instance, cc_Smartie_hangup_reply_t callback,
+    struct cc_call **call);
+/* Calls time out after usec, or the timeout of the instance for 0 */
+int cc_Smartie_hangup_timeout(struct cc_client_Smartie *instance, uint64_t usec, int32_t *status);
+int cc_Smartie_hangup_async_timeout(
+    struct cc_client_Smartie *instance, uint64_t usec, cc_Smartie_hangup_reply_t callback,
+    struct cc_call **call);
+
+typedef void (
+    *cc_Smartie_availability_handler_t)(struct cc_client_Smartie *instance, bool available);
 
 int cc_client_Smartie_new(
     const char *address, void *data, struct cc_client_Smartie **instance);
 struct cc_client_Smartie *cc_client_Smartie_free(struct cc_client_Smartie *instance);
 void *cc_client_Smartie_get_data(struct cc_client_Smartie *instance);
+/* Method calls time out after usec, or 25 s if synchronous and 2 s if asynchronous for 0 */
+void cc_client_Smartie_set_timeout(struct cc_client_Smartie *instance, uint64_t usec);
+/* Whether the service of the instance has an owner on the bus, which peers always have,
+ * tracked only once a handler is set or calls are held and true before */
+bool cc_client_Smartie_is_available(struct cc_client_Smartie *instance);
+/* Invokes handler whenever the service appears or disappears, none for NULL */
+int cc_client_Smartie_set_availability_handler(
+    struct cc_client_Smartie *instance, cc_Smartie_availability_handler_t handler);
+/* Asynchronous calls made while the service is unavailable are made once it appears */
+int cc_client_Smartie_set_hold_calls(struct cc_client_Smartie *instance, bool hold);
+int cc_client_Smartie_init(
+    void *storage, size_t size, const char *address, void *data,
+    struct cc_client_Smartie **instance);
+void cc_client_Smartie_fini(struct cc_client_Smartie *instance);
 
 
 #ifdef __cplusplus
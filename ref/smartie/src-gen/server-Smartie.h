@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -23,6 +24,10 @@ extern "C" {
 #endif
 
 struct cc_server_Smartie;
+struct cc_server_Smartie_family;
+
+/* Storage for cc_server_Smartie_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+#define CC_SERVER_SMARTIE_SIZE (8 * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
 
 typedef int (*cc_Smartie_ring_t)(struct cc_server_Smartie *instance, int32_t *status);
 typedef int (*cc_Smartie_hangup_t)(struct cc_server_Smartie *instance, int32_t *status);
@@ -32,11 +37,34 @@ struct cc_server_Smartie_impl {
     cc_Smartie_hangup_t hangup;
 };
 
+/* Object families resolve paths below the family path into per-object data */
+typedef int (*cc_server_Smartie_lookup_t)(
+    struct cc_server_Smartie_family *family, const char *path, void **data);
+typedef int (*cc_server_Smartie_enumerate_t)(
+    struct cc_server_Smartie_family *family, char ***paths);
+
 int cc_server_Smartie_new(
     const char *address, const struct cc_server_Smartie_impl *impl, void *data,
     struct cc_server_Smartie **instance);
 struct cc_server_Smartie *cc_server_Smartie_free(struct cc_server_Smartie *instance);
 void *cc_server_Smartie_get_data(struct cc_server_Smartie *instance);
+int cc_server_Smartie_init(
+    void *storage, size_t size, const char *address, const struct cc_server_Smartie_impl *impl,
+    void *data, struct cc_server_Smartie **instance);
+void cc_server_Smartie_fini(struct cc_server_Smartie *instance);
+
+int cc_server_Smartie_family_new(
+    const char *address, const struct cc_server_Smartie_impl *impl,
+    cc_server_Smartie_lookup_t lookup, cc_server_Smartie_enumerate_t enumerate, void *data,
+    struct cc_server_Smartie_family **family);
+struct cc_server_Smartie_family *cc_server_Smartie_family_free(
+    struct cc_server_Smartie_family *family);
+void *cc_server_Smartie_family_get_data(struct cc_server_Smartie_family *family);
+
+/* Calls beyond limit in progress at once are refused, 0 removes the limit */
+void cc_Smartie_set_limit(struct cc_server_Smartie *instance, unsigned int limit);
+void cc_Smartie_ring_set_limit(struct cc_server_Smartie *instance, unsigned int limit);
+void cc_Smartie_hangup_set_limit(struct cc_server_Smartie *instance, unsigned int limit);
 
 
 #ifdef __cplusplus
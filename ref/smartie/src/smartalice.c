@@ -36,12 +36,23 @@ static int Smartie_impl_ring(struct cc_server_Smartie *instance, int32_t *status
     return 0;
 }
 
+/* Invoked by bob while he serves the ring of alice */
 static int Smartie_impl_hangup(struct cc_server_Smartie *instance, int32_t *status)
 {
+    struct cc_client_Smartie *bob;
+    int result;
+
     CC_LOG_DEBUG("invoked Smartie_impl_hangup()\n");
     assert(instance);
     assert(status);
-    *status = 0;
+    bob = (struct cc_client_Smartie *) cc_server_Smartie_get_data(instance);
+    result = cc_Smartie_hangup(bob, status);
+    if (result < 0) {
+        printf("unable to call bob.hangup(): %s\n", strerror(-result));
+        return result;
+    }
+    printf("status=%d returned by bob.hangup()\n", *status);
+    alice_state = SMARTIE_IDLE;
     CC_LOG_DEBUG("returning status=%d\n", *status);
 
     return 0;
@@ -123,6 +134,7 @@ int main()
     sd_event *event = NULL;
     struct cc_server_Smartie *alice = NULL;
     struct cc_client_Smartie *bob = NULL;
+    int32_t status;
 
     CC_LOG_OPEN("smartalice");
     printf("Started smartalice\n");
@@ -132,11 +144,10 @@ int main()
         printf("unable to startup the backend: %s\n", strerror(-result));
         goto fail;
     }
-    result = cc_server_Smartie_new(
-        "org.genivi.capic.Smartie.Alice:/alice:org.genivi.capic.Smartie",
-        &alice_impl, NULL, &alice);
+    /* Calls made by alice and her implementations are served by her meanwhile */
+    result = cc_backend_set_reentrant_calls(2);
     if (result < 0) {
-        printf("unable to create server instance '/alice': %s\n", strerror(-result));
+        printf("unable to make reentrant calls: %s\n", strerror(-result));
         goto fail;
     }
     result = cc_client_Smartie_new(
@@ -145,6 +156,13 @@ int main()
         printf("unable to create client instance '/bob': %s\n", strerror(-result));
         goto fail;
     }
+    result = cc_server_Smartie_new(
+        "org.genivi.capic.Smartie.Alice:/alice:org.genivi.capic.Smartie",
+        &alice_impl, bob, &alice);
+    if (result < 0) {
+        printf("unable to create server instance '/alice': %s\n", strerror(-result));
+        goto fail;
+    }
 
     result = cc_backend_get_event_context(&context);
     if (result < 0) {
@@ -160,8 +178,19 @@ int main()
         goto fail;
     }
 
+    /* Bob calls alice back before he replies, and alice calls bob again from
+     * within that call, which waits for neither of them to time out */
+    printf("invoking synchronously method bob.ring()\n");
+    alice_state = SMARTIE_DIALING;
+    result = cc_Smartie_ring(bob, &status);
+    if (result < 0) {
+        printf("unable to complete cc_Smartie_ring(): %s\n", strerror(-result));
+        goto fail;
+    }
+    printf("status=%d returned by bob.ring()\n", status);
+
     printf("invoking asynchronously method bob.ring()\n");
-    result = cc_Smartie_ring_async(bob, &complete_Smartie_ring);
+    result = cc_Smartie_ring_async(bob, &complete_Smartie_ring, NULL);
     if (result < 0) {
         printf("unable to issue cc_Smartie_ring_async(): %s\n", strerror(-result));
         goto fail;
@@ -175,8 +204,8 @@ int main()
     }
 
 fail:
-    bob = cc_client_Smartie_free(bob);
     alice = cc_server_Smartie_free(alice);
+    bob = cc_client_Smartie_free(bob);
     cc_backend_shutdown();
 
     CC_LOG_CLOSE();
@@ -27,14 +27,30 @@ static enum smartie_state bob_state = SMARTIE_IDLE;
 
 static int Smartie_impl_ring(struct cc_server_Smartie *instance, int32_t *status)
 {
+    struct cc_client_Smartie *alice;
+    int32_t alice_status;
+    int result;
+
     CC_LOG_DEBUG("invoked Smartie_impl_ring()\n");
     assert(instance);
     assert(status);
-    if (bob_state == SMARTIE_IDLE) {
-        *status = 0;
-        bob_state = SMARTIE_RINGING;
-    } else
+    if (bob_state != SMARTIE_IDLE) {
         *status = 1;
+        CC_LOG_DEBUG("returning status=%d\n", *status);
+        return 0;
+    }
+    bob_state = SMARTIE_RINGING;
+
+    /* Alice serves the call while she waits for the reply to her ring, and
+     * hangs up by calling back into bob while this call waits in turn */
+    alice = (struct cc_client_Smartie *) cc_server_Smartie_get_data(instance);
+    result = cc_Smartie_hangup(alice, &alice_status);
+    if (result < 0) {
+        printf("unable to call alice.hangup(): %s\n", strerror(-result));
+        return result;
+    }
+    printf("status=%d returned by alice.hangup()\n", alice_status);
+    *status = bob_state == SMARTIE_IDLE ? 0 : 1;
     CC_LOG_DEBUG("returning status=%d\n", *status);
 
     return 0;
@@ -124,11 +140,10 @@ int main()
         printf("unable to startup the backend: %s\n", strerror(-result));
         goto fail;
     }
-    result = cc_server_Smartie_new(
-        "org.genivi.capic.Smartie.Bob:/bob:org.genivi.capic.Smartie",
-        &bob_impl, NULL, &bob);
+    /* Calls made by the implementations are served by the callee meanwhile */
+    result = cc_backend_set_reentrant_calls(2);
     if (result < 0) {
-        printf("unable to create server instance '/bob': %s\n", strerror(-result));
+        printf("unable to make reentrant calls: %s\n", strerror(-result));
         goto fail;
     }
     result = cc_client_Smartie_new(
@@ -137,6 +152,13 @@ int main()
         printf("unable to create client instance '/alice': %s\n", strerror(-result));
         goto fail;
     }
+    result = cc_server_Smartie_new(
+        "org.genivi.capic.Smartie.Bob:/bob:org.genivi.capic.Smartie",
+        &bob_impl, alice, &bob);
+    if (result < 0) {
+        printf("unable to create server instance '/bob': %s\n", strerror(-result));
+        goto fail;
+    }
 
     result = cc_backend_get_event_context(&context);
     if (result < 0) {
@@ -160,8 +182,8 @@ int main()
     }
 
 fail:
-    alice = cc_client_Smartie_free(alice);
     bob = cc_server_Smartie_free(bob);
+    alice = cc_client_Smartie_free(alice);
     cc_backend_shutdown();
 
     CC_LOG_CLOSE();
@@ -13,66 +13,221 @@
 
 #include "private.h"
 #include <capic/backend.h>
+#include <capic/memory.h>
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 #include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <capic/log.h>
 #include <capic/dbus-private.h>
 
 
-/* FIXME: allocate backend objects on explicit client request */
-static struct cc_backend backend = {0};
-static struct cc_event_context event_context = {0};
+/* Backend state is kept per thread, so that every thread can run its own bus
+ * connection and event loop (see cc_shards_start()).
+ *
+ * FIXME: allocate backend objects on explicit client request
+ */
+static __thread struct cc_backend thread_backend = {0};
+static __thread struct cc_event_context event_context = {0};
+/* Backend used in place of that of the thread, e.g. by workers serving several peers */
+static __thread struct cc_backend *switched_backend = NULL;
+
+static int backend_flush_coalesced(struct cc_backend *b, bool force);
+static void deferred_drop(struct cc_backend *b, struct cc_instance *instance);
+
+
+static struct cc_backend *backend_current()
+{
+    return switched_backend ? switched_backend : &thread_backend;
+}
+
+struct cc_backend *cc_backend_switch(struct cc_backend *backend)
+{
+    struct cc_backend *previous = switched_backend;
+
+    switched_backend = backend;
+    return previous;
+}
+
+#if defined(HAVE_SD_BUS_ERROR_ADD_MAP)
+static const sd_bus_error_map backend_errors[] = {
+    SD_BUS_ERROR_MAP(CC_DBUS_ERROR_OVERLOADED, EBUSY),
+    SD_BUS_ERROR_MAP(CC_DBUS_ERROR_DEADLINE_EXPIRED, ETIMEDOUT),
+    SD_BUS_ERROR_MAP(CC_DBUS_ERROR_CANCELLED, ECANCELED),
+    SD_BUS_ERROR_MAP_END
+};
+#endif
+
+
+static int backend_attach_event(sd_event *event)
+{
+    struct cc_backend *backend = backend_current();
+    int result;
+
+    if (event) {
+        /* Share the event loop of the caller, e.g. with other peers of a worker */
+        backend->event = sd_event_ref(event);
+        result = 0;
+    } else
+        result = sd_event_new(&backend->event);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to initialize default event loop: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_attach_event(backend->bus, backend->event, 0);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to attach bus to event loop: %s\n", strerror(-result));
+        return result;
+    }
+#if defined(HAVE_SD_BUS_ERROR_ADD_MAP)
+    /* Refused calls fail with distinct error codes rather than -EIO */
+    result = sd_bus_error_add_map(backend_errors);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add error map: %s\n", strerror(-result));
+        return result;
+    }
+#endif
 
+    return result;
+}
 
 CC_PUBLIC int cc_backend_startup()
 {
+    struct cc_backend *backend = backend_current();
     int result = 0;
     sd_id128_t id;
     const char *scope, *unique;
 
     CC_LOG_DEBUG("invoked cc_backend_startup()\n");
-    assert(!backend.bus);
+    assert(!backend->bus);
 
-    /*result = sd_bus_open_user(&backend.bus);*/
-    result = sd_bus_open_system(&backend.bus);
+    /*result = sd_bus_open_user(&backend->bus);*/
+    result = sd_bus_open_system(&backend->bus);
     if (result < 0) {
         CC_LOG_ERROR("unable to open system bus: %s\n", strerror(-result));
         goto fail;
     }
 
     CC_LOG_DEBUG("connected to bus with:\n");
-    result = sd_bus_get_scope(backend.bus, &scope);
+    result = sd_bus_get_scope(backend->bus, &scope);
     if (result < 0) {
         CC_LOG_ERROR("unable to get bus scope: %s\n", strerror(-result));
         goto fail;
     }
     CC_LOG_DEBUG("scope=%s\n", scope);
-    result = sd_bus_get_bus_id(backend.bus, &id);
+    result = sd_bus_get_bus_id(backend->bus, &id);
     if (result < 0) {
         CC_LOG_ERROR("unable to get peer ID: %s\n", strerror(-result));
         goto fail;
     }
     CC_LOG_DEBUG("peer_id=" SD_ID128_FORMAT_STR "\n", SD_ID128_FORMAT_VAL(id));
-    result = sd_bus_get_unique_name(backend.bus, &unique);
+    result = sd_bus_get_unique_name(backend->bus, &unique);
     if (result < 0) {
         CC_LOG_ERROR("unable to get unique name: %s\n", strerror(-result));
         goto fail;
     }
     CC_LOG_DEBUG("unique_name=%s\n", unique);
 
-    result = sd_event_new(&backend.event);
+    result = backend_attach_event(NULL);
+    if (result < 0)
+        goto fail;
+
+    return result;
+
+fail:
+    cc_backend_shutdown();
+    return result;
+}
+
+CC_PUBLIC int cc_backend_startup_peer(const char *address)
+{
+    struct cc_backend *backend = backend_current();
+    int result = 0;
+
+    CC_LOG_DEBUG("invoked cc_backend_startup_peer()\n");
+    assert(!backend->bus);
+    assert(address);
+    CC_LOG_DEBUG("with address='%s'\n", address);
+
+    result = sd_bus_new(&backend->bus);
     if (result < 0) {
-        CC_LOG_ERROR("unable to initialize default event loop: %s\n", strerror(-result));
+        CC_LOG_ERROR("unable to create bus: %s\n", strerror(-result));
         goto fail;
     }
-    result = sd_bus_attach_event(backend.bus, backend.event, 0);
+    result = sd_bus_set_address(backend->bus, address);
     if (result < 0) {
-        CC_LOG_ERROR("unable to attach bus to event loop: %s\n", strerror(-result));
+        CC_LOG_ERROR("unable to set peer address: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_start(backend->bus);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to connect to peer: %s\n", strerror(-result));
+        goto fail;
+    }
+    backend->peer = true;
+
+    result = backend_attach_event(NULL);
+    if (result < 0)
+        goto fail;
+
+    return result;
+
+fail:
+    cc_backend_shutdown();
+    return result;
+}
+
+int cc_backend_startup_fd(int fd, sd_event *event)
+{
+    struct cc_backend *backend = backend_current();
+    int result = 0;
+    sd_id128_t id;
+
+    CC_LOG_DEBUG("invoked cc_backend_startup_fd()\n");
+    assert(!backend->bus);
+    assert(fd >= 0);
+    assert(event);
+
+    result = sd_bus_new(&backend->bus);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create bus: %s\n", strerror(-result));
+        close(fd);
+        goto fail;
+    }
+    result = sd_bus_set_fd(backend->bus, fd, fd);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to set peer connection: %s\n", strerror(-result));
+        close(fd);
+        goto fail;
+    }
+    result = sd_id128_randomize(&id);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to generate server ID: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_set_server(backend->bus, 1, id);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to set server mode: %s\n", strerror(-result));
         goto fail;
     }
+    result = sd_bus_start(backend->bus);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to accept peer connection: %s\n", strerror(-result));
+        goto fail;
+    }
+    backend->peer = true;
+
+    result = backend_attach_event(event);
+    if (result < 0)
+        goto fail;
 
     return result;
 
@@ -83,16 +238,99 @@ fail:
 
 CC_PUBLIC void cc_backend_shutdown()
 {
+    struct cc_backend *backend = backend_current();
+
     CC_LOG_DEBUG("invoked cc_backend_shutdown()\n");
 
-    if (backend.bus) {
-        sd_bus_detach_event(backend.bus);
-        sd_bus_flush(backend.bus);
-        sd_bus_close(backend.bus);
+    if (backend->bus)
+        backend_flush_coalesced(backend, true);
+    backend->coalesce_idle = sd_event_source_unref(backend->coalesce_idle);
+    backend->coalesce_timer = sd_event_source_unref(backend->coalesce_timer);
+    backend->writable_source = sd_event_source_unref(backend->writable_source);
+    backend->write_high = 0;
+    backend->write_blocked = false;
+    backend->read_backlog = 0;
+    backend->deadline = 0;
+    backend->reentrant_max = 0;
+    deferred_drop(backend, NULL);
+    backend->deferred_source = sd_event_source_unref(backend->deferred_source);
+    backend->fair = cc_fair_free(backend->fair);
+    cc_watch_free_all(backend);
+    if (backend->lane) {
+        sd_bus_detach_event(backend->lane);
+        sd_bus_flush(backend->lane);
+        sd_bus_close(backend->lane);
+    }
+    backend->lane = sd_bus_unref(backend->lane);
+    backend->corked = 0;
+    backend->coalesce_calls = 0;
+    backend->coalesce_usec = 0;
+    if (backend->bus) {
+        sd_bus_detach_event(backend->bus);
+        sd_bus_flush(backend->bus);
+        sd_bus_close(backend->bus);
     }
     /* FIXME: use sd_bus_flush_close_unref() introduced since v222 */
-    backend.bus = sd_bus_unref(backend.bus);
-    backend.event = sd_event_unref(backend.event);
+    backend->bus = sd_bus_unref(backend->bus);
+    backend->event = sd_event_unref(backend->event);
+    backend->peer = false;
+    backend->arena = cc_arena_free(backend->arena);
+}
+
+CC_PUBLIC int cc_backend_open_priority_lane()
+{
+    struct cc_backend *backend = backend_current();
+    int result;
+
+    CC_LOG_DEBUG("invoked cc_backend_open_priority_lane()\n");
+    assert(backend->bus && backend->event);
+    if (backend->peer) {
+        CC_LOG_ERROR("unable to open priority lane to a peer\n");
+        return -ENOTSUP;
+    }
+    if (backend->lane)
+        return 0;
+
+    result = sd_bus_open_system(&backend->lane);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to open priority lane: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_attach_event(backend->lane, backend->event, SD_EVENT_PRIORITY_IMPORTANT);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to attach priority lane to event loop: %s\n", strerror(-result));
+        backend->lane = sd_bus_unref(backend->lane);
+        return result;
+    }
+
+    return 0;
+}
+
+CC_PUBLIC int cc_backend_set_reentrant_calls(unsigned int max_depth)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_reentrant_calls()\n");
+    backend->reentrant_max = max_depth;
+    return 0;
+}
+
+CC_PUBLIC int cc_backend_get_arena(struct cc_arena **arena)
+{
+    struct cc_backend *backend = backend_current();
+    int result;
+
+    CC_LOG_DEBUG("invoked cc_backend_get_arena()\n");
+    assert(arena);
+    if (!backend->arena) {
+        result = cc_arena_new(CC_ARENA_BLOCK_SIZE, &backend->arena);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to create backend arena: %s\n", strerror(-result));
+            return result;
+        }
+    }
+    *arena = backend->arena;
+    return 0;
 }
 
 CC_PUBLIC int cc_instance_new(
@@ -100,26 +338,71 @@ CC_PUBLIC int cc_instance_new(
 {
     int result = 0;
     struct cc_instance *i;
+    size_t size;
+
+    CC_LOG_DEBUG("invoked cc_instance_new()\n");
+    assert(address);
+    assert(instance);
+
+    size = CC_INSTANCE_STORAGE(strlen(address));
+    i = (struct cc_instance *) cc_malloc(size);
+    if (!i) {
+        CC_LOG_ERROR("failed to allocate instance memory\n");
+        return -ENOMEM;
+    }
+    result = cc_instance_init(i, size, address, server, instance);
+    if (result < 0)
+        cc_free(i);
+
+    return result;
+}
+
+CC_PUBLIC struct cc_instance *cc_instance_free(struct cc_instance *instance)
+{
+    CC_LOG_DEBUG("invoked cc_instance_free()\n");
+    if (instance) {
+        cc_instance_fini(instance);
+        cc_free(instance);
+    }
+    return NULL;
+}
+
+/* Storage holds the instance followed by a copy of its address */
+_Static_assert(
+    sizeof(struct cc_instance) <= CC_INSTANCE_STORAGE(0) - 1,
+    "CC_INSTANCE_STORAGE() is too small for struct cc_instance");
+
+CC_PUBLIC int cc_instance_init(
+    void *storage, size_t size, const char *address, bool server,
+    struct cc_instance **instance)
+{
+    struct cc_backend *backend = backend_current();
+    int result = 0;
+    struct cc_instance *i = (struct cc_instance *) storage;
     size_t address_size;
     char *colon = NULL;
 
-    CC_LOG_DEBUG("invoked cc_instance_new()\n");
+    CC_LOG_DEBUG("invoked cc_instance_init()\n");
+    assert(storage);
     assert(address);
     assert(instance);
     CC_LOG_DEBUG("with address='%s', server=%d\n", address, (int) server);
-    if (!backend.bus) {
+    if (!backend->bus) {
         CC_LOG_ERROR("not connected to a bus\n");
         return -ENOTCONN;
     }
-
+    if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+        CC_LOG_ERROR("misaligned instance storage\n");
+        return -EINVAL;
+    }
     address_size = strlen(address) + 1;
-    i = (struct cc_instance *) calloc(1, sizeof(*i) + address_size);
-    if (!i) {
-        CC_LOG_ERROR("failed to allocate instance memory\n");
-        return -ENOMEM;
+    if (size < CC_INSTANCE_STORAGE(address_size - 1)) {
+        CC_LOG_ERROR("insufficient instance storage\n");
+        return -ENOBUFS;
     }
 
-    i->backend = &backend;
+    memset(i, 0, sizeof(*i));
+    i->backend = backend;
     strncpy(i->address, address, address_size);
     /* Expect address to be a colon-separated tuple "service:path:interface" */
     i->service = i->address;
@@ -140,8 +423,9 @@ CC_PUBLIC int cc_instance_new(
     *colon++ = '\0';
     i->interface = colon;
 
-    if (server) {
-        result = sd_bus_request_name(backend.bus, i->service, 0);
+    /* Peer-to-peer connections have no bus to register service names with */
+    if (server && !backend->peer) {
+        result = sd_bus_request_name(backend->bus, i->service, 0);
         if (result < 0) {
             if (result == -EALREADY)
                 CC_LOG_DEBUG("service name already owned\n");
@@ -156,29 +440,1158 @@ CC_PUBLIC int cc_instance_new(
     return 0;
 
 fail:
-    i = cc_instance_free(i);
+    cc_instance_fini(i);
     return result;
 }
 
-CC_PUBLIC struct cc_instance *cc_instance_free(struct cc_instance *instance)
+CC_PUBLIC void cc_instance_fini(struct cc_instance *instance)
 {
-    CC_LOG_DEBUG("invoked cc_instance_free()\n");
-    if (instance) {
-        /* FIXME: deal with registered service names */
-        /* FIXME: fix asserts to correctly handle partially initialized instances */
-        /* assert(instance->backend && instance->backend->bus); */
-        /* assert(sd_event_get_state(instance->backend->event) == SD_EVENT_FINISHED); */
-        free(instance);
+    CC_LOG_DEBUG("invoked cc_instance_fini()\n");
+    assert(instance);
+    /* FIXME: deal with registered service names */
+    /* FIXME: fix asserts to correctly handle partially initialized instances */
+    /* assert(instance->backend && instance->backend->bus); */
+    /* assert(sd_event_get_state(instance->backend->event) == SD_EVENT_FINISHED); */
+    if (instance->backend)
+        deferred_drop(instance->backend, instance);
+    instance->backend = NULL;
+}
+
+static int instance_lane_service(struct cc_instance *instance, char *service, size_t size)
+{
+    if ((size_t) snprintf(service, size, "%s" CC_DBUS_LANE_SUFFIX, instance->service) >= size) {
+        CC_LOG_ERROR("service name too long for priority lane\n");
+        return -ENAMETOOLONG;
     }
-    return NULL;
+    return 0;
 }
 
-CC_PUBLIC int cc_backend_get_event_context(struct cc_event_context **context)
+struct reentrant_call {
+    bool done;
+    sd_bus_message *reply;
+};
+
+static int reentrant_reply_handler(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct reentrant_call *call = (struct reentrant_call *) userdata;
+    (void) ret_error;
+
+    assert(m);
+    assert(call && !call->done);
+    call->done = true;
+    call->reply = sd_bus_message_ref(m);
+    return 1;
+}
+
+/* Runs the thunk of the oldest deferred call, returns 0 if there was none */
+static int backend_run_deferred(struct cc_backend *b)
+{
+    int result;
+    struct cc_deferred call;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+
+    if (b->deferred_count == 0)
+        return 0;
+    /* Taken out of the ring first, as the thunk may defer further calls */
+    call = b->deferred[b->deferred_head];
+    b->deferred_head = (b->deferred_head + 1) % CC_DEFERRED_CALLS;
+    if (--b->deferred_count == 0)
+        sd_event_source_set_enabled(b->deferred_source, SD_EVENT_OFF);
+
+#if CC_SD_API_VERSION >= 220
+    result = call.thunk(call.message, call.userdata, &error);
+#else
+    result = call.thunk(sd_bus_message_get_bus(call.message), call.message, call.userdata, &error);
+#endif
+    /* Failed calls are replied to as sd-bus does for the thunks it invokes */
+    if (result < 0)
+        sd_bus_reply_method_errno(call.message, result, &error);
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(call.message);
+
+    return 1;
+}
+
+static int deferred_handler(sd_event_source *source, void *userdata)
+{
+    struct cc_backend *b = (struct cc_backend *) userdata;
+
+    CC_LOG_DEBUG("invoked deferred_handler()\n");
+    assert(source);
+    /* One call per iteration, so that other sources are not starved */
+    backend_run_deferred(b);
+    return 0;
+}
+
+/* Drops the deferred calls of the instance, or all of them for NULL */
+static void deferred_drop(struct cc_backend *b, struct cc_instance *instance)
+{
+    unsigned int n, kept = 0;
+    struct cc_deferred *call;
+
+    /* The calls kept are moved up in the ring, so that it stays in order */
+    for (n = 0; n < b->deferred_count; ++n) {
+        call = &b->deferred[(b->deferred_head + n) % CC_DEFERRED_CALLS];
+        if (instance && call->instance != instance) {
+            b->deferred[(b->deferred_head + kept++) % CC_DEFERRED_CALLS] = *call;
+            continue;
+        }
+        sd_bus_message_unref(call->message);
+    }
+    b->deferred_count = kept;
+    if (kept == 0 && b->deferred_source)
+        sd_event_source_set_enabled(b->deferred_source, SD_EVENT_OFF);
+}
+
+CC_PUBLIC int cc_instance_defer_call(
+    struct cc_instance *instance, sd_bus_message *m, sd_bus_message_handler_t thunk,
+    void *userdata)
+{
+    int result;
+    struct cc_backend *b;
+    struct cc_deferred *call;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+
+    assert(instance && instance->backend);
+    assert(m);
+    assert(thunk);
+    b = instance->backend;
+    /* Deferred calls are invoked while no message is being dispatched */
+    if (b->reentrant_max == 0 || sd_bus_get_current_message(sd_bus_message_get_bus(m)) != m)
+        return 0;
+
+    if (!b->deferred_source) {
+        result = sd_event_add_defer(b->event, &b->deferred_source, &deferred_handler, b);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to add deferred call source: %s\n", strerror(-result));
+            return result;
+        }
+    }
+    if (b->deferred_count == CC_DEFERRED_CALLS) {
+        /* Served in order or not at all, so the call cannot be served now either */
+        CC_LOG_DEBUG("refusing call with %u calls deferred already\n", b->deferred_count);
+        sd_bus_error_set(&error, CC_DBUS_ERROR_OVERLOADED, "too many calls deferred");
+        result = sd_bus_reply_method_error(m, &error);
+        sd_bus_error_free(&error);
+        if (result < 0)
+            CC_LOG_ERROR("unable to send method error: %s\n", strerror(-result));
+        return 1;
+    }
+    /* Calls arriving meanwhile are deferred as well, so that none overtakes another */
+    call = &b->deferred[(b->deferred_head + b->deferred_count++) % CC_DEFERRED_CALLS];
+    call->instance = instance;
+    call->message = sd_bus_message_ref(m);
+    call->thunk = thunk;
+    call->userdata = userdata;
+    sd_event_source_set_enabled(b->deferred_source, SD_EVENT_ON);
+
+    return 1;
+}
+
+static bool backend_dispatching(struct cc_backend *b)
+{
+    return sd_bus_get_current_message(b->bus) || (b->lane && sd_bus_get_current_message(b->lane));
+}
+
+/* Dispatches a message of either connection or a deferred call as the event
+ * loop would, or waits for the connections if there is nothing to do.  Other
+ * event sources, such as timers, are not dispatched. */
+static int backend_pump(struct cc_backend *b)
+{
+    int result;
+    sd_bus *buses[2] = {b->lane, b->bus};
+    struct pollfd fds[2];
+    unsigned int n, count = 0;
+    uint64_t until, earliest = UINT64_MAX, now;
+    int timeout = -1;
+
+    for (n = 0; n < 2; ++n) {
+        if (!buses[n])
+            continue;
+        result = sd_bus_process(buses[n], NULL);
+        if (result != 0)
+            return result;
+    }
+    result = backend_run_deferred(b);
+    if (result != 0)
+        return result;
+
+    for (n = 0; n < 2; ++n) {
+        if (!buses[n])
+            continue;
+        fds[count].fd = sd_bus_get_fd(buses[n]);
+        if (fds[count].fd < 0)
+            return fds[count].fd;
+        result = sd_bus_get_events(buses[n]);
+        if (result < 0)
+            return result;
+        fds[count].events = (short) result;
+        fds[count].revents = 0;
+        ++count;
+        if (sd_bus_get_timeout(buses[n], &until) > 0 && until < earliest)
+            earliest = until;
+    }
+    if (earliest != UINT64_MAX) {
+        now = cc_deadline_after(0);
+        timeout = earliest <= now ? 0 : (int) ((earliest - now + 999) / 1000);
+    }
+    if (poll(fds, count, timeout) < 0 && errno != EINTR)
+        return -errno;
+
+    return 0;
+}
+
+/* Waits for the reply by running the event loop, or from within one of its
+ * callbacks, where sd-event refuses to do so, by pumping the connections.
+ * sd-bus does not dispatch messages from within its own callbacks, so calls
+ * made from reply callbacks and broadcast handlers block, while method calls
+ * are deferred until sd-bus has returned. */
+static int backend_call(
+    struct cc_backend *b, sd_bus *bus, sd_bus_message *message, uint64_t usec,
+    sd_bus_error *error, sd_bus_message **reply)
+{
+    int result;
+    sd_bus_slot *slot = NULL;
+    struct reentrant_call call = {false, NULL};
+
+    if (b->reentrant_depth >= b->reentrant_max || backend_dispatching(b))
+        return sd_bus_call(bus, message, usec, error, reply);
+
+    result = sd_bus_call_async(bus, &slot, message, &reentrant_reply_handler, &call, usec);
+    if (result < 0)
+        return result;
+    ++b->reentrant_depth;
+    while (!call.done) {
+        if (sd_event_get_state(b->event) == SD_EVENT_INITIAL)
+            result = sd_event_run(b->event, (uint64_t) -1);
+        else
+            result = backend_pump(b);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to wait for reply: %s\n", strerror(-result));
+            break;
+        }
+    }
+    --b->reentrant_depth;
+    sd_bus_slot_unref(slot);
+    if (!call.done)
+        return result;
+
+    if (sd_bus_message_is_method_error(call.reply, NULL))
+        result = sd_bus_error_copy(error, sd_bus_message_get_error(call.reply));
+    else if (reply) {
+        *reply = call.reply;
+        return 1;
+    } else
+        result = 1;
+    sd_bus_message_unref(call.reply);
+
+    return result;
+}
+
+CC_PUBLIC int cc_instance_new_method_call(
+    struct cc_instance *instance, bool lane, const char *member, sd_bus_message **message)
+{
+    int result;
+    struct cc_backend *b;
+    char service[CC_INSTANCE_ADDRESS_MAX + sizeof(CC_DBUS_LANE_SUFFIX)];
+
+    assert(instance && instance->backend && instance->backend->bus);
+    assert(member);
+    assert(message);
+    b = instance->backend;
+
+    if (lane && b->lane && instance_lane_service(instance, service, sizeof(service)) == 0)
+        result = sd_bus_message_new_method_call(
+            b->lane, message, service, instance->path, instance->interface, member);
+    else
+        result = sd_bus_message_new_method_call(
+            b->bus, message, instance->service, instance->path, instance->interface, member);
+    if (result < 0)
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+
+    return result;
+}
+
+CC_PUBLIC int cc_instance_call(
+    struct cc_instance *instance, sd_bus_message *message, uint64_t usec,
+    sd_bus_error *error, sd_bus_message **reply, bool *unlaned)
+{
+    int result;
+    struct cc_backend *b;
+    sd_bus_message *copy = NULL;
+
+    assert(instance && instance->backend && instance->backend->bus);
+    assert(message);
+    b = instance->backend;
+
+    result = backend_call(b, sd_bus_message_get_bus(message), message, usec, error, reply);
+    if (sd_bus_message_get_bus(message) == b->bus ||
+        !sd_bus_error_has_name(error, SD_BUS_ERROR_SERVICE_UNKNOWN))
+        return result;
+
+    /* Servers without a priority lane are called on the bus from now on */
+    CC_LOG_DEBUG("service has no priority lane\n");
+    assert(unlaned);
+    *unlaned = true;
+    sd_bus_error_free(error);
+    result = sd_bus_message_new_method_call(
+        b->bus, &copy, instance->service, instance->path, instance->interface,
+        sd_bus_message_get_member(message));
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_message_rewind(message, true);
+    if (result >= 0)
+        result = sd_bus_message_copy(copy, message, true);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to copy message arguments: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = backend_call(b, b->bus, copy, usec, error, reply);
+
+finish:
+    sd_bus_message_unref(copy);
+    return result;
+}
+
+CC_PUBLIC int cc_instance_serve_lane(
+    struct cc_instance *instance, const sd_bus_vtable *vtable, void *userdata,
+    sd_bus_slot **slot)
 {
+    int result;
+    struct cc_backend *b;
+    char service[CC_INSTANCE_ADDRESS_MAX + sizeof(CC_DBUS_LANE_SUFFIX)];
+
+    assert(instance && instance->backend);
+    assert(vtable);
+    assert(slot);
+    b = instance->backend;
+    if (!b->lane)
+        return 0;
+
+    result = instance_lane_service(instance, service, sizeof(service));
+    if (result < 0)
+        return result;
+    result = sd_bus_request_name(b->lane, service, 0);
+    if (result < 0 && result != -EALREADY) {
+        CC_LOG_ERROR("unable to request priority lane name: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_add_object_vtable(
+        b->lane, slot, instance->path, instance->interface, vtable, userdata);
+    if (result < 0)
+        CC_LOG_ERROR("unable to add priority lane vtable: %s\n", strerror(-result));
+
+    return result;
+}
+
+/* Tells the server on the connection the call was made on, so that the
+ * notice comes from the same sender */
+static int call_send_cancel_notice(struct cc_call *call, sd_bus *bus)
+{
+    int result;
+    struct cc_instance *instance = call->instance;
+    sd_bus_message *notice = NULL;
+    const char *destination = instance->service;
+    char service[CC_INSTANCE_ADDRESS_MAX + sizeof(CC_DBUS_LANE_SUFFIX)];
+
+    if (bus == instance->backend->lane) {
+        result = instance_lane_service(instance, service, sizeof(service));
+        if (result < 0)
+            return result;
+        destination = service;
+    }
+    result = sd_bus_message_new_method_call(
+        bus, &notice, destination, instance->path, instance->interface, CC_DBUS_CANCEL_MEMBER);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_message_set_expect_reply(notice, 0);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to flag message no-reply-expected: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = sd_bus_message_append(notice, "t", call->cookie);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to append cancelled call: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = sd_bus_send(bus, notice, NULL);
+    if (result < 0)
+        CC_LOG_ERROR("unable to send cancel notice: %s\n", strerror(-result));
+
+finish:
+    sd_bus_message_unref(notice);
+    return result;
+}
+
+CC_PUBLIC int cc_call_cancel(struct cc_call *call)
+{
+    sd_bus *bus;
+
+    CC_LOG_DEBUG("invoked cc_call_cancel()\n");
+    assert(call && call->instance);
+
+    if (!call->slot && !call->held)
+        return 0;
+    /* Held calls never reached the server */
+    call->held = sd_bus_message_unref(call->held);
+    if (!call->slot)
+        return 1;
+    bus = sd_bus_slot_get_bus(call->slot);
+    /* The reply is discarded by sd-bus once the slot is gone */
+    call->slot = sd_bus_slot_unref(call->slot);
+    /* The call is cancelled even if the server cannot be told */
+    if (call->cookie != 0)
+        call_send_cancel_notice(call, bus);
+    call->cookie = 0;
+
+    return 1;
+}
+
+/* Match rule values are quoted, a quote inside one is written as '\'' */
+static size_t match_size(const char *key, const char *value)
+{
+    return strlen(",='") + strlen(key) + 4 * strlen(value) + strlen("'");
+}
+
+static char *match_append(char *rule, const char *key, const char *value)
+{
+    rule += sprintf(rule, ",%s='", key);
+    for (; *value; ++value) {
+        if (*value == '\'')
+            rule = stpcpy(rule, "'\\''");
+        else
+            *rule++ = *value;
+    }
+    return stpcpy(rule, "'");
+}
+
+static int instance_add_match(
+    struct cc_instance *instance, const char *interface, const char *member,
+    const char *arg0, sd_bus_message_handler_t callback, void *userdata, sd_bus_slot **slot)
+{
+    int result;
+    bool sender;
+    size_t size;
+    char *rule, *end;
+
+    assert(instance);
+    assert(instance->backend && instance->backend->bus);
+    assert(instance->service && instance->path);
+    assert(interface);
+    assert(member);
+    assert(callback);
+    /* Signals from a peer carry no sender that the rule could match */
+    sender = !instance->backend->peer;
+
+    size = strlen("type='signal'") + match_size("path", instance->path) +
+           match_size("interface", interface) + match_size("member", member) + 1;
+    if (sender)
+        size += match_size("sender", instance->service);
+    if (arg0)
+        size += match_size("arg0", arg0);
+    rule = (char *) cc_malloc(size);
+    if (!rule) {
+        CC_LOG_ERROR("failed to allocate match rule\n");
+        return -ENOMEM;
+    }
+    end = stpcpy(rule, "type='signal'");
+    if (sender)
+        end = match_append(end, "sender", instance->service);
+    end = match_append(end, "path", instance->path);
+    end = match_append(end, "interface", interface);
+    end = match_append(end, "member", member);
+    if (arg0)
+        end = match_append(end, "arg0", arg0);
+    assert((size_t) (end - rule) < size);
+    CC_LOG_DEBUG("with rule=\"%s\"\n", rule);
+
+    /* The bus daemon applies the rule too, so signals nobody subscribed to
+     * are not even delivered */
+    result = sd_bus_add_match(instance->backend->bus, slot, rule, callback, userdata);
+    if (result < 0)
+        CC_LOG_ERROR("unable to add match rule: %s\n", strerror(-result));
+    cc_free(rule);
+
+    return result;
+}
+
+CC_PUBLIC int cc_instance_add_signal_match(
+    struct cc_instance *instance, const char *member, const char *arg0,
+    sd_bus_message_handler_t callback, void *userdata, sd_bus_slot **slot)
+{
+    CC_LOG_DEBUG("invoked cc_instance_add_signal_match()\n");
+    assert(instance && instance->interface);
+    return instance_add_match(
+        instance, instance->interface, member, arg0, callback, userdata, slot);
+}
+
+CC_PUBLIC int cc_instance_add_properties_match(
+    struct cc_instance *instance, sd_bus_message_handler_t callback, void *userdata,
+    sd_bus_slot **slot)
+{
+    CC_LOG_DEBUG("invoked cc_instance_add_properties_match()\n");
+    assert(instance && instance->interface);
+    /* The first argument names the interface whose properties changed */
+    return instance_add_match(
+        instance, "org.freedesktop.DBus.Properties", "PropertiesChanged", instance->interface,
+        callback, userdata, slot);
+}
+
+CC_PUBLIC int cc_throttle_check(
+    struct cc_throttle *throttle, struct cc_instance *instance,
+    sd_event_time_handler_t callback, void *userdata)
+{
+    int result, enabled = SD_EVENT_OFF;
+    uint64_t now, end;
+
+    assert(throttle);
+    assert(instance && instance->backend && instance->backend->event);
+    assert(callback);
+    if (throttle->window == 0)
+        return 1;
+    if (throttle->timer) {
+        result = sd_event_source_get_enabled(throttle->timer, &enabled);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to get throttle timer state: %s\n", strerror(-result));
+            return result;
+        }
+        /* Changes are already held back until the window ends */
+        if (enabled != SD_EVENT_OFF)
+            return 0;
+    }
+    result = sd_event_now(instance->backend->event, CLOCK_MONOTONIC, &now);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to get event loop time: %s\n", strerror(-result));
+        return result;
+    }
+    end = throttle->last + throttle->window;
+    if (now >= end)
+        return 1;
+
+    if (throttle->timer) {
+        result = sd_event_source_set_time(throttle->timer, end);
+        if (result >= 0)
+            result = sd_event_source_set_enabled(throttle->timer, SD_EVENT_ONESHOT);
+    } else {
+        /* The default accuracy of 250ms would stretch short windows */
+        result = sd_event_add_time(
+            instance->backend->event, &throttle->timer, CLOCK_MONOTONIC, end, 1, callback,
+            userdata);
+    }
+    if (result < 0) {
+        CC_LOG_ERROR("unable to arm throttle timer: %s\n", strerror(-result));
+        return result;
+    }
+
+    return 0;
+}
+
+CC_PUBLIC void cc_throttle_emitted(struct cc_throttle *throttle, struct cc_instance *instance)
+{
+    int result;
+
+    assert(throttle);
+    assert(instance && instance->backend && instance->backend->event);
+    if (throttle->window == 0)
+        return;
+    result = sd_event_now(instance->backend->event, CLOCK_MONOTONIC, &throttle->last);
+    if (result < 0)
+        CC_LOG_ERROR("unable to get event loop time: %s\n", strerror(-result));
+}
+
+CC_PUBLIC void cc_throttle_fini(struct cc_throttle *throttle)
+{
+    assert(throttle);
+    throttle->timer = sd_event_source_unref(throttle->timer);
+}
+
+/* Messages of the priority lane take the same memory as those of the bus */
+static int backend_get_queued_write(struct cc_backend *b, uint64_t *queued)
+{
+    int result;
+    uint64_t lane = 0;
+
+    result = sd_bus_get_n_queued_write(b->bus, queued);
+    if (result >= 0 && b->lane)
+        result = sd_bus_get_n_queued_write(b->lane, &lane);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to get write queue size: %s\n", strerror(-result));
+        return result;
+    }
+    *queued += lane;
+
+    return 0;
+}
+
+/* Invoked after every iteration of the event loop while calls are refused */
+static int backend_writable_handler(sd_event_source *source, void *userdata)
+{
+    struct cc_backend *b = (struct cc_backend *) userdata;
+    uint64_t queued;
+
+    assert(source);
+    assert(b && b->bus);
+    if (backend_get_queued_write(b, &queued) < 0)
+        return 0;
+    if (queued > b->write_low)
+        return 0;
+
+    CC_LOG_DEBUG("write queue drained to %" PRIu64 " messages\n", queued);
+    b->write_blocked = false;
+    sd_event_source_set_enabled(source, SD_EVENT_OFF);
+    /* Batches held back while the queue was full go before any new call */
+    if (b->coalesced && b->corked == 0)
+        backend_flush_coalesced(b, false);
+    if (b->writable && !b->write_blocked)
+        b->writable(b->writable_data);
+
+    return 0;
+}
+
+CC_PUBLIC int cc_backend_set_write_watermarks(
+    uint64_t high, uint64_t low, cc_backend_writable_t writable, void *data)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_write_watermarks()\n");
+    CC_LOG_DEBUG("with high=%" PRIu64 ", low=%" PRIu64 "\n", high, low);
+    if (high > 0 && low >= high) {
+        CC_LOG_ERROR("low watermark must be below the high one\n");
+        return -EINVAL;
+    }
+
+    backend->write_high = high;
+    backend->write_low = low;
+    backend->writable = writable;
+    backend->writable_data = data;
+    if (high == 0 && backend->write_blocked) {
+        backend->write_blocked = false;
+        sd_event_source_set_enabled(backend->writable_source, SD_EVENT_OFF);
+    }
+
+    return 0;
+}
+
+static int backend_check_write(struct cc_backend *b)
+{
+    int result;
+    uint64_t queued;
+
+    if (b->write_high == 0)
+        return 0;
+
+    result = backend_get_queued_write(b, &queued);
+    if (result < 0)
+        return result;
+    if (b->write_blocked) {
+        if (queued > b->write_low)
+            return -EAGAIN;
+        /* Drained without running the event loop, e.g. by a synchronous call */
+        b->write_blocked = false;
+        sd_event_source_set_enabled(b->writable_source, SD_EVENT_OFF);
+        return 0;
+    }
+    if (queued < b->write_high)
+        return 0;
+
+    CC_LOG_DEBUG("write queue reached %" PRIu64 " messages\n", queued);
+    if (b->writable_source)
+        result = sd_event_source_set_enabled(b->writable_source, SD_EVENT_ON);
+    else
+        result = sd_event_add_post(b->event, &b->writable_source, &backend_writable_handler, b);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to watch write queue: %s\n", strerror(-result));
+        return result;
+    }
+    b->write_blocked = true;
+
+    return -EAGAIN;
+}
+
+CC_PUBLIC int cc_instance_check_write(struct cc_instance *instance)
+{
+    assert(instance && instance->backend && instance->backend->bus);
+    return backend_check_write(instance->backend);
+}
+
+CC_PUBLIC int cc_backend_set_read_backlog(uint64_t max_bytes)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_read_backlog()\n");
+    CC_LOG_DEBUG("with max_bytes=%" PRIu64 "\n", max_bytes);
+    if (max_bytes > INT32_MAX) {
+        CC_LOG_ERROR("read backlog limit exceeds the socket buffer\n");
+        return -EINVAL;
+    }
+
+    backend->read_backlog = max_bytes;
+
+    return 0;
+}
+
+CC_PUBLIC int cc_backend_set_fair_queuing(unsigned int max_queued)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_fair_queuing()\n");
+    CC_LOG_DEBUG("with max_queued=%u\n", max_queued);
+    assert(backend->bus && backend->event);
+#if !defined(HAVE_SD_BUS_ENQUEUE_FOR_READ)
+    if (max_queued > 0) {
+        CC_LOG_ERROR("fair queuing requires sd_bus_enqueue_for_read() of libsystemd v245\n");
+        return -ENOTSUP;
+    }
+#endif
+
+    /* Calls queued so far go back to sd-bus, weights are forgotten */
+    backend->fair = cc_fair_free(backend->fair);
+    if (max_queued == 0)
+        return 0;
+
+    return cc_fair_new(backend->bus, backend->event, max_queued, &backend->fair);
+}
+
+CC_PUBLIC int cc_backend_set_sender_weight(const char *sender, unsigned int weight)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_sender_weight()\n");
+    assert(sender);
+    CC_LOG_DEBUG("with sender='%s', weight=%u\n", sender, weight);
+    if (!backend->fair) {
+        CC_LOG_ERROR("unable to set weight without fair queuing\n");
+        return -EINVAL;
+    }
+    if (weight == 0) {
+        CC_LOG_ERROR("sender weight must be positive\n");
+        return -EINVAL;
+    }
+
+    return cc_fair_set_weight(backend->fair, sender, weight);
+}
+
+CC_PUBLIC uint64_t cc_deadline_after(uint64_t usec)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000ULL + now.tv_nsec / 1000 + usec;
+}
+
+/* Peer connections have no sender names */
+static const char *cancel_sender(sd_bus_message *m)
+{
+    const char *sender = sd_bus_message_get_sender(m);
+
+    return sender ? sender : "";
+}
+
+CC_PUBLIC int cc_cancel_notice(struct cc_instance *instance, sd_bus_message *notice)
+{
+    int result;
+    struct cc_backend *b;
+    struct cc_cancel_notice *cancelled;
+    const char *sender;
+    uint64_t cookie;
+
+    CC_LOG_DEBUG("invoked cc_cancel_notice()\n");
+    assert(instance && instance->backend);
+    assert(notice);
+    b = instance->backend;
+
+    result = sd_bus_message_read(notice, "t", &cookie);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to read cancelled call: %s\n", strerror(-result));
+        return result;
+    }
+    sender = cancel_sender(notice);
+    if (cookie == 0 || strlen(sender) >= CC_CANCEL_SENDER_MAX) {
+        CC_LOG_DEBUG("ignoring cancel notice of sender '%s'\n", sender);
+        return 1;
+    }
+    cancelled = &b->cancelled[b->cancelled_next];
+    b->cancelled_next = (b->cancelled_next + 1) % CC_CANCEL_NOTICES;
+    cancelled->cookie = cookie;
+    strcpy(cancelled->sender, sender);
+
+    return 1;
+}
+
+/* Notices read before the call is served, e.g. while it waits with fair queuing */
+static bool cancel_take(struct cc_backend *b, sd_bus_message *call)
+{
+    unsigned int n;
+    uint64_t cookie;
+
+    if (sd_bus_message_get_cookie(call, &cookie) < 0)
+        return false;
+    for (n = 0; n < CC_CANCEL_NOTICES; ++n) {
+        if (b->cancelled[n].cookie == cookie && strcmp(b->cancelled[n].sender, cancel_sender(call)) == 0) {
+            b->cancelled[n].cookie = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+CC_PUBLIC int cc_admission_enter(
+    struct cc_admission *interface, struct cc_admission *method, struct cc_instance *instance,
+    sd_bus_message *call, uint64_t deadline, sd_bus_error *error)
+{
+    struct cc_backend *b;
+    int pending;
+
+    assert(interface && method);
+    assert(instance && instance->backend && instance->backend->bus);
+    assert(call);
+    b = instance->backend;
+
+    /* The caller has given up on the reply, so running the call is wasted */
+    if (deadline > 0 && cc_deadline_after(0) >= deadline) {
+        CC_LOG_DEBUG("refusing call past its deadline\n");
+        sd_bus_error_set(error, CC_DBUS_ERROR_DEADLINE_EXPIRED, "deadline expired before the call was processed");
+        sd_bus_reply_method_error(call, error);
+        return -ETIMEDOUT;
+    }
+    if (cancel_take(b, call)) {
+        CC_LOG_DEBUG("refusing call cancelled by its client\n");
+        sd_bus_error_set(error, CC_DBUS_ERROR_CANCELLED, "call cancelled before it was processed");
+        sd_bus_reply_method_error(call, error);
+        return -ECANCELED;
+    }
+    if ((interface->limit > 0 && interface->active >= interface->limit) ||
+        (method->limit > 0 && method->active >= method->limit)) {
+        CC_LOG_DEBUG("refusing call above the limit of calls in progress\n");
+        sd_bus_error_set(error, CC_DBUS_ERROR_OVERLOADED, "too many calls in progress");
+        sd_bus_reply_method_error(call, error);
+        return -EBUSY;
+    }
+    if (b->read_backlog > 0) {
+        /* Queued calls are not parsed yet, so the backlog is measured in bytes */
+        if (ioctl(sd_bus_get_fd(b->bus), FIONREAD, &pending) < 0) {
+            CC_LOG_ERROR("unable to get read backlog: %s\n", strerror(errno));
+        } else if ((uint64_t) pending > b->read_backlog) {
+            CC_LOG_DEBUG("refusing call with %d bytes waiting to be read\n", pending);
+            sd_bus_error_set(error, CC_DBUS_ERROR_OVERLOADED, "too many calls waiting");
+            sd_bus_reply_method_error(call, error);
+            return -EBUSY;
+        }
+    }
+    ++interface->active;
+    ++method->active;
+
+    return 0;
+}
+
+CC_PUBLIC void cc_admission_leave(struct cc_admission *interface, struct cc_admission *method)
+{
+    assert(interface && interface->active > 0);
+    assert(method && method->active > 0);
+    --interface->active;
+    --method->active;
+}
+
+CC_PUBLIC uint64_t cc_deadline_swap(struct cc_instance *instance, uint64_t deadline)
+{
+    uint64_t previous;
+
+    assert(instance && instance->backend);
+    previous = instance->backend->deadline;
+    instance->backend->deadline = deadline;
+    return previous;
+}
+
+CC_PUBLIC int cc_instance_get_timeout(
+    struct cc_instance *instance, uint64_t usec, uint64_t fallback, uint64_t *timeout)
+{
+    uint64_t deadline, now;
+
+    assert(instance && instance->backend);
+    assert(timeout);
+    *timeout = usec ? usec : instance->timeout ? instance->timeout : fallback;
+    deadline = instance->backend->deadline;
+    if (deadline == 0)
+        return 0;
+
+    /* The caller being served stops waiting before a later reply arrives */
+    now = cc_deadline_after(0);
+    if (now >= deadline) {
+        CC_LOG_DEBUG("refusing call past the deadline of the call being served\n");
+        return -ETIMEDOUT;
+    }
+    if (*timeout > deadline - now)
+        *timeout = deadline - now;
+
+    return 0;
+}
+
+static bool coalesce_full(struct cc_backend *b, struct cc_coalesce *coalesce)
+{
+    return coalesce->count >= (b->coalesce_calls > 0 ? b->coalesce_calls : CC_COALESCE_CALLS_MAX);
+}
+
+/* Unless forced, the batch stays pending with -EAGAIN while the write queue
+ * is above the high watermark */
+static int coalesce_send(struct cc_backend *b, struct cc_coalesce *coalesce, bool force)
+{
+    int result;
+    struct cc_coalesce **next;
+    sd_bus_message *message = coalesce->message;
+
+    if (!force) {
+        result = backend_check_write(b);
+        if (result < 0)
+            return result;
+    }
+    for (next = &b->coalesced; *next; next = &(*next)->next)
+        if (*next == coalesce) {
+            *next = coalesce->next;
+            break;
+        }
+    coalesce->next = NULL;
+    coalesce->message = NULL;
+
+    result = sd_bus_message_close_container(message);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to close batch: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = sd_bus_send(b->bus, message, NULL);
+    if (result < 0)
+        CC_LOG_ERROR("unable to send batch of %u calls: %s\n", coalesce->count, strerror(-result));
+
+finish:
+    sd_bus_message_unref(message);
+    return result;
+}
+
+static int backend_flush_coalesced(struct cc_backend *b, bool force)
+{
+    int result = 0, r;
+
+    while (b->coalesced) {
+        r = coalesce_send(b, b->coalesced, force);
+        if (r < 0 && result == 0)
+            result = r;
+        /* The rest is sent once the write queue drains */
+        if (r == -EAGAIN)
+            break;
+    }
+    if (b->coalesce_idle)
+        sd_event_source_set_enabled(b->coalesce_idle, SD_EVENT_OFF);
+    if (b->coalesce_timer)
+        sd_event_source_set_enabled(b->coalesce_timer, SD_EVENT_OFF);
+
+    return result;
+}
+
+static int coalesce_idle_handler(sd_event_source *source, void *userdata)
+{
+    struct cc_backend *b = (struct cc_backend *) userdata;
+
+    CC_LOG_DEBUG("invoked coalesce_idle_handler()\n");
+    assert(source);
+    /* Errors are logged already, returning one would disable the source for good */
+    if (b->corked == 0)
+        backend_flush_coalesced(b, false);
+    return 0;
+}
+
+static int coalesce_timer_handler(sd_event_source *source, uint64_t usec, void *userdata)
+{
+    struct cc_backend *b = (struct cc_backend *) userdata;
+
+    CC_LOG_DEBUG("invoked coalesce_timer_handler()\n");
+    assert(source);
+    (void) usec;
+    if (b->corked == 0)
+        backend_flush_coalesced(b, false);
+    return 0;
+}
+
+/* Batches started while coalescing are sent once nothing else is pending in
+ * the event loop, or at the latest after the configured delay */
+static int backend_arm_coalescing(struct cc_backend *b)
+{
+    int result;
+    uint64_t now;
+
+    if (b->coalesce_idle) {
+        result = sd_event_source_set_enabled(b->coalesce_idle, SD_EVENT_ONESHOT);
+    } else {
+        result = sd_event_add_defer(b->event, &b->coalesce_idle, &coalesce_idle_handler, b);
+        if (result >= 0)
+            result = sd_event_source_set_priority(b->coalesce_idle, SD_EVENT_PRIORITY_IDLE);
+    }
+    if (result < 0) {
+        CC_LOG_ERROR("unable to arm coalescing on idle: %s\n", strerror(-result));
+        return result;
+    }
+    if (b->coalesce_usec == 0)
+        return 0;
+
+    result = sd_event_now(b->event, CLOCK_MONOTONIC, &now);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to get event loop time: %s\n", strerror(-result));
+        return result;
+    }
+    if (b->coalesce_timer) {
+        result = sd_event_source_set_time(b->coalesce_timer, now + b->coalesce_usec);
+        if (result >= 0)
+            result = sd_event_source_set_enabled(b->coalesce_timer, SD_EVENT_ONESHOT);
+    } else {
+        result = sd_event_add_time(
+            b->event, &b->coalesce_timer, CLOCK_MONOTONIC, now + b->coalesce_usec, 1,
+            &coalesce_timer_handler, b);
+    }
+    if (result < 0)
+        CC_LOG_ERROR("unable to arm coalescing timer: %s\n", strerror(-result));
+
+    return result;
+}
+
+CC_PUBLIC void cc_backend_cork()
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_cork()\n");
+    ++backend->corked;
+}
+
+CC_PUBLIC int cc_backend_uncork()
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_uncork()\n");
+    assert(backend->corked > 0);
+
+    if (--backend->corked > 0)
+        return 0;
+    /* Coalescing does not flush batches started while corked on its own */
+    return backend_flush_coalesced(backend, false);
+}
+
+CC_PUBLIC int cc_backend_set_coalescing(unsigned int max_calls, uint64_t max_delay_usec)
+{
+    struct cc_backend *backend = backend_current();
+
+    CC_LOG_DEBUG("invoked cc_backend_set_coalescing()\n");
+    CC_LOG_DEBUG("with max_calls=%u, max_delay_usec=%" PRIu64 "\n", max_calls, max_delay_usec);
+
+    backend->coalesce_calls = max_calls;
+    backend->coalesce_usec = max_calls > 0 ? max_delay_usec : 0;
+    if (backend->corked > 0 || max_calls > 0)
+        return 0;
+
+    return backend_flush_coalesced(backend, false);
+}
+
+CC_PUBLIC int cc_coalesce_begin(
+    struct cc_coalesce *coalesce, struct cc_instance *instance, const char *member,
+    const char *signature, sd_bus_message **message)
+{
+    int result;
+    struct cc_backend *b;
+
+    assert(coalesce);
+    assert(instance && instance->backend && instance->backend->bus);
+    assert(instance->service && instance->path && instance->interface);
+    assert(member && signature);
+    assert(message);
+    b = instance->backend;
+
+    if (coalesce->message && coalesce_full(b, coalesce)) {
+        /* Held back by the write watermark, the call is refused like others */
+        result = coalesce_send(b, coalesce, false);
+        if (result < 0)
+            return result;
+    }
+    if (coalesce->message) {
+        *message = coalesce->message;
+        return 1;
+    }
+    if (b->corked == 0 && b->coalesce_calls == 0)
+        return 0;
+
+    result = sd_bus_message_new_method_call(
+        b->bus, &coalesce->message, instance->service, instance->path, instance->interface,
+        member);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+        return result;
+    }
+    result = sd_bus_message_set_expect_reply(coalesce->message, 0);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to flag message no-reply-expected: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_message_open_container(coalesce->message, SD_BUS_TYPE_ARRAY, signature);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to open batch: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (b->corked == 0) {
+        result = backend_arm_coalescing(b);
+        if (result < 0)
+            goto fail;
+    }
+    coalesce->count = 0;
+    coalesce->next = b->coalesced;
+    b->coalesced = coalesce;
+
+    *message = coalesce->message;
+    return 1;
+
+fail:
+    coalesce->message = sd_bus_message_unref(coalesce->message);
+    return result;
+}
+
+CC_PUBLIC int cc_coalesce_end(struct cc_coalesce *coalesce, struct cc_instance *instance)
+{
+    int result;
+    struct cc_backend *b;
+
+    assert(coalesce && coalesce->message);
+    assert(instance && instance->backend);
+    b = instance->backend;
+
+    ++coalesce->count;
+    if (!coalesce_full(b, coalesce))
+        return 0;
+
+    result = coalesce_send(b, coalesce, false);
+    /* The call is in the batch, which waits for the write queue to drain */
+    if (result == -EAGAIN)
+        return 0;
+    return result;
+}
+
+CC_PUBLIC int cc_coalesce_flush(struct cc_coalesce *coalesce, struct cc_instance *instance)
+{
+    assert(coalesce);
+    assert(instance && instance->backend);
+
+    if (!coalesce->message)
+        return 0;
+
+    /* Keeps the order of calls, which are checked against the watermark themselves */
+    return coalesce_send(instance->backend, coalesce, true);
+}
+
+CC_PUBLIC int cc_backend_get_event_context(struct cc_event_context **context)
+{
+    struct cc_backend *backend = backend_current();
+
     CC_LOG_DEBUG("invoked cc_backend_get_event_context()\n");
     assert(context);
-    assert(backend.event);
-    event_context.event = backend.event;
+    assert(backend->event);
+    event_context.event = backend->event;
     *context = &event_context;
     return 0;
 }
@@ -14,6 +14,8 @@
 #ifndef INCLUDED_CC_BACKEND
 #define INCLUDED_CC_BACKEND
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 
@@ -22,13 +24,97 @@ extern "C" {
 #endif
 
 struct cc_instance;
+struct cc_call;
 struct cc_event_context;
+struct cc_shards;
+
+/* Storage for instances set up by cc_instance_init() without dynamic memory
+ * allocation is counted in slots suitably aligned for any member.  Addresses
+ * longer than CC_INSTANCE_ADDRESS_MAX characters need a larger storage.
+ */
+#define CC_STORAGE_SLOT 8
+#define CC_INSTANCE_ADDRESS_MAX 255
+#define CC_INSTANCE_STORAGE(length) (8 * CC_STORAGE_SLOT + (length) + 1)
+#define CC_INSTANCE_SIZE CC_INSTANCE_STORAGE(CC_INSTANCE_ADDRESS_MAX)
+
+/* Callback invoked once the write queue drained after calls were refused */
+typedef void (*cc_backend_writable_t)(void *data);
+
+/* Callbacks invoked in the shard thread to create and destroy instances */
+typedef int (*cc_shard_init_t)(unsigned int shard, void *data);
+typedef void (*cc_shard_fini_t)(unsigned int shard, void *data);
+
+/* Callbacks invoked in the worker process to create and destroy the instances
+ * of every peer connection, the value stored in peer is passed to fini.
+ */
+typedef int (*cc_peer_init_t)(unsigned int worker, void *data, void **peer);
+typedef void (*cc_peer_fini_t)(unsigned int worker, void *data, void *peer);
 
 int cc_backend_startup();
+int cc_backend_startup_peer(const char *address);
 void cc_backend_shutdown();
 
+/* Opens a second bus connection for methods generated with capic.priority=high,
+ * whose messages are dispatched before those of the first one.
+ */
+int cc_backend_open_priority_lane();
+
 int cc_instance_new(const char *address, bool server, struct cc_instance **instance);
 struct cc_instance *cc_instance_free(struct cc_instance *instance);
+int cc_instance_init(
+    void *storage, size_t size, const char *address, bool server,
+    struct cc_instance **instance);
+void cc_instance_fini(struct cc_instance *instance);
+
+/* Abandons a pending asynchronous call, whose callback is then never invoked,
+ * and tells the server for methods generated with capic.cancel.  Returns 1 if
+ * the call was pending and 0 otherwise.
+ */
+int cc_call_cancel(struct cc_call *call);
+
+int cc_shards_start(
+    unsigned int count, cc_shard_init_t init, cc_shard_fini_t fini, void *data,
+    struct cc_shards **shards);
+struct cc_shards *cc_shards_stop(struct cc_shards *shards);
+
+int cc_workers_run(
+    const char *path, unsigned int count, cc_peer_init_t init, cc_peer_fini_t fini,
+    void *data);
+
+/* One-way and asynchronous calls fail with -EAGAIN once high messages are
+ * queued for writing, until the queue drains to low and writable is invoked.
+ * A high watermark of 0 leaves the queue unbounded.
+ */
+int cc_backend_set_write_watermarks(
+    uint64_t high, uint64_t low, cc_backend_writable_t writable, void *data);
+
+/* Servers refuse calls with org.genivi.capic.Error.Overloaded while more than
+ * max_bytes of incoming messages wait to be read, 0 turns the limit off.
+ */
+int cc_backend_set_read_backlog(uint64_t max_bytes);
+
+/* Servers take turns serving the method calls of every sender, up to weight
+ * calls of a sender per turn and 1 unless set otherwise.  Up to max_queued
+ * calls wait per sender, the rest are refused, 0 serves calls in order again.
+ */
+int cc_backend_set_fair_queuing(unsigned int max_queued);
+int cc_backend_set_sender_weight(const char *sender, unsigned int weight);
+
+/* Synchronous method calls keep dispatching incoming messages while they wait
+ * for their reply, up to max_depth of them nested in each other, and block the
+ * thread for 0, which is the default.  Servers then run method implementations
+ * once sd-bus has returned, so that calls made by them are reentrant as well.
+ */
+int cc_backend_set_reentrant_calls(unsigned int max_depth);
+
+/* One-way methods generated with capic.batch are called in batches while the
+ * backend is corked, which are sent when it is uncorked as often as corked.
+ * Coalescing holds the calls back without corking until the event loop goes
+ * idle, max_calls are pending or max_delay_usec passed, 0 turns it off.
+ */
+void cc_backend_cork();
+int cc_backend_uncork();
+int cc_backend_set_coalescing(unsigned int max_calls, uint64_t max_delay_usec);
 
 int cc_backend_get_event_context(struct cc_event_context **context);
 void *cc_event_get_native(struct cc_event_context *context);
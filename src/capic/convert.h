@@ -0,0 +1,37 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#ifndef INCLUDED_CC_CONVERT
+#define INCLUDED_CC_CONVERT
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Vectorized conversions of arrays whose C and D-Bus element types differ */
+void cc_pack_bools(uint32_t *wire, const bool *data, size_t count);
+int cc_unpack_bools(bool *data, const uint32_t *wire, size_t count);
+void cc_pack_floats(double *wire, const float *data, size_t count);
+void cc_unpack_floats(float *data, const double *wire, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* ifndef INCLUDED_CC_CONVERT */
@@ -14,8 +14,12 @@
 #ifndef INCLUDED_CC_DBUS_PRIVATE
 #define INCLUDED_CC_DBUS_PRIVATE
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <systemd/sd-bus.h>
 #include <systemd/sd-event.h>
+#include <capic/backend.h>
 
 
 #ifdef __cplusplus
@@ -37,12 +41,102 @@ extern "C" {
 #endif
 
 enum {
-    CC_DBUS_ASYNC_CALL_TIMEOUT_USEC = 2000 * 1000ULL
+    CC_DBUS_ASYNC_CALL_TIMEOUT_USEC = 2000 * 1000ULL,
+    /* Default of sd-bus, made explicit where the callee is told the deadline */
+    CC_DBUS_SYNC_CALL_TIMEOUT_USEC = 25 * 1000 * 1000ULL
 };
 
+/* Errors of calls refused by servers before running their implementation */
+#define CC_DBUS_ERROR_OVERLOADED "org.genivi.capic.Error.Overloaded"
+#define CC_DBUS_ERROR_DEADLINE_EXPIRED "org.genivi.capic.Error.DeadlineExpired"
+#define CC_DBUS_ERROR_CANCELLED "org.genivi.capic.Error.Cancelled"
+
+/* Method of servers with methods generated with capic.cancel, which clients
+ * call with the cookie of a cancelled call */
+#define CC_DBUS_CANCEL_MEMBER "CancelCall"
+
+/* Appended to the service name that servers own on their priority lane */
+#define CC_DBUS_LANE_SUFFIX ".PriorityLane"
+
+enum {
+    /* Batches are sent once they hold this many calls unless a limit is set */
+    CC_COALESCE_CALLS_MAX = 1024
+};
+
+enum {
+    /* Messages read ahead of every method call served with fair queuing */
+    CC_FAIR_READ_AHEAD = 64
+};
+
+enum {
+    /* Cancelled calls remembered until they are served, and their sender names */
+    CC_CANCEL_NOTICES = 16,
+    CC_CANCEL_SENDER_MAX = 32,
+    /* Method calls waiting to be served after sd-bus has dispatched them */
+    CC_DEFERRED_CALLS = 16
+};
+
+struct cc_cancel_notice {
+    uint64_t cookie;
+    char sender[CC_CANCEL_SENDER_MAX];
+};
+
+/* Method call whose thunk is invoked again once sd-bus has returned */
+struct cc_deferred {
+    struct cc_instance *instance;
+    sd_bus_message *message;
+    sd_bus_message_handler_t thunk;
+    void *userdata;
+};
+
+struct cc_coalesce;
+struct cc_fair;
+struct cc_watch;
+
 struct cc_backend {
     sd_bus *bus;
     sd_event *event;
+    /* Second connection for high priority methods, dispatched before the bus */
+    sd_bus *lane;
+    /* Connected directly to a peer rather than to a message bus */
+    bool peer;
+    /* Transient memory of the method call being processed */
+    struct cc_arena *arena;
+    /* Batches of one-way calls held back while corked or coalescing */
+    unsigned int corked;
+    unsigned int coalesce_calls;
+    uint64_t coalesce_usec;
+    struct cc_coalesce *coalesced;
+    sd_event_source *coalesce_idle;
+    sd_event_source *coalesce_timer;
+    /* Bounds of the write queue in messages, unbounded if write_high is 0 */
+    uint64_t write_high;
+    uint64_t write_low;
+    bool write_blocked;
+    cc_backend_writable_t writable;
+    void *writable_data;
+    sd_event_source *writable_source;
+    /* Bytes waiting to be read above which calls are refused, 0 if unlimited */
+    uint64_t read_backlog;
+    /* Queues of method calls per sender, NULL while calls are served in order */
+    struct cc_fair *fair;
+    /* Deadline of the method call being served, 0 if it has none */
+    uint64_t deadline;
+    /* Calls cancelled by their clients, the oldest notice is replaced first */
+    struct cc_cancel_notice cancelled[CC_CANCEL_NOTICES];
+    unsigned int cancelled_next;
+    /* Synchronous calls dispatching messages while they wait, up to reentrant_max */
+    unsigned int reentrant_depth;
+    unsigned int reentrant_max;
+    /* Method calls served after sd-bus has dispatched them, a ring of
+     * deferred_count calls starting with the oldest at deferred_head */
+    struct cc_deferred deferred[CC_DEFERRED_CALLS];
+    unsigned int deferred_head;
+    unsigned int deferred_count;
+    sd_event_source *deferred_source;
+    /* Owners of the service names of client instances */
+    struct cc_watch *watches;
+    unsigned int watch_generation;
 };
 
 struct cc_instance {
@@ -50,6 +144,8 @@ struct cc_instance {
     const char *service;
     const char *path;
     const char *interface;
+    /* Timeout of method calls in usec, 0 for that of the kind of call */
+    uint64_t timeout;
     char address[];
 };
 
@@ -57,6 +153,188 @@ struct cc_event_context {
     sd_event *event;
 };
 
+/* Returns -EAGAIN if the write queue of the instance backend is above its high
+ * watermark, or has not drained below the low one since */
+int cc_instance_check_write(struct cc_instance *instance);
+
+/* Creates a call of a method of the instance on the priority lane if lane is
+ * true and the backend has one, otherwise on the bus */
+int cc_instance_new_method_call(
+    struct cc_instance *instance, bool lane, const char *member, sd_bus_message **message);
+/* Makes a synchronous call of a method of the instance, which dispatches
+ * incoming messages while it waits if the backend makes reentrant calls.
+ * Calls created by cc_instance_new_method_call() are repeated on the bus if
+ * the service has no priority lane, setting unlaned in this case. */
+int cc_instance_call(
+    struct cc_instance *instance, sd_bus_message *message, uint64_t usec,
+    sd_bus_error *error, sd_bus_message **reply, bool *unlaned);
+/* Returns 1 if the call is served later by invoking the thunk again, as
+ * sd-bus does not dispatch messages for reentrant calls made by the
+ * implementation while it dispatches the call, or 0 to serve it now.  Calls
+ * beyond CC_DEFERRED_CALLS are refused as overloaded, which also returns 1. */
+int cc_instance_defer_call(
+    struct cc_instance *instance, sd_bus_message *m, sd_bus_message_handler_t thunk,
+    void *userdata);
+/* Serves the object of a server instance on the priority lane if the backend
+ * has one, which takes the service name with CC_DBUS_LANE_SUFFIX */
+int cc_instance_serve_lane(
+    struct cc_instance *instance, const sd_bus_vtable *vtable, void *userdata,
+    sd_bus_slot **slot);
+
+/* Subscribe to a signal of the instance, optionally only where the first
+ * argument equals arg0 */
+int cc_instance_add_signal_match(
+    struct cc_instance *instance, const char *member, const char *arg0,
+    sd_bus_message_handler_t callback, void *userdata, sd_bus_slot **slot);
+/* Subscribe to changes of properties of the instance interface */
+int cc_instance_add_properties_match(
+    struct cc_instance *instance, sd_bus_message_handler_t callback, void *userdata,
+    sd_bus_slot **slot);
+
+/* Limits emissions of a server to one per window, changes made in between are
+ * held back and emitted together when the window ends */
+struct cc_throttle {
+    uint64_t window;
+    uint64_t last;
+    sd_event_source *timer;
+};
+
+/* Returns 1 if a change can be emitted right away, otherwise 0 after arming
+ * a timer that invokes callback at the end of the window */
+int cc_throttle_check(
+    struct cc_throttle *throttle, struct cc_instance *instance,
+    sd_event_time_handler_t callback, void *userdata);
+/* Starts the next window after a change was emitted */
+void cc_throttle_emitted(struct cc_throttle *throttle, struct cc_instance *instance);
+void cc_throttle_fini(struct cc_throttle *throttle);
+
+/* Asynchronous call of a client method, of which a client instance has at
+ * most one pending per method */
+struct cc_call {
+    struct cc_instance *instance;
+    sd_bus_slot *slot;
+    /* Call held back until the service appears */
+    sd_bus_message *held;
+    /* Of the call sent, 0 unless the server is told about the cancellation */
+    uint64_t cookie;
+};
+
+/* Remembers the call cancelled by the notice, so that it is not served */
+int cc_cancel_notice(struct cc_instance *instance, sd_bus_message *notice);
+
+/* One-way calls of a method gathered in a single message for its batch
+ * method, kept on the list of the backend until the message is sent */
+struct cc_coalesce {
+    sd_bus_message *message;
+    unsigned int count;
+    struct cc_coalesce *next;
+};
+
+/* Returns 1 and the batch message to append one tuple of arguments to if
+ * calls are held back, otherwise 0 to send the call right away, or -EAGAIN
+ * if the batch is full and the write queue above the high watermark */
+int cc_coalesce_begin(
+    struct cc_coalesce *coalesce, struct cc_instance *instance, const char *member,
+    const char *signature, sd_bus_message **message);
+/* Counts the call appended to the batch and sends the batch once it is full
+ * and the write queue below the high watermark */
+int cc_coalesce_end(struct cc_coalesce *coalesce, struct cc_instance *instance);
+/* Sends the batch regardless of the watermarks before another call */
+int cc_coalesce_flush(struct cc_coalesce *coalesce, struct cc_instance *instance);
+
+/* Calls of a server interface or method in progress, which exceed limit when
+ * implementations run the event loop of their thread before returning */
+struct cc_admission {
+    unsigned int limit;
+    unsigned int active;
+};
+
+/* Absolute CLOCK_MONOTONIC time usec from now, as passed with method calls */
+uint64_t cc_deadline_after(uint64_t usec);
+/* Replies with an error and returns a negative error code if the call is past
+ * its deadline, 0 for none, was cancelled by its client or the server is
+ * overloaded, otherwise counts the call as active in both interface and method
+ * until cc_admission_leave() */
+int cc_admission_enter(
+    struct cc_admission *interface, struct cc_admission *method, struct cc_instance *instance,
+    sd_bus_message *call, uint64_t deadline, sd_bus_error *error);
+void cc_admission_leave(struct cc_admission *interface, struct cc_admission *method);
+/* Makes deadline that of the method call being served and returns the previous one */
+uint64_t cc_deadline_swap(struct cc_instance *instance, uint64_t deadline);
+/* Returns in timeout the timeout of a call, which is usec, that of the instance
+ * or fallback, whichever is set first, cut short to the deadline of the call
+ * being served.  Returns -ETIMEDOUT if this deadline has passed already. */
+int cc_instance_get_timeout(
+    struct cc_instance *instance, uint64_t usec, uint64_t fallback, uint64_t *timeout);
+
+/* Client instances watching whether their service has an owner, where one
+ * NameOwnerChanged match and one watch are shared by all clients of a name.
+ * The watch is kept in the storage of one of its watchers and moved to
+ * another one when that watcher is removed, so that nothing is allocated. */
+struct cc_watcher;
+typedef void (*cc_watcher_changed_t)(struct cc_watcher *watcher, bool available);
+struct cc_watch {
+    struct cc_watch *next;
+    struct cc_backend *backend;
+    sd_bus_slot *match;
+    /* NameHasOwner call asked once the match is in place, NULL when answered */
+    sd_bus_slot *query;
+    struct cc_watcher *watchers;
+    const char *service;
+    bool available;
+    unsigned int generation;
+};
+struct cc_watcher {
+    struct cc_watcher *next;
+    struct cc_watch *watch;
+    cc_watcher_changed_t changed;
+    void *data;
+    const char *service;
+    unsigned int generation;
+    struct cc_watch storage;
+};
+
+/* Peers are always available and need no watch.  A watcher counts as added
+ * once changed is set, services unknown until the bus answers as unavailable. */
+int cc_watcher_add(
+    struct cc_instance *instance, struct cc_watcher *watcher, cc_watcher_changed_t changed,
+    void *data);
+void cc_watcher_remove(struct cc_watcher *watcher);
+bool cc_watcher_is_available(struct cc_watcher *watcher);
+/* Frees the watches left by clients still alive when the backend shuts down */
+void cc_watch_free_all(struct cc_backend *backend);
+
+/* Method calls taken out of the read queue of the bus into a queue per sender
+ * and put back one at a time in deficit round-robin order, where a sender of
+ * weight n is served n calls per round.
+ */
+int cc_fair_new(sd_bus *bus, sd_event *event, unsigned int max_queued, struct cc_fair **fair);
+/* Puts all calls still queued back into the read queue of the bus */
+struct cc_fair *cc_fair_free(struct cc_fair *fair);
+int cc_fair_set_weight(struct cc_fair *fair, const char *sender, unsigned int weight);
+
+/* Read-only shared memory copies of attribute values, every one guarded by a
+ * seqlock so that local clients read them without a system call.  Servers
+ * hand out the memory and a notification socket with cc_mirror_reply_open(),
+ * clients map them with cc_mirror_map().
+ */
+struct cc_mirror;
+typedef void (*cc_mirror_handler_t)(void *userdata);
+
+int cc_mirror_new(unsigned int count, struct cc_mirror **mirror);
+struct cc_mirror *cc_mirror_free(struct cc_mirror *mirror);
+void cc_mirror_write(struct cc_mirror *mirror, unsigned int index, const void *value, size_t size);
+int cc_mirror_reply_open(struct cc_mirror *mirror, sd_bus_message *call, sd_bus_error *error);
+int cc_mirror_map(int fd, int notify, unsigned int count, struct cc_mirror **mirror);
+/* Returns -ENODATA until the server writes the value for the first time and
+ * -EAGAIN while it is being rewritten, callers fall back to the bus then */
+int cc_mirror_read(
+    struct cc_mirror *mirror, unsigned int index, void *value, size_t size,
+    uint64_t *sequence);
+int cc_mirror_watch(
+    struct cc_mirror *mirror, struct cc_instance *instance, cc_mirror_handler_t handler,
+    void *userdata);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,69 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#ifndef INCLUDED_CC_MEMORY
+#define INCLUDED_CC_MEMORY
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hooks routing all memory allocated by libcapic and generated code */
+struct cc_allocator {
+    void *(*malloc)(size_t size, void *data);
+    void (*free)(void *ptr, void *data);
+    void *data;
+};
+
+/* Transient memory released in one shot, for example when a thunk returns */
+#define CC_ARENA_BLOCK_SIZE 4096
+
+struct cc_arena;
+
+struct cc_arena_mark {
+    void *block;
+    size_t used;
+};
+
+void cc_set_allocator(const struct cc_allocator *allocator);
+void *cc_malloc(size_t size);
+void *cc_calloc(size_t count, size_t size);
+void cc_free(void *ptr);
+
+int cc_arena_new(size_t block_size, struct cc_arena **arena);
+struct cc_arena *cc_arena_free(struct cc_arena *arena);
+void *cc_arena_alloc(struct cc_arena *arena, size_t size);
+void *cc_arena_grow(struct cc_arena *arena, void *ptr, size_t old_size, size_t size);
+struct cc_arena_mark cc_arena_mark(struct cc_arena *arena);
+void cc_arena_release(struct cc_arena *arena, struct cc_arena_mark mark);
+void cc_arena_reset(struct cc_arena *arena);
+
+/* Struct-of-arrays buffers keep every column on its own SIMD friendly boundary */
+#define CC_COLUMN_ALIGNMENT 64
+
+int cc_arena_grow_columns(
+    struct cc_arena *arena, void **columns, const size_t *sizes, size_t count, size_t used,
+    size_t capacity);
+
+int cc_backend_get_arena(struct cc_arena **arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* ifndef INCLUDED_CC_MEMORY */
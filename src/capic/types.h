@@ -0,0 +1,37 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#ifndef INCLUDED_CC_TYPES
+#define INCLUDED_CC_TYPES
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Franca ByteBuffer, received buffers point into the message they came with */
+struct cc_byte_buffer {
+    const uint8_t *data;
+    size_t size;
+};
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* ifndef INCLUDED_CC_TYPES */
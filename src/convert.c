@@ -0,0 +1,328 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/convert.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CC_CONVERT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CC_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+/* Kernels below store booleans as single bytes holding 0 or 1 */
+_Static_assert(sizeof(bool) == 1, "bool must be a single byte");
+
+
+/* Every kernel converts a prefix of the array and returns its length, the
+ * public functions finish the remaining elements with scalar code.  Wire
+ * arrays come from message buffers, so no alignment is assumed on either side.
+ */
+
+#if defined(CC_CONVERT_X86)
+
+static size_t pack_bools_sse2(uint32_t *wire, const bool *data, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i lo = _mm_unpacklo_epi8(b, zero);
+        __m128i hi = _mm_unpackhi_epi8(b, zero);
+
+        _mm_storeu_si128((__m128i *) (wire + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (wire + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (wire + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *) (wire + i + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+
+    return i;
+}
+
+static size_t unpack_bools_sse2(bool *data, const uint32_t *wire, size_t count, uint32_t *bits)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i any = _mm_setzero_si128();
+    uint32_t lanes[4];
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (wire + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (wire + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i *) (wire + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i *) (wire + i + 12));
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+
+        any = _mm_or_si128(any, _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)));
+        _mm_storeu_si128((__m128i *) (data + i), _mm_min_epu8(v, one));
+    }
+    _mm_storeu_si128((__m128i *) lanes, any);
+    *bits |= lanes[0] | lanes[1] | lanes[2] | lanes[3];
+
+    return i;
+}
+
+static size_t pack_floats_sse2(double *wire, const float *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128 f = _mm_loadu_ps(data + i);
+
+        _mm_storeu_pd(wire + i, _mm_cvtps_pd(f));
+        _mm_storeu_pd(wire + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+    }
+
+    return i;
+}
+
+static size_t unpack_floats_sse2(float *data, const double *wire, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(wire + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(wire + i + 2));
+
+        _mm_storeu_ps(data + i, _mm_movelh_ps(lo, hi));
+    }
+
+    return i;
+}
+
+__attribute__ ((target("avx2")))
+static size_t pack_bools_avx2(uint32_t *wire, const bool *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (data + i));
+
+        _mm256_storeu_si256((__m256i *) (wire + i), _mm256_cvtepu8_epi32(b));
+        _mm256_storeu_si256(
+            (__m256i *) (wire + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)));
+    }
+
+    return i;
+}
+
+__attribute__ ((target("avx2")))
+static size_t unpack_bools_avx2(bool *data, const uint32_t *wire, size_t count, uint32_t *bits)
+{
+    /* Packing works within 128-bit lanes, the permutation restores element order */
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i any = _mm256_setzero_si256();
+    uint32_t lanes[8];
+    size_t i;
+
+    for (i = 0; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (wire + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (wire + i + 8));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (wire + i + 16));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (wire + i + 24));
+        __m256i v = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+
+        any = _mm256_or_si256(any, _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d)));
+        v = _mm256_permutevar8x32_epi32(v, order);
+        _mm256_storeu_si256((__m256i *) (data + i), _mm256_min_epu8(v, one));
+    }
+    _mm256_storeu_si256((__m256i *) lanes, any);
+    *bits |= lanes[0] | lanes[1] | lanes[2] | lanes[3] | lanes[4] | lanes[5] | lanes[6] | lanes[7];
+
+    return i;
+}
+
+__attribute__ ((target("avx2")))
+static size_t pack_floats_avx2(double *wire, const float *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        _mm256_storeu_pd(wire + i, _mm256_cvtps_pd(_mm_loadu_ps(data + i)));
+        _mm256_storeu_pd(wire + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(data + i + 4)));
+    }
+
+    return i;
+}
+
+__attribute__ ((target("avx2")))
+static size_t unpack_floats_avx2(float *data, const double *wire, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        _mm_storeu_ps(data + i, _mm256_cvtpd_ps(_mm256_loadu_pd(wire + i)));
+        _mm_storeu_ps(data + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(wire + i + 4)));
+    }
+
+    return i;
+}
+
+static bool has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#elif defined(CC_CONVERT_NEON)
+
+static size_t pack_bools_neon(uint32_t *wire, const bool *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        uint8x16_t b = vld1q_u8((const uint8_t *) (data + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(b));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(b));
+
+        vst1q_u32(wire + i, vmovl_u16(vget_low_u16(lo)));
+        vst1q_u32(wire + i + 4, vmovl_u16(vget_high_u16(lo)));
+        vst1q_u32(wire + i + 8, vmovl_u16(vget_low_u16(hi)));
+        vst1q_u32(wire + i + 12, vmovl_u16(vget_high_u16(hi)));
+    }
+
+    return i;
+}
+
+static size_t unpack_bools_neon(bool *data, const uint32_t *wire, size_t count, uint32_t *bits)
+{
+    const uint8x16_t one = vdupq_n_u8(1);
+    uint32x4_t any = vdupq_n_u32(0);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        uint32x4_t a = vld1q_u32(wire + i);
+        uint32x4_t b = vld1q_u32(wire + i + 4);
+        uint32x4_t c = vld1q_u32(wire + i + 8);
+        uint32x4_t d = vld1q_u32(wire + i + 12);
+        uint16x8_t ab = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+        uint16x8_t cd = vcombine_u16(vmovn_u32(c), vmovn_u32(d));
+        uint8x16_t v = vcombine_u8(vmovn_u16(ab), vmovn_u16(cd));
+
+        any = vorrq_u32(any, vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d)));
+        vst1q_u8((uint8_t *) (data + i), vminq_u8(v, one));
+    }
+    *bits |= vgetq_lane_u32(any, 0) | vgetq_lane_u32(any, 1) |
+             vgetq_lane_u32(any, 2) | vgetq_lane_u32(any, 3);
+
+    return i;
+}
+
+static size_t pack_floats_neon(double *wire, const float *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        float32x4_t f = vld1q_f32(data + i);
+
+        vst1q_f64(wire + i, vcvt_f64_f32(vget_low_f32(f)));
+        vst1q_f64(wire + i + 2, vcvt_high_f64_f32(f));
+    }
+
+    return i;
+}
+
+static size_t unpack_floats_neon(float *data, const double *wire, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        float32x2_t lo = vcvt_f32_f64(vld1q_f64(wire + i));
+
+        vst1q_f32(data + i, vcvt_high_f32_f64(lo, vld1q_f64(wire + i + 2)));
+    }
+
+    return i;
+}
+
+#endif
+
+
+CC_PUBLIC void cc_pack_bools(uint32_t *wire, const bool *data, size_t count)
+{
+    size_t i = 0;
+
+    assert(wire || count == 0);
+    assert(data || count == 0);
+#if defined(CC_CONVERT_X86)
+    i = has_avx2() ? pack_bools_avx2(wire, data, count) : pack_bools_sse2(wire, data, count);
+#elif defined(CC_CONVERT_NEON)
+    i = pack_bools_neon(wire, data, count);
+#endif
+    for (; i < count; ++i)
+        wire[i] = data[i];
+}
+
+/* D-Bus allows only 0 and 1 as boolean values, anything else fails the whole array */
+CC_PUBLIC int cc_unpack_bools(bool *data, const uint32_t *wire, size_t count)
+{
+    uint32_t bits = 0;
+    size_t i = 0;
+
+    assert(data || count == 0);
+    assert(wire || count == 0);
+#if defined(CC_CONVERT_X86)
+    i = has_avx2() ?
+        unpack_bools_avx2(data, wire, count, &bits) :
+        unpack_bools_sse2(data, wire, count, &bits);
+#elif defined(CC_CONVERT_NEON)
+    i = unpack_bools_neon(data, wire, count, &bits);
+#endif
+    for (; i < count; ++i) {
+        bits |= wire[i];
+        data[i] = wire[i] != 0;
+    }
+
+    return (bits & ~UINT32_C(1)) ? -EBADMSG : 0;
+}
+
+CC_PUBLIC void cc_pack_floats(double *wire, const float *data, size_t count)
+{
+    size_t i = 0;
+
+    assert(wire || count == 0);
+    assert(data || count == 0);
+#if defined(CC_CONVERT_X86)
+    i = has_avx2() ? pack_floats_avx2(wire, data, count) : pack_floats_sse2(wire, data, count);
+#elif defined(CC_CONVERT_NEON)
+    i = pack_floats_neon(wire, data, count);
+#endif
+    for (; i < count; ++i)
+        wire[i] = data[i];
+}
+
+CC_PUBLIC void cc_unpack_floats(float *data, const double *wire, size_t count)
+{
+    size_t i = 0;
+
+    assert(data || count == 0);
+    assert(wire || count == 0);
+#if defined(CC_CONVERT_X86)
+    i = has_avx2() ?
+        unpack_floats_avx2(data, wire, count) :
+        unpack_floats_sse2(data, wire, count);
+#elif defined(CC_CONVERT_NEON)
+    i = unpack_floats_neon(data, wire, count);
+#endif
+    for (; i < count; ++i)
+        data[i] = (float) wire[i];
+}
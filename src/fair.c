@@ -0,0 +1,404 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/memory.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <capic/log.h>
+#include <capic/dbus-private.h>
+
+
+#define FAIR_MATCH_RULE \
+    "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus'," \
+    "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg2=''"
+
+
+/* Calls of one sender waiting to be served */
+struct fair_flow {
+    struct fair_flow *next;
+    /* Next flow in the round while the flow has calls waiting */
+    struct fair_flow *next_active;
+    bool active;
+    /* Kept while empty since the weight was set explicitly */
+    bool pinned;
+    unsigned int weight;
+    unsigned int deficit;
+    unsigned int head;
+    unsigned int count;
+    sd_bus_message **queue;
+    char sender[];
+};
+
+struct cc_fair {
+    sd_bus *bus;
+    sd_bus_slot *filter;
+    sd_bus_slot *match;
+    sd_event_source *dispatch;
+    unsigned int max_queued;
+    struct fair_flow *flows;
+    struct fair_flow *active_head;
+    struct fair_flow *active_tail;
+    /* Put back into the read queue, so that the filter lets it pass */
+    sd_bus_message *released;
+};
+
+
+static struct fair_flow *fair_find(struct cc_fair *fair, const char *sender)
+{
+    struct fair_flow *flow;
+
+    for (flow = fair->flows; flow; flow = flow->next) {
+        if (strcmp(flow->sender, sender) == 0)
+            return flow;
+    }
+    return NULL;
+}
+
+static struct fair_flow *fair_add(struct cc_fair *fair, const char *sender)
+{
+    struct fair_flow *flow;
+    size_t length = strlen(sender) + 1;
+
+    flow = (struct fair_flow *) cc_calloc(1, sizeof(*flow) + length);
+    if (!flow)
+        return NULL;
+    flow->queue = (sd_bus_message **) cc_malloc(fair->max_queued * sizeof(*flow->queue));
+    if (!flow->queue) {
+        cc_free(flow);
+        return NULL;
+    }
+    flow->weight = 1;
+    memcpy(flow->sender, sender, length);
+    flow->next = fair->flows;
+    fair->flows = flow;
+    return flow;
+}
+
+static void fair_remove(struct cc_fair *fair, struct fair_flow *flow)
+{
+    struct fair_flow **link;
+
+    assert(!flow->active && flow->count == 0);
+    for (link = &fair->flows; *link != flow; link = &(*link)->next)
+        ;
+    *link = flow->next;
+    cc_free(flow->queue);
+    cc_free(flow);
+}
+
+static void fair_push_active(struct cc_fair *fair, struct fair_flow *flow)
+{
+    flow->active = true;
+    flow->next_active = NULL;
+    if (fair->active_tail)
+        fair->active_tail->next_active = flow;
+    else
+        fair->active_head = flow;
+    fair->active_tail = flow;
+}
+
+static struct fair_flow *fair_pop_active(struct cc_fair *fair)
+{
+    struct fair_flow *flow = fair->active_head;
+
+    fair->active_head = flow->next_active;
+    if (!fair->active_head)
+        fair->active_tail = NULL;
+    flow->next_active = NULL;
+    flow->active = false;
+    return flow;
+}
+
+/* Calls of senders that left the bus are not served, their replies would go nowhere */
+static void fair_drop(struct cc_fair *fair, struct fair_flow *flow)
+{
+    struct fair_flow **link;
+
+    if (flow->active) {
+        for (link = &fair->active_head; *link != flow; link = &(*link)->next_active)
+            ;
+        *link = flow->next_active;
+        if (fair->active_tail == flow) {
+            for (fair->active_tail = fair->active_head;
+                 fair->active_tail && fair->active_tail->next_active;
+                 fair->active_tail = fair->active_tail->next_active)
+                ;
+        }
+        flow->next_active = NULL;
+        flow->active = false;
+    }
+    for (; flow->count > 0; --flow->count) {
+        sd_bus_message_unref(flow->queue[flow->head]);
+        flow->head = (flow->head + 1) % fair->max_queued;
+    }
+    fair_remove(fair, flow);
+}
+
+static int fair_name_owner_changed(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    int result;
+    struct cc_fair *fair = (struct cc_fair *) userdata;
+    struct fair_flow *flow;
+    const char *name, *old_owner, *new_owner;
+    (void) ret_error;
+
+    assert(m);
+    assert(fair);
+    result = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to read name owner change: %s\n", strerror(-result));
+        return 0;
+    }
+    /* Weights are set for unique names, which are never owned again */
+    if (new_owner[0] != '\0')
+        return 0;
+    flow = fair_find(fair, name);
+    if (flow) {
+        CC_LOG_DEBUG("dropping %u calls of sender '%s'\n", flow->count, name);
+        fair_drop(fair, flow);
+    }
+
+    return 0;
+}
+
+static int fair_filter(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct cc_fair *fair = (struct cc_fair *) userdata;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    struct fair_flow *flow;
+    const char *sender;
+    (void) ret_error;
+
+    assert(m);
+    assert(fair);
+    if (m == fair->released) {
+        /* Served now, so the next call can be released */
+        fair->released = NULL;
+        if (fair->active_head)
+            sd_event_source_set_enabled(fair->dispatch, SD_EVENT_ON);
+        return 0;
+    }
+    if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected")) {
+        /* A released call may never come back through the filter now */
+        fair->released = NULL;
+        while (fair->flows)
+            fair_drop(fair, fair->flows);
+        return 0;
+    }
+    if (!sd_bus_message_is_method_call(m, NULL, NULL))
+        return 0;
+    /* Cancel notices overtake the calls they cancel */
+    if (sd_bus_message_is_method_call(m, NULL, CC_DBUS_CANCEL_MEMBER))
+        return 0;
+    /* Peer connections have a single sender and no sender names */
+    sender = sd_bus_message_get_sender(m);
+    if (!sender)
+        return 0;
+
+    flow = fair_find(fair, sender);
+    if (!flow) {
+        flow = fair_add(fair, sender);
+        if (!flow) {
+            CC_LOG_ERROR("failed to allocate queue for sender '%s'\n", sender);
+            return 0;
+        }
+    }
+    if (flow->count == fair->max_queued) {
+        CC_LOG_DEBUG("refusing call with %u calls queued for sender '%s'\n", flow->count, sender);
+        sd_bus_error_set(&error, CC_DBUS_ERROR_OVERLOADED, "too many calls queued for sender");
+        sd_bus_reply_method_error(m, &error);
+        sd_bus_error_free(&error);
+        return 1;
+    }
+    flow->queue[(flow->head + flow->count++) % fair->max_queued] = sd_bus_message_ref(m);
+    if (!flow->active)
+        fair_push_active(fair, flow);
+    if (!fair->released)
+        sd_event_source_set_enabled(fair->dispatch, SD_EVENT_ON);
+
+    /* The message is taken from sd-bus until it is put back */
+    return 1;
+}
+
+/* Serves one call of the flow at the head of the round, which stays there
+ * until it has been served as many calls as its weight */
+static int fair_dispatch_handler(sd_event_source *source, void *userdata)
+{
+    int result = 0;
+    struct cc_fair *fair = (struct cc_fair *) userdata;
+    struct fair_flow *flow;
+    sd_bus_message *m;
+    unsigned int count;
+
+    assert(source);
+    assert(fair && !fair->released);
+
+    /* Reading calls ahead lets the round see senders queued behind a flood */
+    for (count = 0; count < CC_FAIR_READ_AHEAD; ++count) {
+        result = sd_bus_process(fair->bus, NULL);
+        if (result <= 0)
+            break;
+    }
+    if (result < 0)
+        CC_LOG_ERROR("unable to read calls ahead: %s\n", strerror(-result));
+    sd_event_source_set_enabled(source, SD_EVENT_OFF);
+    if (!fair->active_head)
+        return 0;
+
+    flow = fair->active_head;
+    if (flow->deficit == 0)
+        flow->deficit = flow->weight;
+    m = flow->queue[flow->head];
+    flow->head = (flow->head + 1) % fair->max_queued;
+    --flow->count;
+    --flow->deficit;
+    if (flow->count == 0 || flow->deficit == 0) {
+        fair_pop_active(fair);
+        /* Flows do not save up turns while they have no calls waiting */
+        if (flow->count > 0)
+            fair_push_active(fair, flow);
+        else if (flow->pinned)
+            flow->deficit = 0;
+        else
+            fair_remove(fair, flow);
+    }
+
+    result = sd_bus_enqueue_for_read(fair->bus, m);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to put call back into read queue: %s\n", strerror(-result));
+        sd_bus_reply_method_errno(m, result, NULL);
+        if (fair->active_head)
+            sd_event_source_set_enabled(source, SD_EVENT_ON);
+    } else {
+        fair->released = m;
+    }
+    sd_bus_message_unref(m);
+
+    return 0;
+}
+
+CC_PUBLIC int cc_fair_new(
+    sd_bus *bus, sd_event *event, unsigned int max_queued, struct cc_fair **fair)
+{
+    int result;
+    struct cc_fair *f;
+
+    CC_LOG_DEBUG("invoked cc_fair_new()\n");
+    assert(bus && event);
+    assert(max_queued > 0);
+    assert(fair);
+
+    f = (struct cc_fair *) cc_calloc(1, sizeof(*f));
+    if (!f) {
+        CC_LOG_ERROR("failed to allocate fair queuing\n");
+        return -ENOMEM;
+    }
+    f->bus = sd_bus_ref(bus);
+    f->max_queued = max_queued;
+    result = sd_event_add_defer(event, &f->dispatch, &fair_dispatch_handler, f);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create dispatch source: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_event_source_set_enabled(f->dispatch, SD_EVENT_OFF);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to disable dispatch source: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_add_filter(bus, &f->filter, &fair_filter, f);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add filter: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_add_match(bus, &f->match, FAIR_MATCH_RULE, &fair_name_owner_changed, f);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add match rule: %s\n", strerror(-result));
+        goto fail;
+    }
+
+    *fair = f;
+    return 0;
+
+fail:
+    cc_fair_free(f);
+    return result;
+}
+
+CC_PUBLIC struct cc_fair *cc_fair_free(struct cc_fair *fair)
+{
+    int result;
+    struct fair_flow *flow;
+    sd_bus_message *m;
+
+    CC_LOG_DEBUG("invoked cc_fair_free()\n");
+    if (!fair)
+        return NULL;
+    fair->filter = sd_bus_slot_unref(fair->filter);
+    fair->match = sd_bus_slot_unref(fair->match);
+    fair->dispatch = sd_event_source_unref(fair->dispatch);
+    fair->released = NULL;
+    /* Calls keep their order per sender, but not across senders */
+    while (fair->active_head) {
+        flow = fair_pop_active(fair);
+        for (; flow->count > 0; --flow->count) {
+            m = flow->queue[flow->head];
+            flow->head = (flow->head + 1) % fair->max_queued;
+            result = sd_bus_enqueue_for_read(fair->bus, m);
+            if (result < 0)
+                sd_bus_reply_method_errno(m, result, NULL);
+            sd_bus_message_unref(m);
+        }
+    }
+    while (fair->flows) {
+        flow = fair->flows;
+        fair->flows = flow->next;
+        cc_free(flow->queue);
+        cc_free(flow);
+    }
+    sd_bus_unref(fair->bus);
+    cc_free(fair);
+    return NULL;
+}
+
+CC_PUBLIC int cc_fair_set_weight(struct cc_fair *fair, const char *sender, unsigned int weight)
+{
+    struct fair_flow *flow;
+
+    CC_LOG_DEBUG("invoked cc_fair_set_weight()\n");
+    assert(fair);
+    assert(sender);
+    assert(weight > 0);
+
+    flow = fair_find(fair, sender);
+    if (!flow) {
+        flow = fair_add(fair, sender);
+        if (!flow) {
+            CC_LOG_ERROR("failed to allocate queue for sender '%s'\n", sender);
+            return -ENOMEM;
+        }
+    }
+    flow->weight = weight;
+    if (flow->deficit > weight)
+        flow->deficit = weight;
+    /* Senders of the default weight are kept only while they have calls waiting */
+    flow->pinned = weight != 1;
+    if (!flow->pinned && !flow->active)
+        fair_remove(fair, flow);
+
+    return 0;
+}
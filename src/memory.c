@@ -0,0 +1,288 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/memory.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <capic/log.h>
+
+
+enum {
+    CC_ARENA_ALIGN = _Alignof(max_align_t)
+};
+
+struct cc_arena_block {
+    struct cc_arena_block *next;
+    size_t size;
+    size_t used;
+    _Alignas(CC_ARENA_ALIGN) unsigned char data[];
+};
+
+struct cc_arena {
+    /* Blocks form a stack with the one being allocated from on top */
+    struct cc_arena_block *top;
+    /* Released block kept to avoid allocating again on every call */
+    struct cc_arena_block *spare;
+    size_t block_size;
+    void *last;
+    size_t last_size;
+};
+
+
+static void *default_malloc(size_t size, void *data)
+{
+    (void) data;
+    return malloc(size);
+}
+
+static void default_free(void *ptr, void *data)
+{
+    (void) data;
+    free(ptr);
+}
+
+static struct cc_allocator allocator = {
+    .malloc = &default_malloc,
+    .free = &default_free,
+    .data = NULL
+};
+
+
+CC_PUBLIC void cc_set_allocator(const struct cc_allocator *a)
+{
+    CC_LOG_DEBUG("invoked cc_set_allocator()\n");
+    if (a) {
+        assert(a->malloc && a->free);
+        allocator = *a;
+    } else {
+        allocator.malloc = &default_malloc;
+        allocator.free = &default_free;
+        allocator.data = NULL;
+    }
+}
+
+CC_PUBLIC void *cc_malloc(size_t size)
+{
+    return allocator.malloc(size, allocator.data);
+}
+
+CC_PUBLIC void *cc_calloc(size_t count, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+    ptr = allocator.malloc(count * size, allocator.data);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+CC_PUBLIC void cc_free(void *ptr)
+{
+    if (ptr)
+        allocator.free(ptr, allocator.data);
+}
+
+
+static size_t arena_align(size_t size)
+{
+    return (size + CC_ARENA_ALIGN - 1) & ~((size_t) CC_ARENA_ALIGN - 1);
+}
+
+static struct cc_arena_block *arena_push(struct cc_arena *arena, size_t size)
+{
+    struct cc_arena_block *block = NULL;
+
+    if (arena->spare && arena->spare->size >= size) {
+        block = arena->spare;
+        arena->spare = NULL;
+    } else {
+        if (size < arena->block_size)
+            size = arena->block_size;
+        block = (struct cc_arena_block *) cc_malloc(sizeof(*block) + size);
+        if (!block) {
+            CC_LOG_ERROR("failed to allocate arena block\n");
+            return NULL;
+        }
+        block->size = size;
+    }
+    block->used = 0;
+    block->next = arena->top;
+    arena->top = block;
+
+    return block;
+}
+
+static void arena_pop(struct cc_arena *arena)
+{
+    struct cc_arena_block *block = arena->top;
+
+    arena->top = block->next;
+    if (!arena->spare || arena->spare->size < block->size) {
+        cc_free(arena->spare);
+        arena->spare = block;
+    } else
+        cc_free(block);
+}
+
+
+CC_PUBLIC int cc_arena_new(size_t block_size, struct cc_arena **arena)
+{
+    struct cc_arena *a;
+
+    CC_LOG_DEBUG("invoked cc_arena_new()\n");
+    assert(arena);
+    CC_LOG_DEBUG("with block_size=%zu\n", block_size);
+    if (block_size == 0)
+        return -EINVAL;
+
+    a = (struct cc_arena *) cc_calloc(1, sizeof(*a));
+    if (!a) {
+        CC_LOG_ERROR("failed to allocate arena memory\n");
+        return -ENOMEM;
+    }
+    a->block_size = arena_align(block_size);
+
+    *arena = a;
+    return 0;
+}
+
+CC_PUBLIC struct cc_arena *cc_arena_free(struct cc_arena *arena)
+{
+    CC_LOG_DEBUG("invoked cc_arena_free()\n");
+    if (arena) {
+        while (arena->top)
+            arena_pop(arena);
+        cc_free(arena->spare);
+        cc_free(arena);
+    }
+    return NULL;
+}
+
+CC_PUBLIC void *cc_arena_alloc(struct cc_arena *arena, size_t size)
+{
+    struct cc_arena_block *block;
+    void *ptr;
+
+    assert(arena);
+    size = arena_align(size);
+    block = arena->top;
+    if (!block || block->size - block->used < size) {
+        block = arena_push(arena, size);
+        if (!block)
+            return NULL;
+    }
+    ptr = block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+    arena->last_size = size;
+
+    return ptr;
+}
+
+/* The most recent allocation grows in place, which is what decoding arrays needs */
+CC_PUBLIC void *cc_arena_grow(struct cc_arena *arena, void *ptr, size_t old_size, size_t size)
+{
+    struct cc_arena_block *block;
+    void *p;
+
+    assert(arena);
+    if (!ptr)
+        return cc_arena_alloc(arena, size);
+    size = arena_align(size);
+    if (size <= arena_align(old_size))
+        return ptr;
+    block = arena->top;
+    if (ptr == arena->last && block->size - block->used >= size - arena->last_size) {
+        block->used += size - arena->last_size;
+        arena->last_size = size;
+        return ptr;
+    }
+    p = cc_arena_alloc(arena, size);
+    if (p)
+        memcpy(p, ptr, old_size);
+    return p;
+}
+
+CC_PUBLIC struct cc_arena_mark cc_arena_mark(struct cc_arena *arena)
+{
+    struct cc_arena_mark mark = {NULL, 0};
+
+    assert(arena);
+    if (arena->top) {
+        mark.block = arena->top;
+        mark.used = arena->top->used;
+    }
+    return mark;
+}
+
+CC_PUBLIC void cc_arena_release(struct cc_arena *arena, struct cc_arena_mark mark)
+{
+    assert(arena);
+    while (arena->top && arena->top != mark.block)
+        arena_pop(arena);
+    if (arena->top)
+        arena->top->used = mark.used;
+    arena->last = NULL;
+    arena->last_size = 0;
+}
+
+CC_PUBLIC void cc_arena_reset(struct cc_arena *arena)
+{
+    struct cc_arena_mark mark = {NULL, 0};
+
+    cc_arena_release(arena, mark);
+}
+
+static size_t column_size(size_t size)
+{
+    return (size + CC_COLUMN_ALIGNMENT - 1) & ~(size_t) (CC_COLUMN_ALIGNMENT - 1);
+}
+
+/* All columns share one allocation, so growing them costs a single arena call */
+CC_PUBLIC int cc_arena_grow_columns(
+    struct cc_arena *arena, void **columns, const size_t *sizes, size_t count, size_t used,
+    size_t capacity)
+{
+    size_t index, total = CC_COLUMN_ALIGNMENT - 1;
+    unsigned char *block;
+
+    assert(arena);
+    assert(columns);
+    assert(sizes);
+    assert(used <= capacity);
+    for (index = 0; index < count; ++index) {
+        if (sizes[index] && capacity > (SIZE_MAX / 2 - total) / sizes[index])
+            return -ENOMEM;
+        total += column_size(capacity * sizes[index]);
+    }
+    block = (unsigned char *) cc_arena_alloc(arena, total);
+    if (!block)
+        return -ENOMEM;
+    block += (CC_COLUMN_ALIGNMENT - (uintptr_t) block % CC_COLUMN_ALIGNMENT) % CC_COLUMN_ALIGNMENT;
+    for (index = 0; index < count; ++index) {
+        if (used)
+            memcpy(block, columns[index], used * sizes[index]);
+        columns[index] = block;
+        block += column_size(capacity * sizes[index]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,372 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/memory.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <capic/log.h>
+#include <capic/dbus-private.h>
+
+
+/* Attempts at reading a value the server keeps rewriting */
+#define MIRROR_READ_RETRIES 64
+
+
+/* Every value lives on its own cache line, so that readers of one value do
+ * not contend with the writer of another */
+struct cc_mirror_slot {
+    /* Odd while the value is being written, 0 until it is written first */
+    uint64_t sequence;
+    uint64_t value;
+    uint8_t padding[48];
+};
+
+struct cc_mirror {
+    struct cc_mirror_slot *slots;
+    unsigned int count;
+    size_t size;
+    /* Server side: the segment and the notification sockets of its readers */
+    int memfd;
+    int *clients;
+    unsigned int client_count;
+    unsigned int client_capacity;
+    /* Client side: the notification socket watched in the event loop */
+    int notify;
+    sd_event_source *source;
+    cc_mirror_handler_t handler;
+    void *userdata;
+};
+
+
+static size_t mirror_size(unsigned int count)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    return (count * sizeof(struct cc_mirror_slot) + page - 1) / page * page;
+}
+
+static struct cc_mirror *mirror_alloc(unsigned int count)
+{
+    struct cc_mirror *mirror;
+
+    mirror = (struct cc_mirror *) cc_calloc(1, sizeof(*mirror));
+    if (!mirror)
+        return NULL;
+    mirror->slots = MAP_FAILED;
+    mirror->count = count;
+    mirror->size = mirror_size(count);
+    mirror->memfd = -1;
+    mirror->notify = -1;
+    return mirror;
+}
+
+CC_PUBLIC int cc_mirror_new(unsigned int count, struct cc_mirror **mirror)
+{
+    int result;
+    struct cc_mirror *m;
+
+    CC_LOG_DEBUG("invoked cc_mirror_new()\n");
+    assert(count > 0);
+    assert(mirror);
+
+    m = mirror_alloc(count);
+    if (!m) {
+        CC_LOG_ERROR("failed to allocate mirror\n");
+        return -ENOMEM;
+    }
+    m->memfd = memfd_create("capic-mirror", MFD_CLOEXEC);
+    if (m->memfd < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to create mirror memory: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (ftruncate(m->memfd, m->size) < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to size mirror memory: %s\n", strerror(-result));
+        goto fail;
+    }
+    m->slots = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, m->memfd, 0);
+    if (m->slots == MAP_FAILED) {
+        result = -errno;
+        CC_LOG_ERROR("unable to map mirror memory: %s\n", strerror(-result));
+        goto fail;
+    }
+
+    *mirror = m;
+    return 0;
+
+fail:
+    cc_mirror_free(m);
+    return result;
+}
+
+CC_PUBLIC struct cc_mirror *cc_mirror_free(struct cc_mirror *mirror)
+{
+    unsigned int index;
+
+    CC_LOG_DEBUG("invoked cc_mirror_free()\n");
+    if (!mirror)
+        return NULL;
+    mirror->source = sd_event_source_unref(mirror->source);
+    if (mirror->slots != MAP_FAILED)
+        munmap(mirror->slots, mirror->size);
+    if (mirror->memfd >= 0)
+        close(mirror->memfd);
+    if (mirror->notify >= 0)
+        close(mirror->notify);
+    for (index = 0; index < mirror->client_count; ++index)
+        close(mirror->clients[index]);
+    cc_free(mirror->clients);
+    cc_free(mirror);
+    return NULL;
+}
+
+CC_PUBLIC void cc_mirror_write(
+    struct cc_mirror *mirror, unsigned int index, const void *value, size_t size)
+{
+    struct cc_mirror_slot *slot;
+    uint64_t sequence, word = 0;
+    unsigned int client = 0;
+
+    assert(mirror && mirror->memfd >= 0);
+    assert(index < mirror->count);
+    assert(size <= sizeof(word));
+    slot = &mirror->slots[index];
+    memcpy(&word, value, size);
+
+    /* Readers retry while the sequence is odd or changes under them */
+    sequence = slot->sequence;
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->value, word, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    while (client < mirror->client_count) {
+        /* A full socket already holds a notification the reader has not seen */
+        if (send(mirror->clients[client], "", 1, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0 ||
+            errno == EAGAIN) {
+            ++client;
+            continue;
+        }
+        /* The reader has gone away, as the socket tells unlike an eventfd */
+        CC_LOG_DEBUG("dropping mirror reader: %s\n", strerror(errno));
+        close(mirror->clients[client]);
+        mirror->clients[client] = mirror->clients[--mirror->client_count];
+    }
+}
+
+static int mirror_add_client(struct cc_mirror *mirror, int fd)
+{
+    int *clients;
+    unsigned int capacity;
+
+    if (mirror->client_count == mirror->client_capacity) {
+        capacity = mirror->client_capacity ? 2 * mirror->client_capacity : 4;
+        clients = (int *) cc_malloc(capacity * sizeof(*clients));
+        if (!clients)
+            return -ENOMEM;
+        if (mirror->client_count > 0)
+            memcpy(clients, mirror->clients, mirror->client_count * sizeof(*clients));
+        cc_free(mirror->clients);
+        mirror->clients = clients;
+        mirror->client_capacity = capacity;
+    }
+    mirror->clients[mirror->client_count++] = fd;
+    return 0;
+}
+
+CC_PUBLIC int cc_mirror_reply_open(
+    struct cc_mirror *mirror, sd_bus_message *call, sd_bus_error *error)
+{
+    int result, fd = -1, pair[2] = {-1, -1};
+    char path[64];
+
+    CC_LOG_DEBUG("invoked cc_mirror_reply_open()\n");
+    assert(mirror && mirror->memfd >= 0);
+    assert(call);
+
+    /* Reopening the memory read-only keeps readers from mapping it writable */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", mirror->memfd);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to reopen mirror memory: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to create mirror notification: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = mirror_add_client(mirror, pair[0]);
+    if (result < 0) {
+        CC_LOG_ERROR("failed to allocate mirror reader\n");
+        goto fail;
+    }
+    pair[0] = -1;
+    /* The reply holds copies of the descriptors */
+    result = sd_bus_reply_method_return(call, "hh", fd, pair[1]);
+    if (result < 0)
+        CC_LOG_ERROR("unable to send reply: %s\n", strerror(-result));
+
+fail:
+    if (result < 0)
+        sd_bus_error_set_errno(error, result);
+    if (fd >= 0)
+        close(fd);
+    if (pair[0] >= 0)
+        close(pair[0]);
+    if (pair[1] >= 0)
+        close(pair[1]);
+    return result;
+}
+
+CC_PUBLIC int cc_mirror_map(int fd, int notify, unsigned int count, struct cc_mirror **mirror)
+{
+    int result;
+    struct cc_mirror *m;
+    struct stat st;
+
+    CC_LOG_DEBUG("invoked cc_mirror_map()\n");
+    assert(fd >= 0 && notify >= 0);
+    assert(count > 0);
+    assert(mirror);
+
+    m = mirror_alloc(count);
+    if (!m) {
+        CC_LOG_ERROR("failed to allocate mirror\n");
+        return -ENOMEM;
+    }
+    if (fstat(fd, &st) < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to get mirror size: %s\n", strerror(-result));
+        goto fail;
+    }
+    if ((size_t) st.st_size < m->size) {
+        CC_LOG_ERROR("mirror holds fewer values than expected\n");
+        result = -EPROTO;
+        goto fail;
+    }
+    m->slots = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m->slots == MAP_FAILED) {
+        result = -errno;
+        CC_LOG_ERROR("unable to map mirror memory: %s\n", strerror(-result));
+        goto fail;
+    }
+    /* The descriptor belongs to the message it was received with */
+    m->notify = fcntl(notify, F_DUPFD_CLOEXEC, 3);
+    if (m->notify < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to keep mirror notification: %s\n", strerror(-result));
+        goto fail;
+    }
+
+    *mirror = m;
+    return 0;
+
+fail:
+    cc_mirror_free(m);
+    return result;
+}
+
+CC_PUBLIC int cc_mirror_read(
+    struct cc_mirror *mirror, unsigned int index, void *value, size_t size,
+    uint64_t *sequence)
+{
+    const struct cc_mirror_slot *slot;
+    uint64_t begin, end, word;
+    unsigned int retries = 0;
+
+    assert(mirror && mirror->slots != MAP_FAILED);
+    assert(index < mirror->count);
+    assert(size <= sizeof(word));
+    slot = &mirror->slots[index];
+
+    /* A server that stopped halfway through a write must not hang the client */
+    do {
+        if (retries++ == MIRROR_READ_RETRIES)
+            return -EAGAIN;
+        begin = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        word = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    } while (begin != end || (begin & 1));
+    if (begin == 0)
+        return -ENODATA;
+
+    memcpy(value, &word, size);
+    if (sequence)
+        *sequence = begin;
+    return 0;
+}
+
+static int mirror_notify_handler(
+    sd_event_source *source, int fd, uint32_t revents, void *userdata)
+{
+    struct cc_mirror *mirror = (struct cc_mirror *) userdata;
+    char byte;
+    ssize_t size;
+
+    CC_LOG_DEBUG("invoked mirror_notify_handler()\n");
+    assert(source);
+    assert(mirror);
+    (void) revents;
+
+    /* Several updates are reported at once */
+    while ((size = recv(fd, &byte, sizeof(byte), MSG_DONTWAIT)) > 0)
+        ;
+    if (size == 0) {
+        CC_LOG_DEBUG("mirror notification closed by server\n");
+        sd_event_source_set_enabled(source, SD_EVENT_OFF);
+    } else if (errno != EAGAIN) {
+        CC_LOG_ERROR("mirror notification failed: %s\n", strerror(errno));
+        sd_event_source_set_enabled(source, SD_EVENT_OFF);
+    }
+    mirror->handler(mirror->userdata);
+
+    return 0;
+}
+
+CC_PUBLIC int cc_mirror_watch(
+    struct cc_mirror *mirror, struct cc_instance *instance, cc_mirror_handler_t handler,
+    void *userdata)
+{
+    int result;
+
+    CC_LOG_DEBUG("invoked cc_mirror_watch()\n");
+    assert(mirror && mirror->notify >= 0);
+    assert(instance && instance->backend && instance->backend->event);
+    assert(handler);
+    assert(!mirror->source);
+
+    mirror->handler = handler;
+    mirror->userdata = userdata;
+    result = sd_event_add_io(
+        instance->backend->event, &mirror->source, mirror->notify, EPOLLIN,
+        &mirror_notify_handler, mirror);
+    if (result < 0)
+        CC_LOG_ERROR("unable to watch mirror notification: %s\n", strerror(-result));
+
+    return result;
+}
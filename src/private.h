@@ -22,6 +22,14 @@
 #define CC_PUBLIC __attribute__ ((visibility("default")))
 #define CC_UNUSED __attribute__ ((unused))
 
+struct cc_backend;
+struct sd_event;
+
+/* Start the current backend on an accepted peer connection served from event */
+int cc_backend_startup_fd(int fd, struct sd_event *event);
+/* Make backend current in the calling thread, NULL restores the backend of the thread */
+struct cc_backend *cc_backend_switch(struct cc_backend *backend);
+
 #if defined(HAVE_DECL_SD_EVENT_INITIAL) && !HAVE_DECL_SD_EVENT_INITIAL
 /* These enum constants were renamed between v219 and v220 */
 #define SD_EVENT_INITIAL SD_EVENT_PASSIVE
@@ -35,5 +43,60 @@ static inline int mock_sd_bus_get_scope(sd_bus CC_UNUSED *bus, const char **scop
 { *scope = "unknown"; return 0; }
 #endif
 
+#if !defined(HAVE_SD_BUS_GET_N_QUEUED_WRITE)
+#include <stdint.h>
+#include <systemd/sd-bus.h>
+/* Without this function the write queue appears empty and is not bounded */
+#define sd_bus_get_n_queued_write(x, y) mock_sd_bus_get_n_queued_write(x, y)
+static inline int mock_sd_bus_get_n_queued_write(sd_bus CC_UNUSED *bus, uint64_t *ret)
+{ *ret = 0; return 0; }
+#endif
+
+#if !defined(HAVE_SD_BUS_CALL_METHOD_ASYNC)
+#include <stdarg.h>
+#include <stdint.h>
+#include <systemd/sd-bus.h>
+/* This function is exported since v222 */
+#define sd_bus_call_method_async mock_sd_bus_call_method_async
+static inline int mock_sd_bus_call_method_async(
+    sd_bus *bus, sd_bus_slot **slot, const char *destination, const char *path,
+    const char *interface, const char *member, sd_bus_message_handler_t callback,
+    void *userdata, const char *types, ...)
+{
+    sd_bus_message *m = NULL;
+    va_list ap;
+    int result;
+
+    result = sd_bus_message_new_method_call(bus, &m, destination, path, interface, member);
+    if (result >= 0 && types && types[0]) {
+        va_start(ap, types);
+        result = sd_bus_message_appendv(m, types, ap);
+        va_end(ap);
+    }
+    if (result >= 0)
+        result = sd_bus_call_async(bus, slot, m, callback, userdata, 0);
+    sd_bus_message_unref(m);
+    return result;
+}
+#endif
+
+#if !defined(HAVE_SD_BUS_ENQUEUE_FOR_READ)
+#include <errno.h>
+#include <systemd/sd-bus.h>
+/* Without this function calls taken out of the read queue cannot be put back */
+#define sd_bus_enqueue_for_read(x, y) mock_sd_bus_enqueue_for_read(x, y)
+static inline int mock_sd_bus_enqueue_for_read(sd_bus CC_UNUSED *bus, sd_bus_message CC_UNUSED *m)
+{ return -ENOTSUP; }
+#endif
+
+#if !defined(HAVE_MEMFD_CREATE)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#define memfd_create(x, y) mock_memfd_create(x, y)
+static inline int mock_memfd_create(const char *name, unsigned int flags)
+{ return syscall(SYS_memfd_create, name, flags); }
+#endif
+
 
 #endif /* ifndef INCLUDED_CC_PRIVATE */
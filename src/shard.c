@@ -0,0 +1,234 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/backend.h>
+#include <capic/memory.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <capic/log.h>
+#include <capic/dbus-private.h>
+
+
+struct cc_shards;
+
+struct cc_shard {
+    struct cc_shards *shards;
+    unsigned int index;
+    pthread_t thread;
+    bool running;
+    /* Written by cc_shards_stop() to make the shard leave its event loop */
+    int stop_fd;
+    int result;
+};
+
+struct cc_shards {
+    cc_shard_init_t init;
+    cc_shard_fini_t fini;
+    void *data;
+    pthread_mutex_t mutex;
+    pthread_cond_t initialized;
+    unsigned int pending;
+    unsigned int count;
+    struct cc_shard shard[];
+};
+
+
+static int shard_stop_handler(
+    sd_event_source *source, int fd, uint32_t revents, void *userdata)
+{
+    sd_event *event = (sd_event *) userdata;
+    uint64_t value;
+    int result;
+
+    CC_LOG_DEBUG("invoked shard_stop_handler()\n");
+    assert(source);
+    assert(event);
+    (void) revents;
+
+    if (read(fd, &value, sizeof(value)) < 0)
+        CC_LOG_ERROR("unable to read shard stop event: %s\n", strerror(errno));
+    result = sd_event_exit(event, 0);
+    if (result < 0)
+        CC_LOG_ERROR("unable to exit shard event loop: %s\n", strerror(-result));
+
+    return result;
+}
+
+static void shard_initialized(struct cc_shard *shard, int result)
+{
+    struct cc_shards *shards = shard->shards;
+
+    pthread_mutex_lock(&shards->mutex);
+    shard->result = result;
+    --shards->pending;
+    pthread_cond_signal(&shards->initialized);
+    pthread_mutex_unlock(&shards->mutex);
+}
+
+static void *shard_main(void *userdata)
+{
+    struct cc_shard *shard = (struct cc_shard *) userdata;
+    struct cc_shards *shards = shard->shards;
+    struct cc_event_context *context = NULL;
+    sd_event *event = NULL;
+    int result;
+
+    CC_LOG_DEBUG("invoked shard_main() for shard %u\n", shard->index);
+
+    result = cc_backend_startup();
+    if (result < 0) {
+        CC_LOG_ERROR("unable to startup shard backend: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = cc_backend_get_event_context(&context);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to get shard event context: %s\n", strerror(-result));
+        goto fail;
+    }
+    event = (sd_event *) cc_event_get_native(context);
+    result = sd_event_add_io(event, NULL, shard->stop_fd, EPOLLIN, &shard_stop_handler, event);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add shard stop source: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (shards->init) {
+        result = shards->init(shard->index, shards->data);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to initialize shard: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+    shard_initialized(shard, 0);
+
+    result = sd_event_loop(event);
+    if (result < 0)
+        CC_LOG_ERROR("unable to run shard event loop: %s\n", strerror(-result));
+    if (shards->fini)
+        shards->fini(shard->index, shards->data);
+    cc_backend_shutdown();
+    return NULL;
+
+fail:
+    cc_backend_shutdown();
+    shard_initialized(shard, result);
+    return NULL;
+}
+
+
+CC_PUBLIC int cc_shards_start(
+    unsigned int count, cc_shard_init_t init, cc_shard_fini_t fini, void *data,
+    struct cc_shards **shards)
+{
+    int result = 0;
+    struct cc_shards *s;
+    unsigned int index;
+
+    CC_LOG_DEBUG("invoked cc_shards_start()\n");
+    assert(shards);
+    CC_LOG_DEBUG("with count=%u\n", count);
+    if (count == 0)
+        return -EINVAL;
+
+    s = (struct cc_shards *) cc_calloc(1, sizeof(*s) + count * sizeof(s->shard[0]));
+    if (!s) {
+        CC_LOG_ERROR("failed to allocate shards memory\n");
+        return -ENOMEM;
+    }
+    s->init = init;
+    s->fini = fini;
+    s->data = data;
+    s->count = count;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->initialized, NULL);
+    for (index = 0; index < count; ++index) {
+        s->shard[index].shards = s;
+        s->shard[index].index = index;
+        s->shard[index].stop_fd = -1;
+    }
+
+    for (index = 0; index < count; ++index) {
+        struct cc_shard *shard = &s->shard[index];
+
+        shard->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (shard->stop_fd < 0) {
+            result = -errno;
+            CC_LOG_ERROR("unable to create shard stop event: %s\n", strerror(-result));
+            break;
+        }
+        pthread_mutex_lock(&s->mutex);
+        ++s->pending;
+        pthread_mutex_unlock(&s->mutex);
+        result = -pthread_create(&shard->thread, NULL, &shard_main, shard);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to create shard thread: %s\n", strerror(-result));
+            pthread_mutex_lock(&s->mutex);
+            --s->pending;
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        }
+        shard->running = true;
+    }
+
+    /* Wait until every started shard has either registered its instances or failed */
+    pthread_mutex_lock(&s->mutex);
+    while (s->pending > 0)
+        pthread_cond_wait(&s->initialized, &s->mutex);
+    pthread_mutex_unlock(&s->mutex);
+    for (index = 0; index < count && result >= 0; ++index)
+        result = s->shard[index].result;
+    if (result < 0)
+        goto fail;
+
+    *shards = s;
+    return 0;
+
+fail:
+    s = cc_shards_stop(s);
+    return result;
+}
+
+CC_PUBLIC struct cc_shards *cc_shards_stop(struct cc_shards *shards)
+{
+    unsigned int index;
+    uint64_t value = 1;
+
+    CC_LOG_DEBUG("invoked cc_shards_stop()\n");
+    if (!shards)
+        return NULL;
+
+    for (index = 0; index < shards->count; ++index) {
+        struct cc_shard *shard = &shards->shard[index];
+
+        if (shard->running) {
+            /* A shard that failed to initialize has already left its thread */
+            if (shard->result >= 0 && write(shard->stop_fd, &value, sizeof(value)) < 0)
+                CC_LOG_ERROR("unable to stop shard: %s\n", strerror(errno));
+            pthread_join(shard->thread, NULL);
+        }
+        if (shard->stop_fd >= 0)
+            close(shard->stop_fd);
+    }
+    pthread_cond_destroy(&shards->initialized);
+    pthread_mutex_destroy(&shards->mutex);
+    cc_free(shards);
+
+    return NULL;
+}
@@ -0,0 +1,279 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <capic/log.h>
+#include <capic/dbus-private.h>
+
+
+#define WATCH_MATCH_RULE \
+    "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus'," \
+    "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='%s'"
+/* Longest bus name allowed by the D-Bus specification */
+#define WATCH_SERVICE_MAX 255
+
+
+static struct cc_watch *watch_find(struct cc_backend *b, const char *service)
+{
+    struct cc_watch *watch;
+
+    for (watch = b->watches; watch; watch = watch->next)
+        if (strcmp(watch->service, service) == 0)
+            break;
+    return watch;
+}
+
+static void watch_unlink(struct cc_watch *watch, struct cc_watch *replacement)
+{
+    struct cc_watch **link;
+
+    for (link = &watch->backend->watches; *link && *link != watch; link = &(*link)->next)
+        ;
+    if (*link)
+        *link = replacement ? replacement : watch->next;
+}
+
+/* Watchers may be added and removed by the callbacks, which may move the watch
+ * into the storage of another watcher, so it is looked up again by name after
+ * every one of them */
+static void watch_notify(struct cc_watch *watch)
+{
+    struct cc_backend *b = watch->backend;
+    struct cc_watcher *watcher;
+    char service[WATCH_SERVICE_MAX + 1];
+    unsigned int generation;
+    bool available = watch->available;
+
+    strcpy(service, watch->service);
+    generation = watch->generation = ++b->watch_generation;
+    do {
+        watch = watch_find(b, service);
+        if (!watch)
+            break;
+        for (watcher = watch->watchers; watcher; watcher = watcher->next)
+            if (watcher->generation != generation)
+                break;
+        if (watcher) {
+            watcher->generation = generation;
+            watcher->changed(watcher, available);
+        }
+    } while (watcher);
+}
+
+static void watch_set_available(struct cc_watch *watch, bool available)
+{
+    CC_LOG_DEBUG("service '%s' %s\n", watch->service, available ? "appeared" : "disappeared");
+    if (available == watch->available)
+        return;
+    watch->available = available;
+    watch_notify(watch);
+}
+
+static int watch_name_owner_changed(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    int result;
+    struct cc_watch *watch = (struct cc_watch *) userdata;
+    const char *name, *old_owner, *new_owner;
+    (void) ret_error;
+
+    CC_LOG_DEBUG("invoked watch_name_owner_changed()\n");
+    assert(m);
+    assert(watch);
+    result = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to read name owner change: %s\n", strerror(-result));
+        return 0;
+    }
+    if (strcmp(name, watch->service) != 0)
+        return 0;
+    /* The change is newer than any answer still to come */
+    watch->query = sd_bus_slot_unref(watch->query);
+    watch_set_available(watch, new_owner[0] != '\0');
+
+    return 0;
+}
+
+static int watch_has_owner_reply(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    int result;
+    struct cc_watch *watch = (struct cc_watch *) userdata;
+    int has_owner;
+    (void) ret_error;
+
+    CC_LOG_DEBUG("invoked watch_has_owner_reply()\n");
+    assert(m);
+    assert(watch);
+    watch->query = sd_bus_slot_unref(watch->query);
+    if (sd_bus_message_is_method_error(m, NULL)) {
+        CC_LOG_ERROR(
+            "unable to ask for service owner: %s\n", strerror(sd_bus_message_get_errno(m)));
+        return 0;
+    }
+    result = sd_bus_message_read(m, "b", &has_owner);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to read service owner: %s\n", strerror(-result));
+        return 0;
+    }
+    watch_set_available(watch, has_owner);
+
+    return 0;
+}
+
+static int watch_init(struct cc_backend *b, struct cc_watcher *watcher, struct cc_watch **watch)
+{
+    int result;
+    struct cc_watch *w = &watcher->storage;
+    char rule[sizeof(WATCH_MATCH_RULE) + WATCH_SERVICE_MAX];
+
+    if (strlen(watcher->service) > WATCH_SERVICE_MAX) {
+        CC_LOG_ERROR("service name is too long\n");
+        return -EINVAL;
+    }
+    memset(w, 0, sizeof(*w));
+    w->backend = b;
+    w->service = watcher->service;
+    w->generation = b->watch_generation;
+
+    /* Service names cannot contain quotes, so they need no escaping */
+    sprintf(rule, WATCH_MATCH_RULE, watcher->service);
+    result = sd_bus_add_match(b->bus, &w->match, rule, &watch_name_owner_changed, w);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add match rule: %s\n", strerror(-result));
+        return result;
+    }
+    /* Asked after the match is in place so that no change goes unnoticed, and
+     * answered on the event loop so that adding a watcher does not block */
+    result = sd_bus_call_method_async(
+        b->bus, &w->query, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+        "org.freedesktop.DBus", "NameHasOwner", &watch_has_owner_reply, w, "s",
+        watcher->service);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to ask for service owner: %s\n", strerror(-result));
+        w->match = sd_bus_slot_unref(w->match);
+        return result;
+    }
+    w->next = b->watches;
+    b->watches = w;
+
+    *watch = w;
+    return 0;
+}
+
+/* Moves the watch out of the storage of a watcher being removed */
+static void watch_move(struct cc_watch *watch)
+{
+    struct cc_watcher *heir = watch->watchers, *watcher;
+    struct cc_watch *moved = &heir->storage;
+
+    *moved = *watch;
+    moved->service = heir->service;
+    watch_unlink(watch, moved);
+    sd_bus_slot_set_userdata(moved->match, moved);
+    if (moved->query)
+        sd_bus_slot_set_userdata(moved->query, moved);
+    for (watcher = moved->watchers; watcher; watcher = watcher->next)
+        watcher->watch = moved;
+}
+
+CC_PUBLIC int cc_watcher_add(
+    struct cc_instance *instance, struct cc_watcher *watcher, cc_watcher_changed_t changed,
+    void *data)
+{
+    int result;
+    struct cc_backend *b;
+    struct cc_watch *watch;
+
+    CC_LOG_DEBUG("invoked cc_watcher_add()\n");
+    assert(instance && instance->backend && instance->backend->bus);
+    assert(instance->service);
+    assert(watcher && !watcher->watch && !watcher->changed);
+    assert(changed);
+    b = instance->backend;
+
+    watcher->service = instance->service;
+    /* Peers are there for as long as the connection is */
+    if (!b->peer) {
+        watch = watch_find(b, instance->service);
+        if (!watch) {
+            result = watch_init(b, watcher, &watch);
+            if (result < 0)
+                return result;
+        }
+        /* Not notified of a change being notified already */
+        watcher->generation = watch->generation;
+        watcher->watch = watch;
+        watcher->next = watch->watchers;
+        watch->watchers = watcher;
+    }
+    watcher->changed = changed;
+    watcher->data = data;
+
+    return 0;
+}
+
+CC_PUBLIC void cc_watcher_remove(struct cc_watcher *watcher)
+{
+    struct cc_watch *watch;
+    struct cc_watcher **link;
+
+    CC_LOG_DEBUG("invoked cc_watcher_remove()\n");
+    assert(watcher);
+    watcher->changed = NULL;
+    watch = watcher->watch;
+    if (!watch)
+        return;
+
+    for (link = &watch->watchers; *link != watcher; link = &(*link)->next)
+        assert(*link);
+    *link = watcher->next;
+    watcher->next = NULL;
+    watcher->watch = NULL;
+    if (watch != &watcher->storage)
+        return;
+    if (watch->watchers) {
+        watch_move(watch);
+        return;
+    }
+    watch_unlink(watch, NULL);
+    sd_bus_slot_unref(watch->query);
+    sd_bus_slot_unref(watch->match);
+}
+
+CC_PUBLIC bool cc_watcher_is_available(struct cc_watcher *watcher)
+{
+    assert(watcher);
+    return !watcher->watch || watcher->watch->available;
+}
+
+CC_PUBLIC void cc_watch_free_all(struct cc_backend *backend)
+{
+    struct cc_watch *watch;
+    struct cc_watcher *watcher;
+
+    assert(backend);
+    while ((watch = backend->watches)) {
+        /* Left behind by clients that were not freed before the backend */
+        for (watcher = watch->watchers; watcher; watcher = watcher->next)
+            watcher->watch = NULL;
+        backend->watches = watch->next;
+        watch->watchers = NULL;
+        watch->query = sd_bus_slot_unref(watch->query);
+        watch->match = sd_bus_slot_unref(watch->match);
+    }
+}
@@ -0,0 +1,497 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include "private.h"
+#include <capic/backend.h>
+#include <capic/memory.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <capic/log.h>
+#include <capic/dbus-private.h>
+
+
+/* Workers exiting sooner after they started count as failed, e.g. by crashing in init */
+#define WORKER_STABLE_USEC 1000000
+/* Respawning failed workers is delayed twice as long every time, from 100 ms up to 5 s */
+#define WORKER_BACKOFF_MIN_USEC 100000
+#define WORKER_BACKOFF_MAX_USEC 5000000
+/* Workers failing this many times in a row are not respawned any more */
+#define WORKER_FAILURES_MAX 8
+
+
+struct cc_worker {
+    pid_t pid;
+    uint64_t started;
+    unsigned int failures;
+    /* Time to spawn the worker again at, 0 if it is running or given up */
+    uint64_t respawn;
+};
+
+struct cc_workers {
+    const char *path;
+    int listen_fd;
+    cc_peer_init_t init;
+    cc_peer_fini_t fini;
+    void *data;
+    sigset_t mask;
+    unsigned int count;
+    struct cc_worker *worker;
+};
+
+/* Event loop of a worker process with the peer connections it serves */
+struct cc_worker_loop {
+    struct cc_workers *workers;
+    unsigned int index;
+    sd_event *event;
+    /* Frees the peers that disconnected */
+    sd_event_source *reap;
+    struct cc_worker_peer *peers;
+};
+
+struct cc_worker_peer {
+    struct cc_worker_peer *next;
+    struct cc_worker_loop *loop;
+    struct cc_backend backend;
+    /* Set once init succeeded, so that fini is invoked */
+    bool started;
+    /* Set once the peer disconnected, so that it is freed */
+    bool closed;
+    /* Returned by init for the instances of the peer */
+    void *data;
+};
+
+
+static uint64_t workers_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+
+/* Every peer connection accepted by a worker runs its own backend on the event loop of the worker */
+static int worker_peer_filter(
+    CC_IGNORE_BUS_ARG sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    struct cc_worker_peer *peer = (struct cc_worker_peer *) userdata;
+
+    (void) message;
+    (void) error;
+    /* Make the backend of the peer current for the handlers of its messages */
+    cc_backend_switch(&peer->backend);
+    return 0;
+}
+
+static int worker_peer_disconnected(
+    CC_IGNORE_BUS_ARG sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    struct cc_worker_peer *peer = (struct cc_worker_peer *) userdata;
+    int result;
+
+    CC_LOG_DEBUG("invoked worker_peer_disconnected()\n");
+    assert(message);
+    (void) error;
+
+    /* The backend cannot be shut down while it dispatches, so do it later */
+    peer->closed = true;
+    result = sd_event_source_set_enabled(peer->loop->reap, SD_EVENT_ONESHOT);
+    if (result < 0)
+        CC_LOG_ERROR("unable to enable peer reaping: %s\n", strerror(-result));
+
+    return result;
+}
+
+static void worker_peer_free(struct cc_worker_loop *loop, struct cc_worker_peer *peer)
+{
+    struct cc_backend *previous;
+
+    previous = cc_backend_switch(&peer->backend);
+    if (peer->started && loop->workers->fini)
+        loop->workers->fini(loop->index, loop->workers->data, peer->data);
+    cc_backend_shutdown();
+    cc_backend_switch(previous);
+    cc_free(peer);
+}
+
+static int worker_reap_handler(sd_event_source *source, void *userdata)
+{
+    struct cc_worker_loop *loop = (struct cc_worker_loop *) userdata;
+    struct cc_worker_peer **link = &loop->peers, *peer;
+
+    CC_LOG_DEBUG("invoked worker_reap_handler()\n");
+    (void) source;
+
+    while ((peer = *link)) {
+        if (!peer->closed) {
+            link = &peer->next;
+            continue;
+        }
+        *link = peer->next;
+        worker_peer_free(loop, peer);
+    }
+
+    return 0;
+}
+
+static int worker_accept_handler(sd_event_source *source, int fd, uint32_t revents, void *userdata)
+{
+    struct cc_worker_loop *loop = (struct cc_worker_loop *) userdata;
+    struct cc_worker_peer *peer;
+    struct cc_backend *previous;
+    int peer_fd, result;
+
+    CC_LOG_DEBUG("invoked worker_accept_handler() for worker %u\n", loop->index);
+    (void) source;
+    (void) revents;
+
+    peer_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+    if (peer_fd < 0) {
+        /* Another worker accepted the connection first */
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+            return 0;
+        CC_LOG_ERROR("unable to accept connection: %s\n", strerror(errno));
+        return 0;
+    }
+    peer = (struct cc_worker_peer *) cc_calloc(1, sizeof(*peer));
+    if (!peer) {
+        CC_LOG_ERROR("failed to allocate peer memory\n");
+        close(peer_fd);
+        return 0;
+    }
+    peer->loop = loop;
+
+    previous = cc_backend_switch(&peer->backend);
+    result = cc_backend_startup_fd(peer_fd, loop->event);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to startup peer backend: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_add_filter(peer->backend.bus, NULL, &worker_peer_filter, peer);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add peer filter: %s\n", strerror(-result));
+        goto fail;
+    }
+    result = sd_bus_add_match(
+        peer->backend.bus, NULL,
+        "type='signal',path='/org/freedesktop/DBus/Local',"
+        "interface='org.freedesktop.DBus.Local',member='Disconnected'",
+        &worker_peer_disconnected, peer);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to watch peer connection: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (loop->workers->init) {
+        result = loop->workers->init(loop->index, loop->workers->data, &peer->data);
+        if (result < 0) {
+            CC_LOG_ERROR("unable to initialize peer: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+    peer->started = true;
+    cc_backend_switch(previous);
+    peer->next = loop->peers;
+    loop->peers = peer;
+
+    return 0;
+
+fail:
+    cc_backend_shutdown();
+    cc_backend_switch(previous);
+    cc_free(peer);
+    return 0;
+}
+
+/* Accept and serve any number of peer connections until the worker is terminated */
+static int worker_main(struct cc_workers *workers, unsigned int index)
+{
+    int result = 0;
+    struct cc_worker_loop loop = {0};
+    struct cc_worker_peer *peer;
+    sd_event_source *listen_source = NULL;
+
+    CC_LOG_DEBUG("invoked worker_main() for worker %u\n", index);
+
+    loop.workers = workers;
+    loop.index = index;
+    result = sd_event_new(&loop.event);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to create worker event loop: %s\n", strerror(-result));
+        return result;
+    }
+    /* The listen socket is non-blocking, so all workers wake up and only one accepts */
+    result = sd_event_add_io(
+        loop.event, &listen_source, workers->listen_fd, EPOLLIN, &worker_accept_handler, &loop);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to watch listen socket: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = sd_event_add_defer(loop.event, &loop.reap, &worker_reap_handler, &loop);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to add peer reaping: %s\n", strerror(-result));
+        goto finish;
+    }
+    result = sd_event_source_set_enabled(loop.reap, SD_EVENT_OFF);
+    if (result < 0) {
+        CC_LOG_ERROR("unable to disable peer reaping: %s\n", strerror(-result));
+        goto finish;
+    }
+
+    result = sd_event_loop(loop.event);
+    if (result < 0)
+        CC_LOG_ERROR("unable to run worker event loop: %s\n", strerror(-result));
+
+finish:
+    while ((peer = loop.peers)) {
+        loop.peers = peer->next;
+        worker_peer_free(&loop, peer);
+    }
+    sd_event_source_unref(loop.reap);
+    sd_event_source_unref(listen_source);
+    sd_event_unref(loop.event);
+
+    return result;
+}
+
+static int workers_spawn(struct cc_workers *workers, unsigned int index)
+{
+    pid_t pid;
+    int result;
+
+    pid = fork();
+    if (pid < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to fork worker: %s\n", strerror(-result));
+        return result;
+    }
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &workers->mask, NULL);
+        result = worker_main(workers, index);
+        _exit(result < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    CC_LOG_DEBUG("started worker %u with pid %d\n", index, (int) pid);
+    workers->worker[index].pid = pid;
+    workers->worker[index].started = workers_now();
+    workers->worker[index].respawn = 0;
+    return 0;
+}
+
+/* Failing workers are respawned with a growing delay so that they cannot make the parent spin */
+static void workers_failed(struct cc_workers *workers, unsigned int index, uint64_t now)
+{
+    struct cc_worker *w = &workers->worker[index];
+    uint64_t delay;
+
+    if (++w->failures >= WORKER_FAILURES_MAX) {
+        CC_LOG_ERROR("worker %u failed %u times in a row, not respawning it\n", index, w->failures);
+        w->respawn = 0;
+        return;
+    }
+    delay = (uint64_t) WORKER_BACKOFF_MIN_USEC << (w->failures - 1);
+    if (delay > WORKER_BACKOFF_MAX_USEC)
+        delay = WORKER_BACKOFF_MAX_USEC;
+    CC_LOG_DEBUG("respawning worker %u in %" PRIu64 " usec\n", index, delay);
+    w->respawn = now + delay;
+}
+
+static void workers_reap(struct cc_workers *workers, bool respawn)
+{
+    pid_t pid;
+    unsigned int index;
+    uint64_t now = workers_now();
+    struct cc_worker *w;
+
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (index = 0; index < workers->count; ++index) {
+            w = &workers->worker[index];
+            if (w->pid != pid)
+                continue;
+            CC_LOG_DEBUG("worker %u with pid %d exited\n", index, (int) pid);
+            w->pid = 0;
+            if (!respawn)
+                continue;
+            if (now - w->started < WORKER_STABLE_USEC) {
+                workers_failed(workers, index, now);
+            } else {
+                w->failures = 0;
+                w->respawn = now;
+            }
+        }
+    }
+}
+
+/* Spawns the workers that are due and returns when the next one is, 0 for none */
+static int workers_respawn(struct cc_workers *workers, uint64_t *next)
+{
+    unsigned int index;
+    uint64_t now = workers_now();
+    bool alive = false;
+    struct cc_worker *w;
+
+    *next = 0;
+    for (index = 0; index < workers->count; ++index) {
+        w = &workers->worker[index];
+        if (w->pid == 0 && w->respawn != 0 && w->respawn <= now &&
+            workers_spawn(workers, index) < 0)
+            workers_failed(workers, index, now);
+        if (w->pid == 0 && w->respawn != 0 && (*next == 0 || w->respawn < *next))
+            *next = w->respawn;
+        if (w->pid > 0 || w->respawn != 0)
+            alive = true;
+    }
+    if (!alive) {
+        CC_LOG_ERROR("all workers failed\n");
+        return -ECHILD;
+    }
+
+    return 0;
+}
+
+static int workers_listen(struct cc_workers *workers)
+{
+    struct sockaddr_un address = {0};
+    int result;
+
+    if (strlen(workers->path) >= sizeof(address.sun_path)) {
+        CC_LOG_ERROR("socket path is too long\n");
+        return -ENAMETOOLONG;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, workers->path, sizeof(address.sun_path) - 1);
+
+    workers->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (workers->listen_fd < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to create socket: %s\n", strerror(-result));
+        return result;
+    }
+    unlink(workers->path);
+    if (bind(workers->listen_fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to bind socket: %s\n", strerror(-result));
+        return result;
+    }
+    if (listen(workers->listen_fd, SOMAXCONN) < 0) {
+        result = -errno;
+        CC_LOG_ERROR("unable to listen on socket: %s\n", strerror(-result));
+        return result;
+    }
+
+    return 0;
+}
+
+
+CC_PUBLIC int cc_workers_run(
+    const char *path, unsigned int count, cc_peer_init_t init, cc_peer_fini_t fini,
+    void *data)
+{
+    int result = 0;
+    struct cc_workers workers = {0};
+    sigset_t signals;
+    siginfo_t info;
+    struct timespec timeout;
+    unsigned int index;
+    uint64_t next, now;
+
+    CC_LOG_DEBUG("invoked cc_workers_run()\n");
+    assert(path);
+    CC_LOG_DEBUG("with path='%s', count=%u\n", path, count);
+    if (count == 0)
+        return -EINVAL;
+
+    workers.path = path;
+    workers.listen_fd = -1;
+    workers.init = init;
+    workers.fini = fini;
+    workers.data = data;
+    workers.count = count;
+    workers.worker = (struct cc_worker *) cc_calloc(count, sizeof(workers.worker[0]));
+    if (!workers.worker) {
+        CC_LOG_ERROR("failed to allocate workers memory\n");
+        return -ENOMEM;
+    }
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, &workers.mask);
+
+    result = workers_listen(&workers);
+    if (result < 0)
+        goto finish;
+    for (index = 0; index < count; ++index) {
+        result = workers_spawn(&workers, index);
+        if (result < 0)
+            goto finish;
+    }
+
+    /* The parent only supervises, workers accept connections on the shared socket */
+    for (;;) {
+        result = workers_respawn(&workers, &next);
+        if (result < 0)
+            break;
+        if (next == 0) {
+            result = sigwaitinfo(&signals, &info);
+        } else {
+            now = workers_now();
+            next = next > now ? next - now : 0;
+            timeout.tv_sec = next / 1000000;
+            timeout.tv_nsec = next % 1000000 * 1000;
+            result = sigtimedwait(&signals, &info, &timeout);
+        }
+        if (result < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            result = -errno;
+            CC_LOG_ERROR("unable to wait for signals: %s\n", strerror(-result));
+            break;
+        }
+        result = 0;
+        if (info.si_signo != SIGCHLD)
+            break;
+        workers_reap(&workers, true);
+    }
+
+finish:
+    for (index = 0; index < count; ++index) {
+        if (workers.worker[index].pid > 0)
+            kill(workers.worker[index].pid, SIGTERM);
+    }
+    for (index = 0; index < count; ++index) {
+        if (workers.worker[index].pid > 0)
+            waitpid(workers.worker[index].pid, NULL, 0);
+    }
+    if (workers.listen_fd >= 0) {
+        close(workers.listen_fd);
+        unlink(path);
+    }
+    sigprocmask(SIG_SETMASK, &workers.mask, NULL);
+    cc_free(workers.worker);
+
+    return result;
+}
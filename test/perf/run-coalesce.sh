@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# SPDX license identifier: MPL-2.0
+# Copyright (C) 2016, Visteon Corp.
+# Author: Pavel Konopelko, pkonopel@visteon.com
+#
+# This file is part of Common API C
+#
+# This Source Code Form is subject to the terms of the
+# Mozilla Public License (MPL), version 2.0.
+# If a copy of the MPL was not distributed with this file,
+# you can obtain one at http://mozilla.org/MPL/2.0/.
+# For further information see http://www.genivi.org/.
+
+# Run capic-server on the system bus producing broadcasts at a given rate
+# while coalescing them within a given window, and count how many of them
+# reach a subscriber.  A window of 0 disables coalescing.  The defaults model
+# a 10 kHz producer whose consumers need 50 Hz.
+#
+# Usage: run-coalesce.sh [broadcasts [rate [window_usec]]]
+
+broadcasts=${1:-10000}
+rate=${2:-10000}
+window=${3:-20000}
+log=${TMPDIR:-/tmp}/capic-coalesce-$$.log
+
+./capic-server -z "$rate" -c "$window" > "$log" 2>&1 &
+server=$!
+while ! grep -q "entering main loop" "$log"; do sleep 0.1; done
+
+./capic-client -r "$broadcasts" > "$log.client" 2>&1 &
+client=$!
+while ! grep -q "^subscribed" "$log.client"; do sleep 0.1; done
+
+./capic-client -e "$broadcasts" > /dev/null
+wait $client
+
+kill -TERM "$server"
+wait "$server"
+
+echo "broadcast rate [1/s]:    $rate"
+echo "coalescing window [us]:  $window"
+echo "broadcasts emitted:      $broadcasts"
+grep -E "broadcasts (received|saved)|CPU per broadcast" "$log.client"
+
+rm -f "$log" "$log".*
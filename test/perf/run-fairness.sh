@@ -0,0 +1,44 @@
+#!/bin/sh
+
+# SPDX license identifier: MPL-2.0
+# Copyright (C) 2016, Visteon Corp.
+# Author: Pavel Konopelko, pkonopel@visteon.com
+#
+# This file is part of Common API C
+#
+# This Source Code Form is subject to the terms of the
+# Mozilla Public License (MPL), version 2.0.
+# If a copy of the MPL was not distributed with this file,
+# you can obtain one at http://mozilla.org/MPL/2.0/.
+# For further information see http://www.genivi.org/.
+
+# Run capic-server on the system bus while one client floods it with one-way
+# calls, and report the latencies of another client making synchronous calls
+# at the same time.  The run is repeated with calls served in order and with
+# fair queuing of up to a given count of calls per sender.
+#
+# Usage: run-fairness.sh [calls [flood [queued]]]
+
+calls=${1:-10000}
+flood=${2:-1000000}
+queued=${3:-64}
+log=${TMPDIR:-/tmp}/capic-fairness-$$.log
+
+for option in "" "-s $queued"; do
+    ./capic-server $option > "$log" 2>&1 &
+    server=$!
+    while ! grep -q "entering main loop" "$log"; do sleep 0.1; done
+
+    ./capic-client -o -m "$flood" > /dev/null 2>&1 &
+    neighbour=$!
+    sleep 0.5
+    ./capic-client -t -m "$calls" > "$log.client" 2>&1
+
+    kill -TERM "$neighbour" "$server"
+    wait "$neighbour" "$server"
+
+    echo "server options:          ${option:-none}"
+    grep -E "messages per|latency" "$log.client"
+done
+
+rm -f "$log" "$log".*
@@ -0,0 +1,54 @@
+#!/bin/sh
+
+# SPDX license identifier: MPL-2.0
+# Copyright (C) 2016, Visteon Corp.
+# Author: Pavel Konopelko, pkonopel@visteon.com
+#
+# This file is part of Common API C
+#
+# This Source Code Form is subject to the terms of the
+# Mozilla Public License (MPL), version 2.0.
+# If a copy of the MPL was not distributed with this file,
+# you can obtain one at http://mozilla.org/MPL/2.0/.
+# For further information see http://www.genivi.org/.
+
+# Run capic-server on the system bus with a given number of subscribers
+# spread across broadcast channels, then broadcast samples on every channel.
+# Each subscriber filters on its channel, so the bus daemon delivers it only
+# its own share.  Prints the CPU time subscribers spend per received
+# broadcast.
+#
+# Usage: run-fanout.sh [subscribers [broadcasts [channels]]]
+
+subscribers=${1:-4}
+broadcasts=${2:-10000}
+channels=${3:-1}
+log=${TMPDIR:-/tmp}/capic-fanout-$$.log
+
+./capic-server > "$log" 2>&1 &
+server=$!
+while ! grep -q "entering main loop" "$log"; do sleep 0.1; done
+
+pids=""
+for i in $(seq 1 "$subscribers"); do
+    ./capic-client -r "$broadcasts" -f $((i % channels)) > "$log.$i" 2>&1 &
+    pids="$pids $!"
+done
+for i in $(seq 1 "$subscribers"); do
+    while ! grep -q "^subscribed" "$log.$i"; do sleep 0.1; done
+done
+
+for channel in $(seq 0 $((channels - 1))); do
+    ./capic-client -e "$broadcasts" -f "$channel" > /dev/null
+done
+wait $pids
+
+kill -TERM "$server"
+wait "$server"
+
+echo "subscribers:             $subscribers"
+echo "channels:                $channels"
+echo "broadcasts per channel:  $broadcasts"
+cat "$log".* | awk '/CPU per broadcast/ {sum += $5; n++} END {print "CPU per broadcast [us]:  " sum / n}'
+
+rm -f "$log" "$log".*
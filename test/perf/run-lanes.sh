@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# SPDX license identifier: MPL-2.0
+# Copyright (C) 2016, Visteon Corp.
+# Author: Pavel Konopelko, pkonopel@visteon.com
+#
+# This file is part of Common API C
+#
+# This Source Code Form is subject to the terms of the
+# Mozilla Public License (MPL), version 2.0.
+# If a copy of the MPL was not distributed with this file,
+# you can obtain one at http://mozilla.org/MPL/2.0/.
+# For further information see http://www.genivi.org/.
+
+# Run capic-server on the system bus while one client floods it with one-way
+# calls, and report the latencies of another client making synchronous calls
+# at the same time.  The run is repeated with calls of a normal method on the
+# bus and calls of a high priority method on the priority lane.
+#
+# Usage: run-lanes.sh [calls [flood]]
+
+calls=${1:-10000}
+flood=${2:-1000000}
+log=${TMPDIR:-/tmp}/capic-lanes-$$.log
+
+for option in "" "-i"; do
+    ./capic-server $option > "$log" 2>&1 &
+    server=$!
+    while ! grep -q "entering main loop" "$log"; do sleep 0.1; done
+
+    ./capic-client -o -m "$flood" > /dev/null 2>&1 &
+    neighbour=$!
+    sleep 0.5
+    ./capic-client -t $option -m "$calls" > "$log.client" 2>&1
+
+    kill -TERM "$neighbour" "$server"
+    wait "$neighbour" "$server"
+
+    echo "priority lane:           ${option:+yes}${option:-no}"
+    grep -E "messages per|latency" "$log.client"
+done
+
+rm -f "$log" "$log".*
@@ -0,0 +1,69 @@
+#!/bin/sh
+
+# SPDX license identifier: MPL-2.0
+# Copyright (C) 2016, Visteon Corp.
+# Author: Pavel Konopelko, pkonopel@visteon.com
+#
+# This file is part of Common API C
+#
+# This Source Code Form is subject to the terms of the
+# Mozilla Public License (MPL), version 2.0.
+# If a copy of the MPL was not distributed with this file,
+# you can obtain one at http://mozilla.org/MPL/2.0/.
+# For further information see http://www.genivi.org/.
+
+# Run capic-server in pre-fork mode with a given number of worker processes
+# and load it with concurrent peer-to-peer clients.  Prints aggregated
+# throughput and how connections were distributed across the workers,
+# then checks that workers serve many clients at a time: twice as many
+# clients as workers that stay connected are all served concurrently.
+#
+# Usage: run-workers.sh [workers [clients [messages]]]
+
+workers=${1:-4}
+clients=${2:-$workers}
+messages=${3:-10000}
+socket=${TMPDIR:-/tmp}/capic-perf-$$
+log=${TMPDIR:-/tmp}/capic-perf-$$.log
+
+./capic-server -l "$socket" -w "$workers" > "$log" 2>&1 &
+server=$!
+while [ ! -S "$socket" ]; do sleep 0.1; done
+
+pids=""
+for i in $(seq 1 "$clients"); do
+    ./capic-client -p -m "$messages" -a "unix:path=$socket" > "$log.$i" 2>&1 &
+    pids="$pids $!"
+done
+wait $pids
+
+hold=3
+holders=""
+start=$(date +%s.%N)
+for i in $(seq 1 $((workers * 2))); do
+    ./capic-client -m 1 -w "$hold" -a "unix:path=$socket" > /dev/null 2>&1 &
+    holders="$holders $!"
+done
+wait $holders
+stop=$(date +%s.%N)
+
+kill -TERM "$server"
+wait "$server"
+
+echo "workers:                 $workers"
+echo "clients:                 $clients"
+cat "$log".* | awk '/messages per \[s\]/ {sum += $4} END {print "messages per [s]:        " sum}'
+echo "connections per worker:"
+grep "accepted connection" "$log" | sort | uniq -c
+held=$(echo "$start $stop" | awk '{print $2 - $1}')
+echo "held clients took [s]:   $held"
+
+rm -f "$log" "$log".*
+
+# Served one at a time per worker, the holders would take at least 2 * hold
+if echo "$held $hold" | awk '{exit !($1 < $2 * 1.5)}'; then
+    echo "concurrent clients:      PASS"
+else
+    echo "concurrent clients:      FAIL"
+    exit 1
+fi
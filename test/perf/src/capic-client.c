@@ -16,6 +16,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <sys/resource.h>
 
 #include <systemd/sd-event.h>
 #include <capic/log.h>
@@ -33,30 +37,207 @@ static double out2, out3;
 static double out41, out42;
 static uint32_t out43;
 
+static struct cc_byte_buffer buffer_in, buffer_out;
+
+static struct cc_TestPerf_Sample *samples;
+static uint32_t samples_out;
+static double sum_out;
+
+static sd_event *event = NULL;
+static int broadcasts_expected = 0, broadcasts_received = 0;
+static bool writable = true;
+
+
+static void sampled_handler(
+    struct cc_client_TestPerf *instance, const char *channel, uint64_t sequence,
+    double value)
+{
+    assert(instance);
+    (void) channel;
+    (void) value;
+    /* Coalescing servers skip samples but always deliver the last one */
+    if (++broadcasts_received == broadcasts_expected ||
+        sequence + 1 == (uint64_t) broadcasts_expected)
+        sd_event_exit(event, 0);
+}
+
+static void writable_handler(void *data)
+{
+    (void) data;
+    writable = true;
+}
+
+static void availability_handler(struct cc_client_TestPerf *instance, bool available)
+{
+    (void) instance;
+    if (!available)
+        printf("server disappeared\n");
+}
+
+static long max_resident()
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return -1;
+    return usage.ru_maxrss;
+}
+
+static double elapsed_usec(const struct timespec *start)
+{
+    struct timespec stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    return (stop.tv_sec - start->tv_sec) * 1.0e+6 + (stop.tv_nsec - start->tv_nsec) / 1.0e+3;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void report_latencies(double *latencies, int count)
+{
+    qsort(latencies, count, sizeof(*latencies), &compare_latencies);
+    printf("latency p50 [us]:        %g\n", latencies[count / 2]);
+    printf("latency p99 [us]:        %g\n", latencies[count - 1 - count / 100]);
+    printf("latency max [us]:        %g\n", latencies[count - 1]);
+}
+
+/* Run the event loop until the backend accepts calls again */
+static int wait_writable()
+{
+    int result = 0;
+
+    writable = false;
+    while (!writable && result >= 0)
+        result = sd_event_run(event, (uint64_t) -1);
+    return result;
+}
+
+/* Count broadcasts on the channel and report the CPU time it took to receive them */
+static int receive_broadcasts(struct cc_client_TestPerf *instance, const char *channel)
+{
+    struct timespec start, stop;
+    double seconds;
+    int result;
+
+    result = cc_TestPerf_sampled_subscribe(instance, channel, &sampled_handler);
+    if (result < 0) {
+        printf("unable to subscribe to cc_TestPerf_sampled: %s\n", strerror(-result));
+        return result;
+    }
+    printf("subscribed to channel '%s'\n", channel);
+    fflush(stdout);
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    result = sd_event_loop(event);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+    cc_TestPerf_sampled_unsubscribe(instance);
+    if (result < 0) {
+        printf("unable to run event loop: %s\n", strerror(-result));
+        return result;
+    }
+    seconds = stop.tv_sec - start.tv_sec + (stop.tv_nsec - start.tv_nsec) / 1.0e+9;
+    printf("broadcasts received:     %d\n", broadcasts_received);
+    printf("broadcasts saved [%%]:    %g\n",
+           100.0 * (broadcasts_expected - broadcasts_received) / broadcasts_expected);
+    printf("CPU per broadcast [us]:  %g\n", seconds * 1.0e+6 / broadcasts_received);
+
+    return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
-    int message_count = 10000, message_payload = 0;
+    int message_count = 10000, message_payload = 0, buffer_size = -1;
+    int sample_count = -1, packed = 0, sum = 0, emit_count = -1, batch_size = 0, one_way = 0;
+    int write_high = 0, latency = 0, priority_lane = 0, hold_seconds = 0;
+    double *latencies = NULL;
+    struct timespec call_start;
+    const char *peer_address = NULL, *channel = "0";
     int option, result = 0;
     struct cc_event_context *context = NULL;
-    sd_event *event = NULL;
     struct cc_client_TestPerf *instance = NULL;
     struct timespec start, stop;
     double seconds;
     int counter;
 
-    while ((option = getopt(argc, argv, "m:p")) != -1) {
+    while ((option = getopt(argc, argv, "m:pn:oq:tib:s:kucr:e:f:a:w:")) != -1) {
         switch (option) {
         case 'm':
             message_count = atoi(optarg);
             break;
         case 'p':
-            message_payload = 1;
+            message_payload = 40;
+            break;
+        case 'n':
+            batch_size = atoi(optarg);
+            break;
+        case 'o':
+            one_way = 1;
+            break;
+        case 'q':
+            write_high = atoi(optarg);
+            break;
+        case 't':
+            latency = 1;
+            break;
+        case 'i':
+            priority_lane = 1;
+            break;
+        case 'b':
+            buffer_size = atoi(optarg);
+            break;
+        case 's':
+            sample_count = atoi(optarg);
+            break;
+        case 'k':
+            packed = 1;
+            break;
+        case 'u':
+            sum = 1;
+            break;
+        case 'c':
+            sum = 2;
+            break;
+        case 'r':
+            broadcasts_expected = atoi(optarg);
+            break;
+        case 'e':
+            emit_count = atoi(optarg);
+            break;
+        case 'f':
+            channel = optarg;
+            break;
+        case 'a':
+            peer_address = optarg;
+            break;
+        case 'w':
+            hold_seconds = atoi(optarg);
             break;
         default:
-            printf("Usage: %s [-m count] [-p]\n", argv[0]);
-            printf("-m count  send count messages\n");
-            printf("-p        send messages with payload\n");
+            printf("Usage: %s [-m count] [-p [-n size] | -o [-n size] | -b size | -s count [-k | -u | -c] | -r count | -e count] [-f channel] [-a address [-w seconds]]\n", argv[0]);
+            printf("-m count    send count messages\n");
+            printf("-p          send messages with payload\n");
+            printf("-o          send one-way messages\n");
+            printf("-n size     make the calls in batches of size per message\n");
+            printf("-q count    wait while count one-way messages are queued for writing\n");
+            printf("-t          report latencies of calls without arguments\n");
+            printf("-i          make high priority calls on a priority lane instead\n");
+            printf("-b size     send messages with byte buffer of size bytes\n");
+            printf("-s count    send messages with array of count structs, e.g. 10000\n");
+            printf("-k          send the array of structs as one block of bytes\n");
+            printf("-u          sum the array of structs on the server\n");
+            printf("-c          sum the array decoded into columns on the server\n");
+            printf("-r count    subscribe to broadcasts and wait for count of them\n");
+            printf("-e count    make the server broadcast count samples\n");
+            printf("-f channel  subscribe to or broadcast on channel, '0' by default\n");
+            printf("-a address  connect directly to server at address, e.g.\n");
+            printf("            unix:path=/tmp/capic-perf\n");
+            printf("-w seconds  stay connected for seconds after the test\n");
             return EXIT_FAILURE;
         }
     }
@@ -64,11 +245,21 @@ int main(int argc, char *argv[])
     CC_LOG_OPEN(argv[0]);
     printf("Started %s\n", argv[0]);
 
-    result = cc_backend_startup();
+    if (peer_address)
+        result = cc_backend_startup_peer(peer_address);
+    else
+        result = cc_backend_startup();
     if (result < 0) {
         printf("unable to startup the backend: %s\n", strerror(-result));
         goto fail;
     }
+    if (priority_lane) {
+        result = cc_backend_open_priority_lane();
+        if (result < 0) {
+            printf("unable to open priority lane: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
     result = cc_client_TestPerf_new(
         "org.genivi.capic.TestPerf:/instance:org.genivi.capic.TestPerf",
         NULL, &instance);
@@ -88,11 +279,216 @@ int main(int argc, char *argv[])
         goto fail;
     }
     sd_event_ref(event);
+    /* The server may still be starting up, which only tracked clients tell */
+    result = cc_client_TestPerf_set_availability_handler(instance, &availability_handler);
+    if (result < 0) {
+        printf("unable to track server availability: %s\n", strerror(-result));
+        goto fail;
+    }
+    while (!cc_client_TestPerf_is_available(instance)) {
+        result = sd_event_run(event, (uint64_t) -1);
+        if (result < 0) {
+            printf("unable to run event loop: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+
+    if (broadcasts_expected > 0) {
+        result = receive_broadcasts(instance, channel);
+        goto fail;
+    }
+    if (emit_count >= 0) {
+        result = cc_TestPerf_emitSamples(instance, channel, emit_count);
+        if (result < 0)
+            printf("failed while calling cc_TestPerf_emitSamples(): %s\n", strerror(-result));
+        else
+            printf("broadcasts sent:         %d\n", emit_count);
+        goto fail;
+    }
+
+    if (buffer_size >= 0) {
+        buffer_in.data = (const uint8_t *) calloc(1, buffer_size + 1);
+        buffer_in.size = buffer_size;
+        message_payload = buffer_size;
+        if (!buffer_in.data) {
+            result = -ENOMEM;
+            printf("unable to allocate byte buffer\n");
+            goto fail;
+        }
+    }
+
+    if (sample_count >= 0) {
+        samples = (struct cc_TestPerf_Sample *) calloc(sample_count + 1, sizeof(*samples));
+        message_payload = sample_count * sizeof(*samples);
+        if (!samples) {
+            result = -ENOMEM;
+            printf("unable to allocate samples\n");
+            goto fail;
+        }
+        for (counter = 0; counter < sample_count; ++counter) {
+            samples[counter].timestamp = counter;
+            samples[counter].value = counter * 0.5;
+            samples[counter].id = counter;
+            samples[counter].flags = counter % 2;
+        }
+    }
 
     printf("starting test...\n");
     clock_gettime(CLOCK_REALTIME, &start);
 
-    if (message_payload) {
+    if (samples && sum == 2) {
+        struct cc_TestPerf_Samples_columns in = {0};
+        uint64_t *timestamp = (uint64_t *) calloc(sample_count + 1, sizeof(*timestamp));
+        double *value = (double *) calloc(sample_count + 1, sizeof(*value));
+        int32_t *id = (int32_t *) calloc(sample_count + 1, sizeof(*id));
+        uint32_t *flags = (uint32_t *) calloc(sample_count + 1, sizeof(*flags));
+
+        if (!timestamp || !value || !id || !flags) {
+            result = -ENOMEM;
+            printf("unable to allocate sample columns\n");
+        }
+        for (counter = 0; result == 0 && counter < sample_count; ++counter) {
+            timestamp[counter] = samples[counter].timestamp;
+            value[counter] = samples[counter].value;
+            id[counter] = samples[counter].id;
+            flags[counter] = samples[counter].flags;
+        }
+        in.timestamp = timestamp;
+        in.value = value;
+        in.id = id;
+        in.flags = flags;
+        in.size = sample_count;
+        for (counter = message_count; result == 0 && counter > 0; --counter) {
+            result = cc_TestPerf_sumSampleColumns(instance, &in, &sum_out);
+            if (result < 0)
+                printf(
+                    "failed while calling cc_TestPerf_sumSampleColumns(): %s\n",
+                    strerror(-result));
+        }
+        free(timestamp);
+        free(value);
+        free(id);
+        free(flags);
+        if (result < 0)
+            goto fail;
+    } else if (samples && sum == 1) {
+        struct cc_TestPerf_Samples in = {samples, sample_count};
+
+        for (counter = message_count; counter > 0; --counter) {
+            result = cc_TestPerf_sumSamples(instance, &in, &sum_out);
+            if (result < 0) {
+                printf(
+                    "failed while calling cc_TestPerf_sumSamples(): %s\n",
+                    strerror(-result));
+                goto fail;
+            }
+        }
+    } else if (samples && packed) {
+        struct cc_TestPerf_PackedSamples in = {samples, sample_count};
+
+        for (counter = message_count; counter > 0; --counter) {
+            result = cc_TestPerf_takePackedSamples(instance, &in, &samples_out);
+            if (result < 0) {
+                printf(
+                    "failed while calling cc_TestPerf_takePackedSamples(): %s\n",
+                    strerror(-result));
+                goto fail;
+            }
+            assert(samples_out == in.size);
+        }
+    } else if (samples) {
+        struct cc_TestPerf_Samples in = {samples, sample_count};
+
+        for (counter = message_count; counter > 0; --counter) {
+            result = cc_TestPerf_takeSamples(instance, &in, &samples_out);
+            if (result < 0) {
+                printf(
+                    "failed while calling cc_TestPerf_takeSamples(): %s\n",
+                    strerror(-result));
+                goto fail;
+            }
+            assert(samples_out == in.size);
+        }
+    } else if (buffer_in.data) {
+        for (counter = message_count; counter > 0; --counter) {
+            result = cc_TestPerf_takeByteBuffer(instance, buffer_in, &buffer_out);
+            if (result < 0) {
+                printf(
+                    "failed while calling cc_TestPerf_takeByteBuffer(): %s\n",
+                    strerror(-result));
+                goto fail;
+            }
+            assert(buffer_out.size == buffer_in.size);
+        }
+    } else if (one_way) {
+        if (write_high > 0) {
+            result = cc_backend_set_write_watermarks(
+                write_high, write_high / 2, &writable_handler, NULL);
+            if (result < 0) {
+                printf("unable to set write watermarks: %s\n", strerror(-result));
+                goto fail;
+            }
+        }
+        for (counter = 0; counter < message_count; ++counter) {
+            /* One-way calls made while corked go out in batches */
+            if (batch_size > 0 && counter % batch_size == 0)
+                cc_backend_cork();
+            result = cc_TestPerf_takeOneWay(instance, counter);
+            while (result == -EAGAIN) {
+                result = wait_writable();
+                if (result >= 0)
+                    result = cc_TestPerf_takeOneWay(instance, counter);
+            }
+            if (result >= 0 && batch_size > 0 &&
+                (counter % batch_size == batch_size - 1 || counter == message_count - 1))
+                result = cc_backend_uncork();
+            if (result < 0) {
+                printf(
+                    "failed while calling cc_TestPerf_takeOneWay(): %s\n",
+                    strerror(-result));
+                goto fail;
+            }
+        }
+        /* Calls on one instance are processed in order, so this waits for all of them */
+        result = cc_TestPerf_takeNoArgs(instance);
+        if (result < 0) {
+            printf("failed while calling cc_TestPerf_takeNoArgs(): %s\n", strerror(-result));
+            goto fail;
+        }
+    } else if (message_payload && batch_size > 0) {
+        struct cc_TestPerf_take40ByteArgs_in *batch_in;
+        struct cc_TestPerf_take40ByteArgs_out *batch_out;
+        int size;
+
+        batch_in = (struct cc_TestPerf_take40ByteArgs_in *) calloc(batch_size, sizeof(*batch_in));
+        batch_out = (struct cc_TestPerf_take40ByteArgs_out *) calloc(batch_size, sizeof(*batch_out));
+        if (!batch_in || !batch_out) {
+            result = -ENOMEM;
+            printf("unable to allocate batch\n");
+        }
+        for (counter = 0; result == 0 && counter < batch_size; ++counter) {
+            batch_in[counter].in1 = in1 + counter;
+            batch_in[counter].in2 = in2;
+            batch_in[counter].in3 = in3;
+            batch_in[counter].in41 = in41;
+            batch_in[counter].in42 = in42;
+            batch_in[counter].in43 = in43;
+        }
+        for (counter = message_count; result == 0 && counter > 0; counter -= size) {
+            size = counter < batch_size ? counter : batch_size;
+            result = cc_TestPerf_take40ByteArgs_batch(instance, size, batch_in, batch_out);
+            if (result < 0)
+                printf(
+                    "failed while calling cc_TestPerf_take40ByteArgs_batch(): %s\n",
+                    strerror(-result));
+            else
+                assert(batch_out[size - 1].out1 == batch_in[size - 1].in1);
+        }
+        free(batch_in);
+        free(batch_out);
+        if (result < 0)
+            goto fail;
+    } else if (message_payload) {
         for (counter = message_count; counter > 0; --counter) {
             result = cc_TestPerf_take40ByteArgs(
                 instance, in1, in2, in3, in41, in42, in43,
@@ -111,27 +507,61 @@ int main(int argc, char *argv[])
             in43 = out43;
         }
     } else {
-        for (counter = message_count; counter > 0; --counter) {
-            result = cc_TestPerf_takeNoArgs(instance);
+        if (latency) {
+            latencies = (double *) calloc(message_count, sizeof(*latencies));
+            if (!latencies) {
+                result = -ENOMEM;
+                printf("unable to allocate latencies\n");
+                goto fail;
+            }
+        }
+        for (counter = 0; counter < message_count; ++counter) {
+            if (latencies)
+                clock_gettime(CLOCK_MONOTONIC, &call_start);
+            if (priority_lane)
+                result = cc_TestPerf_takeControl(instance);
+            else
+                result = cc_TestPerf_takeNoArgs(instance);
             if (result < 0) {
                 printf(
-                    "failed while calling cc_TestPerf_takeNoArgs(): %s\n",
-                    strerror(-result));
+                    "failed while calling cc_TestPerf_%s(): %s\n",
+                    priority_lane ? "takeControl" : "takeNoArgs", strerror(-result));
                 goto fail;
             }
+            if (latencies)
+                latencies[counter] = elapsed_usec(&call_start);
         }
     }
 
     clock_gettime(CLOCK_REALTIME, &stop);
     seconds = stop.tv_sec - start.tv_sec + (stop.tv_nsec - start.tv_nsec) / 1.0e+9;
     printf("test completed\n");
-    printf("message payload [bytes]: %d\n", message_payload ? 40 : 0);
-    printf("sync messages sent:      %d\n", message_count);
-    printf("messages per [s]:        %g\n", message_count / seconds);
+    printf("message payload [bytes]: %d\n", message_payload);
+    if (one_way) {
+        printf("calls per message:       %d\n", batch_size > 0 ? batch_size : 1);
+        printf("one-way calls made:      %d\n", message_count);
+        printf("calls per [s]:           %g\n", message_count / seconds);
+        printf("max resident [KiB]:      %ld\n", max_resident());
+    } else if (message_payload && batch_size > 0) {
+        printf("calls per message:       %d\n", batch_size);
+        printf("sync calls made:         %d\n", message_count);
+        printf("calls per [s]:           %g\n", message_count / seconds);
+    } else {
+        printf("sync messages sent:      %d\n", message_count);
+        printf("messages per [s]:        %g\n", message_count / seconds);
+        if (latencies && message_count > 0)
+            report_latencies(latencies, message_count);
+    }
+    /* Keeps the server worker that accepted the connection busy */
+    if (hold_seconds > 0)
+        sleep(hold_seconds);
 
 fail:
     instance = cc_client_TestPerf_free(instance);
     cc_backend_shutdown();
+    free((void *) buffer_in.data);
+    free(samples);
+    free(latencies);
 
     CC_LOG_CLOSE();
     printf("exiting capic-client\n");
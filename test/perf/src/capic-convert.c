@@ -0,0 +1,189 @@
+/* SPDX license identifier: MPL-2.0
+ * Copyright (C) 2016, Visteon Corp.
+ * Author: Pavel Konopelko, pkonopel@visteon.com
+ *
+ * This file is part of Common API C
+ *
+ * This Source Code Form is subject to the terms of the
+ * Mozilla Public License (MPL), version 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * you can obtain one at http://mozilla.org/MPL/2.0/.
+ * For further information see http://www.genivi.org/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <capic/convert.h>
+
+
+static bool *bools;
+static uint32_t *wire_bools;
+static float *floats;
+static double *wire_floats;
+
+
+/* Element by element conversions as done for scalar arguments, kept scalar on purpose */
+__attribute__ ((noinline, optimize("no-tree-vectorize")))
+static void loop_pack_bools(uint32_t *wire, const bool *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+        wire[i] = data[i];
+}
+
+__attribute__ ((noinline, optimize("no-tree-vectorize")))
+static int loop_unpack_bools(bool *data, const uint32_t *wire, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        if (wire[i] > 1)
+            return -EBADMSG;
+        data[i] = wire[i];
+    }
+    return 0;
+}
+
+__attribute__ ((noinline, optimize("no-tree-vectorize")))
+static void loop_pack_floats(double *wire, const float *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+        wire[i] = data[i];
+}
+
+__attribute__ ((noinline, optimize("no-tree-vectorize")))
+static void loop_unpack_floats(float *data, const double *wire, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+        data[i] = (float) wire[i];
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    return stop.tv_sec - start->tv_sec + (stop.tv_nsec - start->tv_nsec) / 1.0e+9;
+}
+
+static void report(const char *name, double loop, double kernel, double elements)
+{
+    printf(
+        "%-14s loop [ns/element]: %8.3f  kernel [ns/element]: %8.3f  speedup: %6.2f\n",
+        name, loop * 1.0e+9 / elements, kernel * 1.0e+9 / elements, loop / kernel);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int element_count = 4096, iteration_count = 10000;
+    int option, counter, result = 0;
+    struct timespec start;
+    double loop, kernel, elements;
+    size_t i;
+
+    while ((option = getopt(argc, argv, "n:m:")) != -1) {
+        switch (option) {
+        case 'n':
+            element_count = atoi(optarg);
+            break;
+        case 'm':
+            iteration_count = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-n count] [-m count]\n", argv[0]);
+            printf("-n count    convert arrays of count elements\n");
+            printf("-m count    convert every array count times\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (element_count <= 0 || iteration_count <= 0) {
+        printf("invalid element or iteration count\n");
+        return EXIT_FAILURE;
+    }
+
+    bools = (bool *) calloc(element_count, sizeof(*bools));
+    wire_bools = (uint32_t *) calloc(element_count, sizeof(*wire_bools));
+    floats = (float *) calloc(element_count, sizeof(*floats));
+    wire_floats = (double *) calloc(element_count, sizeof(*wire_floats));
+    if (!bools || !wire_bools || !floats || !wire_floats) {
+        printf("unable to allocate arrays\n");
+        result = -ENOMEM;
+        goto fail;
+    }
+    for (i = 0; i < (size_t) element_count; ++i) {
+        bools[i] = i % 3 == 0;
+        floats[i] = i * 0.25f;
+    }
+    elements = (double) element_count * iteration_count;
+
+    printf("starting test...\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        loop_pack_bools(wire_bools, bools, element_count);
+    loop = elapsed(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        cc_pack_bools(wire_bools, bools, element_count);
+    kernel = elapsed(&start);
+    report("pack bools", loop, kernel, elements);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0 && result == 0; --counter)
+        result = loop_unpack_bools(bools, wire_bools, element_count);
+    loop = elapsed(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0 && result == 0; --counter)
+        result = cc_unpack_bools(bools, wire_bools, element_count);
+    kernel = elapsed(&start);
+    if (result < 0) {
+        printf("failed to unpack booleans: %s\n", strerror(-result));
+        goto fail;
+    }
+    report("unpack bools", loop, kernel, elements);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        loop_pack_floats(wire_floats, floats, element_count);
+    loop = elapsed(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        cc_pack_floats(wire_floats, floats, element_count);
+    kernel = elapsed(&start);
+    report("pack floats", loop, kernel, elements);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        loop_unpack_floats(floats, wire_floats, element_count);
+    loop = elapsed(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (counter = iteration_count; counter > 0; --counter)
+        cc_unpack_floats(floats, wire_floats, element_count);
+    kernel = elapsed(&start);
+    report("unpack floats", loop, kernel, elements);
+
+    printf("test completed\n");
+    printf("elements per array:      %d\n", element_count);
+    printf("conversions per array:   %d\n", iteration_count);
+
+fail:
+    free(bools);
+    free(wire_bools);
+    free(floats);
+    free(wire_floats);
+
+    return result < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -14,11 +14,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
 #include <assert.h>
 
 #include <systemd/sd-event.h>
 #include <capic/log.h>
 #include <capic/backend.h>
+#include <capic/memory.h>
 #include "src-gen/server-TestPerf.h"
 
 
@@ -29,6 +34,13 @@ static int TestPerf_impl_takeNoArgs(struct cc_server_TestPerf *instance)
     return 0;
 }
 
+static int TestPerf_impl_takeControl(struct cc_server_TestPerf *instance)
+{
+    CC_LOG_DEBUG("invoked method TestPerf_impl_takeControl()\n");
+    assert(instance);
+    return 0;
+}
+
 static int TestPerf_impl_take40ByteArgs(
     struct cc_server_TestPerf *instance,
     int32_t in1, double in2, double in3, double in41, double in42, uint32_t in43,
@@ -45,11 +57,336 @@ static int TestPerf_impl_take40ByteArgs(
     return 0;
 }
 
+static int TestPerf_impl_takeOneWay(struct cc_server_TestPerf *instance, uint64_t sequence)
+{
+    CC_LOG_DEBUG("invoked method TestPerf_impl_takeOneWay()\n");
+    assert(instance);
+    (void) sequence;
+    return 0;
+}
+
+static int TestPerf_impl_takeByteBuffer(
+    struct cc_server_TestPerf *instance, struct cc_byte_buffer in1,
+    struct cc_byte_buffer *out1)
+{
+    CC_LOG_DEBUG("invoked method TestPerf_impl_takeByteBuffer()\n");
+    assert(instance);
+    /* The request message outlives the reply, so the buffer is echoed without copying */
+    *out1 = in1;
+    return 0;
+}
+
+static int TestPerf_impl_takeSamples(
+    struct cc_server_TestPerf *instance, const struct cc_TestPerf_Samples *in1,
+    uint32_t *out1)
+{
+    CC_LOG_DEBUG("invoked method TestPerf_impl_takeSamples()\n");
+    assert(instance);
+    *out1 = in1->size;
+    return 0;
+}
+
+static int TestPerf_impl_takePackedSamples(
+    struct cc_server_TestPerf *instance, const struct cc_TestPerf_PackedSamples *in1,
+    uint32_t *out1)
+{
+    CC_LOG_DEBUG("invoked method TestPerf_impl_takePackedSamples()\n");
+    assert(instance);
+    *out1 = in1->size;
+    return 0;
+}
+
+/* The same kernel over an array of structs and over struct-of-arrays columns */
+static int TestPerf_impl_sumSamples(
+    struct cc_server_TestPerf *instance, const struct cc_TestPerf_Samples *in1,
+    double *out1)
+{
+    double sum = 0.0;
+    size_t i;
+
+    CC_LOG_DEBUG("invoked method TestPerf_impl_sumSamples()\n");
+    assert(instance);
+    for (i = 0; i < in1->size; ++i)
+        sum += in1->data[i].value * (double) in1->data[i].flags;
+    *out1 = sum;
+    return 0;
+}
+
+static int TestPerf_impl_sumSampleColumns(
+    struct cc_server_TestPerf *instance, const struct cc_TestPerf_Samples_columns *in1,
+    double *out1)
+{
+    const double *value = __builtin_assume_aligned(in1->value, CC_COLUMN_ALIGNMENT);
+    const uint32_t *flags = __builtin_assume_aligned(in1->flags, CC_COLUMN_ALIGNMENT);
+    double sum = 0.0;
+    size_t i;
+
+    CC_LOG_DEBUG("invoked method TestPerf_impl_sumSampleColumns()\n");
+    assert(instance);
+    for (i = 0; i < in1->size; ++i)
+        sum += value[i] * (double) flags[i];
+    *out1 = sum;
+    return 0;
+}
+
+/* Synthetic producer that emits samples from a timer at a fixed rate */
+static unsigned int emit_rate = 0;
+static struct {
+    struct cc_server_TestPerf *instance;
+    char channel[64];
+    uint32_t sequence;
+    uint32_t count;
+    sd_event_source *timer;
+} producer = {0};
+
+static int producer_handler(sd_event_source *source, uint64_t usec, void *user_data)
+{
+    int result;
+
+    CC_LOG_DEBUG("invoked producer_handler()\n");
+    (void) user_data;
+    result = cc_TestPerf_sampled_emit(
+        producer.instance, producer.channel, producer.sequence, producer.sequence * 0.5);
+    if (result < 0)
+        CC_LOG_ERROR("unable to emit sample: %s\n", strerror(-result));
+    if (++producer.sequence == producer.count)
+        return 0;
+    /* Falling behind shortens the following periods, keeping the average rate */
+    result = sd_event_source_set_time(source, usec + 1000000 / emit_rate);
+    if (result >= 0)
+        result = sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+    if (result < 0)
+        CC_LOG_ERROR("unable to rearm producer timer: %s\n", strerror(-result));
+
+    return 0;
+}
+
+static int start_producer(
+    struct cc_server_TestPerf *instance, const char *channel, uint32_t count)
+{
+    struct cc_event_context *context;
+    sd_event *event;
+    uint64_t now;
+    int result;
+
+    if (producer.sequence < producer.count)
+        return -EBUSY;
+    producer.instance = instance;
+    snprintf(producer.channel, sizeof(producer.channel), "%s", channel);
+    producer.sequence = 0;
+    producer.count = count;
+    if (count == 0)
+        return 0;
+
+    result = cc_backend_get_event_context(&context);
+    if (result < 0)
+        return result;
+    event = (sd_event *) cc_event_get_native(context);
+    result = sd_event_now(event, CLOCK_MONOTONIC, &now);
+    if (result < 0)
+        return result;
+    if (producer.timer) {
+        result = sd_event_source_set_time(producer.timer, now);
+        if (result >= 0)
+            result = sd_event_source_set_enabled(producer.timer, SD_EVENT_ONESHOT);
+    } else {
+        result = sd_event_add_time(
+            event, &producer.timer, CLOCK_MONOTONIC, now, 1, &producer_handler, NULL);
+    }
+
+    return result;
+}
+
+/* Subscribers filter on the channel, so the bus only delivers them their own */
+static int TestPerf_impl_emitSamples(
+    struct cc_server_TestPerf *instance, const char *channel, uint32_t count)
+{
+    int result;
+    uint32_t i;
+
+    CC_LOG_DEBUG("invoked method TestPerf_impl_emitSamples()\n");
+    assert(instance);
+    if (emit_rate > 0)
+        return start_producer(instance, channel, count);
+    for (i = 0; i < count; ++i) {
+        result = cc_TestPerf_sampled_emit(instance, channel, i, i * 0.5);
+        if (result < 0)
+            return result;
+    }
+    return 0;
+}
+
 static struct cc_server_TestPerf_impl impl = {
     .takeNoArgs = &TestPerf_impl_takeNoArgs,
-    .take40ByteArgs = &TestPerf_impl_take40ByteArgs
+    .takeControl = &TestPerf_impl_takeControl,
+    .take40ByteArgs = &TestPerf_impl_take40ByteArgs,
+    .takeByteBuffer = &TestPerf_impl_takeByteBuffer,
+    .takeSamples = &TestPerf_impl_takeSamples,
+    .takePackedSamples = &TestPerf_impl_takePackedSamples,
+    .sumSamples = &TestPerf_impl_sumSamples,
+    .sumSampleColumns = &TestPerf_impl_sumSampleColumns,
+    .takeOneWay = &TestPerf_impl_takeOneWay,
+    .emitSamples = &TestPerf_impl_emitSamples
 };
 
+static const char *instance_address =
+    "org.genivi.capic.TestPerf:/instance:org.genivi.capic.TestPerf";
+
+/* Calls are refused while more than this many bytes wait to be read */
+static uint64_t read_backlog = 0;
+
+/* Every peer connection of a worker process is served with its own instance */
+static int worker_init(unsigned int worker, void *data, void **peer)
+{
+    struct cc_server_TestPerf *instance = NULL;
+    int result;
+
+    CC_LOG_DEBUG("invoked worker_init() for worker %u\n", worker);
+    (void) data;
+    printf("worker %u accepted connection\n", worker);
+    fflush(stdout);
+    result = cc_backend_set_read_backlog(read_backlog);
+    if (result < 0) {
+        printf("unable to set read backlog: %s\n", strerror(-result));
+        return result;
+    }
+    result = cc_server_TestPerf_new(instance_address, &impl, NULL, &instance);
+    if (result < 0) {
+        printf("unable to create server instance '/instance': %s\n", strerror(-result));
+        return result;
+    }
+    *peer = instance;
+
+    return result;
+}
+
+static void worker_fini(unsigned int worker, void *data, void *peer)
+{
+    CC_LOG_DEBUG("invoked worker_fini() for worker %u\n", worker);
+    (void) data;
+    cc_server_TestPerf_free((struct cc_server_TestPerf *) peer);
+}
+
+/* Objects served in addition to '/instance' to benchmark startup time and memory */
+static const char *objects_prefix = "/objects/";
+static unsigned int object_count = 0;
+static struct cc_server_TestPerf **objects = NULL;
+static struct cc_server_TestPerf_family *family = NULL;
+
+static int family_lookup(
+    struct cc_server_TestPerf_family *family, const char *path, void **data)
+{
+    size_t prefix_size = strlen(objects_prefix);
+    unsigned long index;
+    char *end;
+
+    CC_LOG_DEBUG("invoked family_lookup()\n");
+    assert(family);
+    if (strncmp(path, objects_prefix, prefix_size) != 0)
+        return 0;
+    index = strtoul(path + prefix_size, &end, 10);
+    if (end == path + prefix_size || *end != '\0' || index >= object_count)
+        return 0;
+    *data = (void *) (uintptr_t) index;
+
+    return 1;
+}
+
+static int family_enumerate(struct cc_server_TestPerf_family *family, char ***paths)
+{
+    char **p;
+    char path[64];
+    unsigned int index;
+
+    CC_LOG_DEBUG("invoked family_enumerate()\n");
+    assert(family);
+    p = (char **) calloc(object_count + 1, sizeof(*p));
+    if (!p)
+        return -ENOMEM;
+    for (index = 0; index < object_count; ++index) {
+        snprintf(path, sizeof(path), "%s%u", objects_prefix, index);
+        p[index] = strdup(path);
+        if (!p[index]) {
+            for (; index > 0; --index)
+                free(p[index - 1]);
+            free(p);
+            return -ENOMEM;
+        }
+    }
+    *paths = p;
+
+    return 0;
+}
+
+static long resident_set_kbytes()
+{
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm) {
+        if (fscanf(statm, "%*d %ld", &pages) != 1)
+            pages = 0;
+        fclose(statm);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int create_objects(bool use_family)
+{
+    struct timespec start, stop;
+    long rss_before = resident_set_kbytes();
+    char address[128];
+    unsigned int index;
+    int result = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (use_family) {
+        result = cc_server_TestPerf_family_new(
+            "org.genivi.capic.TestPerf:/objects:org.genivi.capic.TestPerf",
+            &impl, &family_lookup, &family_enumerate, NULL, &family);
+        if (result < 0) {
+            printf("unable to create server family '/objects': %s\n", strerror(-result));
+            return result;
+        }
+    } else {
+        objects = (struct cc_server_TestPerf **) calloc(object_count, sizeof(*objects));
+        if (!objects)
+            return -ENOMEM;
+        for (index = 0; index < object_count; ++index) {
+            snprintf(
+                address, sizeof(address), "org.genivi.capic.TestPerf:%s%u:org.genivi.capic.TestPerf",
+                objects_prefix, index);
+            result = cc_server_TestPerf_new(address, &impl, NULL, &objects[index]);
+            if (result < 0) {
+                printf("unable to create server instance '%s': %s\n", address, strerror(-result));
+                return result;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    printf("objects served as:       %s\n", use_family ? "family" : "instances");
+    printf("objects created:         %u\n", object_count);
+    printf("startup time [s]:        %g\n",
+           stop.tv_sec - start.tv_sec + (stop.tv_nsec - start.tv_nsec) / 1.0e+9);
+    printf("resident memory [kB]:    %ld\n", resident_set_kbytes() - rss_before);
+
+    return result;
+}
+
+static void free_objects()
+{
+    unsigned int index;
+
+    family = cc_server_TestPerf_family_free(family);
+    if (objects) {
+        for (index = 0; index < object_count; ++index)
+            objects[index] = cc_server_TestPerf_free(objects[index]);
+        free(objects);
+        objects = NULL;
+    }
+}
+
 static int signal_handler(
     sd_event_source *source, const struct signalfd_siginfo *signal_info, void *user_data)
 {
@@ -104,23 +441,104 @@ int main(int argc, char* argv[])
     struct cc_event_context *context = NULL;
     sd_event *event = NULL;
     struct cc_server_TestPerf *instance = NULL;
-    (void) argc;
+    const char *socket_path = NULL;
+    int worker_count = 1;
+    bool use_family = false;
+    int fair_queued = 0;
+    bool priority_lane = false;
+    uint64_t window = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "l:w:o:fz:c:q:s:i")) != -1) {
+        switch (option) {
+        case 'l':
+            socket_path = optarg;
+            break;
+        case 'w':
+            worker_count = atoi(optarg);
+            break;
+        case 'o':
+            object_count = atoi(optarg);
+            break;
+        case 'f':
+            use_family = true;
+            break;
+        case 'z':
+            emit_rate = atoi(optarg);
+            break;
+        case 'c':
+            window = strtoull(optarg, NULL, 10);
+            break;
+        case 'q':
+            read_backlog = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            fair_queued = atoi(optarg);
+            break;
+        case 'i':
+            priority_lane = true;
+            break;
+        default:
+            printf("Usage: %s [-l path [-w count]] [-o count [-f]] [-z rate] [-c usec] [-q bytes] [-s count] [-i]\n", argv[0]);
+            printf("-l path   serve peer-to-peer connections on socket path\n");
+            printf("-w count  pre-fork count worker processes\n");
+            printf("-o count  serve count additional objects below '/objects'\n");
+            printf("-f        serve additional objects as one object family\n");
+            printf("-z rate   emit broadcasts at rate per second instead of all at once\n");
+            printf("-c usec   coalesce broadcasts emitted within windows of usec\n");
+            printf("-q bytes  refuse calls while more than bytes wait to be read\n");
+            printf("-s count  serve senders in turn, queueing up to count calls each\n");
+            printf("-i        serve high priority methods on a priority lane\n");
+            return EXIT_FAILURE;
+        }
+    }
 
     CC_LOG_OPEN(argv[0]);
     printf("Started %s\n", argv[0]);
 
+    if (socket_path) {
+        printf("serving %s with %d workers...\n", socket_path, worker_count);
+        result = cc_workers_run(socket_path, worker_count, &worker_init, &worker_fini, NULL);
+        if (result < 0)
+            printf("unable to run workers: %s\n", strerror(-result));
+        goto fail;
+    }
+
     result = cc_backend_startup();
     if (result < 0) {
         printf("unable to startup backend: %s\n", strerror(-result));
         goto fail;
     }
-    result = cc_server_TestPerf_new(
-        "org.genivi.capic.TestPerf:/instance:org.genivi.capic.TestPerf",
-        &impl, NULL, &instance);
+    result = cc_backend_set_read_backlog(read_backlog);
+    if (result < 0) {
+        printf("unable to set read backlog: %s\n", strerror(-result));
+        goto fail;
+    }
+    if (fair_queued > 0) {
+        result = cc_backend_set_fair_queuing(fair_queued);
+        if (result < 0) {
+            printf("unable to set fair queuing: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+    if (priority_lane) {
+        result = cc_backend_open_priority_lane();
+        if (result < 0) {
+            printf("unable to open priority lane: %s\n", strerror(-result));
+            goto fail;
+        }
+    }
+    result = cc_server_TestPerf_new(instance_address, &impl, NULL, &instance);
     if (result < 0) {
         printf("unable to create server instance '/instance': %s\n", strerror(-result));
         goto fail;
     }
+    cc_TestPerf_sampled_set_window(instance, window);
+    if (object_count > 0) {
+        result = create_objects(use_family);
+        if (result < 0)
+            goto fail;
+    }
 
     result = cc_backend_get_event_context(&context);
     if (result < 0) {
@@ -144,8 +562,10 @@ int main(int argc, char* argv[])
     }
 
 fail:
+    producer.timer = sd_event_source_unref(producer.timer);
     if (event)
         sd_event_unref(event);
+    free_objects();
     instance = cc_server_TestPerf_free(instance);
     cc_backend_shutdown();
 
@@ -14,13 +14,31 @@
  */
 package org.genivi.capic.core;
 
+import java.math.BigInteger;
+
 import org.eclipse.emf.common.util.BasicEList;
 import org.eclipse.emf.common.util.EList;
+import org.franca.core.franca.FAnnotation;
+import org.franca.core.franca.FAnnotationBlock;
 import org.franca.core.franca.FArgument;
+import org.franca.core.franca.FArrayType;
+import org.franca.core.franca.FAttribute;
 import org.franca.core.franca.FBasicTypeId;
+import org.franca.core.franca.FBroadcast;
+import org.franca.core.franca.FEnumerationType;
+import org.franca.core.franca.FEnumerator;
+import org.franca.core.franca.FField;
+import org.franca.core.franca.FIntegerConstant;
 import org.franca.core.franca.FInterface;
+import org.franca.core.franca.FMapType;
 import org.franca.core.franca.FMethod;
+import org.franca.core.franca.FModelElement;
+import org.franca.core.franca.FOperator;
+import org.franca.core.franca.FStructType;
+import org.franca.core.franca.FType;
 import org.franca.core.franca.FTypeRef;
+import org.franca.core.franca.FUnaryOperation;
+import org.franca.core.franca.FUnionType;
 import org.franca.core.franca.FrancaFactory;
 
 public class MockFModel {
@@ -46,6 +64,29 @@ public class MockFModel {
         api.eSet(api.eClass().getEStructuralFeature("methods"), ms);
     }
 
+    public static FInterface makeInterface(String name, Iterable<FMethod> methods, Iterable<FType> types) {
+        FInterface result = makeInterface(name, methods);
+        for (FType t : types)
+            result.getTypes().add(t);
+        return result;
+    }
+
+    public static FInterface makeInterface(String name, Iterable<FMethod> methods, Iterable<FType> types, Iterable<FBroadcast> broadcasts) {
+        FInterface result = makeInterface(name, methods, types);
+        for (FBroadcast b : broadcasts)
+            result.getBroadcasts().add(b);
+        return result;
+    }
+
+    public static FInterface makeInterface(
+            String name, Iterable<FMethod> methods, Iterable<FType> types, Iterable<FBroadcast> broadcasts,
+            Iterable<FAttribute> attributes) {
+        FInterface result = makeInterface(name, methods, types, broadcasts);
+        for (FAttribute a : attributes)
+            result.getAttributes().add(a);
+        return result;
+    }
+
     public static FMethod makeMethod(String name) {
         return makeMethod(name, (Iterable<FArgument>)null, (Iterable<FArgument>)null, false);
     }
@@ -74,6 +115,32 @@ public class MockFModel {
         return result;
     }
 
+    public static FBroadcast makeBroadcast(String name, Iterable<FArgument> outArgs) {
+        return makeBroadcast(name, outArgs, false);
+    }
+
+    public static FBroadcast makeBroadcast(String name, Iterable<FArgument> outArgs, boolean isSelective) {
+        FBroadcast result = FrancaFactory.eINSTANCE.createFBroadcast();
+        result.setName(name);
+        if (outArgs != null)
+            result.eSet(result.eClass().getEStructuralFeature("outArgs"), makeArgList(outArgs));
+        result.setSelective(isSelective);
+        return result;
+    }
+
+    public static FAttribute makeAttribute(String name, FTypeRef typeRef) {
+        return makeAttribute(name, typeRef, false, false);
+    }
+
+    public static FAttribute makeAttribute(String name, FTypeRef typeRef, boolean isReadonly, boolean isNoSubscriptions) {
+        FAttribute result = FrancaFactory.eINSTANCE.createFAttribute();
+        result.setName(name);
+        result.setType(typeRef);
+        result.setReadonly(isReadonly);
+        result.setNoSubscriptions(isNoSubscriptions);
+        return result;
+    }
+
     public static EList<FArgument> makeArgList(Iterable<FArgument> args) {
         BasicEList<FArgument> result = new BasicEList<FArgument>();
         if (args == null)
@@ -103,4 +170,92 @@ public class MockFModel {
         result.eSet(result.eClass().getEStructuralFeature("predefined"), typeId);
         return result;
     }
+
+    public static FTypeRef makeTypeRef(FType type) {
+        FTypeRef result = makeTypeRef();
+        result.setDerived(type);
+        return result;
+    }
+
+    public static FField makeField(FBasicTypeId typeId, String name) {
+        return makeField(makeTypeRef(typeId), name);
+    }
+
+    public static FField makeField(FTypeRef typeRef, String name) {
+        FField result = FrancaFactory.eINSTANCE.createFField();
+        result.setName(name);
+        result.setType(typeRef);
+        return result;
+    }
+
+    public static FStructType makeStruct(String name, Iterable<FField> fields) {
+        FStructType result = FrancaFactory.eINSTANCE.createFStructType();
+        result.setName(name);
+        for (FField f : fields)
+            result.getElements().add(f);
+        return result;
+    }
+
+    public static FArrayType makeArray(String name, FTypeRef elementType) {
+        FArrayType result = FrancaFactory.eINSTANCE.createFArrayType();
+        result.setName(name);
+        result.setElementType(elementType);
+        return result;
+    }
+
+    public static FMapType makeMap(String name, FTypeRef keyType, FTypeRef valueType) {
+        FMapType result = FrancaFactory.eINSTANCE.createFMapType();
+        result.setName(name);
+        result.setKeyType(keyType);
+        result.setValueType(valueType);
+        return result;
+    }
+
+    public static FEnumerator makeEnumerator(String name) {
+        FEnumerator result = FrancaFactory.eINSTANCE.createFEnumerator();
+        result.setName(name);
+        return result;
+    }
+
+    public static FEnumerator makeEnumerator(String name, long value) {
+        FEnumerator result = makeEnumerator(name);
+        FIntegerConstant constant = FrancaFactory.eINSTANCE.createFIntegerConstant();
+        constant.setVal(BigInteger.valueOf(Math.abs(value)));
+        if (value >= 0) {
+            result.setValue(constant);
+        } else {
+            FUnaryOperation negation = FrancaFactory.eINSTANCE.createFUnaryOperation();
+            negation.setOp(FOperator.SUBTRACTION);
+            negation.setOperand(constant);
+            result.setValue(negation);
+        }
+        return result;
+    }
+
+    public static FEnumerationType makeEnumeration(String name, Iterable<FEnumerator> enumerators) {
+        FEnumerationType result = FrancaFactory.eINSTANCE.createFEnumerationType();
+        result.setName(name);
+        for (FEnumerator e : enumerators)
+            result.getEnumerators().add(e);
+        return result;
+    }
+
+    public static FUnionType makeUnion(String name, Iterable<FField> fields) {
+        FUnionType result = FrancaFactory.eINSTANCE.createFUnionType();
+        result.setName(name);
+        for (FField f : fields)
+            result.getElements().add(f);
+        return result;
+    }
+
+    public static <T extends FModelElement> T annotate(T element, String details) {
+        if (element.getComment() == null) {
+            FAnnotationBlock block = FrancaFactory.eINSTANCE.createFAnnotationBlock();
+            element.setComment(block);
+        }
+        FAnnotation annotation = FrancaFactory.eINSTANCE.createFAnnotation();
+        annotation.setRawText("@details: " + details);
+        element.getComment().getElements().add(annotation);
+        return element;
+    }
 }
@@ -25,6 +25,7 @@ import org.eclipse.xtext.junit4.InjectWith
 import org.franca.core.dsl.FrancaIDLTestsInjectorProvider
 import org.franca.core.franca.FBasicTypeId
 import org.franca.core.franca.FArgument
+import org.franca.core.franca.FInterface
 import org.franca.core.franca.FMethod
 import org.genivi.capic.core.XGenerator
 import org.hamcrest.Matcher
@@ -40,6 +41,20 @@ class XGeneratorTest {
 		Assert.assertThat("", s.toString(), matcher)
 	}
 
+	/* Callers allocate the advertised size, the generated code checks its layout against the same count */
+	static def assertStorageFits(XGenerator xgen, FInterface api) {
+		val clientSlots = xgen.clientStorageSlots(api)
+		assertThat(xgen.generateClientInterfaceHeader(api).toString(),
+				containsString("_SIZE (" + clientSlots + " * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)"))
+		assertThat(xgen.generateClientInterfaceBody(api).toString(),
+				containsString(") <= " + clientSlots + " * CC_STORAGE_SLOT, "))
+		val serverSlots = xgen.serverStorageSlots(api)
+		assertThat(xgen.generateServerInterfaceHeader(api).toString(),
+				containsString("_SIZE (" + serverSlots + " * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)"))
+		assertThat(xgen.generateServerInterfaceBody(api).toString(),
+				containsString(") <= " + serverSlots + " * CC_STORAGE_SLOT, "))
+	}
+
 
 	@Test
 	def testBasicTypeMappingToCapicSignature() {
@@ -220,6 +235,669 @@ class XGeneratorTest {
 				"SD_BUS_METHOD(\"func\", \"qx\", \"ybd\", &cc_MyService_func_thunk, SD_BUS_VTABLE_UNPRIVILEGED),"))
 		assertThat(serverBody, containsString(
 				"SD_BUS_METHOD(\"fire\", \"\", \"\", &cc_MyService_fire_thunk, SD_BUS_VTABLE_METHOD_NO_REPLY | SD_BUS_VTABLE_UNPRIVILEGED),"))
+		/* Calls run again by the backend when sd-bus cannot dispatch reentrant calls */
+		assertThat(serverBody, containsString(
+				"result = cc_instance_defer_call(ii->instance, m, &cc_MyService_func_thunk, ii);"))
+		assertThat(serverBody, containsString(
+				"result = cc_instance_defer_call(ii->instance, m, &cc_MyService_fire_thunk, ii);"))
+	}
+
+
+	@Test
+	def testServerFamily() {
+		val xgen = new XGenerator()
+		val methods = #[makeMethod("func")]
+		val api = makeInterface("MyService", methods)
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString(
+				"(*cc_server_MyService_lookup_t)(struct cc_server_MyService_family *family, const char *path, void **data)"))
+		assertThat(serverHeader, containsString(
+				"cc_server_MyService_family_new(const char *address, const struct cc_server_MyService_impl *impl, " +
+				"cc_server_MyService_lookup_t lookup, cc_server_MyService_enumerate_t enumerate, void *data, " +
+				"struct cc_server_MyService_family **family)"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("struct cc_server_MyService object;"))
+		assertThat(serverBody, containsString(
+				"sd_bus_add_fallback_vtable(i->backend->bus, &ff->vtable_slot, i->path, i->interface, vtable_MyService, " +
+				"&cc_server_MyService_family_find, ff)"))
+		assertThat(serverBody, containsString(
+				"sd_bus_add_node_enumerator(i->backend->bus, &ff->enumerator_slot, i->path, " +
+				"&cc_server_MyService_family_enumerate, ff)"))
+		/* Parameters only logged would be unused with logging disabled */
+		assertThat(serverBody, containsString("(void) prefix;"))
+		/* Object data is looked up per call, so that nested calls do not clobber it */
+		assertThat(serverBody, not(containsString("ff->object.data = data;")))
+		assertThat(serverBody, containsString("ff->object.family = ff;"))
+		assertThat(serverBody, containsString(
+				"result = cc_server_MyService_object_enter(ii, sd_bus_message_get_path(m), &previous_data);"))
+		assertThat(serverBody, containsString("ii->data = previous_data;"))
+	}
+
+
+	@Test
+	def testStaticStorage() {
+		val xgen = new XGenerator()
+		val methods = #[makeMethod("func"), makeMethod("other"), makeMethodFireAndForget("fire", null)]
+		val api = makeInterface("MyService", methods)
+		assertStorageFits(xgen, api)
+		// One-way methods keep no reply around
+		assertEquals(xgen.clientStorageSlots(makeInterface("MyService", #[makeMethod("func"), makeMethod("other")])),
+				xgen.clientStorageSlots(api))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"cc_client_MyService_init(void *storage, size_t size, const char *address, void *data, " +
+				"struct cc_client_MyService **instance)"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("_Static_assert(sizeof(struct cc_client_MyService) <= "))
+		assertThat(clientBody, not(containsString("calloc(")))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString("#define CC_SERVER_MYSERVICE_SIZE ("))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("_Static_assert(sizeof(struct cc_server_MyService) <= "))
+	}
+
+
+	@Test
+	def testStringMethods() {
+		val xgen = new XGenerator()
+		val inArgs = #[makeArgument(FBasicTypeId.STRING, "name")]
+		val outArgs = #[makeArgument(FBasicTypeId.STRING, "value")]
+		val methods = #[makeMethod("lookup", inArgs, outArgs)]
+		val api = makeInterface("MyService", methods)
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"cc_MyService_lookup(struct cc_client_MyService *instance, const char *name, const char **value)"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("sd_bus_message *lookup_reply;"))
+		assertThat(clientBody, containsString("result = sd_bus_message_read(reply, \"s\", value);"))
+		assertThat(clientBody, containsString("instance->lookup_reply = reply;"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("mark = cc_arena_mark(arena);"))
+		assertThat(serverBody, containsString("result = sd_bus_message_append(reply, \"s\", value);"))
+	}
+
+
+	@Test
+	def testByteBufferMethods() {
+		val xgen = new XGenerator()
+		val inArgs = #[
+				makeArgument(FBasicTypeId.BYTE_BUFFER, "data"),
+				makeArgument(FBasicTypeId.UINT32, "offset"),
+				makeArgument(FBasicTypeId.BOOLEAN, "last")]
+		val outArgs = #[makeArgument(FBasicTypeId.BYTE_BUFFER, "echo")]
+		val methods = #[makeMethod("send", inArgs, outArgs)]
+		val api = makeInterface("MyService", methods)
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("#include <capic/types.h>"))
+		assertThat(clientHeader, containsString(
+				"cc_MyService_send(struct cc_client_MyService *instance, struct cc_byte_buffer data, uint32_t offset, " +
+				"bool last, struct cc_byte_buffer *echo)"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("result = sd_bus_message_append_array(message, 'y', data.data, data.size);"))
+		assertThat(clientBody, containsString("result = sd_bus_message_append(message, \"ub\", offset, (int) last);"))
+		assertThat(clientBody, containsString("result = cc_instance_call(i, message, timeout, &error, &reply, NULL);"))
+		assertThat(clientBody, containsString(
+				"result = sd_bus_message_read_array(reply, 'y', (const void **) &echo->data, &echo->size);"))
+		assertThat(clientBody, containsString(
+				"result = sd_bus_message_read_array(message, 'y', (const void **) &echo.data, &echo.size);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"result = sd_bus_message_read_array(m, 'y', (const void **) &data.data, &data.size);"))
+		assertThat(serverBody, containsString("result = sd_bus_message_read(m, \"ub\", &offset, &last_int);"))
+		assertThat(serverBody, containsString("result = sd_bus_message_append_array(reply, 'y', echo.data, echo.size);"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(\"send\", \"ayub\", \"ay\", &cc_MyService_send_thunk, SD_BUS_VTABLE_UNPRIVILEGED),"))
+	}
+
+
+	@Test
+	def testStructTypes() {
+		val xgen = new XGenerator()
+		val sample = makeStruct("Sample", #[
+				makeField(FBasicTypeId.UINT64, "timestamp"),
+				makeField(FBasicTypeId.DOUBLE, "value"),
+				makeField(FBasicTypeId.INT32, "id"),
+				makeField(FBasicTypeId.UINT32, "flags")])
+		val status = makeStruct("Status", #[
+				makeField(FBasicTypeId.BOOLEAN, "ok"),
+				makeField(FBasicTypeId.UINT32, "code")])
+		val record = makeStruct("Record", #[makeField(makeTypeRef(sample), "sample")])
+		val samples = makeArray("Samples", makeTypeRef(sample))
+		val inArgs = #[makeArgument(makeTypeRef(samples), "samples")]
+		val outArgs = #[makeArgument(makeTypeRef(status), "status")]
+		val methods = #[makeMethod("store", inArgs, outArgs)]
+		val api = makeInterface("MyService", methods, #[samples, status, record, sample])
+		assertEquals(#[0, 8, 16, 20, 24], sample.layout)
+		assertNull(status.layout)
+		assertEquals("a(tdiu)", makeTypeRef(samples).asSdBusSig)
+		val typesHeader = xgen.generateTypesHeader(api).toString()
+		assertThat(typesHeader, containsString(
+				"struct cc_MyService_Samples {\n\tconst struct cc_MyService_Sample *data;\n\tsize_t size;\n};"))
+		assertTrue(typesHeader.indexOf("struct cc_MyService_Sample {") < typesHeader.indexOf("struct cc_MyService_Record {"))
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString("_Static_assert(sizeof(struct cc_MyService_Sample) == 24"))
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_read(message, \"(tdiu)\", &value->timestamp, &value->value, &value->id, &value->flags);"))
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_read(message, \"(bu)\", &ok_int, &value->code);"))
+		assertThat(typesBody, containsString("result = cc_MyService_Sample_read(message, arena, &data[size]);"))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("#include \"src-gen/types-MyService.h\""))
+		assertThat(clientHeader, containsString(
+				"cc_MyService_store(struct cc_client_MyService *instance, const struct cc_MyService_Samples *samples, " +
+				"struct cc_MyService_Status *status)"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("result = cc_MyService_Samples_append(message, samples);"))
+		assertThat(clientBody, containsString("result = cc_MyService_Status_read(reply, instance->store_arena, status);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("result = cc_MyService_Samples_read(m, arena, &samples);"))
+		assertThat(serverBody, containsString("result = ii->impl->store(ii, &samples, &status);"))
+		assertThat(serverBody, containsString("result = cc_MyService_Status_append(reply, &status);"))
+	}
+
+
+	@Test
+	def testBulkArrays() {
+		val xgen = new XGenerator()
+		val pair = makeStruct("Pair", #[makeField(FBasicTypeId.INT32, "x"), makeField(FBasicTypeId.INT32, "y")])
+		val pairs = makeArray("Pairs", makeTypeRef(pair))
+		annotate(pairs, "capic.bulk")
+		val api = makeInterface("MyService", #[], #[pair, pairs])
+		assertEquals("ay", makeTypeRef(pairs).asSdBusSig)
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_append_array(message, 'y', value->data, value->size * sizeof(value->data[0]));"))
+		assertThat(typesBody, containsString("(uintptr_t) data % _Alignof(struct cc_MyService_Pair) != 0"))
+	}
+
+
+	@Test
+	def testSampleColumns() {
+		val xgen = new XGenerator()
+		val sample = makeStruct("Sample", #[
+				makeField(FBasicTypeId.UINT64, "timestamp"),
+				makeField(FBasicTypeId.DOUBLE, "value"),
+				makeField(FBasicTypeId.BOOLEAN, "valid"),
+				makeField(FBasicTypeId.INT32, "id")])
+		val samples = makeArray("Samples", makeTypeRef(sample))
+		val arg = annotate(makeArgument(makeTypeRef(samples), "samples"), "capic.soa")
+		val methods = #[makeMethod("store", #[arg], #[])]
+		val api = makeInterface("MyService", methods, #[sample, samples])
+		assertTrue(arg.isColumns)
+		val typesHeader = xgen.generateTypesHeader(api).toString()
+		assertThat(typesHeader, containsString(
+				"struct cc_MyService_Samples_columns {\n\tconst uint64_t *timestamp;\n\tconst double *value;\n\tconst bool *valid;\n\tconst int32_t *id;\n\tsize_t size;\n};"))
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString("result = cc_arena_grow_columns(arena, column, sizes, 4, size, capacity);"))
+		assertThat(typesBody, containsString("((bool *) column[2])[size] = !!valid_int;"))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("const struct cc_MyService_Samples_columns *samples"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("cc_MyService_Samples_columns_read(m, arena, &samples)"))
+	}
+
+
+	@Test
+	def testConvertedArrays() {
+		val xgen = new XGenerator()
+		val flags = makeArray("Flags", makeTypeRef(FBasicTypeId.BOOLEAN))
+		val levels = makeArray("Levels", makeTypeRef(FBasicTypeId.FLOAT))
+		val api = makeInterface("MyService", #[], #[flags, levels])
+		assertFalse(flags.canPack)
+		assertTrue(levels.canPack)
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString("#include <capic/convert.h>"))
+		assertThat(typesBody, containsString("result = sd_bus_message_read_array(message, 'b', &wire, &size);"))
+		assertThat(typesBody, containsString("result = cc_unpack_bools(data, (const uint32_t *) wire, size);"))
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_append_array_space(message, 'd', value->size * sizeof(*wire), (void **) &wire);"))
+		assertThat(typesBody, containsString("cc_pack_floats(wire, value->data, value->size);"))
+		assertThat(typesBody, containsString("cc_unpack_floats(data, (const double *) wire, size);"))
+	}
+
+
+	@Test
+	def testMapTypes() {
+		val xgen = new XGenerator()
+		val sample = makeStruct("Sample", #[
+				makeField(FBasicTypeId.UINT64, "timestamp"),
+				makeField(FBasicTypeId.BOOLEAN, "valid")])
+		val gains = makeMap("Gains", makeTypeRef(FBasicTypeId.UINT32), makeTypeRef(FBasicTypeId.FLOAT))
+		val named = makeMap("Named", makeTypeRef(FBasicTypeId.STRING), makeTypeRef(sample))
+		val api = makeInterface("MyService", #[], #[named, gains, sample])
+		assertEquals("a{ud}", makeTypeRef(gains).asSdBusSig)
+		assertEquals("a{s(tb)}", makeTypeRef(named).asSdBusSig)
+		val typesHeader = xgen.generateTypesHeader(api).toString()
+		assertThat(typesHeader, containsString(
+				"struct cc_MyService_Gains_entry {\n\tuint32_t key;\n\tfloat value;\n};"))
+		assertThat(typesHeader, containsString(
+				"struct cc_MyService_Gains {\n\tconst struct cc_MyService_Gains_entry *data;\n\tsize_t size;\n};"))
+		assertThat(typesHeader, containsString(
+				"const struct cc_MyService_Named_entry *cc_MyService_Named_find(const struct cc_MyService_Named *map, const char *key);"))
+		assertTrue(typesHeader.indexOf("struct cc_MyService_Sample {") < typesHeader.indexOf("struct cc_MyService_Named_entry {"))
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_append(message, \"{ud}\", value->data[i].key, (double) value->data[i].value);"))
+		assertThat(typesBody, containsString(
+				"result = sd_bus_message_read(message, \"{ud}\", &data[size].key, &element_double);"))
+		assertThat(typesBody, containsString("result = cc_MyService_Sample_read(message, arena, &data[size].value);"))
+		assertThat(typesBody, containsString("if (size > 0 && strcmp(data[size - 1].key, data[size].key) > 0)"))
+		assertThat(typesBody, containsString("qsort(data, size, sizeof(*data), &cc_MyService_Gains_compare);"))
+		assertThat(typesBody, containsString("int order = (map->data[middle].key > key) - (map->data[middle].key < key);"))
+	}
+
+
+	@Test
+	def testEnumerationAndUnionTypes() {
+		val xgen = new XGenerator()
+		val color = makeEnumeration("Color", #[makeEnumerator("RED"), makeEnumerator("GREEN", 5), makeEnumerator("BLUE")])
+		val offset = makeEnumeration("Offset", #[makeEnumerator("LOW", -3), makeEnumerator("HIGH", 40000)])
+		val sample = makeStruct("Sample", #[
+				makeField(FBasicTypeId.UINT64, "timestamp"),
+				makeField(makeTypeRef(color), "color")])
+		val value = makeUnion("Value", #[
+				makeField(FBasicTypeId.INT32, "number"),
+				makeField(FBasicTypeId.STRING, "name"),
+				makeField(makeTypeRef(sample), "sample"),
+				makeField(FBasicTypeId.BOOLEAN, "flag")])
+		val inArgs = #[makeArgument(makeTypeRef(color), "color"), makeArgument(makeTypeRef(value), "value")]
+		val methods = #[makeMethod("paint", inArgs, #[])]
+		val api = makeInterface("MyService", methods, #[value, sample, offset, color])
+		assertEquals(FBasicTypeId.UINT8, color.backingType)
+		assertEquals(FBasicTypeId.INT32, offset.backingType)
+		assertEquals("i", makeTypeRef(offset).asSdBusSig)
+		assertEquals(#[0, 8, 16], sample.layout)
+		assertEquals("(yv)", makeTypeRef(value).asSdBusSig)
+		val typesHeader = xgen.generateTypesHeader(api).toString()
+		assertThat(typesHeader, containsString("typedef uint8_t cc_MyService_Color_t;"))
+		assertThat(typesHeader, containsString("\tcc_MyService_Color_GREEN = 5,\n\tcc_MyService_Color_BLUE = 6,\n"))
+		assertThat(typesHeader, containsString("typedef int32_t cc_MyService_Offset_t;"))
+		assertThat(typesHeader, containsString("\tcc_MyService_Offset_LOW = -3,\n"))
+		assertThat(typesHeader, containsString("\tcc_MyService_Color_t color;\n"))
+		assertThat(typesHeader, not(containsString("cc_MyService_Color_append")))
+		assertTrue(typesHeader.indexOf("typedef uint8_t cc_MyService_Color_t;") < typesHeader.indexOf("struct cc_MyService_Sample {"))
+		assertThat(typesHeader, containsString("\tuint8_t tag;\n\tunion {\n\t\tint32_t number;\n"))
+		val typesBody = xgen.generateTypesBody(api).toString()
+		assertThat(typesBody, containsString("static const char *const signatures[] = {\"i\", \"s\", \"(ty)\", \"b\"};"))
+		assertThat(typesBody, containsString("\t&cc_MyService_Value_read_sample,\n"))
+		assertThat(typesBody, containsString("result = cc_MyService_Value_readers[value->tag](message, arena, value);"))
+		assertThat(typesBody, containsString("result = sd_bus_message_read(message, \"(ty)\", &value->timestamp, &value->color);"))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("cc_MyService_Color_t color, const struct cc_MyService_Value *value"))
+	}
+
+
+	@Test
+	def testBroadcasts() {
+		val xgen = new XGenerator()
+		val samples = makeArray("Samples", makeTypeRef(FBasicTypeId.DOUBLE))
+		val sampled = makeBroadcast("sampled", #[
+				makeArgument(FBasicTypeId.STRING, "channel"),
+				makeArgument(FBasicTypeId.UINT64, "sequence")], true)
+		val block = makeBroadcast("block", #[makeArgument(makeTypeRef(samples), "samples")])
+		val api = makeInterface("MyService", #[], #[samples], #[sampled, block])
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"typedef void (*cc_MyService_sampled_handler_t)(struct cc_client_MyService *instance, const char *channel, uint64_t sequence);"))
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_sampled_subscribe(struct cc_client_MyService *instance, const char *channel, cc_MyService_sampled_handler_t handler);"))
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_block_subscribe(struct cc_client_MyService *instance, cc_MyService_block_handler_t handler);"))
+		assertThat(clientHeader, containsString("void cc_MyService_block_unsubscribe(struct cc_client_MyService *instance);"))
+		assertStorageFits(xgen, api)
+		assertTrue(xgen.clientStorageSlots(api) > xgen.clientStorageSlots(makeInterface("MyService")))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"instance->instance, \"sampled\", channel, &cc_MyService_sampled_signal_thunk, instance,"))
+		assertThat(clientBody, containsString(
+				"instance->instance, \"block\", NULL, &cc_MyService_block_signal_thunk, instance,"))
+		assertThat(clientBody, containsString("result = sd_bus_message_read(message, \"st\", &channel, &sequence);"))
+		assertThat(clientBody, containsString("result = cc_MyService_Samples_read(message, arena, &samples);"))
+		assertThat(clientBody, containsString("instance->block_slot = sd_bus_slot_unref(instance->block_slot);"))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString(
+				"int cc_MyService_sampled_emit(struct cc_server_MyService *instance, const char *channel, uint64_t sequence);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"i->backend->bus, i->path, i->interface, \"sampled\", \"st\", channel, sequence);"))
+		assertThat(serverBody, containsString("result = cc_MyService_Samples_append(message, samples);"))
+		assertThat(serverBody, containsString("SD_BUS_SIGNAL(\"block\", \"ad\", 0),"))
+		val unfiltered = makeBroadcast("unfiltered", #[makeArgument(FBasicTypeId.UINT64, "sequence")], true)
+		try { unfiltered.filterArg; fail("Expected UnsupportedOperationException"); }
+		catch (UnsupportedOperationException e) {}
+	}
+
+
+	@Test
+	def testAttributes() {
+		val xgen = new XGenerator()
+		val samples = makeArray("Samples", makeTypeRef(FBasicTypeId.DOUBLE))
+		val speed = makeAttribute("speed", makeTypeRef(FBasicTypeId.UINT32))
+		val history = makeAttribute("history", makeTypeRef(samples), true, false)
+		val label = makeAttribute("label", makeTypeRef(FBasicTypeId.STRING), true, true)
+		val api = makeInterface("MyService", #[], #[samples], #[], #[speed, history, label])
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"typedef void (*cc_MyService_speed_handler_t)(struct cc_client_MyService *instance, uint32_t value);"))
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_get_history(struct cc_client_MyService *instance, struct cc_MyService_Samples *value);"))
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_fetch_speed(struct cc_client_MyService *instance, uint32_t *value);"))
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_set_speed(struct cc_client_MyService *instance, uint32_t value);"))
+		assertThat(clientHeader, not(containsString("cc_MyService_set_history")))
+		assertThat(clientHeader, not(containsString("cc_MyService_label_subscribe")))
+		assertStorageFits(xgen, api)
+		assertTrue(xgen.clientStorageSlots(api) > xgen.clientStorageSlots(makeInterface("MyService")))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("if (strcmp(name, \"speed\") == 0) {"))
+		assertThat(clientBody, containsString("} else if (strcmp(name, \"history\") == 0) {"))
+		assertThat(clientBody, not(containsString("if (strcmp(name, \"label\") == 0)")))
+		assertThat(clientBody, containsString("result = cc_MyService_Samples_read(message, ii->history_arena, &value);"))
+		assertThat(clientBody, containsString("*value = *instance->history_value;"))
+		assertThat(clientBody, containsString("instance->properties_slot = sd_bus_slot_unref(instance->properties_slot);"))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString(
+				"typedef int (*cc_MyService_set_speed_t)(struct cc_server_MyService *instance, uint32_t value);"))
+		assertThat(serverHeader, containsString("cc_MyService_get_history_t get_history;"))
+		assertThat(serverHeader, containsString("int cc_MyService_speed_changed(struct cc_server_MyService *instance);"))
+		assertThat(serverHeader, not(containsString("cc_MyService_label_changed")))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"SD_BUS_WRITABLE_PROPERTY(\"speed\", \"u\", &cc_MyService_speed_get_thunk, &cc_MyService_speed_set_thunk, 0, " +
+				"SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE | SD_BUS_VTABLE_UNPRIVILEGED),"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_PROPERTY(\"label\", \"s\", &cc_MyService_label_get_thunk, 0, 0),"))
+		assertThat(serverBody, containsString("result = cc_MyService_Samples_append(reply, &value);"))
+	}
+
+
+	@Test
+	def testThrottledEmissions() {
+		val xgen = new XGenerator()
+		val sampled = makeBroadcast("sampled", #[
+				makeArgument(FBasicTypeId.STRING, "channel"),
+				makeArgument(FBasicTypeId.UINT64, "sequence")], true)
+		val block = makeBroadcast("block", #[makeArgument(FBasicTypeId.BYTE_BUFFER, "data")])
+		val speed = makeAttribute("speed", makeTypeRef(FBasicTypeId.UINT32))
+		val mode = makeAttribute("mode", makeTypeRef(FBasicTypeId.UINT8))
+		val api = makeInterface("MyService", #[], #[], #[sampled, block], #[speed, mode])
+		assertStorageFits(xgen, api)
+		assertTrue(xgen.serverStorageSlots(api) > xgen.serverStorageSlots(makeInterface("MyService")))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString(
+				"void cc_MyService_sampled_set_window(struct cc_server_MyService *instance, uint64_t window_usec);"))
+		assertThat(serverHeader, containsString(
+				"void cc_MyService_set_changes_window(struct cc_server_MyService *instance, uint64_t window_usec);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("if (instance->sampled_throttle.window == 0) {"))
+		assertThat(serverBody, not(containsString("if (instance->block_throttle.window == 0) {")))
+		assertThat(serverBody, containsString(
+				"if (instance->sampled_pending && strcmp(instance->sampled_filter, channel) != 0) {"))
+		assertThat(serverBody, not(containsString("instance->block_filter")))
+		assertThat(serverBody, containsString("const char *names[3];"))
+		assertThat(serverBody, containsString("instance->speed_changed = true;"))
+		assertThat(serverBody, containsString("cc_server_MyService_flush_throttles(&family->object);"))
+		assertThat(xgen.generateServerInterfaceBody(makeInterface("MyService")).toString(),
+				not(containsString("flush_throttles")))
+	}
+
+
+	@Test
+	def testMirroredAttributes() {
+		val xgen = new XGenerator()
+		val speed = makeAttribute("speed", makeTypeRef(FBasicTypeId.UINT32))
+		val level = makeAttribute("level", makeTypeRef(FBasicTypeId.BOOLEAN), true, true)
+		val label = makeAttribute("label", makeTypeRef(FBasicTypeId.STRING))
+		for (a : #[speed, level, label])
+			annotate(a, "capic.shm")
+		try { label.isMirrored; fail("Expected IllegalArgumentException"); }
+		catch (IllegalArgumentException e) {}
+		val api = makeInterface("MyService", #[], #[], #[], #[speed, level])
+		assertEquals(1, level.mirrorIndex)
+		assertStorageFits(xgen, api)
+		// The mapping is kept on both ends
+		val plain = makeInterface("MyService", #[], #[], #[], #[
+				makeAttribute("speed", makeTypeRef(FBasicTypeId.UINT32)),
+				makeAttribute("level", makeTypeRef(FBasicTypeId.BOOLEAN), true, true)])
+		assertTrue(xgen.clientStorageSlots(api) > xgen.clientStorageSlots(plain))
+		assertTrue(xgen.serverStorageSlots(api) > xgen.serverStorageSlots(plain))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"int cc_MyService_speed_subscribe(struct cc_client_MyService *instance, cc_MyService_speed_handler_t handler);"))
+		assertThat(clientHeader, not(containsString("cc_MyService_level_subscribe")))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("result = cc_mirror_map(fd, notify, 2, &ii->mirror);"))
+		assertThat(clientBody, containsString(
+				"cc_mirror_read(instance->mirror, 1, value, sizeof(*value), NULL) == 0)"))
+		assertThat(clientBody, not(containsString("properties_slot")))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString("int cc_MyService_level_changed(struct cc_server_MyService *instance);"))
+		assertThat(serverHeader, not(containsString("set_changes_window")))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("cc_mirror_write(instance->mirror, 0, &value, sizeof(value));"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(\"OpenAttributeMirror\", \"\", \"hh\", &cc_MyService_open_mirror_thunk, SD_BUS_VTABLE_UNPRIVILEGED),"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_WRITABLE_PROPERTY(\"speed\", \"u\", &cc_MyService_speed_get_thunk, &cc_MyService_speed_set_thunk, 0, " +
+				"SD_BUS_VTABLE_UNPRIVILEGED),"))
+	}
+
+
+	@Test
+	def testBatchedMethods() {
+		val xgen = new XGenerator()
+		val split = makeMethod("split", #[
+				makeArgument(FBasicTypeId.DOUBLE, "value"),
+				makeArgument(FBasicTypeId.BOOLEAN, "round")], #[
+				makeArgument(FBasicTypeId.INT32, "whole"),
+				makeArgument(FBasicTypeId.FLOAT, "fraction")], false)
+		val describe = makeMethod("describe", #[makeArgument(FBasicTypeId.INT32, "code")],
+				#[makeArgument(FBasicTypeId.STRING, "text")], false)
+		for (m : #[split, describe])
+			annotate(m, "capic.batch")
+		try { describe.isBatched; fail("Expected IllegalArgumentException"); }
+		catch (IllegalArgumentException e) {}
+		val api = makeInterface("Calculator", #[split])
+		assertStorageFits(xgen, api)
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("int32_t whole;"))
+		assertThat(clientHeader, containsString(
+				"int cc_Calculator_split_batch(struct cc_client_Calculator *instance, size_t count, " +
+				"const struct cc_Calculator_split_in *in, struct cc_Calculator_split_out *out);"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"result = sd_bus_message_append(message, \"(db)\", in[k].value, (int) in[k].round);"))
+		assertThat(clientBody, containsString("out[k].fraction = (float) fraction_double;"))
+		assertThat(clientBody, containsString(
+				"result = cc_Calculator_split(instance, in[k].value, in[k].round, &out[k].whole, &out[k].fraction);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(\"splitBatch\", \"a(db)\", \"a(id)\", &cc_Calculator_split_batch_thunk, SD_BUS_VTABLE_UNPRIVILEGED),"))
+		assertThat(serverBody, containsString(
+				"result = ii->impl->split(ii, value, !!round_int, &whole, &fraction);"))
+		assertThat(serverBody, containsString(
+				"result = cc_instance_defer_call(ii->instance, m, &cc_Calculator_split_batch_thunk, ii);"))
+	}
+
+
+	@Test
+	def testCoalescedMethods() {
+		val xgen = new XGenerator()
+		val drop = annotate(makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")]), "capic.batch")
+		val grab = makeMethod("grab", #[], #[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		val api = makeInterface("Ball", #[drop, grab])
+		assertTrue(drop.isCoalesced)
+		assertStorageFits(xgen, api)
+		// The open batch and its timer are kept on top of what a plain one-way method needs
+		val plain = makeInterface("Ball", #[
+				makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")]),
+				makeMethod("grab", #[], #[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)])
+		assertTrue(xgen.clientStorageSlots(api) > xgen.clientStorageSlots(plain))
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, not(containsString("cc_Ball_drop_batch")))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"result = cc_coalesce_begin(&instance->drop_coalesce, i, \"dropBatch\", \"(i)\", &batch);"))
+		assertThat(clientBody, containsString("cc_Ball_flush_coalesced(instance, &instance->drop_coalesce);"))
+		assertThat(clientBody, containsString("cc_Ball_flush_coalesced(instance, NULL);"))
+		// Refused calls do not send the batches of other methods past the watermark
+		assertTrue(clientBody.indexOf("result = cc_instance_check_write(i);") <
+				clientBody.indexOf("cc_Ball_flush_coalesced(instance, &instance->drop_coalesce);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(\"dropBatch\", \"a(i)\", \"\", &cc_Ball_drop_batch_thunk, " +
+				"SD_BUS_VTABLE_METHOD_NO_REPLY | SD_BUS_VTABLE_UNPRIVILEGED),"))
+		assertThat(serverBody, not(containsString("unable to open batch results")))
+	}
+
+
+	@Test
+	def testWriteBackpressure() {
+		val xgen = new XGenerator()
+		val drop = makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")])
+		val grab = makeMethod("grab", #[], #[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		val api = makeInterface("Ball", #[drop, grab])
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		// One-way and asynchronous calls are refused, sync calls flush the queue themselves
+		assertEquals(2, clientBody.split("result = cc_instance_check_write\\(i\\);").length - 1)
+	}
+
+
+	@Test
+	def testAdmissionControl() {
+		val xgen = new XGenerator()
+		val drop = makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")])
+		val grab = makeMethod("grab", #[makeArgument(FBasicTypeId.INT32, "height")],
+				#[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		for (m : #[drop, grab])
+			annotate(m, "capic.deadline")
+		try { drop.hasDeadline; fail("Expected IllegalArgumentException"); }
+		catch (IllegalArgumentException e) {}
+		drop.comment = null
+		val api = makeInterface("Ball", #[drop, grab])
+		assertStorageFits(xgen, api)
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"result = sd_bus_message_append(message, \"t\", cc_deadline_after(timeout));"))
+		val serverHeader = xgen.generateServerInterfaceHeader(api).toString()
+		assertThat(serverHeader, containsString(
+				"void cc_Ball_grab_set_limit(struct cc_server_Ball *instance, unsigned int limit);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"result = cc_admission_enter(&ii->admission, &ii->grab_admission, ii->instance, m, deadline, error);"))
+		assertThat(serverBody, containsString(
+				"result = cc_admission_enter(&ii->admission, &ii->drop_admission, ii->instance, m, 0, error);"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(\"grab\", \"ti\", \"b\", &cc_Ball_grab_thunk, SD_BUS_VTABLE_UNPRIVILEGED),"))
+	}
+
+
+	@Test
+	def testCallTimeouts() {
+		val xgen = new XGenerator()
+		val grab = makeMethod("grab", #[makeArgument(FBasicTypeId.INT32, "height")],
+				#[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		annotate(grab, "capic.deadline")
+		val api = makeInterface("Ball", #[grab])
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"void cc_client_Ball_set_timeout(struct cc_client_Ball *instance, uint64_t usec);"))
+		assertThat(clientHeader, containsString(
+				"int cc_Ball_grab_timeout(struct cc_client_Ball *instance, uint64_t usec, int32_t height, bool *held);"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("return cc_Ball_grab_timeout(instance, 0, height, held);"))
+		assertThat(clientBody, containsString("return cc_Ball_grab_async_timeout(instance, 0, height, callback, call);"))
+		assertThat(clientBody, containsString(
+				"result = cc_instance_get_timeout(i, usec, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);"))
+		assertThat(clientBody, containsString("CC_LOG_DEBUG(\"invoked cc_Ball_grab_timeout()\\n\");"))
+		assertThat(clientBody, containsString("CC_LOG_DEBUG(\"invoked cc_Ball_grab_async_timeout()\\n\");"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("previous = cc_deadline_swap(ii->instance, deadline);"))
+		assertThat(serverBody, containsString("cc_deadline_swap(ii->instance, previous);"))
+	}
+
+
+	@Test
+	def testCancelAsyncCall() {
+		val xgen = new XGenerator()
+		val drop = makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")])
+		val grab = makeMethod("grab", #[], #[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		val api = makeInterface("Ball", #[drop, grab])
+		assertStorageFits(xgen, api)
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString(
+				"int cc_Ball_grab_async(struct cc_client_Ball *instance, cc_Ball_grab_reply_t callback, struct cc_call **call);"))
+		assertThat(clientHeader, not(containsString("_cancel(")))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString("*call = &instance->grab_call;"))
+		assertThat(clientBody, containsString("ii->grab_call.instance = ii->instance;"))
+		assertThat(clientBody, not(containsString("grab_call.cookie")))
+		assertThat(xgen.generateServerInterfaceBody(api).toString(), not(containsString("CC_DBUS_CANCEL_MEMBER")))
+
+		annotate(drop, "capic.cancel")
+		try { drop.isCancellable; fail("Expected IllegalArgumentException"); }
+		catch (IllegalArgumentException e) {}
+		drop.comment = null
+		annotate(grab, "capic.cancel")
+		val cancelBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(cancelBody, containsString("sd_bus_message_get_cookie(message, &instance->grab_call.cookie);"))
+		assertThat(cancelBody, containsString("sd_bus_message_get_cookie(message, &ii->grab_call.cookie);"))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString("return cc_cancel_notice(ii->instance, m);"))
+		assertThat(serverBody, containsString(
+				"SD_BUS_METHOD(CC_DBUS_CANCEL_MEMBER, \"t\", \"\", &cc_Ball_cancel_call_thunk, SD_BUS_VTABLE_METHOD_NO_REPLY | SD_BUS_VTABLE_UNPRIVILEGED),"))
+	}
+
+
+	@Test
+	def testPriorityLane() {
+		val xgen = new XGenerator()
+		val open = makeMethod("open", #[makeArgument(FBasicTypeId.INT32, "angle")],
+				#[makeArgument(FBasicTypeId.BOOLEAN, "opened")], false)
+		val shut = makeMethod("shut")
+		annotate(open, "capic.priority=urgent")
+		try { open.hasPriority; fail("Expected IllegalArgumentException"); }
+		catch (IllegalArgumentException e) {}
+		open.comment = null
+		annotate(open, "capic.priority=high")
+		val api = makeInterface("Valve", #[open, shut])
+		assertStorageFits(xgen, api)
+		val plain = makeInterface("Valve", #[makeMethod("open", #[makeArgument(FBasicTypeId.INT32, "angle")],
+				#[makeArgument(FBasicTypeId.BOOLEAN, "opened")], false), makeMethod("shut")])
+		assertTrue(xgen.clientStorageSlots(api) > xgen.clientStorageSlots(plain))
+		assertTrue(xgen.serverStorageSlots(api) > xgen.serverStorageSlots(plain))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"result = cc_instance_new_method_call(i, !instance->unlaned, \"open\", &message);"))
+		assertThat(clientBody, containsString(
+				"result = cc_instance_call(i, message, timeout, &error, &reply, &instance->unlaned);"))
+		assertThat(clientBody, not(containsString("\"shut\", &message);")))
+		val serverBody = xgen.generateServerInterfaceBody(api).toString()
+		assertThat(serverBody, containsString(
+				"result = cc_instance_serve_lane(i, vtable_Valve, ii, &ii->lane_vtable_slot);"))
+	}
+
+
+	@Test
+	def testServiceAvailability() {
+		val xgen = new XGenerator()
+		val drop = makeMethodFireAndForget("drop", #[makeArgument(FBasicTypeId.INT32, "height")])
+		val grab = makeMethod("grab", #[], #[makeArgument(FBasicTypeId.BOOLEAN, "held")], false)
+		val api = makeInterface("Ball", #[drop, grab])
+		assertStorageFits(xgen, api)
+		val clientHeader = xgen.generateClientInterfaceHeader(api).toString()
+		assertThat(clientHeader, containsString("bool cc_client_Ball_is_available(struct cc_client_Ball *instance);"))
+		assertThat(clientHeader, containsString(
+				"int cc_client_Ball_set_availability_handler(struct cc_client_Ball *instance, cc_Ball_availability_handler_t handler);"))
+		assertThat(clientHeader, containsString("int cc_client_Ball_set_hold_calls(struct cc_client_Ball *instance, bool hold);"))
+		val clientBody = xgen.generateClientInterfaceBody(api).toString()
+		assertThat(clientBody, containsString(
+				"result = cc_watcher_add(instance->instance, &instance->watcher, &cc_client_Ball_availability_changed, instance);"))
+		assertThat(clientBody, containsString("return hold ? cc_client_Ball_watch(instance) : 0;"))
+		assertTrue(clientBody.lastIndexOf("cc_watcher_add(") < clientBody.indexOf("int cc_client_Ball_init("))
+		assertThat(clientBody, containsString("instance->grab_call.held = sd_bus_message_ref(message);"))
+		assertThat(clientBody, not(containsString("drop_call")))
 	}
 
 
@@ -441,8 +1119,8 @@ class XGeneratorTest {
 		assertThat(makeTypeRef(FBasicTypeId.UINT64).asSdBusSig, is("t"))
 		assertThat(makeTypeRef(FBasicTypeId.FLOAT).asSdBusSig, is("d"))
 		assertThat(makeTypeRef(FBasicTypeId.DOUBLE).asSdBusSig, is("d"))
-		try { makeTypeRef(FBasicTypeId.BYTE_BUFFER).asSdBusSig; fail("Expected IllegalArgumentException"); }
-		catch (IllegalArgumentException e) {}
+		assertThat(makeTypeRef(FBasicTypeId.STRING).asSdBusSig, is("s"))
+		assertThat(makeTypeRef(FBasicTypeId.BYTE_BUFFER).asSdBusSig, is("ay"))
 		return
 	}
 
@@ -476,8 +1154,8 @@ class XGeneratorTest {
 		assertThat(makeTypeRef(FBasicTypeId.UINT64).asPrintfSig, is("PRIu64"))
 		assertThat(makeTypeRef(FBasicTypeId.FLOAT).asPrintfSig, is("g"))
 		assertThat(makeTypeRef(FBasicTypeId.DOUBLE).asPrintfSig, is("g"))
-		try { makeTypeRef(FBasicTypeId.BYTE_BUFFER).asSdBusSig; fail("Expected IllegalArgumentException"); }
-		catch (IllegalArgumentException e) {}
+		assertThat(makeTypeRef(FBasicTypeId.STRING).asPrintfSig, is("s"))
+		assertThat(makeTypeRef(FBasicTypeId.BYTE_BUFFER).asPrintfSig, is("zu"))
 		return
 	}
 
@@ -63,6 +63,10 @@ public class Generator {
                 throw new GeneratorException("Syntax error(s):" + errorMessage);
             for (FInterface ifs : model.getInterfaces()) {
                 XGenerator xgen = new XGenerator();
+                if (!ifs.getTypes().isEmpty()) {
+                    writeFile(fileMaker, "types-" + ifs.getName() + ".h", xgen.generateTypesHeader(ifs).toString());
+                    writeFile(fileMaker, "types-" + ifs.getName() + ".c", xgen.generateTypesBody(ifs).toString());
+                }
                 writeFile(fileMaker, "client-" + ifs.getName() + ".h", xgen.generateClientInterfaceHeader(ifs).toString());
                 writeFile(fileMaker, "client-" + ifs.getName() + ".c", xgen.generateClientInterfaceBody(ifs).toString());
                 writeFile(fileMaker, "server-" + ifs.getName() + ".h", xgen.generateServerInterfaceHeader(ifs).toString());
@@ -19,8 +19,27 @@ import static org.genivi.capic.core.XGenerator.Domain.*
 import org.franca.core.franca.FBasicTypeId
 import org.franca.core.franca.FInterface
 import org.franca.core.franca.FMethod
+import org.franca.core.franca.FBroadcast
+import org.franca.core.franca.FAttribute
 import org.franca.core.franca.FTypeRef
 import org.franca.core.franca.FArgument
+import org.franca.core.franca.FType
+import org.franca.core.franca.FStructType
+import org.franca.core.franca.FArrayType
+import org.franca.core.franca.FMapType
+import org.franca.core.franca.FUnionType
+import org.franca.core.franca.FEnumerationType
+import org.franca.core.franca.FEnumerator
+import org.franca.core.franca.FExpression
+import org.franca.core.franca.FIntegerConstant
+import org.franca.core.franca.FUnaryOperation
+import org.franca.core.franca.FOperator
+import org.franca.core.franca.FField
+import org.franca.core.franca.FModelElement
+import java.math.BigInteger
+import java.util.List
+import java.util.Map
+import java.util.Set
 
 class XGenerator {
 
@@ -32,12 +51,18 @@ class XGenerator {
 		final FTypeRef type
 		final boolean isRef
 		final Domain domain
+		/* Array of structs passed as struct-of-arrays */
+		final boolean columns
 
 		new(String name, FTypeRef type, boolean isRef, Domain domain) {
+			this(name, type, isRef, domain, false)
+		}
+		new(String name, FTypeRef type, boolean isRef, Domain domain, boolean columns) {
 			this.name = name
 			this.type = type
 			this.isRef = isRef
 			this.domain = domain
+			this.columns = columns
 		}
 		override boolean equals(Object obj) {
 			if (obj.class != typeof(Symbol))
@@ -46,6 +71,8 @@ class XGenerator {
 			name == sym.name && type.match(sym.type) && isRef == sym.isRef && domain == sym.domain
 		}
 		def match(FTypeRef it, FTypeRef obj) {
+			if (derived != null)
+				return derived == obj.derived
 			return predefined != FBasicTypeId.UNDEFINED && predefined == obj.predefined
 		}
 		override def String toString() {
@@ -53,10 +80,10 @@ class XGenerator {
 					", isRef=" + isRef.toString() + ", domain=" + domain.toString()
 		}
 		def byVal(Domain domain) {
-			new Symbol(this.name, this.type, false, domain)
+			new Symbol(this.name, this.type, false, domain, this.columns)
 		}
 		def byRef(Domain domain) {
-			new Symbol(this.name, this.type, true, domain)
+			new Symbol(this.name, this.type, true, domain, this.columns)
 		}
 	}
 
@@ -69,6 +96,13 @@ class XGenerator {
 
 		#include <stdint.h>
 		#include <stdbool.h>
+		#include <capic/backend.h>
+		«IF api.usesByteBuffer»
+		#include <capic/types.h>
+		«ENDIF»
+		«IF !api.types.empty»
+		#include "src-gen/types-«api.name».h"
+		«ENDIF»
 
 
 		#ifdef __cplusplus
@@ -77,6 +111,9 @@ class XGenerator {
 
 		«api.clientTypeSignature»;
 
+		/* Storage for «api.clientMethodPrefix»_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+		#define «api.clientStorageSize» («api.clientStorageSlots» * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
+
 		«FOR m : api.methods»
 		«IF !m.fireAndForget»
 		typedef void (*«m.clientReplyTypeName»)(«api.clientTypeSignature» *instance«m.outArgs.byVal(Capic).asParam»);
@@ -84,15 +121,92 @@ class XGenerator {
 		«ENDFOR»
 
 		«FOR m : api.methods»
+		«IF m.hasDerivedOutArgs»
+		/* Returned values and everything they point to stay valid until the next call of cc_«api.name»_«m.name»() */
+		«ELSEIF m.hasBorrowedOutArgs»
+		/* Returned strings and buffers stay valid until the next call of cc_«api.name»_«m.name»() */
+		«ENDIF»
+		«IF m.isCoalesced»
+		/* Calls are sent in batches while the backend is corked or coalescing */
+		«ENDIF»
 		int cc_«api.name»_«m.name»(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»);
 		«IF !m.fireAndForget»
-		int cc_«api.name»_«m.name»_async(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback);
+		/* The call, if not NULL, is set to the handle for cc_call_cancel() until the callback is invoked */
+		int cc_«api.name»_«m.name»_async(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback, struct cc_call **call);
+		/* Calls time out after usec, or the timeout of the instance for 0 */
+		int cc_«api.name»_«m.name»_timeout(«api.clientTypeSignature» *instance, uint64_t usec«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»);
+		int cc_«api.name»_«m.name»_async_timeout(«api.clientTypeSignature» *instance, uint64_t usec«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback, struct cc_call **call);
+		«ENDIF»
+		«IF m.isBatched && !m.fireAndForget»
+
+		struct cc_«api.name»_«m.name»_in {
+			«m.inArgs.byVal(Capic).asDecl»
+		};
+
+		struct cc_«api.name»_«m.name»_out {
+			«m.outArgs.byVal(Capic).asDecl»
+		};
+
+		/* Makes count calls in one message, servers without the batch method are called once per element */
+		int cc_«api.name»_«m.name»_batch(«api.clientTypeSignature» *instance, size_t count, const struct cc_«api.name»_«m.name»_in *in, struct cc_«api.name»_«m.name»_out *out);
+		«ENDIF»
+
+		«ENDFOR»
+		«FOR b : api.broadcasts»
+		typedef void (*«b.clientHandlerTypeName»)(«api.clientTypeSignature» *instance«b.outArgs.byVal(Capic).asParam»);
+		«IF b.hasDerivedOutArgs»
+		/* Values passed to the handler and everything they point to stay valid until it returns */
+		«ELSEIF b.hasBorrowedOutArgs»
+		/* Strings and buffers passed to the handler stay valid until it returns */
+		«ENDIF»
+		«IF b.selective»
+		/* Only broadcasts with the given «b.filterArg.name» are delivered, or all of them for NULL */
+		«ENDIF»
+		int cc_«api.name»_«b.name»_subscribe(«api.clientTypeSignature» *instance«b.filterParam», «b.clientHandlerTypeName» handler);
+		void cc_«api.name»_«b.name»_unsubscribe(«api.clientTypeSignature» *instance);
+
+		«ENDFOR»
+		«FOR a : api.attributes»
+		«IF !a.noSubscriptions»
+		typedef void (*«a.clientHandlerTypeName»)(«api.clientTypeSignature» *instance«#[a.valueSymbol(false, Capic)].asParam»);
+		«ENDIF»
+		«IF a.isMirrored»
+		/* Reads shared memory without a system call if the server is local, cc_«api.name»_fetch_«a.name»() asks it instead */
+		«ELSEIF a.isCached»
+		/* Returns the cached value, which cc_«api.name»_fetch_«a.name»() asks the server for instead */
+		«ELSE»
+		/* Changes of «a.name» are not notified, so it is always asked from the server */
+		«ENDIF»
+		«IF a.type.isBorrowed»
+		/* Returned strings, buffers and derived values stay valid until the value is received again */
+		«ENDIF»
+		int cc_«api.name»_get_«a.name»(«api.clientTypeSignature» *instance«#[a.valueSymbol(true, Capic)].asParam»);
+		int cc_«api.name»_fetch_«a.name»(«api.clientTypeSignature» *instance«#[a.valueSymbol(true, Capic)].asParam»);
+		«IF !a.readonly»
+		int cc_«api.name»_set_«a.name»(«api.clientTypeSignature» *instance«#[a.valueSymbol(false, Capic)].asParam»);
+		«ENDIF»
+		«IF !a.noSubscriptions»
+		int cc_«api.name»_«a.name»_subscribe(«api.clientTypeSignature» *instance, «a.clientHandlerTypeName» handler);
+		void cc_«api.name»_«a.name»_unsubscribe(«api.clientTypeSignature» *instance);
 		«ENDIF»
 
 		«ENDFOR»
+		typedef void (*cc_«api.name»_availability_handler_t)(«api.clientTypeSignature» *instance, bool available);
+
 		int «api.clientMethodPrefix»_new(const char *address, void *data, «api.clientTypeSignature» **instance);
 		«api.clientTypeSignature» *«api.clientMethodPrefix»_free(«api.clientTypeSignature» *instance);
 		void *«api.clientMethodPrefix»_get_data(«api.clientTypeSignature» *instance);
+		/* Method calls time out after usec, or 25 s if synchronous and 2 s if asynchronous for 0 */
+		void «api.clientMethodPrefix»_set_timeout(«api.clientTypeSignature» *instance, uint64_t usec);
+		/* Whether the service of the instance has an owner on the bus, which peers always have,
+		 * tracked only once a handler is set or calls are held and true before */
+		bool «api.clientMethodPrefix»_is_available(«api.clientTypeSignature» *instance);
+		/* Invokes handler whenever the service appears or disappears, none for NULL */
+		int «api.clientMethodPrefix»_set_availability_handler(«api.clientTypeSignature» *instance, cc_«api.name»_availability_handler_t handler);
+		/* Asynchronous calls made while the service is unavailable are made once it appears */
+		int «api.clientMethodPrefix»_set_hold_calls(«api.clientTypeSignature» *instance, bool hold);
+		int «api.clientMethodPrefix»_init(void *storage, size_t size, const char *address, void *data, «api.clientTypeSignature» **instance);
+		void «api.clientMethodPrefix»_fini(«api.clientTypeSignature» *instance);
 
 
 		#ifdef __cplusplus
@@ -112,10 +226,12 @@ class XGenerator {
 		#include <assert.h>
 		#include <errno.h>
 		#include <stdlib.h>
+		#include <string.h>
 		#include <inttypes.h>
 		#include <capic/backend.h>
 		#include <capic/dbus-private.h>
 		#include <capic/log.h>
+		#include <capic/memory.h>
 
 
 		«api.clientTypeSignature» {
@@ -124,11 +240,70 @@ class XGenerator {
 			«FOR m : api.methods»
 			«IF !m.fireAndForget»
 			«m.clientReplyTypeName» «m.name»_reply_callback;
-			sd_bus_slot *«m.name»_reply_slot;
+			struct cc_call «m.name»_call;
+			«ENDIF»
+			«IF m.hasBorrowedOutArgs»
+			sd_bus_message *«m.name»_reply;
+			«ENDIF»
+			«IF m.hasDerivedOutArgs»
+			struct cc_arena *«m.name»_arena;
+			«ENDIF»
+			«IF m.isCoalesced»
+			struct cc_coalesce «m.name»_coalesce;
+			«ELSEIF m.isBatched»
+			bool «m.name»_unbatched;
+			«ENDIF»
+			«ENDFOR»
+			«FOR b : api.broadcasts»
+			«b.clientHandlerTypeName» «b.name»_handler;
+			sd_bus_slot *«b.name»_slot;
+			«ENDFOR»
+			«FOR a : api.attributes»
+			«a.type.asCapicSig»«IF a.type.aggregate != null»*«ENDIF»«a.name»_value;
+			«IF a.type.isBorrowed»
+			sd_bus_message *«a.name»_message;
+			«ENDIF»
+			«IF a.type.aggregate != null»
+			struct cc_arena *«a.name»_arena;
+			«ENDIF»
+			«IF a.isCached»
+			bool «a.name»_valid;
+			«a.clientHandlerTypeName» «a.name»_handler;
+			«ENDIF»
+			«IF a.isMirrored && !a.noSubscriptions»
+			«a.clientHandlerTypeName» «a.name»_handler;
+			uint64_t «a.name»_sequence;
 			«ENDIF»
 			«ENDFOR»
+			«IF api.hasCachedAttributes»
+			sd_bus_slot *properties_slot;
+			«ENDIF»
+			«IF api.hasMirroredAttributes»
+			struct cc_mirror *mirror;
+			bool mirror_unavailable;
+			«ENDIF»
+			«IF api.hasPriorityMethods»
+			bool unlaned;
+			«ENDIF»
+			struct cc_watcher watcher;
+			cc_«api.name»_availability_handler_t availability_handler;
+			bool hold_calls;
 		};
 
+		/* Storage holds the client followed by its instance */
+		_Static_assert(sizeof(«api.clientTypeSignature») <= «api.clientStorageSlots» * CC_STORAGE_SLOT, "«api.clientStorageSize» is too small");
+		«IF api.hasCoalescedMethods»
+
+		/* Calls on one instance arrive in order, so one-way calls held back are sent first */
+		static void cc_«api.name»_flush_coalesced(«api.clientTypeSignature» *instance, struct cc_coalesce *except)
+		{
+			«FOR m : api.methods.filter[isCoalesced]»
+			if (&instance->«m.name»_coalesce != except)
+				cc_coalesce_flush(&instance->«m.name»_coalesce, instance->instance);
+			«ENDFOR»
+		}
+		«ENDIF»
+
 		«FOR m : api.methods»
 		«IF m.isFireAndForget»
 
@@ -137,6 +312,9 @@ class XGenerator {
 			int result = 0;
 			struct cc_instance *i;
 			sd_bus_message *message = NULL;
+			«IF m.isCoalesced»
+			sd_bus_message *batch;
+			«ENDIF»
 
 			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»()\n");
 			assert(instance);
@@ -144,13 +322,34 @@ class XGenerator {
 			assert(i && i->backend && i->backend->bus);
 			assert(i->service && i->path && i->interface);
 
+			result = cc_instance_check_write(i);
+			if (result < 0)
+				return result;
+			«IF api.hasCoalescedMethods»
+			cc_«api.name»_flush_coalesced(instance, «IF m.isCoalesced»&instance->«m.name»_coalesce«ELSE»NULL«ENDIF»);
+			«ENDIF»
+			«IF m.isCoalesced»
+			result = cc_coalesce_begin(&instance->«m.name»_coalesce, i, "«m.batchName»", «m.inArgs.byVal(Capic).asSdBusStructSig», &batch);
+			if (result < 0)
+				return result;
+			if (result > 0) {
+				result = sd_bus_message_append(batch, «m.inArgs.byVal(Capic).asSdBusStructSig»«m.inArgs.byVal(Capic).asRVal(SdBus)»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
+					return result;
+				}
+				return cc_coalesce_end(&instance->«m.name»_coalesce, i);
+			}
+			«ENDIF»
 			result = sd_bus_message_new_method_call(
 				i->backend->bus, &message, i->service, i->path, i->interface, "«m.name»");
 			if (result < 0) {
 				CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
 				goto fail;
 			}
-			«IF !m.inArgs.empty»
+			«IF !m.inArgs.isVarArgs»
+			«m.inArgs.byVal(Capic).asAppend("message", "goto fail;", "unable to append message method arguments")»
+			«ELSEIF !m.inArgs.empty»
 			result = sd_bus_message_append(message, «m.inArgs.byVal(Capic).asSdBusSig»«m.inArgs.byVal(Capic).asRVal(SdBus)»);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
@@ -177,9 +376,15 @@ class XGenerator {
 		«ELSE»
 
 		int cc_«api.name»_«m.name»(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»)
+		{
+			return cc_«api.name»_«m.name»_timeout(instance, 0«m.inArgs.byVal(Capic).asRVal(Capic)»«m.outArgs.byVal(Capic).asRVal(Capic)»);
+		}
+
+		int cc_«api.name»_«m.name»_timeout(«api.clientTypeSignature» *instance, uint64_t usec«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»)
 		{
 			int result = 0;
 			struct cc_instance *i;
+			uint64_t timeout;
 			sd_bus_message *message = NULL;
 			sd_bus_message *reply = NULL;
 			sd_bus_error error = SD_BUS_ERROR_NULL;
@@ -188,33 +393,65 @@ class XGenerator {
 			«s.byVal(SdBus).asSig»«s.byVal(SdBus).asLVal(SdBus)»;
 			«ENDFOR»
 
-			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»()\n");
+			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»_timeout()\n");
 			assert(instance);
 			i = instance->instance;
 			assert(i && i->backend && i->backend->bus);
 			assert(i->service && i->path && i->interface);
 
-			if (instance->«m.name»_reply_slot) {
+			if (instance->«m.name»_call.slot || instance->«m.name»_call.held) {
 				CC_LOG_ERROR("unable to call method with already pending reply\n");
 				return -EBUSY;
 			}
-			assert(!instance->«m.name»_reply_callback);
+			«IF api.hasCoalescedMethods»
+			cc_«api.name»_flush_coalesced(instance, NULL);
+			«ENDIF»
+			result = cc_instance_get_timeout(i, usec, CC_DBUS_SYNC_CALL_TIMEOUT_USEC, &timeout);
+			if (result < 0)
+				return result;
+			«IF m.hasBorrowedOutArgs»
+			instance->«m.name»_reply = sd_bus_message_unref(instance->«m.name»_reply);
+			«ENDIF»
+			«IF m.hasDerivedOutArgs»
+			if (!instance->«m.name»_arena) {
+				result = cc_arena_new(CC_ARENA_BLOCK_SIZE, &instance->«m.name»_arena);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to create reply arena: %s\n", strerror(-result));
+					return result;
+				}
+			}
+			/* Values returned by the previous call are released here */
+			cc_arena_reset(instance->«m.name»_arena);
+			«ENDIF»
 
-			result = sd_bus_call_method(
-				i->backend->bus, i->service, i->path, i->interface, "«m.name»", &error, &reply, «m.inArgs.byVal(Capic).asSdBusSig»«m.inArgs.byVal(Capic).asRVal(SdBus)»);
+			«m.newMethodCall»
+			«IF m.hasDeadline»
+			«m.appendDeadline»
+			«ENDIF»
+			«m.inArgs.byVal(Capic).asAppend("message", "goto fail;", "unable to append message method arguments")»
+			result = cc_instance_call(i, message, timeout, &error, &reply, «IF m.hasPriority»&instance->unlaned«ELSE»NULL«ENDIF»);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to call method: %s\n", strerror(-result));
 				goto fail;
 			}
+			«IF m.outArgs.isVarArgs»
 			result = sd_bus_message_read(reply, «m.outArgs.byRef(Capic).asSdBusSig»«m.outArgs.byRef(Capic).asRef(SdBus)»);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to get reply value: %s\n", strerror(-result));
 				goto fail;
 			}
+			«ELSE»
+			«m.outArgs.byRef(Capic).asRead("reply", "instance->" + m.name + "_arena", "goto fail;", "unable to get reply value")»
+			«ENDIF»
 			«FOR s : outArgsDiff»
 			«s.byRef(Capic).asLVal(Capic)» = «s.byVal(SdBus).asRVal(Capic)»;
 			«ENDFOR»
 			CC_LOG_DEBUG("returning «m.outArgs.byRef(Capic).asPrintfFormat»\n"«m.outArgs.byRef(Capic).asRVal(Printf)»);
+			«IF m.hasBorrowedOutArgs»
+			/* Keep the reply that returned values point into */
+			instance->«m.name»_reply = reply;
+			reply = NULL;
+			«ENDIF»
 
 		fail:
 			sd_bus_error_free(&error);
@@ -229,6 +466,10 @@ class XGenerator {
 			int result = 0;
 			sd_bus *bus;
 			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) userdata;
+			«IF m.hasDerivedOutArgs»
+			struct cc_arena *arena = NULL;
+			struct cc_arena_mark mark = {NULL, 0};
+			«ENDIF»
 			«m.outArgs.byVal(SdBus).asDecl»
 			(void) ret_error;
 
@@ -238,673 +479,4024 @@ class XGenerator {
 			assert(bus);
 			assert(ii);
 			assert(ii->«m.name»_reply_callback);
-			assert(ii->«m.name»_reply_slot == sd_bus_get_current_slot(bus));
+			assert(ii->«m.name»_call.slot == sd_bus_get_current_slot(bus));
 			result = sd_bus_message_get_errno(message);
+			«IF m.hasPriority»
+			if (bus != ii->instance->backend->bus && sd_bus_message_is_method_error(message, SD_BUS_ERROR_SERVICE_UNKNOWN)) {
+				/* Later calls are made on the bus, the service has no priority lane */
+				CC_LOG_DEBUG("service has no priority lane\n");
+				ii->unlaned = true;
+			}
+			«ENDIF»
 			if (result != 0) {
 				CC_LOG_ERROR("failed to receive response: %s\n", strerror(result));
 				goto finish;
 			}
+			«IF m.hasDerivedOutArgs»
+			result = cc_backend_get_arena(&arena);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get backend arena: %s\n", strerror(-result));
+				goto finish;
+			}
+			/* Decoded values live until the callback returns */
+			mark = cc_arena_mark(arena);
+			«ENDIF»
+			«IF m.outArgs.isVarArgs»
 			result = sd_bus_message_read(message, «m.outArgs.byVal(SdBus).asSdBusSig»«m.outArgs.byVal(SdBus).asRef(SdBus)»);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to get reply value: %s\n", strerror(-result));
 				goto finish;
 			}
+			«ELSE»
+			«m.outArgs.byVal(SdBus).asRead("message", "arena", "goto finish;", "unable to get reply value")»
+			«ENDIF»
 			CC_LOG_DEBUG("invoking callback in «m.clientReplyThunkName»()\n");
 			CC_LOG_DEBUG("with «m.outArgs.byVal(SdBus).asPrintfFormat»\n"«m.outArgs.byVal(SdBus).asRVal(Printf)»);
 			ii->«m.name»_reply_callback(ii«m.outArgs.byVal(SdBus).asRVal(Capic)»);
 			result = 1;
 
 		finish:
+			«IF m.hasDerivedOutArgs»
+			if (arena)
+				cc_arena_release(arena, mark);
+			«ENDIF»
 			ii->«m.name»_reply_callback = NULL;
-			ii->«m.name»_reply_slot = sd_bus_slot_unref(ii->«m.name»_reply_slot);
+			ii->«m.name»_call.slot = sd_bus_slot_unref(ii->«m.name»_call.slot);
 
 			return result;
 		}
 
-		int cc_«api.name»_«m.name»_async(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback)
+		int cc_«api.name»_«m.name»_async(«api.clientTypeSignature» *instance«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback, struct cc_call **call)
+		{
+			return cc_«api.name»_«m.name»_async_timeout(instance, 0«m.inArgs.byVal(Capic).asRVal(Capic)», callback, call);
+		}
+
+		int cc_«api.name»_«m.name»_async_timeout(«api.clientTypeSignature» *instance, uint64_t usec«m.inArgs.byVal(Capic).asParam», «m.clientReplyTypeName» callback, struct cc_call **call)
 		{
 			int result = 0;
 			struct cc_instance *i;
+			uint64_t timeout;
 			sd_bus_message *message = NULL;
 
-			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»_async()\n");
+			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»_async_timeout()\n");
 			assert(instance);
 			assert(callback);
 			i = instance->instance;
 			assert(i && i->backend && i->backend->bus);
 			assert(i->service && i->path && i->interface);
 
-			if (instance->«m.name»_reply_slot) {
+			if (instance->«m.name»_call.slot || instance->«m.name»_call.held) {
 				CC_LOG_ERROR("unable to call method with already pending reply\n");
 				return -EBUSY;
 			}
-			assert(!instance->«m.name»_reply_callback);
+			result = cc_instance_check_write(i);
+			if (result < 0)
+				return result;
+			«IF api.hasCoalescedMethods»
+			cc_«api.name»_flush_coalesced(instance, NULL);
+			«ENDIF»
+			result = cc_instance_get_timeout(i, usec, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+			if (result < 0)
+				return result;
 
-			result = sd_bus_message_new_method_call(
-				i->backend->bus, &message, i->service, i->path, i->interface, "«m.name»");
-			if (result < 0) {
-				CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
-				goto fail;
-			}
+			«m.newMethodCall»
+			«IF m.hasDeadline»
+			«m.appendDeadline»
+			«ENDIF»
+			«IF m.inArgs.isVarArgs»
 			result = sd_bus_message_append(message, «m.inArgs.byVal(Capic).asSdBusSig»«m.inArgs.byVal(Capic).asRVal(SdBus)»);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
 				goto fail;
 			}
+			«ELSE»
+			«m.inArgs.byVal(Capic).asAppend("message", "goto fail;", "unable to append message method arguments")»
+			«ENDIF»
+			if (instance->hold_calls && !cc_watcher_is_available(&instance->watcher)) {
+				CC_LOG_DEBUG("holding call until service appears\n");
+				instance->«m.name»_call.held = sd_bus_message_ref(message);
+				instance->«m.name»_reply_callback = callback;
+				result = 0;
+				goto fail;
+			}
 
 			result = sd_bus_call_async(
-				i->backend->bus, &instance->«m.name»_reply_slot, message, &«m.clientReplyThunkName»,
-				instance, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC);
+				«IF m.hasPriority»sd_bus_message_get_bus(message)«ELSE»i->backend->bus«ENDIF», &instance->«m.name»_call.slot, message, &«m.clientReplyThunkName»,
+				instance, timeout);
 			if (result < 0) {
 				CC_LOG_ERROR("unable to issue method call: %s\n", strerror(-result));
 				goto fail;
 			}
+			«IF m.isCancellable»
+			/* Identifies the call to the server if it is cancelled */
+			sd_bus_message_get_cookie(message, &instance->«m.name»_call.cookie);
+			«ENDIF»
 			instance->«m.name»_reply_callback = callback;
 
 		fail:
 			message = sd_bus_message_unref(message);
+			if (call && result >= 0)
+				*call = &instance->«m.name»_call;
 
 			return result;
 		}
 		«ENDIF»
-		«ENDFOR»
+		«IF m.isBatched && !m.fireAndForget»
+		«val batchIn = m.inArgs.map[a | new Symbol("in[k]." + a.name, a.type, false, Capic)]»
+		«val batchOut = m.outArgs.map[a | new Symbol("out[k]." + a.name, a.type, false, Capic)]»
 
-		int «api.clientMethodPrefix»_new(const char *address, void *data, «api.clientTypeSignature» **instance)
+		static int cc_«api.name»_«m.name»_unbatched(«api.clientTypeSignature» *instance, size_t count, const struct cc_«api.name»_«m.name»_in *in, struct cc_«api.name»_«m.name»_out *out)
 		{
-			int result;
-			«api.clientTypeSignature» *ii;
+			int result = 0;
+			size_t k;
 
-			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_new\n");
-			assert(address);
+			for (k = 0; k < count && result >= 0; ++k)
+				result = cc_«api.name»_«m.name»(instance«batchIn.asRVal(Capic)»«batchOut.asRef(Capic)»);
+
+			return result < 0 ? result : 0;
+		}
+
+		int cc_«api.name»_«m.name»_batch(«api.clientTypeSignature» *instance, size_t count, const struct cc_«api.name»_«m.name»_in *in, struct cc_«api.name»_«m.name»_out *out)
+		{
+			int result = 0;
+			struct cc_instance *i;
+			uint64_t timeout;
+			sd_bus_message *message = NULL;
+			sd_bus_message *reply = NULL;
+			sd_bus_error error = SD_BUS_ERROR_NULL;
+			size_t k;
+			«m.outArgs.byVal(SdBus).asDecl»
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»_batch()\n");
 			assert(instance);
+			assert(in || count == 0);
+			assert(out || count == 0);
+			i = instance->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->service && i->path && i->interface);
 
-			ii = («api.clientTypeSignature» *) calloc(1, sizeof(*ii));
-			if (!ii) {
-				CC_LOG_ERROR("failed to allocate instance memory\n");
-				return -ENOMEM;
-			}
+			if (count == 0)
+				return 0;
+			«IF api.hasCoalescedMethods»
+			cc_«api.name»_flush_coalesced(instance, NULL);
+			«ENDIF»
+			if (instance->«m.name»_unbatched)
+				return cc_«api.name»_«m.name»_unbatched(instance, count, in, out);
+			result = cc_instance_get_timeout(i, 0, CC_DBUS_SYNC_CALL_TIMEOUT_USEC, &timeout);
+			if (result < 0)
+				return result;
 
-			result = cc_instance_new(address, false, &ii->instance);
+			result = sd_bus_message_new_method_call(
+				i->backend->bus, &message, i->service, i->path, i->interface, "«m.batchName»");
 			if (result < 0) {
-				CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+				CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
 				goto fail;
 			}
-			ii->data = data;
-
-			*instance = ii;
-			return 0;
+			result = sd_bus_message_open_container(message, SD_BUS_TYPE_ARRAY, «m.inArgs.byVal(Capic).asSdBusStructSig»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to open batch arguments: %s\n", strerror(-result));
+				goto fail;
+			}
+			for (k = 0; k < count; ++k) {
+				result = sd_bus_message_append(message, «m.inArgs.byVal(Capic).asSdBusStructSig»«batchIn.asRVal(SdBus)»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append message method arguments: %s\n", strerror(-result));
+					goto fail;
+				}
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to close batch arguments: %s\n", strerror(-result));
+				goto fail;
+			}
+			result = cc_instance_call(i, message, timeout, &error, &reply, NULL);
+			if (result < 0 && sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD)) {
+				CC_LOG_DEBUG("server does not support batches of «api.name».«m.name»\n");
+				instance->«m.name»_unbatched = true;
+				result = cc_«api.name»_«m.name»_unbatched(instance, count, in, out);
+				goto fail;
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to call method: %s\n", strerror(-result));
+				goto fail;
+			}
+			result = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, «m.outArgs.byVal(SdBus).asSdBusStructSig»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get batch results: %s\n", strerror(-result));
+				goto fail;
+			}
+			for (k = 0; k < count; ++k) {
+				result = sd_bus_message_read(reply, «m.outArgs.byVal(SdBus).asSdBusStructSig»«m.outArgs.byVal(SdBus).asRef(SdBus)»);
+				if (result == 0)
+					result = -EBADMSG;
+				if (result < 0) {
+					CC_LOG_ERROR("unable to get reply value: %s\n", strerror(-result));
+					goto fail;
+				}
+				«FOR a : m.outArgs»
+				out[k].«a.name» = «a.byVal(SdBus).asRVal(Capic)»;
+				«ENDFOR»
+			}
+			result = 0;
 
 		fail:
-			ii = «api.clientMethodPrefix»_free(ii);
+			sd_bus_error_free(&error);
+			reply = sd_bus_message_unref(reply);
+			message = sd_bus_message_unref(message);
+
 			return result;
 		}
+		«ENDIF»
+		«ENDFOR»
+		«FOR b : api.broadcasts»
 
-		«api.clientTypeSignature» *«api.clientMethodPrefix»_free(«api.clientTypeSignature» *instance)
+		static int «b.clientSignalThunkName»(CC_IGNORE_BUS_ARG sd_bus_message *message, void *userdata, sd_bus_error *ret_error)
 		{
-			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_free()\n");
-			if (instance) {
-				«FOR m : api.methods»
-				«IF !m.fireAndForget»
-				instance->«m.name»_reply_slot = sd_bus_slot_unref(instance->«m.name»_reply_slot);
-				«ENDIF»
-				«ENDFOR»
-				instance->instance = cc_instance_free(instance->instance);
-				/* User is responsible for memory management of data. */
-				free(instance);
+			int result = 0;
+			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) userdata;
+			«IF b.hasDerivedOutArgs»
+			struct cc_arena *arena = NULL;
+			struct cc_arena_mark mark = {NULL, 0};
+			«ENDIF»
+			«b.outArgs.byVal(SdBus).asDecl»
+			(void) ret_error;
+
+			CC_LOG_DEBUG("invoked «b.clientSignalThunkName»()\n");
+			assert(message);
+			assert(ii);
+			assert(ii->«b.name»_handler);
+			«IF b.hasDerivedOutArgs»
+			result = cc_backend_get_arena(&arena);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get backend arena: %s\n", strerror(-result));
+				goto finish;
 			}
-			return NULL;
-		}
+			/* Decoded values live until the handler returns */
+			mark = cc_arena_mark(arena);
+			«ENDIF»
+			«IF b.outArgs.isVarArgs»
+			result = sd_bus_message_read(message, «b.outArgs.byVal(SdBus).asSdBusSig»«b.outArgs.byVal(SdBus).asRef(SdBus)»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read broadcast values: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ELSE»
+			«b.outArgs.byVal(SdBus).asRead("message", "arena", "goto finish;", "unable to read broadcast values")»
+			«ENDIF»
+			CC_LOG_DEBUG("invoking handler in «b.clientSignalThunkName»()\n");
+			CC_LOG_DEBUG("with «b.outArgs.byVal(SdBus).asPrintfFormat»\n"«b.outArgs.byVal(SdBus).asRVal(Printf)»);
+			ii->«b.name»_handler(ii«b.outArgs.byVal(SdBus).asRVal(Capic)»);
 
-		void *«api.clientMethodPrefix»_get_data(«api.clientTypeSignature» *instance)
-		{
-			assert(instance);
-			return instance->data;
+		finish:
+			«IF b.hasDerivedOutArgs»
+			if (arena)
+				cc_arena_release(arena, mark);
+			«ENDIF»
+			/* Other subscribers get the signal as well, and an error returned here
+			 * would stop processing the bus */
+			return 0;
 		}
-	'''
 
+		int cc_«api.name»_«b.name»_subscribe(«api.clientTypeSignature» *instance«b.filterParam», «b.clientHandlerTypeName» handler)
+		{
+			int result;
 
-	def generateServerInterfaceHeader(FInterface api) '''
-		«copyrightNotice»
+			CC_LOG_DEBUG("invoked cc_«api.name»_«b.name»_subscribe()\n");
+			assert(instance);
+			assert(instance->instance);
+			assert(handler);
 
-		#ifndef «api.serverHeaderGuard»
-		#define «api.serverHeaderGuard»
+			if (instance->«b.name»_slot) {
+				CC_LOG_ERROR("unable to subscribe to broadcast already subscribed to\n");
+				return -EBUSY;
+			}
+			result = cc_instance_add_signal_match(
+				instance->instance, "«b.name»", «IF b.selective»«b.filterArg.name»«ELSE»NULL«ENDIF», &«b.clientSignalThunkName», instance,
+				&instance->«b.name»_slot);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to subscribe to broadcast: %s\n", strerror(-result));
+				return result;
+			}
+			instance->«b.name»_handler = handler;
 
-		#include <stdint.h>
-		#include <stdbool.h>
+			return 0;
+		}
 
+		void cc_«api.name»_«b.name»_unsubscribe(«api.clientTypeSignature» *instance)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_«b.name»_unsubscribe()\n");
+			assert(instance);
+			instance->«b.name»_slot = sd_bus_slot_unref(instance->«b.name»_slot);
+			instance->«b.name»_handler = NULL;
+		}
+		«ENDFOR»
+		«FOR a : api.attributes»
+		«val value = a.valueSymbol(false, SdBus)»
 
-		#ifdef __cplusplus
-		extern "C" {
-		#endif
+		static int «a.clientCacheName»(«api.clientTypeSignature» *ii, sd_bus_message *message)
+		{
+			int result;
+			«value.asDecl»;
 
-		«api.serverTypeSignature»;
+			assert(ii);
+			assert(message);
+			«IF a.isCached»
+			ii->«a.name»_valid = false;
+			«ENDIF»
+			«IF a.type.aggregate != null»
+			if (!ii->«a.name»_arena) {
+				result = cc_arena_new(CC_ARENA_BLOCK_SIZE, &ii->«a.name»_arena);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to create attribute arena: %s\n", strerror(-result));
+					return result;
+				}
+			}
+			/* The previous value is released here */
+			cc_arena_reset(ii->«a.name»_arena);
+			«ENDIF»
+			result = sd_bus_message_enter_container(message, 'v', "«a.type.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attribute value: %s\n", strerror(-result));
+				return result;
+			}
+			«#[value].asRead("message", "ii->" + a.name + "_arena", "return result;", "unable to read attribute value")»
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attribute value: %s\n", strerror(-result));
+				return result;
+			}
+			«IF a.type.aggregate != null»
+			ii->«a.name»_value = cc_arena_alloc(ii->«a.name»_arena, sizeof(*ii->«a.name»_value));
+			if (!ii->«a.name»_value) {
+				CC_LOG_ERROR("failed to allocate attribute value\n");
+				return -ENOMEM;
+			}
+			*ii->«a.name»_value = «value.asLVal(SdBus)»;
+			«ELSE»
+			ii->«a.name»_value = «value.asRVal(Capic)»;
+			«ENDIF»
+			«IF a.type.isBorrowed»
+			/* Keep the message that the value points into */
+			sd_bus_message_unref(ii->«a.name»_message);
+			ii->«a.name»_message = sd_bus_message_ref(message);
+			«ENDIF»
+			«IF a.isCached»
+			ii->«a.name»_valid = true;
+			«ENDIF»
 
-		«FOR m : api.methods»
-		typedef int (*cc_«api.name»_«m.name»_t)(«api.serverTypeSignature» *instance«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»);
+			return 0;
+		}
 		«ENDFOR»
+		«IF api.hasCachedAttributes»
+		«val cached = api.attributes.filter[isCached]»
 
-		«api.serverImplTypeSignature» {
-			«FOR m : api.methods»
-			cc_«api.name»_«m.name»_t «m.name»;
-			«ENDFOR»
-		};
-
-		int «api.serverMethodPrefix»_new(const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance);
-		«api.serverTypeSignature» *«api.serverMethodPrefix»_free(«api.serverTypeSignature» *instance);
-		void *«api.serverMethodPrefix»_get_data(«api.serverTypeSignature» *instance);
+		/* Reads a dictionary of attribute values into the cache */
+		static int cc_«api.name»_attributes_read(«api.clientTypeSignature» *ii, sd_bus_message *message, bool notify)
+		{
+			int result;
+			const char *name;
 
+			result = sd_bus_message_enter_container(message, 'a', "{sv}");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attributes: %s\n", strerror(-result));
+				return result;
+			}
+			while ((result = sd_bus_message_enter_container(message, 'e', "sv")) > 0) {
+				result = sd_bus_message_read(message, "s", &name);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read attribute name: %s\n", strerror(-result));
+					return result;
+				}
+				«FOR a : cached»
+				«IF a != cached.head»} else «ENDIF»if (strcmp(name, "«a.name»") == 0) {
+					result = «a.clientCacheName»(ii, message);
+					if (result >= 0 && notify && ii->«a.name»_handler)
+						ii->«a.name»_handler(ii, ii->«a.name»_value);
+				«ENDFOR»
+				} else {
+					result = sd_bus_message_skip(message, "v");
+				}
+				if (result < 0)
+					return result;
+				result = sd_bus_message_exit_container(message);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read attributes: %s\n", strerror(-result));
+					return result;
+				}
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attributes: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attributes: %s\n", strerror(-result));
+				return result;
+			}
 
-		#ifdef __cplusplus
+			return 0;
 		}
-		#endif
-
-
-		#endif /* ifndef «api.serverHeaderGuard» */
-	'''
 
+		static int cc_«api.name»_attributes_changed_thunk(CC_IGNORE_BUS_ARG sd_bus_message *message, void *userdata, sd_bus_error *ret_error)
+		{
+			int result;
+			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) userdata;
+			const char *name;
+			(void) ret_error;
 
-	def generateServerInterfaceBody(FInterface api) '''
-		«copyrightNotice»
-
-		#include "src-gen/server-«api.name».h"
-
-		#include <assert.h>
-		#include <errno.h>
-		#include <stdlib.h>
-		#include <capic/backend.h>
-		#include <capic/dbus-private.h>
-		#include <capic/log.h>
-
-
-		«api.serverTypeSignature» {
-			struct cc_instance *instance;
-			void *data;
-			const «api.serverImplTypeSignature» *impl;
-			struct sd_bus_slot *vtable_slot;
-		};
+			CC_LOG_DEBUG("invoked cc_«api.name»_attributes_changed_thunk()\n");
+			assert(message);
+			assert(ii);
+			result = sd_bus_message_skip(message, "s");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read attribute changes: %s\n", strerror(-result));
+				return 0;
+			}
+			result = cc_«api.name»_attributes_read(ii, message, true);
+			if (result < 0)
+				return 0;
+			/* Invalidated values are fetched again when they are used next */
+			result = sd_bus_message_enter_container(message, 'a', "s");
+			while (result >= 0 && (result = sd_bus_message_read(message, "s", &name)) > 0) {
+				«FOR a : cached»
+				«IF a != cached.head»else «ENDIF»if (strcmp(name, "«a.name»") == 0)
+					ii->«a.name»_valid = false;
+				«ENDFOR»
+			}
+			if (result < 0)
+				CC_LOG_ERROR("unable to read invalidated attributes: %s\n", strerror(-result));
 
-		«FOR m : api.methods»
+			/* Other subscribers get the signal as well, and an error returned here
+			 * would stop processing the bus */
+			return 0;
+		}
 
-		static int «m.serverThunkName»(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		/* Subscribes to changes before loading the values, so that none is missed in between */
+		static int cc_«api.name»_attributes_load(«api.clientTypeSignature» *ii)
 		{
-			int result = 0;
-			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
-			«m.inArgs.byVal(SdBus).asDecl»
-			«m.outArgs.byVal(Capic).asDecl»
+			int result;
+			struct cc_instance *i;
+			sd_bus_message *reply = NULL;
+			sd_bus_error error = SD_BUS_ERROR_NULL;
 
-			CC_LOG_DEBUG("invoked «m.serverThunkName»()\n");
-			assert(m);
-			assert(ii && ii->impl);
-			CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
+			CC_LOG_DEBUG("invoked cc_«api.name»_attributes_load()\n");
+			assert(ii);
+			i = ii->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->service && i->path && i->interface);
+			assert(!ii->properties_slot);
 
-			result = sd_bus_message_read(m, «m.inArgs.byVal(SdBus).asSdBusSig»«m.inArgs.byVal(SdBus).asRef(SdBus)»);
+			result = cc_instance_add_properties_match(
+				i, &cc_«api.name»_attributes_changed_thunk, ii, &ii->properties_slot);
 			if (result < 0) {
-				CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
+				CC_LOG_ERROR("unable to subscribe to attribute changes: %s\n", strerror(-result));
 				return result;
 			}
-			if (!ii->impl->«m.name») {
-				CC_LOG_ERROR("unsupported method invoked: %s\n", "«api.name».«m.name»");
-				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support method «api.name».«m.name»");
-				sd_bus_reply_method_error(m, error);
-				return -ENOTSUP;
+			result = sd_bus_call_method(
+				i->backend->bus, i->service, i->path, "org.freedesktop.DBus.Properties", "GetAll",
+				&error, &reply, "s", i->interface);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get attributes: %s\n", strerror(-result));
+				goto fail;
+			}
+			result = cc_«api.name»_attributes_read(ii, reply, false);
+
+		fail:
+			if (result < 0)
+				ii->properties_slot = sd_bus_slot_unref(ii->properties_slot);
+			sd_bus_error_free(&error);
+			reply = sd_bus_message_unref(reply);
+
+			return result;
+		}
+		«ENDIF»
+		«IF api.hasMirroredAttributes»
+		«val notified = api.attributes.filter[isMirrored && !noSubscriptions]»
+		«IF !notified.empty»
+
+		static void cc_«api.name»_mirror_changed(void *userdata)
+		{
+			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) userdata;
+			uint64_t sequence;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_mirror_changed()\n");
+			assert(ii && ii->mirror);
+			«FOR a : notified»
+			if (ii->«a.name»_handler) {
+				«a.valueSymbol(false, Capic).asDecl»;
+
+				if (cc_mirror_read(ii->mirror, «a.mirrorIndex», &value, sizeof(value), &sequence) == 0 &&
+					sequence != ii->«a.name»_sequence) {
+					ii->«a.name»_sequence = sequence;
+					ii->«a.name»_handler(ii, value);
+				}
 			}
-			result = ii->impl->«m.name»(ii«m.inArgs.byVal(SdBus).asRVal(Capic)»«m.outArgs.byVal(Capic).asRef(Capic)»);
+			«ENDFOR»
+		}
+		«ENDIF»
+
+		/* Servers on another host or without a mirror are asked over D-Bus instead */
+		static int cc_«api.name»_mirror_open(«api.clientTypeSignature» *ii)
+		{
+			int result, fd, notify;
+			struct cc_instance *i;
+			sd_bus_message *reply = NULL;
+			sd_bus_error error = SD_BUS_ERROR_NULL;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_mirror_open()\n");
+			assert(ii);
+			i = ii->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->service && i->path && i->interface);
+
+			result = sd_bus_call_method(
+				i->backend->bus, i->service, i->path, i->interface, "OpenAttributeMirror", &error,
+				&reply, "");
 			if (result < 0) {
-				CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
-				sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "method implementation failed with error=%d", result);
-				sd_bus_reply_method_error(m, error);
-				return result;
+				CC_LOG_ERROR("unable to open attribute mirror: %s\n", strerror(-result));
+				goto fail;
 			}
-			«IF !m.fireAndForget»
-			result = sd_bus_reply_method_return(m, «m.outArgs.byVal(Capic).asSdBusSig»«m.outArgs.byVal(Capic).asRVal(SdBus)»);
+			result = sd_bus_message_read(reply, "hh", &fd, &notify);
 			if (result < 0) {
-				CC_LOG_ERROR("unable to send method reply: %s\n", strerror(-result));
-				return result;
+				CC_LOG_ERROR("unable to read attribute mirror: %s\n", strerror(-result));
+				goto fail;
 			}
+			result = cc_mirror_map(fd, notify, «api.attributes.filter[isMirrored].size», &ii->mirror);
+			if (result < 0)
+				goto fail;
+			«IF !notified.empty»
+			result = cc_mirror_watch(ii->mirror, i, &cc_«api.name»_mirror_changed, ii);
+			if (result < 0)
+				ii->mirror = cc_mirror_free(ii->mirror);
 			«ENDIF»
 
-			/* Successful method invocation must return >0 */
-			return 1;
+		fail:
+			if (result < 0)
+				ii->mirror_unavailable = true;
+			sd_bus_error_free(&error);
+			reply = sd_bus_message_unref(reply);
+
+			return result;
 		}
-		«ENDFOR»
+		«ENDIF»
+		«FOR a : api.attributes»
+		«val value = a.valueSymbol(true, Capic)»
 
-		static const sd_bus_vtable vtable_«api.name»[] = {
-			SD_BUS_VTABLE_START(0),
-			«FOR m : api.methods»
-			SD_BUS_METHOD("«m.name»", «m.inArgs.byVal(SdBus).asSdBusSig», «m.outArgs.byVal(SdBus).asSdBusSig», &«m.serverThunkName», «IF m.fireAndForget»SD_BUS_VTABLE_METHOD_NO_REPLY | «ENDIF»SD_BUS_VTABLE_UNPRIVILEGED),
-			«ENDFOR»
-			SD_BUS_VTABLE_END
-		};
+		int cc_«api.name»_get_«a.name»(«api.clientTypeSignature» *instance«#[value].asParam»)
+		{
+			«IF a.isCached»
+			int result;
 
-		int «api.serverMethodPrefix»_new(const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance)
+			«ENDIF»
+			CC_LOG_DEBUG("invoked cc_«api.name»_get_«a.name»()\n");
+			assert(instance);
+			assert(value);
+
+			«IF a.isCached»
+			if (!instance->properties_slot) {
+				result = cc_«api.name»_attributes_load(instance);
+				if (result < 0)
+					return result;
+			}
+			if (!instance->«a.name»_valid)
+				return cc_«api.name»_fetch_«a.name»(instance, value);
+			«value.asLVal(Capic)» = «IF a.type.aggregate != null»*«ENDIF»instance->«a.name»_value;
+
+			return 0;
+			«ELSEIF a.isMirrored»
+			if (!instance->mirror && !instance->mirror_unavailable)
+				cc_«api.name»_mirror_open(instance);
+			/* Values the server has not written yet or is rewriting are fetched */
+			if (instance->mirror &&
+				cc_mirror_read(instance->mirror, «a.mirrorIndex», value, sizeof(*value), NULL) == 0)
+				return 0;
+			return cc_«api.name»_fetch_«a.name»(instance, value);
+			«ELSE»
+			return cc_«api.name»_fetch_«a.name»(instance, value);
+			«ENDIF»
+		}
+
+		int cc_«api.name»_fetch_«a.name»(«api.clientTypeSignature» *instance«#[value].asParam»)
 		{
 			int result;
-			«api.serverTypeSignature» *ii;
 			struct cc_instance *i;
+			sd_bus_message *reply = NULL;
+			sd_bus_error error = SD_BUS_ERROR_NULL;
 
-			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_new\n");
-			assert(address);
-			assert(impl);
+			CC_LOG_DEBUG("invoked cc_«api.name»_fetch_«a.name»()\n");
 			assert(instance);
+			assert(value);
+			i = instance->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->service && i->path && i->interface);
 
-			ii = («api.serverTypeSignature» *) calloc(1, sizeof(*ii));
-			if (!ii) {
-				CC_LOG_ERROR("failed to allocate instance memory\n");
-				return -ENOMEM;
+			result = sd_bus_call_method(
+				i->backend->bus, i->service, i->path, "org.freedesktop.DBus.Properties", "Get",
+				&error, &reply, "ss", i->interface, "«a.name»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get attribute: %s\n", strerror(-result));
+				goto fail;
 			}
+			result = «a.clientCacheName»(instance, reply);
+			if (result < 0)
+				goto fail;
+			«value.asLVal(Capic)» = «IF a.type.aggregate != null»*«ENDIF»instance->«a.name»_value;
 
-			result = cc_instance_new(address, true, &i);
+		fail:
+			sd_bus_error_free(&error);
+			reply = sd_bus_message_unref(reply);
+
+			return result;
+		}
+		«IF !a.readonly»
+
+		int cc_«api.name»_set_«a.name»(«api.clientTypeSignature» *instance«#[a.valueSymbol(false, Capic)].asParam»)
+		{
+			int result;
+			struct cc_instance *i;
+			sd_bus_message *message = NULL;
+			sd_bus_message *reply = NULL;
+			sd_bus_error error = SD_BUS_ERROR_NULL;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_set_«a.name»()\n");
+			assert(instance);
+			i = instance->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->service && i->path && i->interface);
+
+			result = sd_bus_message_new_method_call(
+				i->backend->bus, &message, i->service, i->path, "org.freedesktop.DBus.Properties", "Set");
 			if (result < 0) {
-				CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+				CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
 				goto fail;
 			}
-			ii->instance = i;
-			ii->impl = impl;
-			ii->data = data;
-
-			result = sd_bus_add_object_vtable(i->backend->bus, &ii->vtable_slot, i->path, i->interface, vtable_«api.name», ii);
+			result = sd_bus_message_append(message, "ss", i->interface, "«a.name»");
 			if (result < 0) {
-				CC_LOG_ERROR("unable to initialize instance vtable: %s\n", strerror(-result));
+				CC_LOG_ERROR("unable to append attribute value: %s\n", strerror(-result));
+				goto fail;
+			}
+			result = sd_bus_message_open_container(message, 'v', "«a.type.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append attribute value: %s\n", strerror(-result));
+				goto fail;
+			}
+			«#[a.valueSymbol(false, Capic)].asAppend("message", "goto fail;", "unable to append attribute value")»
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append attribute value: %s\n", strerror(-result));
+				goto fail;
+			}
+			result = sd_bus_call(i->backend->bus, message, 0, &error, &reply);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to set attribute: %s\n", strerror(-result));
 				goto fail;
 			}
+			«IF a.isCached»
+			/* The cache catches up with the change notification, until then the value is fetched */
+			instance->«a.name»_valid = false;
+			«ENDIF»
+
+		fail:
+			sd_bus_error_free(&error);
+			reply = sd_bus_message_unref(reply);
+			message = sd_bus_message_unref(message);
+
+			return result;
+		}
+		«ENDIF»
+		«IF !a.noSubscriptions»
+
+		int cc_«api.name»_«a.name»_subscribe(«api.clientTypeSignature» *instance, «a.clientHandlerTypeName» handler)
+		{
+			«IF a.isCached»
+			int result;
+
+			«ENDIF»
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_subscribe()\n");
+			assert(instance);
+			assert(handler);
+
+			if (instance->«a.name»_handler) {
+				CC_LOG_ERROR("unable to subscribe to attribute already subscribed to\n");
+				return -EBUSY;
+			}
+			«IF a.isMirrored»
+			if (!instance->mirror && !instance->mirror_unavailable)
+				cc_«api.name»_mirror_open(instance);
+			/* Changes of mirrored attributes are notified only through the mirror */
+			if (!instance->mirror)
+				return -ENOTSUP;
+			«ELSE»
+			if (!instance->properties_slot) {
+				result = cc_«api.name»_attributes_load(instance);
+				if (result < 0)
+					return result;
+			}
+			«ENDIF»
+			instance->«a.name»_handler = handler;
 
-			*instance = ii;
 			return 0;
+		}
+
+		void cc_«api.name»_«a.name»_unsubscribe(«api.clientTypeSignature» *instance)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_unsubscribe()\n");
+			assert(instance);
+			instance->«a.name»_handler = NULL;
+		}
+		«ENDIF»
+		«ENDFOR»
+
+		int «api.clientMethodPrefix»_new(const char *address, void *data, «api.clientTypeSignature» **instance)
+		{
+			int result;
+			void *storage;
+			size_t size;
+
+			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_new\n");
+			assert(address);
+			assert(instance);
+
+			size = «api.clientStorageSlots» * CC_STORAGE_SLOT + CC_INSTANCE_STORAGE(strlen(address));
+			storage = cc_malloc(size);
+			if (!storage) {
+				CC_LOG_ERROR("failed to allocate instance memory\n");
+				return -ENOMEM;
+			}
+
+			result = «api.clientMethodPrefix»_init(storage, size, address, data, instance);
+			if (result < 0)
+				cc_free(storage);
 
-		fail:
-			ii = «api.serverMethodPrefix»_free(ii);
 			return result;
 		}
 
-		«api.serverTypeSignature» *«api.serverMethodPrefix»_free(«api.serverTypeSignature» *instance)
+		«api.clientTypeSignature» *«api.clientMethodPrefix»_free(«api.clientTypeSignature» *instance)
 		{
-			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_free()\n");
+			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_free()\n");
 			if (instance) {
-				instance->vtable_slot = sd_bus_slot_unref(instance->vtable_slot);
-				instance->instance = cc_instance_free(instance->instance);
-				/* User is resposible for memory management of impl and data. */
-				free(instance);
+				«api.clientMethodPrefix»_fini(instance);
+				/* User is responsible for memory management of data. */
+				cc_free(instance);
 			}
 			return NULL;
 		}
 
-		void *«api.serverMethodPrefix»_get_data(«api.serverTypeSignature» *instance)
+		void *«api.clientMethodPrefix»_get_data(«api.clientTypeSignature» *instance)
 		{
 			assert(instance);
 			return instance->data;
 		}
-	'''
 
+		void «api.clientMethodPrefix»_set_timeout(«api.clientTypeSignature» *instance, uint64_t usec)
+		{
+			assert(instance && instance->instance);
+			instance->instance->timeout = usec;
+		}
+
+		static void «api.clientMethodPrefix»_availability_changed(struct cc_watcher *watcher, bool available)
+		{
+			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) watcher->data;
+			«IF api.methods.exists[!fireAndForget]»
+			int result;
+			uint64_t timeout;
+			sd_bus_message *message;
+			«ENDIF»
 
-	def copyrightNotice() '''
-		/* This file is created by Common API C code generator automatically. */'''
+			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_availability_changed()\n");
+			assert(ii);
+			«FOR m : api.methods.filter[!fireAndForget]»
+			if (available && ii->«m.name»_call.held) {
+				message = ii->«m.name»_call.held;
+				ii->«m.name»_call.held = NULL;
+				result = cc_instance_get_timeout(ii->instance, 0, CC_DBUS_ASYNC_CALL_TIMEOUT_USEC, &timeout);
+				if (result >= 0)
+					result = sd_bus_call_async(
+						sd_bus_message_get_bus(message), &ii->«m.name»_call.slot, message, &«m.clientReplyThunkName»,
+						ii, timeout);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to issue held method call: %s\n", strerror(-result));
+					ii->«m.name»_reply_callback = NULL;
+				}
+				«IF m.isCancellable»
+				if (result >= 0)
+					sd_bus_message_get_cookie(message, &ii->«m.name»_call.cookie);
+				«ENDIF»
+				sd_bus_message_unref(message);
+			}
+			«ENDFOR»
+			if (ii->availability_handler)
+				ii->availability_handler(ii, available);
+		}
 
+		/* Availability is tracked once asked for, so that other clients cost nothing */
+		static int «api.clientMethodPrefix»_watch(«api.clientTypeSignature» *instance)
+		{
+			int result;
 
-	def clientHeaderGuard(FInterface it) '''
-		INCLUDED_CLIENT_«it.name.toUpperCase»'''
+			if (instance->watcher.changed)
+				return 0;
+			result = cc_watcher_add(instance->instance, &instance->watcher, &«api.clientMethodPrefix»_availability_changed, instance);
+			if (result < 0)
+				CC_LOG_ERROR("unable to watch service: %s\n", strerror(-result));
+			return result;
+		}
+
+		bool «api.clientMethodPrefix»_is_available(«api.clientTypeSignature» *instance)
+		{
+			assert(instance);
+			return cc_watcher_is_available(&instance->watcher);
+		}
+
+		int «api.clientMethodPrefix»_set_availability_handler(«api.clientTypeSignature» *instance, cc_«api.name»_availability_handler_t handler)
+		{
+			assert(instance);
+			instance->availability_handler = handler;
+			return handler ? «api.clientMethodPrefix»_watch(instance) : 0;
+		}
+
+		int «api.clientMethodPrefix»_set_hold_calls(«api.clientTypeSignature» *instance, bool hold)
+		{
+			assert(instance);
+			instance->hold_calls = hold;
+			return hold ? «api.clientMethodPrefix»_watch(instance) : 0;
+		}
+
+		int «api.clientMethodPrefix»_init(void *storage, size_t size, const char *address, void *data, «api.clientTypeSignature» **instance)
+		{
+			int result;
+			«api.clientTypeSignature» *ii = («api.clientTypeSignature» *) storage;
+
+			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_init\n");
+			assert(storage);
+			assert(address);
+			assert(instance);
+			if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+				CC_LOG_ERROR("misaligned instance storage\n");
+				return -EINVAL;
+			}
+			if (size < «api.clientStorageSlots» * CC_STORAGE_SLOT) {
+				CC_LOG_ERROR("insufficient instance storage\n");
+				return -ENOBUFS;
+			}
+
+			memset(ii, 0, sizeof(*ii));
+			result = cc_instance_init((char *) storage + «api.clientStorageSlots» * CC_STORAGE_SLOT, size - «api.clientStorageSlots» * CC_STORAGE_SLOT, address, false, &ii->instance);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+				return result;
+			}
+			ii->data = data;
+			«FOR m : api.methods.filter[!fireAndForget]»
+			ii->«m.name»_call.instance = ii->instance;
+			«ENDFOR»
+
+			*instance = ii;
+			return 0;
+		}
+
+		void «api.clientMethodPrefix»_fini(«api.clientTypeSignature» *instance)
+		{
+			CC_LOG_DEBUG("invoked «api.clientMethodPrefix»_fini()\n");
+			assert(instance);
+			«IF api.hasCoalescedMethods»
+			cc_«api.name»_flush_coalesced(instance, NULL);
+			«ENDIF»
+			cc_watcher_remove(&instance->watcher);
+			«FOR m : api.methods»
+			«IF !m.fireAndForget»
+			instance->«m.name»_call.slot = sd_bus_slot_unref(instance->«m.name»_call.slot);
+			instance->«m.name»_call.held = sd_bus_message_unref(instance->«m.name»_call.held);
+			«ENDIF»
+			«IF m.hasBorrowedOutArgs»
+			instance->«m.name»_reply = sd_bus_message_unref(instance->«m.name»_reply);
+			«ENDIF»
+			«IF m.hasDerivedOutArgs»
+			instance->«m.name»_arena = cc_arena_free(instance->«m.name»_arena);
+			«ENDIF»
+			«ENDFOR»
+			«FOR b : api.broadcasts»
+			instance->«b.name»_slot = sd_bus_slot_unref(instance->«b.name»_slot);
+			«ENDFOR»
+			«IF api.hasCachedAttributes»
+			instance->properties_slot = sd_bus_slot_unref(instance->properties_slot);
+			«ENDIF»
+			«IF api.hasMirroredAttributes»
+			instance->mirror = cc_mirror_free(instance->mirror);
+			«ENDIF»
+			«FOR a : api.attributes»
+			«IF a.type.isBorrowed»
+			instance->«a.name»_message = sd_bus_message_unref(instance->«a.name»_message);
+			«ENDIF»
+			«IF a.type.aggregate != null»
+			instance->«a.name»_arena = cc_arena_free(instance->«a.name»_arena);
+			«ENDIF»
+			«ENDFOR»
+			if (instance->instance)
+				cc_instance_fini(instance->instance);
+			instance->instance = NULL;
+		}
+	'''
+
+
+	def generateServerInterfaceHeader(FInterface api) '''
+		«copyrightNotice»
+
+		#ifndef «api.serverHeaderGuard»
+		#define «api.serverHeaderGuard»
+
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <capic/backend.h>
+		«IF api.usesByteBuffer»
+		#include <capic/types.h>
+		«ENDIF»
+		«IF !api.types.empty»
+		#include "src-gen/types-«api.name».h"
+		«ENDIF»
+
+
+		#ifdef __cplusplus
+		extern "C" {
+		#endif
+
+		«api.serverTypeSignature»;
+		«api.serverFamilyTypeSignature»;
+
+		/* Storage for «api.serverMethodPrefix»_init() with addresses of up to CC_INSTANCE_ADDRESS_MAX */
+		#define «api.serverStorageSize» («api.serverStorageSlots» * CC_STORAGE_SLOT + CC_INSTANCE_SIZE)
+
+		«FOR m : api.methods»
+		typedef int (*cc_«api.name»_«m.name»_t)(«api.serverTypeSignature» *instance«m.inArgs.byVal(Capic).asParam»«m.outArgs.byRef(Capic).asParam»);
+		«ENDFOR»
+		«FOR a : api.attributes»
+		typedef int (*cc_«api.name»_get_«a.name»_t)(«api.serverTypeSignature» *instance«#[a.valueSymbol(true, Capic)].asParam»);
+		«IF !a.readonly»
+		typedef int (*cc_«api.name»_set_«a.name»_t)(«api.serverTypeSignature» *instance«#[a.valueSymbol(false, Capic)].asParam»);
+		«ENDIF»
+		«ENDFOR»
+
+		«api.serverImplTypeSignature» {
+			«FOR m : api.methods»
+			cc_«api.name»_«m.name»_t «m.name»;
+			«ENDFOR»
+			«FOR a : api.attributes»
+			cc_«api.name»_get_«a.name»_t get_«a.name»;
+			«IF !a.readonly»
+			cc_«api.name»_set_«a.name»_t set_«a.name»;
+			«ENDIF»
+			«ENDFOR»
+		};
+
+		/* Object families resolve paths below the family path into per-object data */
+		typedef int (*«api.serverMethodPrefix»_lookup_t)(«api.serverFamilyTypeSignature» *family, const char *path, void **data);
+		typedef int (*«api.serverMethodPrefix»_enumerate_t)(«api.serverFamilyTypeSignature» *family, char ***paths);
+
+		int «api.serverMethodPrefix»_new(const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance);
+		«api.serverTypeSignature» *«api.serverMethodPrefix»_free(«api.serverTypeSignature» *instance);
+		void *«api.serverMethodPrefix»_get_data(«api.serverTypeSignature» *instance);
+		int «api.serverMethodPrefix»_init(void *storage, size_t size, const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance);
+		void «api.serverMethodPrefix»_fini(«api.serverTypeSignature» *instance);
+
+		int «api.serverMethodPrefix»_family_new(const char *address, const «api.serverImplTypeSignature» *impl, «api.serverMethodPrefix»_lookup_t lookup, «api.serverMethodPrefix»_enumerate_t enumerate, void *data, «api.serverFamilyTypeSignature» **family);
+		«api.serverFamilyTypeSignature» *«api.serverMethodPrefix»_family_free(«api.serverFamilyTypeSignature» *family);
+		void *«api.serverMethodPrefix»_family_get_data(«api.serverFamilyTypeSignature» *family);
+		«IF !api.methods.empty»
+
+		/* Calls beyond limit in progress at once are refused, 0 removes the limit */
+		void cc_«api.name»_set_limit(«api.serverTypeSignature» *instance, unsigned int limit);
+		«FOR m : api.methods»
+		void cc_«api.name»_«m.name»_set_limit(«api.serverTypeSignature» *instance, unsigned int limit);
+		«ENDFOR»
+		«ENDIF»
+		«IF !api.broadcasts.empty || api.hasCachedAttributes || api.hasMirroredAttributes»
+
+		«FOR b : api.broadcasts»
+		int cc_«api.name»_«b.name»_emit(«api.serverTypeSignature» *instance«b.outArgs.byVal(Capic).asParam»);
+		«ENDFOR»
+		«FOR a : api.attributes.filter[isCached]»
+		/* Notifies subscribers, which receive the value returned by the getter */
+		int cc_«api.name»_«a.name»_changed(«api.serverTypeSignature» *instance);
+		«ENDFOR»
+		«FOR a : api.attributes.filter[isMirrored]»
+		/* Writes the value returned by the getter to the shared memory mirror */
+		int cc_«api.name»_«a.name»_changed(«api.serverTypeSignature» *instance);
+		«ENDFOR»
+		«IF !api.broadcasts.empty || api.hasCachedAttributes»
+
+		/* Emissions within window_usec after the previous one are held back, 0 disables throttling */
+		«FOR b : api.broadcasts»
+		void cc_«api.name»_«b.name»_set_window(«api.serverTypeSignature» *instance, uint64_t window_usec);
+		«ENDFOR»
+		«IF api.hasCachedAttributes»
+		void cc_«api.name»_set_changes_window(«api.serverTypeSignature» *instance, uint64_t window_usec);
+		«ENDIF»
+		«ENDIF»
+		«ENDIF»
+
+
+		#ifdef __cplusplus
+		}
+		#endif
+
+
+		#endif /* ifndef «api.serverHeaderGuard» */
+	'''
+
+
+	def generateServerInterfaceBody(FInterface api) '''
+		«copyrightNotice»
+
+		#include "src-gen/server-«api.name».h"
+
+		#include <assert.h>
+		#include <errno.h>
+		#include <stdlib.h>
+		#include <string.h>
+		#include <capic/backend.h>
+		#include <capic/dbus-private.h>
+		#include <capic/log.h>
+		#include <capic/memory.h>
+
+
+		«api.serverTypeSignature» {
+			struct cc_instance *instance;
+			void *data;
+			const «api.serverImplTypeSignature» *impl;
+			/* Family the instance serves the objects of, NULL for a single object */
+			«api.serverFamilyTypeSignature» *family;
+			struct sd_bus_slot *vtable_slot;
+			«IF api.hasPriorityMethods»
+			struct sd_bus_slot *lane_vtable_slot;
+			«ENDIF»
+			«IF !api.methods.empty»
+			struct cc_admission admission;
+			«FOR m : api.methods»
+			struct cc_admission «m.name»_admission;
+			«ENDFOR»
+			«ENDIF»
+			«FOR b : api.broadcasts»
+			struct cc_throttle «b.name»_throttle;
+			/* Latest value held back until the window ends */
+			sd_bus_message *«b.name»_pending;
+			«IF b.selective»
+			char *«b.name»_filter;
+			«ENDIF»
+			«ENDFOR»
+			«IF api.hasCachedAttributes»
+			struct cc_throttle changes_throttle;
+			«FOR a : api.attributes.filter[isCached]»
+			bool «a.name»_changed;
+			«ENDFOR»
+			«ENDIF»
+			«IF api.hasMirroredAttributes»
+			struct cc_mirror *mirror;
+			«ENDIF»
+		};
+
+		/* Storage holds the server followed by its instance */
+		_Static_assert(sizeof(«api.serverTypeSignature») <= «api.serverStorageSlots» * CC_STORAGE_SLOT, "«api.serverStorageSize» is too small");
+
+		«api.serverFamilyTypeSignature» {
+			struct cc_instance *instance;
+			void *data;
+			«api.serverMethodPrefix»_lookup_t lookup;
+			«api.serverMethodPrefix»_enumerate_t enumerate;
+			/* Passed to method thunks, which look up the data of the object being invoked */
+			«api.serverTypeSignature» object;
+			struct sd_bus_slot *vtable_slot;
+			struct sd_bus_slot *enumerator_slot;
+		};
+
+		/* Objects of a family have their data looked up for every call rather than
+		 * once found, so that calls served within one another each see their own */
+		static int «api.serverMethodPrefix»_object_enter(«api.serverTypeSignature» *ii, const char *path, void **previous)
+		{
+			int result;
+			void *data = NULL;
+
+			*previous = ii->data;
+			if (!ii->family)
+				return 0;
+			result = ii->family->lookup(ii->family, path, &data);
+			if (result == 0)
+				result = -ENOENT;
+			if (result < 0) {
+				CC_LOG_ERROR("unable to look up object data: %s\n", strerror(-result));
+				return result;
+			}
+			ii->data = data;
+			return 0;
+		}
+
+		«FOR m : api.methods»
+		«IF m.isPlain»
+
+		static int «m.serverThunkName»(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		{
+			int result = 0;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			void *previous_data;
+			«IF m.hasDeadline»
+			uint64_t deadline;
+			uint64_t previous;
+			«ENDIF»
+			«m.inArgs.byVal(SdBus).asDecl»
+			«m.outArgs.byVal(Capic).asDecl»
+
+			CC_LOG_DEBUG("invoked «m.serverThunkName»()\n");
+			assert(m);
+			assert(ii && ii->impl);
+			CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
+
+			/* Served once sd-bus returns if the implementation may make reentrant calls */
+			result = cc_instance_defer_call(ii->instance, m, &«m.serverThunkName», ii);
+			if (result != 0)
+				return result;
+			«IF m.hasDeadline»
+			result = sd_bus_message_read(m, "t", &deadline);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read method deadline: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDIF»
+			result = sd_bus_message_read(m, «m.inArgs.byVal(SdBus).asSdBusSig»«m.inArgs.byVal(SdBus).asRef(SdBus)»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
+				return result;
+			}
+			if (!ii->impl->«m.name») {
+				CC_LOG_ERROR("unsupported method invoked: %s\n", "«api.name».«m.name»");
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support method «api.name».«m.name»");
+				sd_bus_reply_method_error(m, error);
+				return -ENOTSUP;
+			}
+			result = cc_admission_enter(&ii->admission, &ii->«m.name»_admission, ii->instance, m, «m.deadlineValue», error);
+			if (result < 0)
+				return result;
+			«IF m.hasDeadline»
+			/* Calls made by the implementation share the deadline of this one */
+			previous = cc_deadline_swap(ii->instance, deadline);
+			«ENDIF»
+			result = «api.serverMethodPrefix»_object_enter(ii, sd_bus_message_get_path(m), &previous_data);
+			if (result >= 0)
+				result = ii->impl->«m.name»(ii«m.inArgs.byVal(SdBus).asRVal(Capic)»«m.outArgs.byVal(Capic).asRef(Capic)»);
+			ii->data = previous_data;
+			«IF m.hasDeadline»
+			cc_deadline_swap(ii->instance, previous);
+			«ENDIF»
+			cc_admission_leave(&ii->admission, &ii->«m.name»_admission);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
+				sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "method implementation failed with error=%d", result);
+				sd_bus_reply_method_error(m, error);
+				return result;
+			}
+			«IF !m.fireAndForget»
+			result = sd_bus_reply_method_return(m, «m.outArgs.byVal(Capic).asSdBusSig»«m.outArgs.byVal(Capic).asRVal(SdBus)»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to send method reply: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDIF»
+
+			/* Successful method invocation must return >0 */
+			return 1;
+		}
+		«ELSE»
+
+		static int «m.serverThunkName»(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		{
+			int result = 0;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			struct cc_arena *arena = NULL;
+			struct cc_arena_mark mark;
+			void *previous_data;
+			«IF !m.fireAndForget»
+			sd_bus_message *reply = NULL;
+			«ENDIF»
+			«IF m.hasDeadline»
+			uint64_t deadline;
+			uint64_t previous;
+			«ENDIF»
+			«m.inArgs.byVal(SdBus).asDecl»
+			«m.outArgs.asLocal.asDecl»
+
+			CC_LOG_DEBUG("invoked «m.serverThunkName»()\n");
+			assert(m);
+			assert(ii && ii->impl);
+			CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
+
+			/* Served once sd-bus returns if the implementation may make reentrant calls */
+			result = cc_instance_defer_call(ii->instance, m, &«m.serverThunkName», ii);
+			if (result != 0)
+				return result;
+			result = cc_backend_get_arena(&arena);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get backend arena: %s\n", strerror(-result));
+				return result;
+			}
+			/* Values decoded or allocated from the arena live until the reply is sent */
+			mark = cc_arena_mark(arena);
+			«IF m.hasDeadline»
+			result = sd_bus_message_read(m, "t", &deadline);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read method deadline: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ENDIF»
+			«m.inArgs.byVal(SdBus).asRead("m", "arena", "goto finish;", "unable to read method parameters")»
+			if (!ii->impl->«m.name») {
+				CC_LOG_ERROR("unsupported method invoked: %s\n", "«api.name».«m.name»");
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support method «api.name».«m.name»");
+				sd_bus_reply_method_error(m, error);
+				result = -ENOTSUP;
+				goto finish;
+			}
+			result = cc_admission_enter(&ii->admission, &ii->«m.name»_admission, ii->instance, m, «m.deadlineValue», error);
+			if (result < 0)
+				goto finish;
+			«IF m.hasDeadline»
+			/* Calls made by the implementation share the deadline of this one */
+			previous = cc_deadline_swap(ii->instance, deadline);
+			«ENDIF»
+			result = «api.serverMethodPrefix»_object_enter(ii, sd_bus_message_get_path(m), &previous_data);
+			if (result >= 0)
+				result = ii->impl->«m.name»(ii«m.inArgs.byVal(SdBus).asRVal(Capic)»«m.outArgs.byVal(Capic).asRef(Capic)»);
+			ii->data = previous_data;
+			«IF m.hasDeadline»
+			cc_deadline_swap(ii->instance, previous);
+			«ENDIF»
+			cc_admission_leave(&ii->admission, &ii->«m.name»_admission);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
+				sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "method implementation failed with error=%d", result);
+				sd_bus_reply_method_error(m, error);
+				goto finish;
+			}
+			«IF !m.fireAndForget»
+			result = sd_bus_message_new_method_return(m, &reply);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to create method reply: %s\n", strerror(-result));
+				goto finish;
+			}
+			«m.outArgs.asLocal.asAppend("reply", "goto finish;", "unable to append method reply values")»
+			result = sd_bus_send(NULL, reply, NULL);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to send method reply: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ENDIF»
+
+			/* Successful method invocation must return >0 */
+			result = 1;
+
+		finish:
+			«IF !m.fireAndForget»
+			reply = sd_bus_message_unref(reply);
+			«ENDIF»
+			cc_arena_release(arena, mark);
+
+			return result;
+		}
+		«ENDIF»
+		«IF m.isBatched»
+
+		static int «m.serverBatchThunkName»(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		{
+			int result = 0;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			void *previous_data;
+			«IF !m.fireAndForget»
+			sd_bus_message *reply = NULL;
+			«ENDIF»
+			«m.inArgs.byVal(SdBus).asDecl»
+			«m.outArgs.byVal(Capic).asDecl»
+
+			CC_LOG_DEBUG("invoked «m.serverBatchThunkName»()\n");
+			assert(m);
+			assert(ii && ii->impl);
+			CC_LOG_DEBUG("with path='%s'\n", sd_bus_message_get_path(m));
+
+			/* Served once sd-bus returns if the implementation may make reentrant calls */
+			result = cc_instance_defer_call(ii->instance, m, &«m.serverBatchThunkName», ii);
+			if (result != 0)
+				return result;
+			if (!ii->impl->«m.name») {
+				CC_LOG_ERROR("unsupported method invoked: %s\n", "«api.name».«m.name»");
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support method «api.name».«m.name»");
+				sd_bus_reply_method_error(m, error);
+				return -ENOTSUP;
+			}
+			/* The batch is admitted as a whole, so that it never runs in part */
+			result = cc_admission_enter(&ii->admission, &ii->«m.name»_admission, ii->instance, m, 0, error);
+			if (result < 0)
+				return result;
+			result = «api.serverMethodPrefix»_object_enter(ii, sd_bus_message_get_path(m), &previous_data);
+			if (result < 0) {
+				sd_bus_error_set(error, SD_BUS_ERROR_UNKNOWN_OBJECT, "object is gone");
+				sd_bus_reply_method_error(m, error);
+				goto finish;
+			}
+			«IF !m.fireAndForget»
+			result = sd_bus_message_new_method_return(m, &reply);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to create method reply: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ENDIF»
+			result = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, «m.inArgs.byVal(SdBus).asSdBusStructSig»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
+				goto finish;
+			}
+			«IF !m.fireAndForget»
+			result = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, «m.outArgs.byVal(Capic).asSdBusStructSig»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to open batch results: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ENDIF»
+			/* Reading past the last element of the array returns 0 */
+			while ((result = sd_bus_message_read(m, «m.inArgs.byVal(SdBus).asSdBusStructSig»«m.inArgs.byVal(SdBus).asRef(SdBus)»)) > 0) {
+				result = ii->impl->«m.name»(ii«m.inArgs.byVal(SdBus).asRVal(Capic)»«m.outArgs.byVal(Capic).asRef(Capic)»);
+				if (result < 0) {
+					CC_LOG_ERROR("failed to execute method: %s\n", strerror(-result));
+					sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "method implementation failed with error=%d", result);
+					sd_bus_reply_method_error(m, error);
+					goto finish;
+				}
+				«IF !m.fireAndForget»
+				result = sd_bus_message_append(reply, «m.outArgs.byVal(Capic).asSdBusStructSig»«m.outArgs.byVal(Capic).asRVal(SdBus)»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append method reply values: %s\n", strerror(-result));
+					goto finish;
+				}
+				«ENDIF»
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read method parameters: %s\n", strerror(-result));
+				goto finish;
+			}
+			«IF !m.fireAndForget»
+			result = sd_bus_message_close_container(reply);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to close batch results: %s\n", strerror(-result));
+				goto finish;
+			}
+			result = sd_bus_send(NULL, reply, NULL);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to send method reply: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ENDIF»
+
+			/* Successful method invocation must return >0 */
+			result = 1;
+
+		finish:
+			ii->data = previous_data;
+			cc_admission_leave(&ii->admission, &ii->«m.name»_admission);
+			«IF !m.fireAndForget»
+			reply = sd_bus_message_unref(reply);
+			«ENDIF»
+
+			return result;
+		}
+		«ENDIF»
+		«ENDFOR»
+		«IF !api.methods.empty»
+
+		void cc_«api.name»_set_limit(«api.serverTypeSignature» *instance, unsigned int limit)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_set_limit()\n");
+			assert(instance);
+			instance->admission.limit = limit;
+		}
+		«FOR m : api.methods»
+
+		void cc_«api.name»_«m.name»_set_limit(«api.serverTypeSignature» *instance, unsigned int limit)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_«m.name»_set_limit()\n");
+			assert(instance);
+			instance->«m.name»_admission.limit = limit;
+		}
+		«ENDFOR»
+		«ENDIF»
+		«FOR b : api.broadcasts»
+
+		static int cc_«api.name»_«b.name»_flush(«api.serverTypeSignature» *instance)
+		{
+			int result;
+			struct cc_instance *i = instance->instance;
+			sd_bus_message *message = instance->«b.name»_pending;
+
+			if (!message)
+				return 0;
+			instance->«b.name»_pending = NULL;
+			«IF b.selective»
+			cc_free(instance->«b.name»_filter);
+			instance->«b.name»_filter = NULL;
+			«ENDIF»
+			result = sd_bus_send(i->backend->bus, message, NULL);
+			sd_bus_message_unref(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to send signal: %s\n", strerror(-result));
+				return result;
+			}
+			cc_throttle_emitted(&instance->«b.name»_throttle, i);
+
+			return 0;
+		}
+
+		static int cc_«api.name»_«b.name»_window_thunk(sd_event_source *source, uint64_t usec, void *userdata)
+		{
+			«api.serverTypeSignature» *instance = («api.serverTypeSignature» *) userdata;
+			(void) source;
+			(void) usec;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«b.name»_window_thunk()\n");
+			assert(instance);
+			/* Errors are logged already, returning one would disable the timer for good */
+			cc_«api.name»_«b.name»_flush(instance);
+
+			return 0;
+		}
+
+		int cc_«api.name»_«b.name»_emit(«api.serverTypeSignature» *instance«b.outArgs.byVal(Capic).asParam»)
+		{
+			int result = 0;
+			struct cc_instance *i;
+			sd_bus_message *message = NULL;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«b.name»_emit()\n");
+			assert(instance);
+			i = instance->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->path && i->interface);
+
+			«IF b.outArgs.isVarArgs»
+			if (instance->«b.name»_throttle.window == 0) {
+				result = sd_bus_emit_signal(
+					i->backend->bus, i->path, i->interface, "«b.name»", «b.outArgs.byVal(Capic).asSdBusSig»«b.outArgs.byVal(Capic).asRVal(SdBus)»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to emit signal: %s\n", strerror(-result));
+					return result;
+				}
+
+				return 0;
+			}
+			«ENDIF»
+			result = sd_bus_message_new_signal(i->backend->bus, &message, i->path, i->interface, "«b.name»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to create signal: %s\n", strerror(-result));
+				goto fail;
+			}
+			«b.outArgs.byVal(Capic).asAppend("message", "goto fail;", "unable to append signal values")»
+			«IF b.selective»
+			/* Values for different filters are not conflated, the one held back goes first */
+			if (instance->«b.name»_pending && strcmp(instance->«b.name»_filter, «b.filterArg.name») != 0) {
+				result = cc_«api.name»_«b.name»_flush(instance);
+				if (result < 0)
+					goto fail;
+			}
+			«ENDIF»
+			result = cc_throttle_check(&instance->«b.name»_throttle, i, &cc_«api.name»_«b.name»_window_thunk, instance);
+			if (result < 0)
+				goto fail;
+			if (result == 0) {
+				«IF b.selective»
+				if (!instance->«b.name»_pending) {
+					instance->«b.name»_filter = (char *) cc_malloc(strlen(«b.filterArg.name») + 1);
+					if (!instance->«b.name»_filter) {
+						CC_LOG_ERROR("failed to allocate broadcast filter\n");
+						result = -ENOMEM;
+						goto fail;
+					}
+					strcpy(instance->«b.name»_filter, «b.filterArg.name»);
+				}
+				«ENDIF»
+				/* Only the latest value held back is emitted when the window ends */
+				sd_bus_message_unref(instance->«b.name»_pending);
+				instance->«b.name»_pending = message;
+				message = NULL;
+			} else {
+				result = sd_bus_send(i->backend->bus, message, NULL);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to send signal: %s\n", strerror(-result));
+					goto fail;
+				}
+				cc_throttle_emitted(&instance->«b.name»_throttle, i);
+			}
+
+		fail:
+			message = sd_bus_message_unref(message);
+
+			return result;
+		}
+
+		void cc_«api.name»_«b.name»_set_window(«api.serverTypeSignature» *instance, uint64_t window_usec)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_«b.name»_set_window()\n");
+			assert(instance);
+			instance->«b.name»_throttle.window = window_usec;
+		}
+		«ENDFOR»
+		«IF api.hasCachedAttributes»
+		«val cached = api.attributes.filter[isCached]»
+
+		/* Changes noted within a window are batched into one PropertiesChanged signal */
+		static int cc_«api.name»_changes_flush(«api.serverTypeSignature» *instance)
+		{
+			int result;
+			struct cc_instance *i = instance->instance;
+			const char *names[«cached.size + 1»];
+			size_t count = 0;
+
+			«FOR a : cached»
+			if (instance->«a.name»_changed)
+				names[count++] = "«a.name»";
+			instance->«a.name»_changed = false;
+			«ENDFOR»
+			if (count == 0)
+				return 0;
+			names[count] = NULL;
+			result = sd_bus_emit_properties_changed_strv(i->backend->bus, i->path, i->interface, (char **) names);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to emit attribute change: %s\n", strerror(-result));
+				return result;
+			}
+			cc_throttle_emitted(&instance->changes_throttle, i);
+
+			return 0;
+		}
+
+		static int cc_«api.name»_changes_window_thunk(sd_event_source *source, uint64_t usec, void *userdata)
+		{
+			«api.serverTypeSignature» *instance = («api.serverTypeSignature» *) userdata;
+			(void) source;
+			(void) usec;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_changes_window_thunk()\n");
+			assert(instance);
+			/* Errors are logged already, returning one would disable the timer for good */
+			cc_«api.name»_changes_flush(instance);
+
+			return 0;
+		}
+
+		void cc_«api.name»_set_changes_window(«api.serverTypeSignature» *instance, uint64_t window_usec)
+		{
+			CC_LOG_DEBUG("invoked cc_«api.name»_set_changes_window()\n");
+			assert(instance);
+			instance->changes_throttle.window = window_usec;
+		}
+		«ENDIF»
+		«IF !api.broadcasts.empty || api.hasCachedAttributes»
+
+		/* Values held back are emitted before the instance goes away */
+		static void «api.serverMethodPrefix»_flush_throttles(«api.serverTypeSignature» *instance)
+		{
+			«FOR b : api.broadcasts»
+			cc_«api.name»_«b.name»_flush(instance);
+			cc_throttle_fini(&instance->«b.name»_throttle);
+			«ENDFOR»
+			«IF api.hasCachedAttributes»
+			cc_«api.name»_changes_flush(instance);
+			cc_throttle_fini(&instance->changes_throttle);
+			«ENDIF»
+		}
+		«ENDIF»
+		«FOR a : api.attributes»
+		«val local = a.localSymbol»
+
+		static int cc_«api.name»_«a.name»_get_thunk(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error)
+		{
+			int result = 0;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			«IF a.type.aggregate != null»
+			struct cc_arena *arena = NULL;
+			struct cc_arena_mark mark;
+			«ENDIF»
+			void *previous_data;
+			«local.asDecl»;
+			(void) bus;
+			(void) interface;
+			(void) property;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_get_thunk()\n");
+			assert(reply);
+			assert(ii && ii->impl);
+
+			if (!ii->impl->get_«a.name») {
+				CC_LOG_ERROR("unsupported attribute read: %s\n", "«api.name».«a.name»");
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support reading attribute «api.name».«a.name»");
+				return -ENOTSUP;
+			}
+			«IF a.type.aggregate != null»
+			result = cc_backend_get_arena(&arena);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get backend arena: %s\n", strerror(-result));
+				return result;
+			}
+			/* Values allocated from the arena live until they are appended */
+			mark = cc_arena_mark(arena);
+			«ENDIF»
+			result = «api.serverMethodPrefix»_object_enter(ii, path, &previous_data);
+			if (result >= 0)
+				result = ii->impl->get_«a.name»(ii, «a.valueSymbol(false, Capic).asRef(Capic)»);
+			ii->data = previous_data;
+			if (result < 0) {
+				CC_LOG_ERROR("failed to get attribute: %s\n", strerror(-result));
+				sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "attribute getter failed with error=%d", result);
+				goto finish;
+			}
+			«#[local].asAppend("reply", "goto finish;", "unable to append attribute value")»
+
+		finish:
+			«IF a.type.aggregate != null»
+			cc_arena_release(arena, mark);
+
+			«ENDIF»
+			return result;
+		}
+		«IF !a.readonly»
+		«val value = a.valueSymbol(false, SdBus)»
+
+		static int cc_«api.name»_«a.name»_set_thunk(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *message, void *userdata, sd_bus_error *error)
+		{
+			int result = 0;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			«IF a.type.aggregate != null»
+			struct cc_arena *arena = NULL;
+			struct cc_arena_mark mark;
+			«ENDIF»
+			void *previous_data;
+			«value.asDecl»;
+			(void) bus;
+			(void) interface;
+			(void) property;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_set_thunk()\n");
+			assert(message);
+			assert(ii && ii->impl);
+
+			if (!ii->impl->set_«a.name») {
+				CC_LOG_ERROR("unsupported attribute write: %s\n", "«api.name».«a.name»");
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not support writing attribute «api.name».«a.name»");
+				return -ENOTSUP;
+			}
+			«IF a.type.aggregate != null»
+			result = cc_backend_get_arena(&arena);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to get backend arena: %s\n", strerror(-result));
+				return result;
+			}
+			/* Values decoded from the arena live until the setter returns */
+			mark = cc_arena_mark(arena);
+			«ENDIF»
+			«#[value].asRead("message", "arena", "goto finish;", "unable to read attribute value")»
+			result = «api.serverMethodPrefix»_object_enter(ii, path, &previous_data);
+			if (result >= 0)
+				result = ii->impl->set_«a.name»(ii, «value.asRVal(Capic)»);
+			ii->data = previous_data;
+			if (result < 0) {
+				CC_LOG_ERROR("failed to set attribute: %s\n", strerror(-result));
+				sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "attribute setter failed with error=%d", result);
+				goto finish;
+			}
+			«IF a.isCached»
+			/* Writes by clients are rare, so they are notified at once and not throttled */
+			result = sd_bus_emit_properties_changed(bus, path, interface, property, NULL);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to emit attribute change: %s\n", strerror(-result));
+				goto finish;
+			}
+			«ELSEIF a.isMirrored»
+			if (ii->mirror)
+				result = cc_«api.name»_«a.name»_changed(ii);
+			«ENDIF»
+
+		finish:
+			«IF a.type.aggregate != null»
+			cc_arena_release(arena, mark);
+
+			«ENDIF»
+			return result;
+		}
+		«ENDIF»
+		«IF a.isCached»
+
+		int cc_«api.name»_«a.name»_changed(«api.serverTypeSignature» *instance)
+		{
+			int result;
+			struct cc_instance *i;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_changed()\n");
+			assert(instance);
+			i = instance->instance;
+			assert(i && i->backend && i->backend->bus);
+			assert(i->path && i->interface);
+
+			instance->«a.name»_changed = true;
+			result = cc_throttle_check(&instance->changes_throttle, i, &cc_«api.name»_changes_window_thunk, instance);
+			if (result <= 0)
+				return result;
+
+			return cc_«api.name»_changes_flush(instance);
+		}
+		«ENDIF»
+		«IF a.isMirrored»
+
+		int cc_«api.name»_«a.name»_changed(«api.serverTypeSignature» *instance)
+		{
+			int result;
+			«a.valueSymbol(false, Capic).asDecl»;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_«a.name»_changed()\n");
+			assert(instance && instance->impl);
+
+			/* Objects of a family share one server without a mirror */
+			if (!instance->mirror || !instance->impl->get_«a.name»)
+				return -ENOTSUP;
+			result = instance->impl->get_«a.name»(instance, &value);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to get attribute: %s\n", strerror(-result));
+				return result;
+			}
+			cc_mirror_write(instance->mirror, «a.mirrorIndex», &value, sizeof(value));
+
+			return 0;
+		}
+		«ENDIF»
+		«ENDFOR»
+		«IF api.hasMirroredAttributes»
+
+		static int cc_«api.name»_open_mirror_thunk(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		{
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_open_mirror_thunk()\n");
+			assert(m);
+			assert(ii);
+			/* Objects of a family share one server without a mirror */
+			if (!ii->mirror) {
+				sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED, "instance does not mirror attributes");
+				return -ENOTSUP;
+			}
+
+			return cc_mirror_reply_open(ii->mirror, m, error);
+		}
+		«ENDIF»
+		«IF api.hasCancellableMethods»
+
+		static int cc_«api.name»_cancel_call_thunk(CC_IGNORE_BUS_ARG sd_bus_message *m, void *userdata, sd_bus_error *error)
+		{
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) userdata;
+			(void) error;
+
+			CC_LOG_DEBUG("invoked cc_«api.name»_cancel_call_thunk()\n");
+			assert(m);
+			assert(ii && ii->instance);
+
+			return cc_cancel_notice(ii->instance, m);
+		}
+		«ENDIF»
+
+		static const sd_bus_vtable vtable_«api.name»[] = {
+			SD_BUS_VTABLE_START(0),
+			«FOR m : api.methods»
+			SD_BUS_METHOD("«m.name»", «m.serverInSig», «m.outArgs.byVal(SdBus).asSdBusSig», &«m.serverThunkName», «IF m.fireAndForget»SD_BUS_VTABLE_METHOD_NO_REPLY | «ENDIF»SD_BUS_VTABLE_UNPRIVILEGED),
+			«IF m.isBatched»
+			«IF m.fireAndForget»
+			SD_BUS_METHOD("«m.batchName»", «m.inArgs.byVal(SdBus).asSdBusArraySig», "", &«m.serverBatchThunkName», SD_BUS_VTABLE_METHOD_NO_REPLY | SD_BUS_VTABLE_UNPRIVILEGED),
+			«ELSE»
+			SD_BUS_METHOD("«m.batchName»", «m.inArgs.byVal(SdBus).asSdBusArraySig», «m.outArgs.byVal(SdBus).asSdBusArraySig», &«m.serverBatchThunkName», SD_BUS_VTABLE_UNPRIVILEGED),
+			«ENDIF»
+			«ENDIF»
+			«ENDFOR»
+			«IF api.hasMirroredAttributes»
+			SD_BUS_METHOD("OpenAttributeMirror", "", "hh", &cc_«api.name»_open_mirror_thunk, SD_BUS_VTABLE_UNPRIVILEGED),
+			«ENDIF»
+			«IF api.hasCancellableMethods»
+			SD_BUS_METHOD(CC_DBUS_CANCEL_MEMBER, "t", "", &cc_«api.name»_cancel_call_thunk, SD_BUS_VTABLE_METHOD_NO_REPLY | SD_BUS_VTABLE_UNPRIVILEGED),
+			«ENDIF»
+			«FOR b : api.broadcasts»
+			SD_BUS_SIGNAL("«b.name»", «b.outArgs.byVal(SdBus).asSdBusSig», 0),
+			«ENDFOR»
+			«FOR a : api.attributes»
+			«IF a.readonly»
+			SD_BUS_PROPERTY("«a.name»", "«a.type.asSdBusSig»", &cc_«api.name»_«a.name»_get_thunk, 0, «a.propertyFlags»),
+			«ELSE»
+			SD_BUS_WRITABLE_PROPERTY("«a.name»", "«a.type.asSdBusSig»", &cc_«api.name»_«a.name»_get_thunk, &cc_«api.name»_«a.name»_set_thunk, 0, «a.propertyFlags»),
+			«ENDIF»
+			«ENDFOR»
+			SD_BUS_VTABLE_END
+		};
+
+		int «api.serverMethodPrefix»_new(const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance)
+		{
+			int result;
+			void *storage;
+			size_t size;
+
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_new\n");
+			assert(address);
+			assert(impl);
+			assert(instance);
+
+			size = «api.serverStorageSlots» * CC_STORAGE_SLOT + CC_INSTANCE_STORAGE(strlen(address));
+			storage = cc_malloc(size);
+			if (!storage) {
+				CC_LOG_ERROR("failed to allocate instance memory\n");
+				return -ENOMEM;
+			}
+
+			result = «api.serverMethodPrefix»_init(storage, size, address, impl, data, instance);
+			if (result < 0)
+				cc_free(storage);
+
+			return result;
+		}
+
+		«api.serverTypeSignature» *«api.serverMethodPrefix»_free(«api.serverTypeSignature» *instance)
+		{
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_free()\n");
+			if (instance) {
+				«api.serverMethodPrefix»_fini(instance);
+				/* User is resposible for memory management of impl and data. */
+				cc_free(instance);
+			}
+			return NULL;
+		}
+
+		void *«api.serverMethodPrefix»_get_data(«api.serverTypeSignature» *instance)
+		{
+			assert(instance);
+			return instance->data;
+		}
+
+		int «api.serverMethodPrefix»_init(void *storage, size_t size, const char *address, const «api.serverImplTypeSignature» *impl, void *data, «api.serverTypeSignature» **instance)
+		{
+			int result;
+			«api.serverTypeSignature» *ii = («api.serverTypeSignature» *) storage;
+			struct cc_instance *i;
+
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_init\n");
+			assert(storage);
+			assert(address);
+			assert(impl);
+			assert(instance);
+			if ((uintptr_t) storage % CC_STORAGE_SLOT != 0) {
+				CC_LOG_ERROR("misaligned instance storage\n");
+				return -EINVAL;
+			}
+			if (size < «api.serverStorageSlots» * CC_STORAGE_SLOT) {
+				CC_LOG_ERROR("insufficient instance storage\n");
+				return -ENOBUFS;
+			}
+
+			memset(ii, 0, sizeof(*ii));
+			result = cc_instance_init((char *) storage + «api.serverStorageSlots» * CC_STORAGE_SLOT, size - «api.serverStorageSlots» * CC_STORAGE_SLOT, address, true, &i);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+				return result;
+			}
+			ii->instance = i;
+			ii->impl = impl;
+			ii->data = data;
+
+			result = sd_bus_add_object_vtable(i->backend->bus, &ii->vtable_slot, i->path, i->interface, vtable_«api.name», ii);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to initialize instance vtable: %s\n", strerror(-result));
+				goto fail;
+			}
+			«IF api.hasPriorityMethods»
+			result = cc_instance_serve_lane(i, vtable_«api.name», ii, &ii->lane_vtable_slot);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to serve instance on priority lane: %s\n", strerror(-result));
+				goto fail;
+			}
+			«ENDIF»
+			«IF api.hasMirroredAttributes»
+			result = cc_mirror_new(«api.attributes.filter[isMirrored].size», &ii->mirror);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to create attribute mirror: %s\n", strerror(-result));
+				goto fail;
+			}
+			«ENDIF»
+
+			*instance = ii;
+			return 0;
+
+		fail:
+			«api.serverMethodPrefix»_fini(ii);
+			return result;
+		}
+
+		void «api.serverMethodPrefix»_fini(«api.serverTypeSignature» *instance)
+		{
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_fini()\n");
+			assert(instance);
+			«IF !api.broadcasts.empty || api.hasCachedAttributes»
+			«api.serverMethodPrefix»_flush_throttles(instance);
+			«ENDIF»
+			instance->vtable_slot = sd_bus_slot_unref(instance->vtable_slot);
+			«IF api.hasPriorityMethods»
+			instance->lane_vtable_slot = sd_bus_slot_unref(instance->lane_vtable_slot);
+			«ENDIF»
+			«IF api.hasMirroredAttributes»
+			instance->mirror = cc_mirror_free(instance->mirror);
+			«ENDIF»
+			if (instance->instance)
+				cc_instance_fini(instance->instance);
+			instance->instance = NULL;
+		}
+
+		static int «api.serverMethodPrefix»_family_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error)
+		{
+			int result;
+			«api.serverFamilyTypeSignature» *ff = («api.serverFamilyTypeSignature» *) userdata;
+			void *data = NULL;
+			(void) bus;
+			(void) interface;
+			(void) error;
+
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_family_find()\n");
+			assert(path);
+			assert(found);
+			assert(ff && ff->lookup);
+			CC_LOG_DEBUG("with path='%s'\n", path);
+
+			/* Only tells whether the object exists, its data is looked up per call */
+			result = ff->lookup(ff, path, &data);
+			if (result <= 0)
+				return result;
+			*found = &ff->object;
+
+			return 1;
+		}
+
+		static int «api.serverMethodPrefix»_family_enumerate(sd_bus *bus, const char *prefix, void *userdata, char ***nodes, sd_bus_error *error)
+		{
+			«api.serverFamilyTypeSignature» *ff = («api.serverFamilyTypeSignature» *) userdata;
+			(void) bus;
+			(void) prefix;
+			(void) error;
+
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_family_enumerate()\n");
+			assert(nodes);
+			assert(ff && ff->enumerate);
+			CC_LOG_DEBUG("with prefix='%s'\n", prefix);
+
+			return ff->enumerate(ff, nodes);
+		}
+
+		int «api.serverMethodPrefix»_family_new(const char *address, const «api.serverImplTypeSignature» *impl, «api.serverMethodPrefix»_lookup_t lookup, «api.serverMethodPrefix»_enumerate_t enumerate, void *data, «api.serverFamilyTypeSignature» **family)
+		{
+			int result;
+			«api.serverFamilyTypeSignature» *ff;
+			struct cc_instance *i;
+
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_family_new\n");
+			assert(address);
+			assert(impl);
+			assert(lookup);
+			assert(family);
+
+			ff = («api.serverFamilyTypeSignature» *) cc_calloc(1, sizeof(*ff));
+			if (!ff) {
+				CC_LOG_ERROR("failed to allocate family memory\n");
+				return -ENOMEM;
+			}
+
+			result = cc_instance_new(address, true, &i);
+			if (result < 0) {
+				CC_LOG_ERROR("failed to create instance: %s\n", strerror(-result));
+				goto fail;
+			}
+			ff->instance = i;
+			ff->data = data;
+			ff->lookup = lookup;
+			ff->enumerate = enumerate;
+			ff->object.instance = i;
+			ff->object.impl = impl;
+			ff->object.family = ff;
+
+			/* A single registration serves all objects below the family path */
+			result = sd_bus_add_fallback_vtable(i->backend->bus, &ff->vtable_slot, i->path, i->interface, vtable_«api.name», &«api.serverMethodPrefix»_family_find, ff);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to initialize family vtable: %s\n", strerror(-result));
+				goto fail;
+			}
+			if (enumerate) {
+				result = sd_bus_add_node_enumerator(i->backend->bus, &ff->enumerator_slot, i->path, &«api.serverMethodPrefix»_family_enumerate, ff);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to initialize family enumerator: %s\n", strerror(-result));
+					goto fail;
+				}
+			}
+
+			*family = ff;
+			return 0;
+
+		fail:
+			ff = «api.serverMethodPrefix»_family_free(ff);
+			return result;
+		}
+
+		«api.serverFamilyTypeSignature» *«api.serverMethodPrefix»_family_free(«api.serverFamilyTypeSignature» *family)
+		{
+			CC_LOG_DEBUG("invoked «api.serverMethodPrefix»_family_free()\n");
+			if (family) {
+				«IF !api.broadcasts.empty || api.hasCachedAttributes»
+				«api.serverMethodPrefix»_flush_throttles(&family->object);
+				«ENDIF»
+				family->enumerator_slot = sd_bus_slot_unref(family->enumerator_slot);
+				family->vtable_slot = sd_bus_slot_unref(family->vtable_slot);
+				family->instance = cc_instance_free(family->instance);
+				/* User is resposible for memory management of impl and data. */
+				cc_free(family);
+			}
+			return NULL;
+		}
+
+		void *«api.serverMethodPrefix»_family_get_data(«api.serverFamilyTypeSignature» *family)
+		{
+			assert(family);
+			return family->data;
+		}
+	'''
+
+
+	def generateTypesHeader(FInterface api) '''
+		«copyrightNotice»
+
+		#ifndef «api.typesHeaderGuard»
+		#define «api.typesHeaderGuard»
+
+		#include <stddef.h>
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <capic/types.h>
+
+
+		#ifdef __cplusplus
+		extern "C" {
+		#endif
+
+		struct sd_bus_message;
+		struct cc_arena;
+
+		«FOR t : api.marshalledTypes»
+		«t.typeSignature»;
+		«ENDFOR»
+		«FOR t : api.types.definitionOrder»
+
+		«t.typeDefinition»
+		«ENDFOR»
+		«FOR t : api.columnTypes»
+
+		/* Columns of «t.name», each starting at a CC_COLUMN_ALIGNMENT byte boundary */
+		«t.columnsSignature» {
+			«FOR f : t.columnFields»
+			«f.type.asElementSig»*«f.name»;
+			«ENDFOR»
+			size_t size;
+		};
+		«ENDFOR»
+
+		«FOR t : api.marshalledTypes»
+		int «t.typeName»_append(struct sd_bus_message *message, const «t.typeSignature» *value);
+		int «t.typeName»_read(struct sd_bus_message *message, struct cc_arena *arena, «t.typeSignature» *value);
+		«ENDFOR»
+		«FOR t : api.types.filter(FMapType)»
+		const «t.entrySignature» *«t.typeName»_find(const «t.typeSignature» *map, «t.keyType.asCapicSig»key);
+		«ENDFOR»
+		«FOR t : api.columnTypes»
+		int «t.typeName»_columns_append(struct sd_bus_message *message, const «t.columnsSignature» *value);
+		int «t.typeName»_columns_read(struct sd_bus_message *message, struct cc_arena *arena, «t.columnsSignature» *value);
+		«ENDFOR»
+
+
+		#ifdef __cplusplus
+		}
+		#endif
+
+
+		#endif /* ifndef «api.typesHeaderGuard» */
+	'''
+
+
+	def generateTypesBody(FInterface api) '''
+		«copyrightNotice»
+
+		#include "src-gen/types-«api.name».h"
+
+		#include <assert.h>
+		#include <errno.h>
+		#include <stdlib.h>
+		#include <string.h>
+		#include <capic/convert.h>
+		#include <capic/dbus-private.h>
+		#include <capic/log.h>
+		#include <capic/memory.h>
+		«FOR t : api.marshalledTypes»
+
+		«t.typeMarshalling»
+		«ENDFOR»
+		«FOR t : api.columnTypes»
+
+		«t.columnsMarshalling»
+		«ENDFOR»
+	'''
+
+
+	def typeDefinition(FType it) {
+		switch it {
+			FStructType: structDefinition
+			FArrayType: arrayDefinition
+			FMapType: mapDefinition
+			FEnumerationType: enumDefinition
+			FUnionType: unionDefinition
+			default: throw new UnsupportedOperationException("Type " + name + " is not supported")
+		}
+	}
+
+
+	def structDefinition(FStructType it) '''
+		«IF layout != null»
+		/* Layout matches the D-Bus wire format */
+		«ENDIF»
+		«typeSignature» {
+			«FOR f : elements»
+			«f.type.asCapicSig»«f.name»;
+			«ENDFOR»
+		};'''
+
+
+	def arrayDefinition(FArrayType it) '''
+		«typeSignature» {
+			«elementType.asElementSig»*data;
+			size_t size;
+		};'''
+
+
+	def enumDefinition(FEnumerationType it) '''
+		/* Values of «name» are sent as "«backingType.asSdBusSig»" */
+		typedef «backingType.asCapicSig»«typeSignature»;
+		«IF !allEnumerators.empty»
+
+		enum «typeName» {
+			«FOR e : enumeratorValues.entrySet»
+			«typeName»_«e.key.name» = «e.value»,
+			«ENDFOR»
+		};
+		«ENDIF»'''
+
+
+	def unionDefinition(FUnionType it) '''
+		enum «typeName»_tag {
+			«FOR n : 0 ..< elements.size»
+			«typeName»_«elements.get(n).name» = «n»,
+			«ENDFOR»
+		};
+
+		/* The tag selects the member in use and is sent as the index in front of the variant */
+		«typeSignature» {
+			uint8_t tag;
+			union {
+				«FOR f : elements»
+				«f.type.asCapicSig»«f.name»;
+				«ENDFOR»
+			};
+		};'''
+
+
+	def mapDefinition(FMapType it) '''
+		«entrySignature» {
+			«keyType.asCapicSig»key;
+			«valueType.asCapicSig»value;
+		};
+
+		/* Entries are sorted by key, which _find() relies on */
+		«typeSignature» {
+			const «entrySignature» *data;
+			size_t size;
+		};'''
+
+
+	def typeMarshalling(FType it) {
+		switch it {
+			FStructType: structMarshalling
+			FArrayType: arrayMarshalling
+			FMapType: mapMarshalling
+			FUnionType: unionMarshalling
+			default: throw new UnsupportedOperationException("Type " + name + " is not supported")
+		}
+	}
+
+
+	def structMarshalling(FStructType it) '''
+		«val fieldLayout = layout»
+		«IF fieldLayout != null»
+		/* Fields sit at their wire offsets, which lets arrays of «name» be copied in bulk */
+		_Static_assert(sizeof(«typeSignature») == «fieldLayout.last», "unexpected size of «typeSignature»");
+		«FOR n : 0 ..< elements.size»
+		_Static_assert(offsetof(«typeSignature», «elements.get(n).name») == «fieldLayout.get(n)», "unexpected offset of «typeSignature».«elements.get(n).name»");
+		«ENDFOR»
+
+		«ENDIF»
+		int «typeName»_append(sd_bus_message *message, const «typeSignature» *value)
+		{
+			int result;
+
+			assert(message);
+			assert(value);
+
+			«IF elements.forall[type.isVarArg]»
+			result = sd_bus_message_append(message, "«asSdBusSig»"«FOR f : elements», «f.fieldSymbol.asRVal(SdBus)»«ENDFOR»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ELSE»
+			result = sd_bus_message_open_container(message, 'r', "«elements.map[type.asSdBusSig].join»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«elements.map[fieldSymbol].asAppend("message", "return result;", "unable to append " + name)»
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDIF»
+
+			return 0;
+		}
+
+		int «typeName»_read(sd_bus_message *message, struct cc_arena *arena, «typeSignature» *value)
+		{
+			int result;
+			«FOR f : elements.filter[type.needsConversion]»
+			«f.tempSymbol.asDecl»;
+			«ENDFOR»
+			«IF !elements.exists[type.aggregate != null]»
+			(void) arena;
+			«ENDIF»
+
+			assert(message);
+			assert(value);
+
+			«IF elements.forall[type.isVarArg]»
+			result = sd_bus_message_read(message, "«asSdBusSig»"«FOR f : elements», «f.readRef»«ENDFOR»);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ELSE»
+			result = sd_bus_message_enter_container(message, 'r', "«elements.map[type.asSdBusSig].join»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«FOR seg : elements.segments[type]»
+			«IF seg.head.type.aggregate != null»
+			result = «seg.head.type.aggregate.typeName»_read(message, arena, &value->«seg.head.name»);
+			«ELSEIF seg.head.type.isByteBuffer»
+			result = sd_bus_message_read_array(message, 'y', (const void **) &value->«seg.head.name».data, &value->«seg.head.name».size);
+			«ELSE»
+			result = sd_bus_message_read(message, "«seg.map[type.asSdBusSig].join»"«FOR f : seg», «f.readRef»«ENDFOR»);
+			«ENDIF»
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDFOR»
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDIF»
+			«FOR f : elements.filter[type.needsConversion]»
+			value->«f.name» = «f.tempSymbol.asRVal(Capic)»;
+			«ENDFOR»
+
+			return 0;
+		}'''
+
+
+	def arrayMarshalling(FArrayType it) '''
+		int «typeName»_append(sd_bus_message *message, const «typeSignature» *value)
+		{
+			int result;
+			«IF canPack»
+			«wireSig»*wire;
+			«ELSEIF !isContiguous»
+			size_t i;
+			«ENDIF»
+
+			assert(message);
+			assert(value);
+
+			«IF isContiguous»
+			result = sd_bus_message_append_array(message, '«contiguousSig»', value->data, value->size * sizeof(value->data[0]));
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ELSEIF canPack»
+			/* Elements are converted straight into the message */
+			result = sd_bus_message_append_array_space(message, '«elementType.asSdBusSig»', value->size * sizeof(*wire), (void **) &wire);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			cc_pack_floats(wire, value->data, value->size);
+			«ELSE»
+			result = sd_bus_message_open_container(message, 'a', "«elementType.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			for (i = 0; i < value->size; ++i) {
+				«#[elementType.elementSymbol("value->data[i]")].asAppend("message", "return result;", "unable to append " + name)»
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ENDIF»
+
+			return 0;
+		}
+
+		int «typeName»_read(sd_bus_message *message, struct cc_arena *arena, «typeSignature» *value)
+		{
+			int result;
+			«IF isContiguous»
+			const void *data;
+			size_t size;
+			«IF !isBulk»
+			(void) arena;
+			«ENDIF»
+			«ELSEIF canUnpack»
+			const void *wire;
+			«elementType.asCapicSig»*data;
+			size_t size;
+			«ELSE»
+			«elementType.asCapicSig»*data = NULL;
+			size_t size = 0, capacity = 0;
+			«IF elementType.needsConversion»
+			«elementType.elementTemp.asDecl»;
+			«ENDIF»
+			«ENDIF»
+
+			assert(message);
+			assert(value);
+
+			«IF isContiguous»
+			result = sd_bus_message_read_array(message, '«contiguousSig»', &data, &size);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«IF isBulk»
+			if (size % sizeof(value->data[0]) != 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(EBADMSG));
+				return -EBADMSG;
+			}
+			/* Byte arrays are not aligned in the message, copy them in one go if needed */
+			if ((uintptr_t) data % _Alignof(«elementType.asCapicSig.trim») != 0) {
+				void *copy = cc_arena_alloc(arena, size);
+
+				if (!copy) {
+					CC_LOG_ERROR("failed to allocate «name» memory\n");
+					return -ENOMEM;
+				}
+				memcpy(copy, data, size);
+				data = copy;
+			}
+			«ENDIF»
+			value->data = («elementType.asElementSig»*) data;
+			value->size = size / sizeof(value->data[0]);
+			«ELSEIF canUnpack»
+			result = sd_bus_message_read_array(message, '«elementType.asSdBusSig»', &wire, &size);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			size /= sizeof(«wireSig.trim»);
+			data = («elementType.asCapicSig»*) cc_arena_alloc(arena, size * sizeof(*data));
+			if (!data) {
+				CC_LOG_ERROR("failed to allocate «name» memory\n");
+				return -ENOMEM;
+			}
+			«IF elementType.basic == FBasicTypeId.BOOLEAN»
+			result = cc_unpack_bools(data, (const uint32_t *) wire, size);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«ELSE»
+			cc_unpack_floats(data, (const double *) wire, size);
+			«ENDIF»
+			value->data = data;
+			value->size = size;
+			«ELSE»
+			result = sd_bus_message_enter_container(message, 'a', "«elementType.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			while ((result = sd_bus_message_at_end(message, 0)) == 0) {
+				if (size == capacity) {
+					capacity = capacity ? 2 * capacity : 16;
+					data = («elementType.asCapicSig»*) cc_arena_grow(arena, data, size * sizeof(*data), capacity * sizeof(*data));
+					if (!data) {
+						CC_LOG_ERROR("failed to allocate «name» memory\n");
+						return -ENOMEM;
+					}
+				}
+				«IF elementType.aggregate != null»
+				result = «elementType.aggregate.typeName»_read(message, arena, &data[size]);
+				«ELSEIF elementType.isByteBuffer»
+				result = sd_bus_message_read_array(message, 'y', (const void **) &data[size].data, &data[size].size);
+				«ELSEIF elementType.needsConversion»
+				result = sd_bus_message_read(message, "«elementType.asSdBusSig»", «elementType.elementTemp.asRef(SdBus)»);
+				«ELSE»
+				result = sd_bus_message_read(message, "«elementType.asSdBusSig»", &data[size]);
+				«ENDIF»
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«IF elementType.needsConversion»
+				data[size] = «elementType.elementTemp.asRVal(Capic)»;
+				«ENDIF»
+				++size;
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			value->data = data;
+			value->size = size;
+			«ENDIF»
+
+			return 0;
+		}'''
+
+
+	def mapMarshalling(FMapType it) '''
+		static int «typeName»_compare(const void *a, const void *b)
+		{
+			const «entrySignature» *x = (const «entrySignature» *) a;
+			const «entrySignature» *y = (const «entrySignature» *) b;
+
+			return «keyType.keyOrder("x->key", "y->key")»;
+		}
+
+		int «typeName»_append(sd_bus_message *message, const «typeSignature» *value)
+		{
+			int result;
+			size_t i;
+
+			assert(message);
+			assert(value);
+
+			result = sd_bus_message_open_container(message, 'a', "«entrySig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			/* Entries are appended straight from the flat array */
+			for (i = 0; i < value->size; ++i) {
+				«IF valueType.isVarArg»
+				result = sd_bus_message_append(message, "«entrySig»", «new Symbol("value->data[i].key", keyType, false, Capic).asRVal(SdBus)», «new Symbol("value->data[i].value", valueType, false, Capic).asRVal(SdBus)»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«ELSE»
+				result = sd_bus_message_open_container(message, 'e', "«keyType.asSdBusSig»«valueType.asSdBusSig»");
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«#[keyType.elementSymbol("value->data[i].key"), valueType.elementSymbol("value->data[i].value")].asAppend("message", "return result;", "unable to append " + name)»
+				result = sd_bus_message_close_container(message);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«ENDIF»
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+
+			return 0;
+		}
+
+		int «typeName»_read(sd_bus_message *message, struct cc_arena *arena, «typeSignature» *value)
+		{
+			«entrySignature» *data = NULL;
+			size_t size = 0, capacity = 0;
+			bool sorted = true;
+			int result;
+			«IF keyType.needsConversion»
+			«keyTemp.asDecl»;
+			«ENDIF»
+			«IF valueType.needsConversion»
+			«valueType.elementTemp.asDecl»;
+			«ENDIF»
+
+			assert(message);
+			assert(value);
+
+			result = sd_bus_message_enter_container(message, 'a', "«entrySig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			while ((result = sd_bus_message_at_end(message, 0)) == 0) {
+				if (size == capacity) {
+					capacity = capacity ? 2 * capacity : 16;
+					data = («entrySignature» *) cc_arena_grow(arena, data, size * sizeof(*data), capacity * sizeof(*data));
+					if (!data) {
+						CC_LOG_ERROR("failed to allocate «name» memory\n");
+						return -ENOMEM;
+					}
+				}
+				«IF valueType.isVarArg»
+				result = sd_bus_message_read(message, "«entrySig»", «keyRef», «valueRef»);
+				«ELSE»
+				result = sd_bus_message_enter_container(message, 'e', "«keyType.asSdBusSig»«valueType.asSdBusSig»");
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				result = sd_bus_message_read(message, "«keyType.asSdBusSig»", «keyRef»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«IF valueType.aggregate != null»
+				result = «valueType.aggregate.typeName»_read(message, arena, &data[size].value);
+				«ELSE»
+				result = sd_bus_message_read_array(message, 'y', (const void **) &data[size].value.data, &data[size].value.size);
+				«ENDIF»
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				result = sd_bus_message_exit_container(message);
+				«ENDIF»
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«IF keyType.needsConversion»
+				data[size].key = «keyTemp.asRVal(Capic)»;
+				«ENDIF»
+				«IF valueType.needsConversion»
+				data[size].value = «valueType.elementTemp.asRVal(Capic)»;
+				«ENDIF»
+				if (size > 0 && «keyType.keyOrder("data[size - 1].key", "data[size].key")» > 0)
+					sorted = false;
+				++size;
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			/* Maps are normally sent sorted, anything else is sorted once here */
+			if (!sorted)
+				qsort(data, size, sizeof(*data), &«typeName»_compare);
+			value->data = data;
+			value->size = size;
+
+			return 0;
+		}
+
+		const «entrySignature» *«typeName»_find(const «typeSignature» *map, «keyType.asCapicSig»key)
+		{
+			size_t low = 0, high;
+
+			assert(map);
+
+			high = map->size;
+			while (low < high) {
+				size_t middle = low + (high - low) / 2;
+				int order = «keyType.keyOrder("map->data[middle].key", "key")»;
+
+				if (order == 0)
+					return &map->data[middle];
+				if (order < 0)
+					low = middle + 1;
+				else
+					high = middle;
+			}
+
+			return NULL;
+		}'''
+
+
+	def unionMarshalling(FUnionType it) '''
+		«FOR f : elements»
+		static int «typeName»_read_«f.name»(sd_bus_message *message, struct cc_arena *arena, «typeSignature» *value)
+		{
+			int result;
+			«IF f.type.needsConversion»
+			«f.tempSymbol.asDecl»;
+			«ENDIF»
+			«IF f.type.aggregate == null»
+			(void) arena;
+			«ENDIF»
+
+			result = sd_bus_message_enter_container(message, 'v', "«f.type.asSdBusSig»");
+			if (result < 0)
+				return result;
+			«IF f.type.aggregate != null»
+			result = «f.type.aggregate.typeName»_read(message, arena, &value->«f.name»);
+			«ELSEIF f.type.isByteBuffer»
+			result = sd_bus_message_read_array(message, 'y', (const void **) &value->«f.name».data, &value->«f.name».size);
+			«ELSE»
+			result = sd_bus_message_read(message, "«f.type.asSdBusSig»", «f.readRef»);
+			«ENDIF»
+			if (result < 0)
+				return result;
+			«IF f.type.needsConversion»
+			value->«f.name» = «f.tempSymbol.asRVal(Capic)»;
+			«ENDIF»
+
+			return sd_bus_message_exit_container(message);
+		}
+
+		«ENDFOR»
+		/* Readers indexed by tag, so that decoding dispatches without comparing signatures */
+		static int (*const «typeName»_readers[])(sd_bus_message *, struct cc_arena *, «typeSignature» *) = {
+			«FOR f : elements»
+			&«typeName»_read_«f.name»,
+			«ENDFOR»
+		};
+
+		int «typeName»_append(sd_bus_message *message, const «typeSignature» *value)
+		{
+			static const char *const signatures[] = {«FOR f : elements SEPARATOR ', '»"«f.type.asSdBusSig»"«ENDFOR»};
+			int result;
+
+			assert(message);
+			assert(value);
+
+			if (value->tag >= sizeof(signatures) / sizeof(signatures[0])) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(EINVAL));
+				return -EINVAL;
+			}
+			result = sd_bus_message_open_container(message, 'r', "yv");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_append(message, "y", value->tag);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_open_container(message, 'v', signatures[value->tag]);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			switch (value->tag) {
+			«FOR f : elements»
+			case «typeName»_«f.name»:
+				«#[f.fieldSymbol].asAppend("message", "return result;", "unable to append " + name)»
+				break;
+			«ENDFOR»
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+
+			return 0;
+		}
+
+		int «typeName»_read(sd_bus_message *message, struct cc_arena *arena, «typeSignature» *value)
+		{
+			int result;
+
+			assert(message);
+			assert(value);
+
+			result = sd_bus_message_enter_container(message, 'r', "yv");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_read(message, "y", &value->tag);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			if (value->tag >= sizeof(«typeName»_readers) / sizeof(«typeName»_readers[0])) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(EBADMSG));
+				return -EBADMSG;
+			}
+			result = «typeName»_readers[value->tag](message, arena, value);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+
+			return 0;
+		}'''
+
+
+	def columnsMarshalling(FArrayType it) '''
+		int «typeName»_columns_append(sd_bus_message *message, const «columnsSignature» *value)
+		{
+			int result;
+			size_t i;
+
+			assert(message);
+			assert(value);
+
+			result = sd_bus_message_open_container(message, 'a', "«elementType.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+			for (i = 0; i < value->size; ++i) {
+				result = sd_bus_message_append(message, "«elementType.asSdBusSig»"«FOR f : columnFields», «new Symbol("value->" + f.name + "[i]", f.type, false, Capic).asRVal(SdBus)»«ENDFOR»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+					return result;
+				}
+			}
+			result = sd_bus_message_close_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to append «name»: %s\n", strerror(-result));
+				return result;
+			}
+
+			return 0;
+		}
+
+		int «typeName»_columns_read(sd_bus_message *message, struct cc_arena *arena, «columnsSignature» *value)
+		{
+			static const size_t sizes[] = {«FOR f : columnFields SEPARATOR ', '»sizeof(«f.type.asCapicSig.trim»)«ENDFOR»};
+			void *column[«columnFields.size»] = {NULL};
+			size_t size = 0, capacity = 0;
+			int result;
+			«FOR f : columnFields.filter[type.needsConversion]»
+			«f.tempSymbol.asDecl»;
+			«ENDFOR»
+
+			assert(message);
+			assert(value);
+
+			result = sd_bus_message_enter_container(message, 'a', "«elementType.asSdBusSig»");
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			/* Fields are scattered into their columns in a single pass over the message */
+			while ((result = sd_bus_message_at_end(message, 0)) == 0) {
+				if (size == capacity) {
+					capacity = capacity ? 2 * capacity : 64;
+					result = cc_arena_grow_columns(arena, column, sizes, «columnFields.size», size, capacity);
+					if (result < 0) {
+						CC_LOG_ERROR("failed to allocate «name» memory\n");
+						return result;
+					}
+				}
+				result = sd_bus_message_read(message, "«elementType.asSdBusSig»"«FOR n : 0 ..< columnFields.size», «columnFields.get(n).columnRef(n)»«ENDFOR»);
+				if (result < 0) {
+					CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+					return result;
+				}
+				«FOR n : 0 ..< columnFields.size»
+				«IF columnFields.get(n).type.needsConversion»
+				((«columnFields.get(n).type.asCapicSig»*) column[«n»])[size] = «columnFields.get(n).tempSymbol.asRVal(Capic)»;
+				«ENDIF»
+				«ENDFOR»
+				++size;
+			}
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			result = sd_bus_message_exit_container(message);
+			if (result < 0) {
+				CC_LOG_ERROR("unable to read «name»: %s\n", strerror(-result));
+				return result;
+			}
+			«FOR n : 0 ..< columnFields.size»
+			value->«columnFields.get(n).name» = («columnFields.get(n).type.asElementSig»*) column[«n»];
+			«ENDFOR»
+			value->size = size;
+
+			return 0;
+		}'''
+
+
+	def copyrightNotice() '''
+		/* This file is created by Common API C code generator automatically. */'''
+
+
+	def clientHeaderGuard(FInterface it) '''
+		INCLUDED_CLIENT_«it.name.toUpperCase»'''
+
+
+	def clientTypeSignature(FInterface it) '''
+		struct cc_client_«it.name»'''
+
+
+	def clientMethodPrefix(FInterface it) '''
+		cc_client_«it.name»'''
+
+
+	def clientStorageSize(FInterface it) '''
+		CC_CLIENT_«it.name.toUpperCase»_SIZE'''
+
+
+	/* The instance, data and availability take nine slots, methods their reply callback and call */
+	def clientStorageSlots(FInterface it) {
+		17 + 5 * methods.filter[!fireAndForget].size + methods.filter[hasBorrowedOutArgs].size +
+				methods.filter[hasDerivedOutArgs].size + methods.filter[isBatched].size +
+				2 * methods.filter[isCoalesced].size + 2 * broadcasts.size +
+				attributes.fold(0)[n, a | n + a.clientStorageSlots] + (if (hasCachedAttributes) 1 else 0) +
+				(if (hasMirroredAttributes) 2 else 0) + (if (hasPriorityMethods) 1 else 0)
+	}
+
+
+	def clientReplyTypeName(FMethod it) '''
+		cc_«it.apiName»_«it.name»_reply_t'''
+
+
+	def clientReplyThunkName(FMethod it) '''
+		cc_«it.apiName»_«it.name»_reply_thunk'''
+
+
+	def clientHandlerTypeName(FBroadcast it) '''
+		cc_«it.apiName»_«it.name»_handler_t'''
+
+
+	def clientSignalThunkName(FBroadcast it) '''
+		cc_«it.apiName»_«it.name»_signal_thunk'''
+
+
+	/* Cached value, the message and arena it points into, validity and handler */
+	static def int clientStorageSlots(FAttribute it) {
+		1 + (if (type.isByteBuffer) 1 else 0) + (if (type.isBorrowed) 1 else 0) +
+				(if (type.aggregate != null) 1 else 0) + (if (isCached || isMirrored && !noSubscriptions) 2 else 0)
+	}
+
+
+	def clientHandlerTypeName(FAttribute it) '''
+		cc_«it.apiName»_«it.name»_handler_t'''
+
+
+	def clientCacheName(FAttribute it) '''
+		cc_«it.apiName»_«it.name»_cache'''
+
+
+	def typesHeaderGuard(FInterface it) '''
+		INCLUDED_TYPES_«it.name.toUpperCase»'''
+
+
+	def serverHeaderGuard(FInterface it) '''
+		INCLUDED_SERVER_«it.name.toUpperCase»'''
+
+
+	def serverStorageSize(FInterface it) '''
+		CC_SERVER_«it.name.toUpperCase»_SIZE'''
+
+
+	/* Throttles take three slots, pending broadcasts another one or two with the filter */
+	def serverStorageSlots(FInterface it) {
+		5 + (if (methods.empty) 0 else 1 + methods.size) +
+				broadcasts.fold(0)[n, b | n + (if (b.selective) 5 else 4)] +
+				(if (hasCachedAttributes) 3 + (attributes.filter[isCached].size + 7) / 8 else 0) +
+				(if (hasMirroredAttributes) 1 else 0) + (if (hasPriorityMethods) 1 else 0)
+	}
+
+
+	def serverTypeSignature(FInterface it) '''
+		struct cc_server_«it.name»'''
+
+
+	def serverMethodPrefix(FInterface it) '''
+		cc_server_«it.name»'''
+
+
+	def serverImplTypeSignature(FInterface it) '''
+		struct cc_server_«it.name»_impl'''
+
+
+	def serverFamilyTypeSignature(FInterface it) '''
+		struct cc_server_«it.name»_family'''
+
+
+	def serverThunkName(FMethod it) '''
+		cc_«it.apiName»_«it.name»_thunk'''
+
+
+	def serverBatchThunkName(FMethod it) '''
+		cc_«it.apiName»_«it.name»_batch_thunk'''
+
+
+	def apiName(FModelElement it) {
+		var api = it.eContainer()
+		api.eGet(api.eClass().getEStructuralFeature("name"))
+	}
+
+
+	static def inArgs(FMethod it) {
+		getInArgs()
+	}
+
+
+	static def outArgs(FMethod it) {
+		getOutArgs()
+	}
+
+
+	static def byVal(Iterable<FArgument> it, Domain domain) {
+		map[a | byVal(a, domain)]
+	}
+
+
+	static def byRef(Iterable<FArgument> it, Domain domain) {
+		map[a | byRef(a, domain)]
+	}
+
+
+	static def asParam(Iterable<Symbol> it) '''
+		«FOR s : it», «s.asParam»«ENDFOR»'''
+
+
+	static def asDecl(Iterable<Symbol> it) '''
+		«FOR s : it»«s.asDecl»;
+		«ENDFOR»'''
+
+
+	static def asAssign(Iterable<Symbol> it, Iterable<Symbol> ss) '''
+		«if (it.size != ss.size)
+			throw new IllegalArgumentException("Sequences must have the same size")»
+		«val iter = ss.iterator()»
+		«val pairs = map[ s | s -> iter.next ]»
+		«FOR p : pairs»«p.key.asAssign(p.value)»;
+		«ENDFOR»'''
+
+
+	static def asRVal(Iterable<Symbol> it, Domain domain) '''
+		«FOR s : it», «s.asRVal(domain)»«ENDFOR»'''
+
+
+	static def asRef(Iterable<Symbol> it, Domain domain) '''
+		«FOR s : it», «s.asRef(domain)»«ENDFOR»'''
+
+
+	static def Iterable<Symbol> diffBySig(Iterable<Symbol> it, Iterable<Symbol> ss) {
+		if (it.size != ss.size)
+			throw new IllegalArgumentException("Sequences must have the same size")
+		var result = newArrayList()
+		for (var n = 0; n < it.size; n++)
+			if (it.get(n).type.aggregate == null && it.get(n).asSig != ss.get(n).asSig)
+				result.add(it.get(n))
+		return result
+	}
+
+
+	static def byVal(FArgument it, Domain domain) {
+		if (array)
+			throw new UnsupportedOperationException("Implicit arrays are not supported, use named array types")
+		new Symbol(name, type, false, domain, isColumns)
+	}
+
+
+	static def byRef(FArgument it, Domain domain) {
+		if (array)
+			throw new UnsupportedOperationException("Implicit arrays are not supported, use named array types")
+		new Symbol(name, type, true, domain, isColumns)
+	}
+
+
+	/* Values of derived types live in local variables and are passed on by reference */
+	static def asLocal(Iterable<FArgument> it) {
+		map[a | if (a.type.aggregate != null) byVal(a, SdBus) else byVal(a, Capic)]
+	}
+
+
+	static def asParam(Symbol it) {
+		asSig + name
+	}
+
+
+	static def asDecl(Symbol it) {
+		asSig + asLVal(domain)
+	}
+
+
+	static def asAssign(Symbol it, Symbol sym) {
+		asLVal(domain) + " = " + sym.asRVal(domain)
+	}
+
+
+	static def asCapicSig(FTypeRef it) {
+		if (derived != null)
+			return derived.typeSignature + " "
+		return basic.asCapicSig
+	}
+
+
+	static def asCapicSig(FBasicTypeId it) {
+		if (it == FBasicTypeId.UNDEFINED)
+			throw new UnsupportedOperationException("Integer types are not supported")
+		switch (it) {
+			case FBasicTypeId::BOOLEAN:     "bool "
+			case FBasicTypeId::INT8:        "int8_t "
+			case FBasicTypeId::INT16:       "int16_t "
+			case FBasicTypeId::INT32:       "int32_t "
+			case FBasicTypeId::INT64:       "int64_t "
+			case FBasicTypeId::UINT8:       "uint8_t "
+			case FBasicTypeId::UINT16:      "uint16_t "
+			case FBasicTypeId::UINT32:      "uint32_t "
+			case FBasicTypeId::UINT64:      "uint64_t "
+			case FBasicTypeId::FLOAT:       "float "
+			case FBasicTypeId::DOUBLE:      "double "
+			case FBasicTypeId::STRING:      "const char *"
+			case FBasicTypeId::BYTE_BUFFER: "struct cc_byte_buffer "
+			default: throw new IllegalArgumentException("Unsupported basic type " + toString)
+		}
+	}
+
+
+	static def asSig(Symbol it) {
+		if (it.domain == Capic && !it.isRef && type.aggregate != null)
+			return "const " + asValueSig + "*"
+		if (it.domain == Capic && !it.isRef)
+			return type.asCapicSig
+		if (it.domain == Capic && it.isRef)
+			return asValueSig + "*"
+		if (it.domain == SdBus && !it.isRef && type.aggregate != null)
+			return asValueSig
+		if (it.domain == SdBus && !it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "int "
+				case FBasicTypeId::FLOAT:       "double "
+				case FBasicTypeId::INT8:        "uint8_t "
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: type.asCapicSig
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	}
+
+
+	static def asRVal(Symbol it, Domain domain) {
+		if (it.domain == Capic && domain == Capic && !it.isRef)
+			return name
+		if (type.aggregate != null) {
+			if (it.domain == Capic && domain == Printf && it.isRef)
+				return "(void *) " + name
+			if (it.domain == SdBus && domain == Capic && !it.isRef)
+				return "&" + name
+			if (it.domain == SdBus && domain == Printf && !it.isRef)
+				return "(void *) &" + name
+		}
+		if (it.domain == Capic && domain == SdBus && !it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "(int) " + name
+				case FBasicTypeId::FLOAT:       "(double) " + name
+				case FBasicTypeId::INT8:        "(uint8_t) " + name
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: name
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		if (it.domain == Capic && domain == Printf && it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "(int) *" + name
+				case FBasicTypeId::FLOAT:       "(double) *" + name
+				case FBasicTypeId::INT8,
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING:      "*" + name
+				case FBasicTypeId::BYTE_BUFFER: name + "->size"
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		if (it.domain == SdBus && domain == Capic && !it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "!!" + name + "_int"
+				case FBasicTypeId::FLOAT:       "(float) " + name + "_double"
+				case FBasicTypeId::INT8:        "(int8_t) " + name + "_uint8_t"
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: name
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		if (it.domain == SdBus && domain == Printf && !it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "!!" + name + "_int"
+				case FBasicTypeId::FLOAT:       name + "_double"
+				case FBasicTypeId::INT8:        "(int8_t) " + name + "_uint8_t"
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING:      name
+				case FBasicTypeId::BYTE_BUFFER: name + ".size"
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	}
+
+
+	static def asLVal(Symbol it, Domain domain) {
+		if (it.domain == Capic && domain == Capic && !it.isRef)
+			return name
+		if (it.domain == Capic && domain == Capic && it.isRef)
+			return "*" + name
+		if (it.domain == SdBus && domain == SdBus && !it.isRef && type.aggregate != null)
+			return name
+		if (it.domain == SdBus && domain == SdBus && !it.isRef) {
+			if (type.basic == FBasicTypeId.UNDEFINED)
+				throw new UnsupportedOperationException("Derived and Integer types are not supported")
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     name + "_int"
+				case FBasicTypeId::FLOAT:       name + "_double"
+				case FBasicTypeId::INT8:        name + "_uint8_t"
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: name
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	}
+
+
+	static def asRef(Symbol it, Domain domain) {
+		if (it.domain == Capic && domain == Capic && !it.isRef)
+			return "&" + name
+		if (it.domain == SdBus && domain == SdBus && !it.isRef && type.aggregate != null)
+			return "&" + name
+		if (it.domain == Capic && domain == SdBus && it.isRef) {
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "&" + name + "_int"
+				case FBasicTypeId::FLOAT:       "&" + name + "_double"
+				case FBasicTypeId::INT8:        "&" + name + "_uint8_t"
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: name
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		if (it.domain == SdBus && domain == SdBus && !it.isRef) {
+			return switch (type.basic) {
+				case FBasicTypeId::BOOLEAN:     "&" + name + "_int"
+				case FBasicTypeId::FLOAT:       "&" + name + "_double"
+				case FBasicTypeId::INT8:        "&" + name + "_uint8_t"
+				case FBasicTypeId::INT16,
+				case FBasicTypeId::INT32,
+				case FBasicTypeId::INT64,
+				case FBasicTypeId::UINT8,
+				case FBasicTypeId::UINT16,
+				case FBasicTypeId::UINT32,
+				case FBasicTypeId::UINT64,
+				case FBasicTypeId::DOUBLE,
+				case FBasicTypeId::STRING,
+				case FBasicTypeId::BYTE_BUFFER: "&" + name
+				default: throw new IllegalArgumentException("Unsupported basic type " + type.basic.toString)
+			}
+		}
+		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	}
+
+
+	static def asPrintfFormat(Iterable<Symbol> it) '''
+		«IF empty»void«ELSE»«FOR s : it SEPARATOR ', '»«s.name»«IF s.type.isByteBuffer».size«ENDIF»=%«s.type.asPrintfSig»«ENDFOR»«ENDIF»'''
+
+
+	static def asPrintfSig(FTypeRef it) {
+		if (aggregate != null)
+			return "p"
+		if (basic == FBasicTypeId.UNDEFINED)
+			throw new UnsupportedOperationException("Integer types are not supported")
+		switch (basic) {
+			case FBasicTypeId::BOOLEAN:     "d"
+			case FBasicTypeId::FLOAT:       "g"
+			case FBasicTypeId::INT8:        "\" PRId8 \""
+			case FBasicTypeId::INT16:       "\" PRId16 \""
+			case FBasicTypeId::INT32:       "\" PRId32 \""
+			case FBasicTypeId::INT64:       "\" PRId64 \""
+			case FBasicTypeId::UINT8:       "\" PRIu8 \""
+			case FBasicTypeId::UINT16:      "\" PRIu16 \""
+			case FBasicTypeId::UINT32:      "\" PRIu32 \""
+			case FBasicTypeId::UINT64:      "\" PRIu64 \""
+			case FBasicTypeId::DOUBLE:      "g"
+			case FBasicTypeId::STRING:      "s"
+			case FBasicTypeId::BYTE_BUFFER: "zu"
+			default: throw new IllegalArgumentException("Unsupported basic type " + basic.toString)
+		}
+	}
+
+
+	static def asSdBusSig(Iterable<Symbol> it) '''
+		"«FOR s : it»«s.type.asSdBusSig»«ENDFOR»"'''
+
+
+	static def asSdBusStructSig(Iterable<Symbol> it) '''
+		"(«FOR s : it»«s.type.asSdBusSig»«ENDFOR»)"'''
+
+
+	static def asSdBusArraySig(Iterable<Symbol> it) '''
+		"a(«FOR s : it»«s.type.asSdBusSig»«ENDFOR»)"'''
+
+
+	static def String asSdBusSig(FTypeRef it) {
+		if (aggregate != null)
+			return aggregate.asSdBusSig
+		return basic.asSdBusSig
+	}
+
+
+	static def asSdBusSig(FBasicTypeId it) {
+		if (it == FBasicTypeId.UNDEFINED)
+			throw new UnsupportedOperationException("Integer types are not supported")
+		switch (it) {
+			case FBasicTypeId::BOOLEAN:     "b"
+			case FBasicTypeId::INT8:        "y"
+			case FBasicTypeId::INT16:       "n"
+			case FBasicTypeId::INT32:       "i"
+			case FBasicTypeId::INT64:       "x"
+			case FBasicTypeId::UINT8:       "y"
+			case FBasicTypeId::UINT16:      "q"
+			case FBasicTypeId::UINT32:      "u"
+			case FBasicTypeId::UINT64:      "t"
+			case FBasicTypeId::FLOAT:       "d"
+			case FBasicTypeId::DOUBLE:      "d"
+			case FBasicTypeId::STRING:      "s"
+			case FBasicTypeId::BYTE_BUFFER: "ay"
+			default: throw new IllegalArgumentException("Unsupported basic type " + toString)
+		}
+	}
+
+
+	static def isByteBuffer(FTypeRef it) {
+		basic == FBasicTypeId.BYTE_BUFFER
+	}
+
+
+	/* Received strings, buffers and derived values point into the message or the arena */
+	static def isBorrowed(FTypeRef it) {
+		basic == FBasicTypeId.STRING || basic == FBasicTypeId.BYTE_BUFFER || aggregate != null
+	}
+
+
+	/* Basic types that sd_bus_message_append() and sd_bus_message_read() take as variadic arguments */
+	static def isVarArg(FTypeRef it) {
+		aggregate == null && !isByteBuffer
+	}
+
+
+	static def isVarArgs(Iterable<FArgument> it) {
+		forall[type.isVarArg]
+	}
+
+
+	static def hasBorrowedOutArgs(FMethod it) {
+		!fireAndForget && outArgs.exists[type.isBorrowed]
+	}
+
+
+	/* Batches pass tuples of basic values in one message, e.g. <** @details: capic.batch **> */
+	static def isBatched(FMethod it) {
+		if (!options.containsKey("capic.batch"))
+			return false
+		if (inArgs.empty || (outArgs.empty && !fireAndForget) || !inArgs.isVarArgs || !outArgs.isVarArgs ||
+				outArgs.exists[type.basic == FBasicTypeId.STRING])
+			throw new IllegalArgumentException("capic.batch requires " + name + " to take and return basic or enumeration values other than returned strings")
+		return true
+	}
+
+
+	/* Calls pass the time their caller stops waiting, e.g. <** @details: capic.deadline **> */
+	static def hasDeadline(FMethod it) {
+		if (!options.containsKey("capic.deadline"))
+			return false
+		if (fireAndForget || isBatched)
+			throw new IllegalArgumentException("capic.deadline requires " + name + " to be neither fireAndForget nor batched")
+		return true
+	}
+
+
+	static def deadlineValue(FMethod it) {
+		if (hasDeadline) "deadline" else "0"
+	}
+
+
+	/* The deadline precedes the arguments of the method */
+	static def serverInSig(FMethod it) '''
+		"«IF hasDeadline»t«ENDIF»«FOR a : inArgs»«a.type.asSdBusSig»«ENDFOR»"'''
+
+
+	static def appendDeadline(FMethod it) '''
+		result = sd_bus_message_append(message, "t", cc_deadline_after(timeout));
+		if (result < 0) {
+			CC_LOG_ERROR("unable to append method deadline: %s\n", strerror(-result));
+			goto fail;
+		}'''
+
+
+	/* Servers are told of cancelled calls, e.g. <** @details: capic.cancel **> */
+	static def isCancellable(FMethod it) {
+		if (!options.containsKey("capic.cancel"))
+			return false
+		if (fireAndForget)
+			throw new IllegalArgumentException("capic.cancel requires " + name + " to have a reply")
+		return true
+	}
+
+
+	static def hasCancellableMethods(FInterface it) {
+		methods.exists[isCancellable]
+	}
+
+
+	/* Calls are made on the priority lane of the backend, e.g. <** @details: capic.priority=high **> */
+	static def hasPriority(FMethod it) {
+		val priority = options.get("capic.priority")
+		if (priority == null || priority == "normal")
+			return false
+		if (priority != "high")
+			throw new IllegalArgumentException("capic.priority of " + name + " must be high or normal")
+		if (fireAndForget || isBatched)
+			throw new IllegalArgumentException("capic.priority requires " + name + " to be neither fireAndForget nor batched")
+		return true
+	}
+
+
+	static def hasPriorityMethods(FInterface it) {
+		methods.exists[hasPriority]
+	}
+
+
+	static def newMethodCall(FMethod it) '''
+		«IF hasPriority»
+		result = cc_instance_new_method_call(i, !instance->unlaned, "«name»", &message);
+		if (result < 0)
+			goto fail;
+		«ELSE»
+		result = sd_bus_message_new_method_call(
+			i->backend->bus, &message, i->service, i->path, i->interface, "«name»");
+		if (result < 0) {
+			CC_LOG_ERROR("unable to create message: %s\n", strerror(-result));
+			goto fail;
+		}
+		«ENDIF»'''
+
+
+	static def batchName(FMethod it) {
+		name + "Batch"
+	}
+
+
+	/* One-way calls are gathered into batches instead of being made one by one */
+	static def isCoalesced(FMethod it) {
+		fireAndForget && isBatched
+	}
+
+
+	static def hasCoalescedMethods(FInterface it) {
+		methods.exists[isCoalesced]
+	}
+
+
+	/* Derived output values are decoded into an arena */
+	static def hasDerivedOutArgs(FMethod it) {
+		!fireAndForget && outArgs.exists[type.aggregate != null]
+	}
+
+
+	static def hasBorrowedOutArgs(FBroadcast it) {
+		outArgs.exists[type.isBorrowed]
+	}
+
+
+	static def hasDerivedOutArgs(FBroadcast it) {
+		outArgs.exists[type.aggregate != null]
+	}
+
+
+	/* Selective broadcasts are filtered by the bus on their leading string */
+	static def filterArg(FBroadcast it) {
+		if (outArgs.empty || outArgs.head.type.basic != FBasicTypeId.STRING)
+			throw new UnsupportedOperationException("Selective broadcasts must start with a String argument")
+		outArgs.head
+	}
+
+
+	static def filterParam(FBroadcast it) {
+		if (selective) ", const char *" + filterArg.name else ""
+	}
+
+
+	/* Clients cache attributes whose changes are notified */
+	/* Mirrored attributes are published in shared memory instead of PropertiesChanged */
+	static def isCached(FAttribute it) {
+		!noSubscriptions && !isMirrored
+	}
+
+
+	static def hasCachedAttributes(FInterface it) {
+		attributes.exists[isCached]
+	}
+
+
+	/* Values in the mirror are copied atomically and take up to 8 bytes, e.g. <** @details: capic.shm **> */
+	static def isMirrored(FAttribute it) {
+		if (!options.containsKey("capic.shm"))
+			return false
+		if (array || !type.isVarArg || type.basic == FBasicTypeId.STRING)
+			throw new IllegalArgumentException("capic.shm requires " + name + " to have a fixed size basic or enumeration type")
+		return true
+	}
+
+
+	static def hasMirroredAttributes(FInterface it) {
+		attributes.exists[isMirrored]
+	}
+
+
+	static def mirrorIndex(FAttribute it) {
+		(eContainer as FInterface).attributes.filter[isMirrored].toList.indexOf(it)
+	}
+
+
+	static def valueSymbol(FAttribute it, boolean isRef, Domain domain) {
+		if (array)
+			throw new UnsupportedOperationException("Implicit arrays are not supported, use named array types")
+		new Symbol("value", type, isRef, domain)
+	}
+
+
+	/* Values returned by getters live in local variables like out arguments */
+	static def localSymbol(FAttribute it) {
+		valueSymbol(false, if (type.aggregate != null) SdBus else Capic)
+	}
+
+
+	static def propertyFlags(FAttribute it) {
+		val flags = <String>newArrayList()
+		if (isCached)
+			flags.add("SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE")
+		if (!readonly)
+			flags.add("SD_BUS_VTABLE_UNPRIVILEGED")
+		if (flags.empty) "0" else flags.join(" | ")
+	}
+
+
+	static def isPlain(FMethod it) {
+		inArgs.isVarArgs && outArgs.isVarArgs && !hasBorrowedOutArgs
+	}
+
+
+	static def usesByteBuffer(FInterface it) {
+		methods.exists[m | (m.inArgs + m.outArgs).exists[type.isByteBuffer]] ||
+				broadcasts.exists[b | b.outArgs.exists[type.isByteBuffer]] ||
+				attributes.exists[type.isByteBuffer]
+	}
+
+
+	/* Split values into runs marshalled by a single sd-bus call each */
+	static def <T> segments(Iterable<T> it, (T) => FTypeRef typeOf) {
+		val result = <List<T>>newArrayList()
+		for (s : it) {
+			if (result.empty || !typeOf.apply(s).isVarArg || !typeOf.apply(result.last.head).isVarArg)
+				result.add(newArrayList(s))
+			else
+				result.last.add(s)
+		}
+		return result
+	}
+
+
+	static def asAppend(Iterable<Symbol> it, String message, String onError, String error) '''
+		«FOR seg : segments[type]»
+		«IF seg.head.type.aggregate != null»
+		result = «seg.head.marshallerName»_append(«message», «seg.head.asPointer»);
+		«ELSEIF seg.head.type.isByteBuffer»
+		result = sd_bus_message_append_array(«message», 'y', «seg.head.name».data, «seg.head.name».size);
+		«ELSE»
+		result = sd_bus_message_append(«message», «seg.asSdBusSig»«seg.asRVal(SdBus)»);
+		«ENDIF»
+		if (result < 0) {
+			CC_LOG_ERROR("«error»: %s\n", strerror(-result));
+			«onError»
+		}
+		«ENDFOR»'''
+
+
+	static def asRead(Iterable<Symbol> it, String message, String arena, String onError, String error) '''
+		«FOR seg : segments[type]»
+		«IF seg.head.type.aggregate != null»
+		result = «seg.head.marshallerName»_read(«message», «arena», «seg.head.asPointer»);
+		«ELSEIF seg.head.type.isByteBuffer»
+		result = sd_bus_message_read_array(«message», 'y', (const void **) «seg.head.asBufferRef("data")», «seg.head.asBufferRef("size")»);
+		«ELSE»
+		result = sd_bus_message_read(«message», «seg.asSdBusSig»«seg.asRef(SdBus)»);
+		«ENDIF»
+		if (result < 0) {
+			CC_LOG_ERROR("«error»: %s\n", strerror(-result));
+			«onError»
+		}
+		«ENDFOR»'''
+
+
+	static def asBufferRef(Symbol it, String field) {
+		"&" + name + (if (isRef) "->" else ".") + field
+	}
+
+
+	/* Derived values are passed by pointer, Capic symbols of them already are one */
+	static def asPointer(Symbol it) {
+		if (isRef || domain == Capic) name else "&" + name
+	}
+
+
+	static def typeName(FType it) {
+		"cc_" + (eContainer as FModelElement).name + "_" + name
+	}
+
+
+	static def typeSignature(FType it) {
+		if (it instanceof FEnumerationType) typeName + "_t" else "struct " + typeName
+	}
+
+
+	/* Derived types other than enumerations, which are passed by pointer */
+	static def aggregate(FTypeRef it) {
+		if (derived instanceof FEnumerationType) null else derived
+	}
+
+
+	/* Enumerations behave like the basic type their values fit in */
+	static def basic(FTypeRef it) {
+		val type = derived
+		if (type instanceof FEnumerationType) type.backingType else predefined
+	}
+
+
+	static def List<FEnumerator> allEnumerators(FEnumerationType it) {
+		val result = <FEnumerator>newArrayList()
+		if (base != null)
+			result.addAll(base.allEnumerators)
+		result.addAll(enumerators)
+		return result
+	}
+
+
+	/* Enumerators without a value count on from the previous one */
+	static def enumeratorValues(FEnumerationType it) {
+		val result = <FEnumerator, BigInteger>newLinkedHashMap()
+		var next = BigInteger.ZERO
+		for (e : allEnumerators) {
+			val value = if (e.value != null) e.value.integerValue else next
+			result.put(e, value)
+			next = value.add(BigInteger.ONE)
+		}
+		return result
+	}
+
+
+	static def BigInteger integerValue(FExpression it) {
+		switch it {
+			FIntegerConstant: ^val
+			FUnaryOperation case op == FOperator.SUBTRACTION: operand.integerValue.negate
+			default: throw new UnsupportedOperationException("Enumerator values must be integer constants")
+		}
+	}
+
+
+	/* Narrowest D-Bus integer holding all values, there is no signed byte */
+	static def FBasicTypeId backingType(FEnumerationType it) {
+		val values = enumeratorValues.values
+		val min = values.fold(BigInteger.ZERO)[a, b | a.min(b)]
+		val max = values.fold(BigInteger.ZERO)[a, b | a.max(b)]
+		val bits = Math.max(min.bitLength, max.bitLength)
+		if (min.signum >= 0) {
+			if (bits <= 8)
+				return FBasicTypeId.UINT8
+			if (bits <= 16)
+				return FBasicTypeId.UINT16
+			if (bits <= 32)
+				return FBasicTypeId.UINT32
+			if (bits <= 64)
+				return FBasicTypeId.UINT64
+		} else {
+			if (bits < 16)
+				return FBasicTypeId.INT16
+			if (bits < 32)
+				return FBasicTypeId.INT32
+			if (bits < 64)
+				return FBasicTypeId.INT64
+		}
+		throw new UnsupportedOperationException("Values of " + name + " do not fit in 64 bits")
+	}
 
 
-	def clientTypeSignature(FInterface it) '''
-		struct cc_client_«it.name»'''
+	/* Enumerations need no marshalling helpers of their own */
+	static def marshalledTypes(FInterface it) {
+		types.filter[!(it instanceof FEnumerationType)]
+	}
 
 
-	def clientMethodPrefix(FInterface it) '''
-		cc_client_«it.name»'''
+	static def entrySignature(FMapType it) {
+		"struct " + typeName + "_entry"
+	}
 
 
-	def clientReplyTypeName(FMethod it) '''
-		cc_«it.apiName»_«it.name»_reply_t'''
+	static def entrySig(FMapType it) {
+		"{" + keyType.asSdBusSig + valueType.asSdBusSig + "}"
+	}
 
 
-	def clientReplyThunkName(FMethod it) '''
-		cc_«it.apiName»_«it.name»_reply_thunk'''
+	static def keyTemp(FMapType it) {
+		new Symbol("key", keyType, false, SdBus)
+	}
 
 
-	def serverHeaderGuard(FInterface it) '''
-		INCLUDED_SERVER_«it.name.toUpperCase»'''
+	static def keyRef(FMapType it) {
+		if (keyType.needsConversion) keyTemp.asRef(SdBus) else "&data[size].key"
+	}
 
 
-	def serverTypeSignature(FInterface it) '''
-		struct cc_server_«it.name»'''
+	static def valueRef(FMapType it) {
+		if (valueType.needsConversion) valueType.elementTemp.asRef(SdBus) else "&data[size].value"
+	}
 
 
-	def serverMethodPrefix(FInterface it) '''
-		cc_server_«it.name»'''
+	/* Three-way comparison of map keys */
+	static def keyOrder(FTypeRef it, String a, String b) {
+		if (basic == FBasicTypeId.STRING)
+			return "strcmp(" + a + ", " + b + ")"
+		return "(" + a + " > " + b + ") - (" + a + " < " + b + ")"
+	}
 
 
-	def serverImplTypeSignature(FInterface it) '''
-		struct cc_server_«it.name»_impl'''
+	static def columnsSignature(FArrayType it) {
+		"struct " + typeName + "_columns"
+	}
 
 
-	def serverThunkName(FMethod it) '''
-		cc_«it.apiName»_«it.name»_thunk'''
+	static def columnFields(FArrayType it) {
+		(elementType.derived as FStructType).elements
+	}
 
 
-	def apiName(FMethod it) {
-		var api = it.eContainer()
-		api.eGet(api.eClass().getEStructuralFeature("name"))
+	static def columnRef(FField it, int n) {
+		if (type.needsConversion) tempSymbol.asRef(SdBus) else "&((" + type.asCapicSig + "*) column[" + n + "])[size]"
 	}
 
 
-	static def inArgs(FMethod it) {
-		getInArgs()
+	/* Arrays of structs passed as struct-of-arrays on request, e.g. <** @details: capic.soa **> */
+	static def isColumns(FArgument it) {
+		if (!options.containsKey("capic.soa"))
+			return false
+		val array = type.derived
+		if (!(array instanceof FArrayType) || !(array as FArrayType).hasColumns)
+			throw new IllegalArgumentException("capic.soa requires " + name + " to be an array of structs with basic fields")
+		return true
 	}
 
 
-	static def outArgs(FMethod it) {
-		getOutArgs()
+	static def hasColumns(FArrayType it) {
+		val struct = elementType.derived
+		struct instanceof FStructType && !(struct as FStructType).elements.empty &&
+				(struct as FStructType).elements.forall[type.isVarArg]
 	}
 
 
-	static def byVal(Iterable<FArgument> it, Domain domain) {
-		map[a | byVal(a, domain)]
+	static def columnTypes(FInterface it) {
+		val args = methods.map[inArgs + outArgs].flatten + broadcasts.map[outArgs].flatten
+		args.filter[isColumns].map[type.derived as FArrayType].toSet
 	}
 
 
-	static def byRef(Iterable<FArgument> it, Domain domain) {
-		map[a | byRef(a, domain)]
+	/* C type of a value, or of its columns when it is passed as struct-of-arrays */
+	static def asValueSig(Symbol it) {
+		if (columns) (type.derived as FArrayType).columnsSignature + " " else type.asCapicSig
 	}
 
 
-	static def asParam(Iterable<Symbol> it) '''
-		«FOR s : it», «s.asParam»«ENDFOR»'''
+	static def marshallerName(Symbol it) {
+		type.aggregate.typeName + (if (columns) "_columns" else "")
+	}
 
 
-	static def asDecl(Iterable<Symbol> it) '''
-		«FOR s : it»«s.asDecl»;
-		«ENDFOR»'''
+	static def String asSdBusSig(FType it) {
+		switch it {
+			FStructType: "(" + elements.map[type.asSdBusSig].join + ")"
+			FArrayType: if (isBulk) "ay" else "a" + elementType.asSdBusSig
+			FMapType: "a" + entrySig
+			FUnionType: "(yv)"
+			default: throw new UnsupportedOperationException("Type " + name + " is not supported")
+		}
+	}
 
 
-	static def asAssign(Iterable<Symbol> it, Iterable<Symbol> ss) '''
-		«if (it.size != ss.size)
-			throw new IllegalArgumentException("Sequences must have the same size")»
-		«val iter = ss.iterator()»
-		«val pairs = map[ s | s -> iter.next ]»
-		«FOR p : pairs»«p.key.asAssign(p.value)»;
-		«ENDFOR»'''
+	/* Element pointer of array views, which never modify what they point to */
+	static def asElementSig(FTypeRef it) {
+		if (basic == FBasicTypeId.STRING)
+			return "const char *const "
+		return "const " + asCapicSig
+	}
 
 
-	static def asRVal(Iterable<Symbol> it, Domain domain) '''
-		«FOR s : it», «s.asRVal(domain)»«ENDFOR»'''
+	/* Booleans and floats differ in size between C and D-Bus */
+	static def needsConversion(FTypeRef it) {
+		basic == FBasicTypeId.BOOLEAN || basic == FBasicTypeId.FLOAT
+	}
 
 
-	static def asRef(Iterable<Symbol> it, Domain domain) '''
-		«FOR s : it», «s.asRef(domain)»«ENDFOR»'''
+	static def fieldSymbol(FField it) {
+		new Symbol("value->" + name, type, false, if (type.aggregate != null) SdBus else Capic)
+	}
 
 
-	static def Iterable<Symbol> diffBySig(Iterable<Symbol> it, Iterable<Symbol> ss) {
-		if (it.size != ss.size)
-			throw new IllegalArgumentException("Sequences must have the same size")
-		var result = newArrayList()
-		for (var n = 0; n < it.size; n++)
-			if (it.get(n).asSig != ss.get(n).asSig)
-				result.add(it.get(n))
-		return result
+	static def tempSymbol(FField it) {
+		new Symbol(name, type, false, SdBus)
 	}
 
 
-	static def byVal(FArgument it, Domain domain) {
-		new Symbol(name, type, false, domain)
+	static def readRef(FField it) {
+		if (type.needsConversion) tempSymbol.asRef(SdBus) else "&value->" + name
 	}
 
 
-	static def byRef(FArgument it, Domain domain) {
-		new Symbol(name, type, true, domain)
+	static def elementSymbol(FTypeRef it, String name) {
+		new Symbol(name, it, false, if (aggregate != null) SdBus else Capic)
 	}
 
 
-	static def asParam(Symbol it) {
-		asSig + name
+	static def elementTemp(FTypeRef it) {
+		new Symbol("element", it, false, SdBus)
 	}
 
 
-	static def asDecl(Symbol it) {
-		asSig + asLVal(domain)
+	/* Size of basic types whose C and wire layouts agree, 0 otherwise */
+	static def int layoutSize(FTypeRef it) {
+		val type = derived
+		if (type instanceof FStructType)
+			return type.layout?.last ?: 0
+		switch (basic) {
+			case FBasicTypeId::INT8,
+			case FBasicTypeId::UINT8:       1
+			case FBasicTypeId::INT16,
+			case FBasicTypeId::UINT16:      2
+			case FBasicTypeId::INT32,
+			case FBasicTypeId::UINT32:      4
+			case FBasicTypeId::INT64,
+			case FBasicTypeId::UINT64,
+			case FBasicTypeId::DOUBLE:      8
+			default: 0
+		}
 	}
 
 
-	static def asAssign(Symbol it, Symbol sym) {
-		asLVal(domain) + " = " + sym.asRVal(domain)
+	static def int layoutAlign(FTypeRef it) {
+		val type = derived
+		if (type instanceof FStructType)
+			return type.elements.fold(1)[a, f | Math.max(a, f.type.layoutAlign)]
+		return layoutSize
 	}
 
 
-	static def asCapicSig(FTypeRef it) {
-		if (predefined == FBasicTypeId.UNDEFINED)
-			throw new UnsupportedOperationException("Derived and Integer types are not supported")
-		switch (predefined) {
-			case FBasicTypeId::BOOLEAN:     "bool "
-			case FBasicTypeId::INT8:        "int8_t "
-			case FBasicTypeId::INT16:       "int16_t "
-			case FBasicTypeId::INT32:       "int32_t "
-			case FBasicTypeId::INT64:       "int64_t "
-			case FBasicTypeId::UINT8:       "uint8_t "
-			case FBasicTypeId::UINT16:      "uint16_t "
-			case FBasicTypeId::UINT32:      "uint32_t "
-			case FBasicTypeId::UINT64:      "uint64_t "
-			case FBasicTypeId::FLOAT:       "float "
-			case FBasicTypeId::DOUBLE:      "double "
-			default: throw new IllegalArgumentException("Unsupported basic type " + predefined.toString)
+	/* Field offsets followed by the size of a struct whose C layout matches the
+	 * D-Bus wire format, null if it does not */
+	static def List<Integer> layout(FStructType it) {
+		val result = <Integer>newArrayList()
+		var offset = 0
+		var align = 1
+		for (f : elements) {
+			val size = f.type.layoutSize
+			if (size == 0 || f.array)
+				return null
+			val a = f.type.layoutAlign
+			offset = (offset + a - 1) / a * a
+			/* D-Bus aligns nested structs to 8 bytes */
+			if (f.type.aggregate != null && offset % 8 != 0)
+				return null
+			result.add(offset)
+			offset = offset + size
+			align = Math.max(align, a)
 		}
+		offset = (offset + align - 1) / align * align
+		/* Array elements start at 8 byte boundaries on the wire */
+		if (elements.empty || offset % 8 != 0)
+			return null
+		result.add(offset)
+		return result
 	}
 
 
-	static def asSig(Symbol it) {
-		if (it.domain == Capic && !it.isRef)
-			return type.asCapicSig
-		if (it.domain == Capic && it.isRef)
-			return type.asCapicSig + "*"
-		if (it.domain == SdBus && !it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "int "
-				case FBasicTypeId::FLOAT:       "double "
-				case FBasicTypeId::INT8:        "uint8_t "
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      type.asCapicSig
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	/* Arrays whose elements can be handed to sd-bus as one block of memory */
+	static def isContiguous(FArrayType it) {
+		isBulk || (elementType.aggregate == null && elementType.layoutSize > 0)
 	}
 
 
-	static def asRVal(Symbol it, Domain domain) {
-		if (it.domain == Capic && domain == Capic && !it.isRef)
-			return name
-		if (it.domain == Capic && domain == SdBus && !it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "(int) " + name
-				case FBasicTypeId::FLOAT:       "(double) " + name
-				case FBasicTypeId::INT8:        "(uint8_t) " + name
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		if (it.domain == Capic && domain == Printf && it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "(int) *" + name
-				case FBasicTypeId::FLOAT:       "(double) *" + name
-				case FBasicTypeId::INT8,
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      "*" + name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		if (it.domain == SdBus && domain == Capic && !it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "!!" + name + "_int"
-				case FBasicTypeId::FLOAT:       "(float) " + name + "_double"
-				case FBasicTypeId::INT8:        "(int8_t) " + name + "_uint8_t"
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		if (it.domain == SdBus && domain == Printf && !it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "!!" + name + "_int"
-				case FBasicTypeId::FLOAT:       name + "_double"
-				case FBasicTypeId::INT8:        "(int8_t) " + name + "_uint8_t"
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	static def contiguousSig(FArrayType it) {
+		if (isBulk) "y" else elementType.asSdBusSig
 	}
 
 
-	static def asLVal(Symbol it, Domain domain) {
-		if (it.domain == Capic && domain == Capic && !it.isRef)
-			return name
-		if (it.domain == Capic && domain == Capic && it.isRef)
-			return "*" + name
-		if (it.domain == SdBus && domain == SdBus && !it.isRef) {
-			if (type.predefined == FBasicTypeId.UNDEFINED)
-				throw new UnsupportedOperationException("Derived and Integer types are not supported")
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     name + "_int"
-				case FBasicTypeId::FLOAT:       name + "_double"
-				case FBasicTypeId::INT8:        name + "_uint8_t"
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	/* Floats are widened into the message, booleans cannot be appended as a block */
+	static def canPack(FArrayType it) {
+		elementType.aggregate == null && elementType.basic == FBasicTypeId.FLOAT
 	}
 
 
-	static def asRef(Symbol it, Domain domain) {
-		if (it.domain == Capic && domain == Capic && !it.isRef)
-			return "&" + name
-		if (it.domain == Capic && domain == SdBus && it.isRef) {
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "&" + name + "_int"
-				case FBasicTypeId::FLOAT:       "&" + name + "_double"
-				case FBasicTypeId::INT8:        "&" + name + "_uint8_t"
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		if (it.domain == SdBus && domain == SdBus && !it.isRef) {
-			return switch (type.predefined) {
-				case FBasicTypeId::BOOLEAN:     "&" + name + "_int"
-				case FBasicTypeId::FLOAT:       "&" + name + "_double"
-				case FBasicTypeId::INT8:        "&" + name + "_uint8_t"
-				case FBasicTypeId::INT16,
-				case FBasicTypeId::INT32,
-				case FBasicTypeId::INT64,
-				case FBasicTypeId::UINT8,
-				case FBasicTypeId::UINT16,
-				case FBasicTypeId::UINT32,
-				case FBasicTypeId::UINT64,
-				case FBasicTypeId::DOUBLE:      "&" + name
-				default: throw new IllegalArgumentException("Unsupported basic type " + type.predefined.toString)
-			}
-		}
-		throw new UnsupportedOperationException("FIXME: Unsupported symbol transformation")
+	/* Arrays of booleans and floats are read as a block and narrowed by libcapic kernels */
+	static def canUnpack(FArrayType it) {
+		elementType.aggregate == null && elementType.needsConversion
 	}
 
 
-	static def asPrintfFormat(Iterable<Symbol> it) '''
-		«IF empty»void«ELSE»«FOR s : it SEPARATOR ', '»«s.name»=%«s.type.asPrintfSig»«ENDFOR»«ENDIF»'''
+	static def wireSig(FArrayType it) {
+		if (elementType.basic == FBasicTypeId.BOOLEAN) "uint32_t " else "double "
+	}
 
 
-	static def asPrintfSig(FTypeRef it) {
-		if (predefined == FBasicTypeId.UNDEFINED)
-			throw new UnsupportedOperationException("Derived and Integer types are not supported")
-		switch (predefined) {
-			case FBasicTypeId::BOOLEAN:     "d"
-			case FBasicTypeId::FLOAT:       "g"
-			case FBasicTypeId::INT8:        "\" PRId8 \""
-			case FBasicTypeId::INT16:       "\" PRId16 \""
-			case FBasicTypeId::INT32:       "\" PRId32 \""
-			case FBasicTypeId::INT64:       "\" PRId64 \""
-			case FBasicTypeId::UINT8:       "\" PRIu8 \""
-			case FBasicTypeId::UINT16:      "\" PRIu16 \""
-			case FBasicTypeId::UINT32:      "\" PRIu32 \""
-			case FBasicTypeId::UINT64:      "\" PRIu64 \""
-			case FBasicTypeId::DOUBLE:      "g"
-			default: throw new IllegalArgumentException("Unsupported basic type " + predefined.toString)
-		}
+	/* Arrays of structs matching the wire layout may be sent as raw bytes on request */
+	static def isBulk(FArrayType it) {
+		if (!options.containsKey("capic.bulk"))
+			return false
+		val type = elementType.derived
+		if (!(type instanceof FStructType) || (type as FStructType).layout == null)
+			throw new IllegalArgumentException("Elements of " + name + " do not match the D-Bus wire format required by capic.bulk")
+		return true
 	}
 
 
-	static def asSdBusSig(Iterable<Symbol> it) '''
-		"«FOR s : it»«s.type.asSdBusSig»«ENDFOR»"'''
+	/* Generator options are given in structured comments, e.g. <** @details: capic.bulk **> */
+	static def Map<String, String> options(FModelElement it) {
+		val result = <String, String>newHashMap()
+		if (comment != null)
+			for (a : comment.elements)
+				for (word : a.rawText.split("[\\s,]+").filter[startsWith("capic.")]) {
+					val pair = word.split("=", 2)
+					result.put(pair.get(0), if (pair.size > 1) pair.get(1) else "")
+				}
+		return result
+	}
 
 
-	static def asSdBusSig(FTypeRef it) {
-		if (predefined == FBasicTypeId.UNDEFINED)
-			throw new UnsupportedOperationException("Derived and Integer types are not supported")
-		switch (predefined) {
-			case FBasicTypeId::BOOLEAN:     "b"
-			case FBasicTypeId::INT8:        "y"
-			case FBasicTypeId::INT16:       "n"
-			case FBasicTypeId::INT32:       "i"
-			case FBasicTypeId::INT64:       "x"
-			case FBasicTypeId::UINT8:       "y"
-			case FBasicTypeId::UINT16:      "q"
-			case FBasicTypeId::UINT32:      "u"
-			case FBasicTypeId::UINT64:      "t"
-			case FBasicTypeId::FLOAT:       "d"
-			case FBasicTypeId::DOUBLE:      "d"
-			default: throw new IllegalArgumentException("Unsupported basic type " + predefined.toString)
+	/* Structs embed the types of their fields, which are therefore defined first */
+	static def definitionOrder(Iterable<FType> it) {
+		val result = <FType>newLinkedHashSet()
+		forEach[t | addDefinition(t, result)]
+		return result
+	}
+
+
+	static def void addDefinition(FType it, Set<FType> result) {
+		if (result.contains(it))
+			return
+		switch it {
+			FStructType: {
+				if (base != null)
+					throw new UnsupportedOperationException("Struct inheritance is not supported")
+				for (f : elements) {
+					if (f.array)
+						throw new UnsupportedOperationException("Implicit arrays are not supported, use named array types")
+					if (f.type.derived != null)
+						addDefinition(f.type.derived, result)
+				}
+			}
+			FArrayType: {
+				/* Enumerations are referred to by their typedef, structs only by pointer */
+				if (elementType.derived instanceof FEnumerationType)
+					addDefinition(elementType.derived, result)
+			}
+			FMapType: {
+				if (!keyType.isVarArg)
+					throw new UnsupportedOperationException("Keys of map " + name + " must be of a basic type")
+				if (keyType.derived != null)
+					addDefinition(keyType.derived, result)
+				if (valueType.derived != null)
+					addDefinition(valueType.derived, result)
+			}
+			FEnumerationType: {}
+			FUnionType: {
+				if (base != null)
+					throw new UnsupportedOperationException("Union inheritance is not supported")
+				if (elements.empty || elements.size > 256)
+					throw new UnsupportedOperationException("Union " + name + " must have between 1 and 256 members")
+				for (f : elements) {
+					if (f.array)
+						throw new UnsupportedOperationException("Implicit arrays are not supported, use named array types")
+					if (f.type.derived != null)
+						addDefinition(f.type.derived, result)
+				}
+			}
+			default: throw new UnsupportedOperationException("Type " + name + " is not supported")
 		}
+		result.add(it)
 	}
 
 }